@@ -1438,7 +1438,8 @@ void print_literal_symbols(struct assembler *as, FILE *fp)
 }
 
 static
-void print_microcode(struct assembler *as, FILE *fp)
+void print_microcode(struct assembler *as, FILE *fp,
+                     const struct listing_profile *prof)
 {
     struct statement *st;
     struct clause *cl;
@@ -1448,8 +1449,11 @@ void print_microcode(struct assembler *as, FILE *fp)
     uint16_t address;
 
     fprintf(fp, "--- MICROCODE ---\n");
-    fprintf(fp, "ADDRESS   MICROCODE    RSEL ALUF BS F1 F2 T L NEXT "
-                "LABEL      STATEMENT\n");
+    fprintf(fp, "ADDRESS   MICROCODE    RSEL ALUF BS F1 F2 T L NEXT ");
+    if (prof) {
+        fprintf(fp, "STEPS        CYCLES       %%CYC   ");
+    }
+    fprintf(fp, "LABEL      STATEMENT\n");
 
     for (address = 0; address < MICROCODE_SIZE; address++) {
         microcode = as->microcode[address];
@@ -1464,6 +1468,19 @@ void print_microcode(struct assembler *as, FILE *fp)
                 MICROCODE_L(microcode),
                 MICROCODE_NEXT(microcode));
 
+        if (prof) {
+            if (prof->steps[address] != 0) {
+                fprintf(fp, "%-12llu %-12llu %6.2f ",
+                        (unsigned long long) prof->steps[address],
+                        (unsigned long long) prof->cycles[address],
+                        (prof->total_cycles == 0) ? 0.0
+                        : (100.0 * prof->cycles[address])
+                          / prof->total_cycles);
+            } else {
+                fprintf(fp, "%-12s %-12s %6s ", "", "", "");
+            }
+        }
+
         st = as->micro_sts[address];
         if (!st) {
             fprintf(fp, "\n");
@@ -1512,7 +1529,8 @@ void print_microcode(struct assembler *as, FILE *fp)
     }
 }
 
-int assembler_print_listing(struct assembler *as, const char *filename)
+int assembler_print_listing(struct assembler *as, const char *filename,
+                            const struct listing_profile *prof)
 {
     FILE *fp;
 
@@ -1529,7 +1547,7 @@ int assembler_print_listing(struct assembler *as, const char *filename)
     fprintf(fp, "\n\n");
     print_literal_symbols(as, fp);
     fprintf(fp, "\n\n");
-    print_microcode(as, fp);
+    print_microcode(as, fp, prof);
 
     fclose(fp);
     return TRUE;
@@ -22,6 +22,17 @@ struct assembler {
     struct statement **micro_sts; /* The statements of the microcode. */
 };
 
+/* Structure with the profile used to annotate the listing. */
+struct listing_profile {
+    const uint64_t *steps;        /* Number of executions of each
+                                   * address of the microcode.
+                                   */
+    const uint64_t *cycles;       /* Number of cycles of each address. */
+    uint64_t total_cycles;        /* Total number of cycles profiled
+                                   * (for the percentages).
+                                   */
+};
+
 /* Functions. */
 
 /* Initializes the assembler variable.
@@ -68,9 +79,12 @@ int assembler_produce_objfile(const struct assembler *as,
                               struct objfile *objf);
 
 /* Prints the assembly listing.
- * The listing is printed to file `filename`.
+ * The listing is printed to file `filename`. If `prof` is not NULL,
+ * the microcode is annotated with the number of executions, the number
+ * of cycles and the percentage of the cycles of each address.
  * Returns TRUE on success.
  */
-int assembler_print_listing(struct assembler *as, const char *filename);
+int assembler_print_listing(struct assembler *as, const char *filename,
+                            const struct listing_profile *prof);
 
 #endif /* __ASSEMBLER_ASSEMBLER_H */
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <SDL.h>
 
 #include "debugger/debugger.h"
 #include "simulator/simulator.h"
@@ -14,11 +15,38 @@
 #include "simulator/display.h"
 #include "simulator/ethernet.h"
 #include "simulator/intr.h"
+#include "simulator/checkpoint.h"
+#include "debugger/symbols.h"
 #include "microcode/microcode.h"
 #include "microcode/nova.h"
 #include "common/string_buffer.h"
 #include "common/utils.h"
 
+/* Macros. */
+
+/* Sets the bit `idx` of the bitmap `map`. */
+#define SET_BIT(map, idx) \
+    do { (map)[(idx) >> 3] |= (uint8_t) (1 << ((idx) & 7)); } while (0)
+
+/* Tests the bit `idx` of the bitmap `map`. */
+#define TEST_BIT(map, idx) \
+    ((map)[(idx) >> 3] & (1 << ((idx) & 7)))
+
+/* Constants. */
+
+/* The default number of entries printed from the profile. */
+#define DEFAULT_PROFILE_ENTRIES           20
+
+/* Data structures and types. */
+
+/* An entry of the microcode or Nova profiles (used for sorting). */
+struct profile_entry {
+    unsigned int idx;             /* The index in the profile. */
+    uint64_t value;               /* The number of cycles (or of
+                                   * instructions, for the Nova profile).
+                                   */
+};
+
 /* Functions. */
 
 /* Gets a command line from the standard input.
@@ -75,6 +103,289 @@ void get_command(struct debugger *dbg, int *is_eof)
     }
 }
 
+/* Compiles the enabled breakpoints into the bitmap of the debugger
+ * and into the watchpoints of the simulator, which are used by
+ * filter_breakpoints() to quickly discard the steps that cannot hit
+ * any breakpoint. Each breakpoint is indexed by the watched memory
+ * accesses, by its task and MPC, or else by the conditions in
+ * `bp_check`. The effective number of breakpoints (one past the last
+ * enabled breakpoint) is returned in `max_breakpoints`.
+ * Returns TRUE on success.
+ */
+static
+int compile_breakpoints(struct debugger *dbg, unsigned int *max_breakpoints)
+{
+    const struct breakpoint *bp;
+    struct simulator *sim;
+    unsigned int num, task;
+
+    sim = dbg->sim;
+    memset(dbg->bp_mpc_map, 0, BP_MPC_MAP_SIZE);
+    dbg->bp_check = 0;
+    simulator_clear_watches(sim);
+    sim->watch_hit = 0;
+
+    *max_breakpoints = 0;
+    for (num = 0; num < dbg->max_breakpoints; num++) {
+        bp = &dbg->bps[num];
+        if (bp->available || !bp->enable) continue;
+        *max_breakpoints = num + 1;
+
+        if (bp->watch) {
+            if (unlikely(!simulator_watch(sim, bp->bank, bp->addr,
+                                          bp->addr_end, bp->watch))) {
+                report_error("debugger: compile_breakpoints: "
+                             "could not watch memory");
+                return FALSE;
+            }
+            continue;
+        }
+
+        if (bp->mpc != 0xFFFF) {
+            /* Some breakpoints can never be hit. */
+            if (bp->mpc >= NUM_MICROCODE_BANKS * MICROCODE_SIZE)
+                continue;
+
+            dbg->bp_check |= BP_CHECK_MPC;
+            if (bp->task != 0xFF) {
+                if (bp->task >= TASK_NUM_TASKS) continue;
+                task = bp->task;
+                SET_BIT(dbg->bp_mpc_map,
+                        task * NUM_MICROCODE_BANKS * MICROCODE_SIZE
+                        + bp->mpc);
+                continue;
+            }
+
+            for (task = 0; task < TASK_NUM_TASKS; task++) {
+                SET_BIT(dbg->bp_mpc_map,
+                        task * NUM_MICROCODE_BANKS * MICROCODE_SIZE
+                        + bp->mpc);
+            }
+            continue;
+        }
+
+        if (bp->on_task_switch) {
+            dbg->bp_check |= BP_CHECK_SWITCH;
+        } else {
+            dbg->bp_check |= BP_CHECK_ALWAYS;
+        }
+    }
+    return TRUE;
+}
+
+/* Checks if the current state of the simulator may hit one of the
+ * breakpoints compiled by compile_breakpoints().
+ * Returns TRUE if the breakpoints must be checked.
+ */
+static
+int filter_breakpoints(const struct debugger *dbg)
+{
+    const struct simulator *sim;
+    unsigned int idx;
+
+    sim = dbg->sim;
+    if (dbg->bp_check != 0) {
+        if (dbg->bp_check & BP_CHECK_ALWAYS) return TRUE;
+        if ((dbg->bp_check & BP_CHECK_SWITCH) && sim->task_switch)
+            return TRUE;
+
+        idx = sim->ctask * NUM_MICROCODE_BANKS * MICROCODE_SIZE + sim->mpc;
+        if (TEST_BIT(dbg->bp_mpc_map, idx)) return TRUE;
+    }
+
+    return (sim->watch_hit != 0);
+}
+
+/* Checks the first `max_breakpoints` breakpoints against the current
+ * state of the simulator.
+ * Returns the number of the breakpoint that was hit, or -1 if none.
+ */
+static
+int find_breakpoint(const struct debugger *dbg, unsigned int max_breakpoints)
+{
+    const struct breakpoint *bp;
+    const struct simulator *sim;
+    unsigned int num;
+    uint32_t addr, bank;
+    int hit1;
+
+    sim = dbg->sim;
+    for (num = 0; num < max_breakpoints; num++) {
+        bp = &dbg->bps[num];
+        if (bp->available || !bp->enable) continue;
+
+        hit1 = TRUE;
+        if (bp->task != 0xFF) {
+            if (bp->task != sim->ctask)
+                hit1 = FALSE;
+        }
+
+        if (bp->ntask != 0xFF) {
+            if (bp->ntask != sim->ntask)
+                hit1 = FALSE;
+        }
+
+        if (bp->mpc != 0xFFFF) {
+            if (bp->mpc != sim->mpc)
+                hit1 = FALSE;
+        }
+
+        if (bp->on_task_switch) {
+            if (!sim->task_switch)
+                hit1 = FALSE;
+        }
+
+        if (bp->mir_mask != 0) {
+            if ((sim->mir & bp->mir_mask) != bp->mir_fmt)
+                hit1 = FALSE;
+            if (!bp->allow_constants) {
+                if ((MICROCODE_F1(sim->mir) == F1_CONSTANT)
+                    || (MICROCODE_F2(sim->mir) == F2_CONSTANT)) {
+                    hit1 = FALSE;
+                }
+            }
+        }
+
+        if (bp->watch) {
+            addr = sim->watch_address % MEMORY_SIZE;
+            bank = sim->watch_address / MEMORY_SIZE;
+            if (!(sim->watch_hit & bp->watch))
+                hit1 = FALSE;
+            if (addr < bp->addr || addr > bp->addr_end)
+                hit1 = FALSE;
+            if (bp->bank != WATCH_ALL_BANKS && bp->bank != bank)
+                hit1 = FALSE;
+        }
+
+        if (hit1) return (int) num;
+    }
+
+    return -1;
+}
+
+/* Clears the execution history. This must be called whenever a
+ * command changes the state of the simulator, since such change
+ * cannot be reproduced by executing again from the snapshots.
+ */
+static
+void clear_history(struct debugger *dbg)
+{
+    dbg->history_first = 0;
+    dbg->history_count = 0;
+    dbg->history_next = dbg->steps;
+}
+
+/* Gets the entry `idx` of the execution history (the oldest entry
+ * has index zero).
+ */
+static
+struct history_entry *get_history(struct debugger *dbg, unsigned int idx)
+{
+    idx = (dbg->history_first + idx) % dbg->history_size;
+    return &dbg->history[idx];
+}
+
+/* Adds a snapshot of the current state to the execution history.
+ * The oldest snapshot is discarded if the history is full.
+ * Returns TRUE on success.
+ */
+static
+int record_history(struct debugger *dbg)
+{
+    struct history_entry *he, *prev;
+
+    prev = NULL;
+    if (dbg->history_count > 0) {
+        prev = get_history(dbg, dbg->history_count - 1);
+    }
+
+    if (dbg->history_count == dbg->history_size) {
+        he = get_history(dbg, 0);
+        dbg->history_first = (dbg->history_first + 1) % dbg->history_size;
+    } else {
+        he = get_history(dbg, dbg->history_count);
+        dbg->history_count++;
+    }
+
+    /* The unmodified pages are shared with the previous snapshot. */
+    if (unlikely(!snapshot_take(&he->snap, dbg->sim,
+                                (prev) ? &prev->snap : NULL))) {
+        report_error("debugger: record_history: could not take snapshot");
+        clear_history(dbg);
+        return FALSE;
+    }
+
+    /* The inputs after the snapshot are needed to execute again from
+     * it, so they are recorded (in memory) if the simulator is not
+     * recording or replaying a journal already.
+     */
+    if (!dbg->sim->journal) {
+        if (unlikely(!journal_record(&dbg->jn, dbg->sim, NULL))) {
+            report_error("debugger: record_history: "
+                         "could not record journal");
+            clear_history(dbg);
+            return FALSE;
+        }
+    }
+    journal_mark(dbg->sim->journal, &he->mark);
+
+    he->step = dbg->steps;
+    dbg->history_next = dbg->steps + dbg->history_interval;
+    return TRUE;
+}
+
+/* Goes back to the snapshot `idx` of the execution history, and
+ * executes `num` steps from there (no breakpoints are checked).
+ * The inputs are replayed from the journal (and the simulator is
+ * disconnected from the network) until resume_history() is called.
+ * The later snapshots are discarded.
+ * Returns TRUE on success.
+ */
+static
+int rewind_history(struct debugger *dbg, unsigned int idx, uint64_t num)
+{
+    struct history_entry *he;
+    struct simulator *sim;
+
+    sim = dbg->sim;
+    he = get_history(dbg, idx);
+    if (unlikely(!snapshot_restore(&he->snap, sim))) {
+        report_error("debugger: rewind_history: could not restore");
+        return FALSE;
+    }
+
+    if (unlikely(!journal_rewind(sim->journal, &he->mark))) {
+        report_error("debugger: rewind_history: could not rewind journal");
+        return FALSE;
+    }
+
+    dbg->steps = he->step;
+    dbg->history_count = idx + 1;
+    dbg->history_next = he->step + dbg->history_interval;
+
+    while (num-- > 0) {
+        if (sim->error) break;
+        simulator_step(sim);
+        dbg->steps++;
+    }
+    sim->watch_hit = 0;
+    return TRUE;
+}
+
+/* Continues the journal from the current state after going back in
+ * the execution history (see rewind_history()).
+ * Returns TRUE on success.
+ */
+static
+int resume_history(struct debugger *dbg)
+{
+    if (unlikely(!journal_resume(dbg->sim->journal))) {
+        report_error("debugger: resume_history: could not resume journal");
+        return FALSE;
+    }
+    return TRUE;
+}
+
 /* Runs the simulation.
  * The parameter `max_steps` specifies the maximum number of steps
  * to run. If `max_steps` is negative, it runs indefinitely. Similarly,
@@ -84,24 +395,29 @@ void get_command(struct debugger *dbg, int *is_eof)
 static
 int simulate(struct debugger *dbg, int max_steps, int max_cycles)
 {
-    const struct breakpoint *bp;
     struct gui *ui;
     struct simulator *sim;
-    unsigned int num, max_breakpoints;
+    unsigned int max_breakpoints, stop_mask;
     int32_t prev_cycle;
-    int32_t step, cycle, cycle_mod;
-    int hit, hit1;
+    int32_t step, cycle, cycle_mod, paced;
+    uint32_t num_cycles;
+    uint64_t prev_steps;
+    uint64_t start, wait_start, wait_ticks;
+    int hit, batch;
     int running, stop_sim;
 
-    /* Get the effective number of breakpoints. */
-    max_breakpoints = 0;
-    for (num = 0; num < dbg->max_breakpoints; num++) {
-        bp = &dbg->bps[num];
-        if (!bp->available && bp->enable) {
-            max_breakpoints = num + 1;
-        }
+    if (unlikely(!compile_breakpoints(dbg, &max_breakpoints))) {
+        report_error("debugger: simulate: could not compile breakpoints");
+        return FALSE;
     }
 
+    /* Unless the breakpoints must be checked at every step, the
+     * simulator runs in batches (up to the end of the frame), only
+     * stopping early at the watchpoints.
+     */
+    batch = (max_steps < 0) && (dbg->bp_check == 0);
+    stop_mask = RUN_WATCH;
+
     ui = dbg->ui;
     sim = dbg->sim;
 
@@ -110,6 +426,12 @@ int simulate(struct debugger *dbg, int max_steps, int max_cycles)
     cycle_mod = (int32_t) (dbg->frequency / 60);
     running = TRUE;
     stop_sim = FALSE;
+
+    /* The time waiting for the pacer is not counted as simulating. */
+    paced = 0;
+    pacer_reset(&dbg->pacer);
+    start = SDL_GetPerformanceCounter();
+    wait_ticks = 0;
     while (TRUE) {
         if ((max_steps >= 0) && (step == max_steps))
             break;
@@ -118,15 +440,38 @@ int simulate(struct debugger *dbg, int max_steps, int max_cycles)
 
         if (sim->error) break;
 
+        if (dbg->history && dbg->steps >= dbg->history_next) {
+            if (unlikely(!record_history(dbg))) {
+                report_error("debugger: simulate: "
+                             "could not record history");
+                return FALSE;
+            }
+        }
+
         prev_cycle = sim->cycle;
-        simulator_step(sim);
+        if (batch) {
+            num_cycles = (uint32_t) (cycle_mod - (sim->cycle % cycle_mod));
+            if (max_cycles >= 0) {
+                num_cycles = MIN(num_cycles, (uint32_t) (max_cycles - cycle));
+            }
+
+            prev_steps = sim->steps;
+            simulator_run(sim, num_cycles, stop_mask);
+            dbg->steps += sim->steps - prev_steps;
+        } else {
+            simulator_step(sim);
+            step++;
+            dbg->steps++;
+        }
         cycle += INTR_CYCLE(sim->cycle - prev_cycle);
-        step++;
 
         cycle = INTR_CYCLE(cycle);
 
-        /* Detect when a wraparound happened. */
-        if ((prev_cycle % cycle_mod) > (sim->cycle % cycle_mod)) {
+        /* Detect when the end of a frame was reached (the batches
+         * stop exactly there).
+         */
+        if (INTR_CYCLE(sim->cycle - prev_cycle)
+            >= cycle_mod - (prev_cycle % cycle_mod)) {
             if (unlikely(!gui_running(ui, &running, &stop_sim))) {
                 report_error("debugger: simulate: "
                              "could not determine if GUI is running");
@@ -139,71 +484,37 @@ int simulate(struct debugger *dbg, int max_steps, int max_cycles)
                              "could not update GUI");
                 return FALSE;
             }
-            if (unlikely(!gui_wait_frame(ui))) {
-                report_error("debugger: simulate: "
-                             "could not wait for next frame");
-                return FALSE;
+            wait_start = SDL_GetPerformanceCounter();
+            pacer_wait(&dbg->pacer, (uint32_t) INTR_CYCLE(cycle - paced));
+            paced = cycle;
+            wait_ticks += SDL_GetPerformanceCounter() - wait_start;
+
+            if (dbg->ckpt_interval != 0
+                && ++dbg->ckpt_frames >= dbg->ckpt_interval) {
+                dbg->ckpt_frames = 0;
+                if (unlikely(!checkpoint_save(&dbg->ckpt, sim))) {
+                    report_error("debugger: simulate: "
+                                 "could not save checkpoint");
+                    return FALSE;
+                }
             }
         }
 
         /* Small optimization. */
         if (max_breakpoints == 0) continue;
+        if (!filter_breakpoints(dbg)) continue;
 
-        hit = FALSE;
-        for (num = 0; num < max_breakpoints; num++) {
-            bp = &dbg->bps[num];
-            if (!bp->enable) continue;
-
-            hit1 = TRUE;
-            if (bp->task != 0xFF) {
-                if (bp->task != sim->ctask)
-                    hit1 = FALSE;
-            }
-
-            if (bp->ntask != 0xFF) {
-                if (bp->ntask != sim->ntask)
-                    hit1 = FALSE;
-            }
-
-            if (bp->mpc != 0xFFFF) {
-                if (bp->mpc != sim->mpc)
-                    hit1 = FALSE;
-            }
-
-            if (bp->on_task_switch) {
-                if (!sim->task_switch)
-                    hit1 = FALSE;
-            }
-
-            if (bp->mir_mask != 0) {
-                if ((sim->mir & bp->mir_mask) != bp->mir_fmt)
-                    hit1 = FALSE;
-                if (!bp->allow_constants) {
-                    if ((MICROCODE_F1(sim->mir) == F1_CONSTANT)
-                        || (MICROCODE_F2(sim->mir) == F2_CONSTANT)) {
-                        hit1 = FALSE;
-                    }
-                }
-            }
-
-            if (bp->watch) {
-                if (bp->addr != sim->mar) {
-                    hit1 = FALSE;
-                }
-            }
-
-            if (hit1) {
-                if (num > 0) {
-                    printf("breakpoint %u hit\n", num);
-                }
-                hit = TRUE;
-                break;
+        hit = find_breakpoint(dbg, max_breakpoints);
+        sim->watch_hit = 0;
+        if (hit >= 0) {
+            if (hit > 0) {
+                printf("breakpoint %d hit\n", hit);
             }
+            break;
         }
-
-        if (hit) break;
     }
 
+    dbg->run_ticks += (SDL_GetPerformanceCounter() - start) - wait_ticks;
     return TRUE;
 }
 
@@ -239,9 +550,11 @@ void cmd_change_frequency(struct debugger *dbg)
     freq = (int) strtoul(arg, (char **) &end, 10);
     if (end[0] != '\0' || freq < 0) {
         printf("invalid decimal number `%s`\n", arg);
+        return;
     }
 
     dbg->frequency = freq;
+    pacer_set_frequency(&dbg->pacer, (uint32_t) freq);
     printf("frequency changed to %d.\n", freq);
 }
 
@@ -429,6 +742,7 @@ void cmd_write_memory(struct debugger *dbg)
     }
 
     simulator_write(sim, addr, val, sim->ctask, FALSE);
+    clear_history(dbg);
 }
 
 /* Processes the continue command.
@@ -545,7 +859,9 @@ int cmd_next_task(struct debugger *dbg)
     bp->mir_mask = 0;
     bp->allow_constants = TRUE;
     bp->addr = 0;
-    bp->watch = FALSE;
+    bp->addr_end = 0;
+    bp->bank = WATCH_ALL_BANKS;
+    bp->watch = 0;
 
     if (unlikely(!simulate(dbg, -1, -1))) {
         report_error("debugger: cmd_next_task: could not simulate");
@@ -594,7 +910,9 @@ int cmd_next_nova(struct debugger *dbg)
     bp->mir_mask = 0;
     bp->allow_constants = TRUE;
     bp->addr = 0;
-    bp->watch = FALSE;
+    bp->addr_end = 0;
+    bp->bank = WATCH_ALL_BANKS;
+    bp->watch = 0;
 
     running = TRUE;
     stop_sim = FALSE;
@@ -616,6 +934,152 @@ int cmd_next_nova(struct debugger *dbg)
     return TRUE;
 }
 
+/* Processes the "reverse next" command, which goes back a number of
+ * steps by restoring the nearest snapshot in the execution history
+ * and executing again from there.
+ * Returns TRUE on success.
+ */
+static
+int cmd_reverse_next(struct debugger *dbg)
+{
+    const struct history_entry *he;
+    const char *arg, *end;
+    uint64_t num, target;
+    unsigned int idx;
+
+    arg = (const char *) dbg->cmd_buf;
+    arg = &arg[strlen(arg) + 1];
+
+    if (arg[0] != '\0') {
+        num = (uint64_t) strtoull(arg, (char **) &end, 10);
+        if (end[0] != '\0') {
+            printf("invalid decimal number `%s`\n", arg);
+            return TRUE;
+        }
+    } else {
+        num = 1;
+    }
+
+    if (!dbg->history || dbg->history_count == 0) {
+        printf("no execution history\n");
+        return TRUE;
+    }
+
+    he = get_history(dbg, 0);
+    if (num > dbg->steps - he->step) {
+        printf("reached the beginning of the history\n");
+        num = dbg->steps - he->step;
+    }
+    target = dbg->steps - num;
+
+    /* Finds the latest snapshot before the target. */
+    idx = dbg->history_count;
+    while (idx-- > 0) {
+        he = get_history(dbg, idx);
+        if (he->step <= target) break;
+    }
+
+    if (unlikely(!rewind_history(dbg, idx, target - he->step)
+                 || !resume_history(dbg))) {
+        report_error("debugger: cmd_reverse_next: could not rewind");
+        return FALSE;
+    }
+
+    cmd_registers(dbg, FALSE);
+    return TRUE;
+}
+
+/* Processes the "reverse continue" command, which goes back to the
+ * last time a breakpoint was hit. Each interval between snapshots of
+ * the execution history is executed again (from the most recent to
+ * the oldest) until a breakpoint hit is found.
+ * Returns TRUE on success.
+ */
+static
+int cmd_reverse_continue(struct debugger *dbg)
+{
+    const struct history_entry *he;
+    struct simulator *sim;
+    unsigned int idx, max_breakpoints;
+    uint64_t target, step, found_step;
+    int hit, found;
+
+    if (!dbg->history || dbg->history_count == 0) {
+        printf("no execution history\n");
+        return TRUE;
+    }
+
+    sim = dbg->sim;
+    dbg->bps[0].enable = FALSE;
+    if (unlikely(!compile_breakpoints(dbg, &max_breakpoints))) {
+        report_error("debugger: cmd_reverse_continue: "
+                     "could not compile breakpoints");
+        return FALSE;
+    }
+
+    found = -1;
+    found_step = 0;
+    target = dbg->steps;
+    idx = dbg->history_count;
+    while (idx-- > 0) {
+        he = get_history(dbg, idx);
+        if (he->step >= target) continue;
+
+        if (unlikely(!rewind_history(dbg, idx, 0))) {
+            report_error("debugger: cmd_reverse_continue: "
+                         "could not rewind");
+            return FALSE;
+        }
+
+        /* Looks for the last hit before the target. */
+        for (step = he->step; step < target; step++) {
+            if (step > he->step) {
+                if (sim->error) break;
+                simulator_step(sim);
+            }
+            if (!filter_breakpoints(dbg)) continue;
+            hit = find_breakpoint(dbg, max_breakpoints);
+            sim->watch_hit = 0;
+            if (hit >= 0) {
+                found = hit;
+                found_step = step;
+            }
+        }
+
+        if (found >= 0) {
+            if (unlikely(!rewind_history(dbg, idx,
+                                         found_step - he->step))) {
+                report_error("debugger: cmd_reverse_continue: "
+                             "could not rewind");
+                return FALSE;
+            }
+            if (found > 0) {
+                printf("breakpoint %d hit\n", found);
+            }
+            break;
+        }
+
+        target = he->step;
+    }
+
+    if (found < 0) {
+        printf("reached the beginning of the history\n");
+        if (unlikely(!rewind_history(dbg, 0, 0))) {
+            report_error("debugger: cmd_reverse_continue: "
+                         "could not rewind");
+            return FALSE;
+        }
+    }
+
+    if (unlikely(!resume_history(dbg))) {
+        report_error("debugger: cmd_reverse_continue: could not resume");
+        return FALSE;
+    }
+
+    cmd_registers(dbg, FALSE);
+    return TRUE;
+}
+
 /* Adds a breakpoint based on the string in the command buffer. */
 static
 void cmd_add_breakpoint(struct debugger *dbg)
@@ -644,7 +1108,9 @@ void cmd_add_breakpoint(struct debugger *dbg)
     bp->mir_mask = 0;
     bp->allow_constants = TRUE;
     bp->addr = 0;
-    bp->watch = FALSE;
+    bp->addr_end = 0;
+    bp->bank = WATCH_ALL_BANKS;
+    bp->watch = 0;
 
     arg = (const char *) dbg->cmd_buf;
     arg = &arg[strlen(arg) + 1];
@@ -840,23 +1306,52 @@ void cmd_add_breakpoint(struct debugger *dbg)
             continue;
         }
 
-        if (strcmp(arg, "-watch") == 0) {
+        if (strcmp(arg, "-watch") == 0 || strcmp(arg, "-rwatch") == 0
+            || strcmp(arg, "-wwatch") == 0) {
+            if (arg[1] == 'r') {
+                bp->watch = WATCH_READ;
+            } else if (arg[1] == 'w' && arg[2] == 'w') {
+                bp->watch = WATCH_WRITE;
+            } else {
+                bp->watch = WATCH_READ | WATCH_WRITE;
+            }
+
             arg = &arg[strlen(arg) + 1];
             if (arg[0] == '\0') {
                 printf("please specify the watch address\n");
                 return;
             }
             bp->addr = (uint16_t) strtoul(arg, (char **) &end, base);
-            if (end[0] != '\0') {
+            bp->addr_end = bp->addr;
+            if (end[0] == '-') {
+                bp->addr_end = (uint16_t) strtoul(&end[1], (char **) &end,
+                                                  base);
+            }
+            if (end[0] != '\0' || bp->addr_end < bp->addr) {
                 printf("invalid address `%s`\n", arg);
+                bp->watch = 0;
                 return;
             }
             arg = &arg[strlen(arg) + 1];
-            bp->watch = TRUE;
             bp->enable = TRUE;
             continue;
         }
 
+        if (strcmp(arg, "-bank") == 0) {
+            arg = &arg[strlen(arg) + 1];
+            if (arg[0] == '\0') {
+                printf("please specify the bank\n");
+                return;
+            }
+            bp->bank = (uint8_t) strtoul(arg, (char **) &end, base);
+            if (end[0] != '\0' || bp->bank >= NUM_MEMORY_BANKS) {
+                printf("invalid bank `%s`\n", arg);
+                return;
+            }
+            arg = &arg[strlen(arg) + 1];
+            continue;
+        }
+
         bp->mpc = (uint16_t) strtoul(arg, (char **) &end, base);
         if (end[0] != '\0') {
             printf("invalid MPC `%s`\n", arg);
@@ -883,30 +1378,45 @@ void cmd_breakpoint_list(struct debugger *dbg)
     struct breakpoint *bp;
 
     printf("NUM  EN  TASK   NTASK  MPC      SW  MIR_FMT      "
-           "MIR_MASK     CT  ADDR\n");
+           "MIR_MASK     CT  WATCH\n");
     for (num = 1; num < dbg->max_breakpoints; num++) {
         bp = &dbg->bps[num];
         if (bp->available) continue;
 
         if (dbg->use_octal) {
             printf("%-4d %d   %04o   %04o   %07o  %d   "
-                   "%012o %012o %d   %07o%s\n",
+                   "%012o %012o %d   ",
                    num, bp->enable ? 1 : 0,
                    bp->task, bp->ntask, bp->mpc,
                    bp->on_task_switch ? 1 : 0,
                    bp->mir_fmt, bp->mir_mask,
-                   bp->allow_constants ? 1 : 0,
-                   bp->addr, bp->watch ? "*" : " ");
+                   bp->allow_constants ? 1 : 0);
         } else {
             printf("%-4d %d   0x%02X   0x%02X   0x%04X   %d   "
-                   "0x%08X   0x%08X   %d   0x%04X%s\n",
+                   "0x%08X   0x%08X   %d   ",
                    num, bp->enable ? 1 : 0,
                    bp->task, bp->ntask, bp->mpc,
                    bp->on_task_switch ? 1 : 0,
                    bp->mir_fmt, bp->mir_mask,
-                   bp->allow_constants ? 1 : 0,
-                   bp->addr, bp->watch ? "*" : " ");
+                   bp->allow_constants ? 1 : 0);
+        }
+
+        if (!bp->watch) {
+            printf("-\n");
+            continue;
+        }
+
+        printf("%s%s ", (bp->watch & WATCH_READ) ? "R" : "",
+               (bp->watch & WATCH_WRITE) ? "W" : "");
+        if (dbg->use_octal) {
+            printf("%07o-%07o", bp->addr, bp->addr_end);
+        } else {
+            printf("0x%04X-0x%04X", bp->addr, bp->addr_end);
         }
+        if (bp->bank != WATCH_ALL_BANKS) {
+            printf(" (bank %u)", bp->bank);
+        }
+        printf("\n");
     }
 }
 
@@ -1022,6 +1532,7 @@ void cmd_load_or_save_image(struct debugger *dbg, int save)
         disk_save_image(&sim->dsk, drive_num, filename);
     } else {
         disk_load_image(&sim->dsk, drive_num, filename);
+        clear_history(dbg);
     }
 }
 
@@ -1050,7 +1561,421 @@ void cmd_load_or_save_state(struct debugger *dbg, int save)
         simulator_save_state(sim, filename);
     } else {
         simulator_load_state(sim, filename);
+        clear_history(dbg);
+    }
+}
+
+/* Starts (or stops) the periodic checkpoints. */
+static
+void cmd_checkpoints(struct debugger *dbg)
+{
+    const char *arg, *end;
+    const char *filename;
+    unsigned int seconds;
+
+    arg = (const char *) dbg->cmd_buf;
+    arg = &arg[strlen(arg) + 1];
+
+    if (arg[0] == '\0') {
+        debugger_set_checkpoints(dbg, NULL, 0);
+        printf("checkpoints stopped\n");
+        return;
     }
+    filename = arg;
+
+    arg = &arg[strlen(arg) + 1];
+    seconds = 5;
+    if (arg[0] != '\0') {
+        seconds = (unsigned int) strtoul(arg, (char **) &end, 10);
+        if (end[0] != '\0' || seconds == 0) {
+            printf("invalid number of seconds `%s`\n", arg);
+            return;
+        }
+    }
+
+    debugger_set_checkpoints(dbg, filename, seconds);
+}
+
+/* Loads a chain of checkpoints. */
+static
+void cmd_load_checkpoint(struct debugger *dbg)
+{
+    const char *arg, *end;
+    const char *filename;
+    unsigned int num, count;
+
+    arg = (const char *) dbg->cmd_buf;
+    arg = &arg[strlen(arg) + 1];
+
+    if (arg[0] == '\0') {
+        printf("please specify a filename\n");
+        return;
+    }
+    filename = arg;
+
+    arg = &arg[strlen(arg) + 1];
+    num = 0;
+    if (arg[0] != '\0') {
+        num = (unsigned int) strtoul(arg, (char **) &end, 10);
+        if (end[0] != '\0') {
+            printf("invalid decimal number `%s`\n", arg);
+            return;
+        }
+    }
+
+    if (checkpoint_load(dbg->sim, filename, num, &count)) {
+        clear_history(dbg);
+        printf("replayed %u checkpoints\n", count);
+        cmd_registers(dbg, FALSE);
+    }
+}
+
+/* Compares two entries of the profile, so that the entries with
+ * larger values come first (for qsort()).
+ */
+static
+int compare_profile_entries(const void *p1, const void *p2)
+{
+    const struct profile_entry *pe1, *pe2;
+
+    pe1 = (const struct profile_entry *) p1;
+    pe2 = (const struct profile_entry *) p2;
+    if (pe1->value != pe2->value)
+        return (pe1->value > pe2->value) ? -1 : 1;
+    if (pe1->idx != pe2->idx)
+        return (pe1->idx < pe2->idx) ? -1 : 1;
+    return 0;
+}
+
+/* Prints the `num` microinstructions with the most cycles in the
+ * microcode profile.
+ * Returns TRUE on success.
+ */
+static
+int print_profile(struct debugger *dbg, unsigned int num)
+{
+    struct simulator *sim;
+    struct profile_entry *entries;
+    unsigned int idx, count, i;
+    uint64_t total_steps, total_cycles;
+    uint16_t task, address;
+
+    sim = dbg->sim;
+    entries = (struct profile_entry *)
+        malloc(PROFILE_SIZE * sizeof(struct profile_entry));
+    if (unlikely(!entries)) {
+        report_error("debugger: print_profile: memory exhausted");
+        return FALSE;
+    }
+
+    count = 0;
+    total_steps = total_cycles = 0;
+    for (idx = 0; idx < PROFILE_SIZE; idx++) {
+        if (sim->prof_steps[idx] == 0) continue;
+        entries[count].idx = idx;
+        entries[count].value = sim->prof_cycles[idx];
+        total_steps += sim->prof_steps[idx];
+        total_cycles += sim->prof_cycles[idx];
+        count++;
+    }
+    qsort(entries, count, sizeof(struct profile_entry),
+          &compare_profile_entries);
+
+    printf("total: %llu steps, %llu cycles\n",
+           (unsigned long long) total_steps,
+           (unsigned long long) total_cycles);
+    printf("TASK   ADDRESS  STEPS          CYCLES         %%CYCLES\n");
+    for (i = 0; i < count && i < num; i++) {
+        idx = entries[i].idx;
+        task = idx / (NUM_MICROCODE_BANKS * MICROCODE_SIZE);
+        address = idx % (NUM_MICROCODE_BANKS * MICROCODE_SIZE);
+        printf("%-6s ", TASK_NAMES[task]);
+        if (dbg->use_octal) {
+            printf("%05o    ", address);
+        } else {
+            printf("0x%03X    ", address);
+        }
+        printf("%-14llu %-14llu %6.2f\n",
+               (unsigned long long) sim->prof_steps[idx],
+               (unsigned long long) sim->prof_cycles[idx],
+               (100.0 * sim->prof_cycles[idx]) / total_cycles);
+    }
+
+    free((void *) entries);
+    return TRUE;
+}
+
+/* Controls the microcode profiler.
+ * Returns TRUE on success.
+ */
+static
+int cmd_profile(struct debugger *dbg)
+{
+    struct simulator *sim;
+    const char *arg, *end;
+    unsigned int num;
+
+    sim = dbg->sim;
+
+    arg = (const char *) dbg->cmd_buf;
+    arg = &arg[strlen(arg) + 1];
+
+    if (strcmp(arg, "on") == 0) {
+        if (simulator_set_profiling(sim, TRUE))
+            printf("profiler enabled\n");
+        return TRUE;
+    }
+
+    if (strcmp(arg, "off") == 0) {
+        simulator_set_profiling(sim, FALSE);
+        printf("profiler disabled\n");
+        return TRUE;
+    }
+
+    if (!sim->prof_steps) {
+        printf("the profiler is not enabled (use `pf on`)\n");
+        return TRUE;
+    }
+
+    if (strcmp(arg, "clear") == 0) {
+        simulator_clear_profile(sim);
+        printf("profile cleared\n");
+        return TRUE;
+    }
+
+    if (strcmp(arg, "save") == 0) {
+        arg = &arg[strlen(arg) + 1];
+        if (arg[0] == '\0') {
+            printf("please specify a filename\n");
+            return TRUE;
+        }
+        if (simulator_save_profile(sim, arg))
+            printf("profile saved to `%s`\n", arg);
+        return TRUE;
+    }
+
+    num = DEFAULT_PROFILE_ENTRIES;
+    if (arg[0] != '\0') {
+        num = (unsigned int) strtoul(arg, (char **) &end, 10);
+        if (end[0] != '\0') {
+            printf("invalid decimal number `%s`\n", arg);
+            return TRUE;
+        }
+    }
+
+    return print_profile(dbg, num);
+}
+
+/* Prints the `num` addresses with the most Nova instructions in the
+ * Nova profile.
+ * Returns TRUE on success.
+ */
+static
+int print_nova_profile(struct debugger *dbg, unsigned int num)
+{
+    struct simulator *sim;
+    struct profile_entry *entries;
+    const struct symbol *sym;
+    unsigned int idx, count, i;
+    uint64_t total;
+
+    sim = dbg->sim;
+    entries = (struct profile_entry *)
+        malloc(NUM_MEMORY_BANKS * MEMORY_SIZE
+               * sizeof(struct profile_entry));
+    if (unlikely(!entries)) {
+        report_error("debugger: print_nova_profile: memory exhausted");
+        return FALSE;
+    }
+
+    count = 0;
+    total = 0;
+    for (idx = 0; idx < NUM_MEMORY_BANKS * MEMORY_SIZE; idx++) {
+        if (sim->nova_prof[idx] == 0) continue;
+        entries[count].idx = idx;
+        entries[count].value = sim->nova_prof[idx];
+        total += sim->nova_prof[idx];
+        count++;
+    }
+    qsort(entries, count, sizeof(struct profile_entry),
+          &compare_profile_entries);
+
+    printf("total: %llu instructions\n", (unsigned long long) total);
+    printf("BANK ADDRESS  COUNT          %%COUNT  SYMBOL\n");
+    for (i = 0; i < count && i < num; i++) {
+        idx = entries[i].idx;
+        printf("%-4u ", idx / MEMORY_SIZE);
+        if (dbg->use_octal) {
+            printf("%06o   ", idx % MEMORY_SIZE);
+        } else {
+            printf("0x%04X   ", idx % MEMORY_SIZE);
+        }
+        printf("%-14llu %6.2f  ", (unsigned long long) entries[i].value,
+               (100.0 * entries[i].value) / total);
+
+        sym = symbol_map_lookup(&dbg->syms, idx);
+        if (sym) {
+            printf("%s+%o", sym->name, idx - sym->address);
+        }
+        printf("\n");
+    }
+
+    free((void *) entries);
+    return TRUE;
+}
+
+/* Controls the Nova profiler.
+ * Returns TRUE on success.
+ */
+static
+int cmd_nova_profile(struct debugger *dbg)
+{
+    struct simulator *sim;
+    const char *arg, *end;
+    unsigned int num;
+
+    sim = dbg->sim;
+
+    arg = (const char *) dbg->cmd_buf;
+    arg = &arg[strlen(arg) + 1];
+
+    if (strcmp(arg, "on") == 0) {
+        if (simulator_set_nova_profiling(sim, TRUE))
+            printf("nova profiler enabled\n");
+        return TRUE;
+    }
+
+    if (strcmp(arg, "off") == 0) {
+        simulator_set_nova_profiling(sim, FALSE);
+        printf("nova profiler disabled\n");
+        return TRUE;
+    }
+
+    if (!sim->nova_prof) {
+        printf("the nova profiler is not enabled (use `np on`)\n");
+        return TRUE;
+    }
+
+    if (strcmp(arg, "clear") == 0) {
+        simulator_clear_nova_profile(sim);
+        printf("nova profile cleared\n");
+        return TRUE;
+    }
+
+    if (strcmp(arg, "save") == 0) {
+        arg = &arg[strlen(arg) + 1];
+        if (arg[0] == '\0') {
+            printf("please specify a filename\n");
+            return TRUE;
+        }
+        if (symbol_map_save_folded(&dbg->syms, sim->nova_prof, arg))
+            printf("nova profile saved to `%s`\n", arg);
+        return TRUE;
+    }
+
+    num = DEFAULT_PROFILE_ENTRIES;
+    if (arg[0] != '\0') {
+        num = (unsigned int) strtoul(arg, (char **) &end, 10);
+        if (end[0] != '\0') {
+            printf("invalid decimal number `%s`\n", arg);
+            return TRUE;
+        }
+    }
+
+    return print_nova_profile(dbg, num);
+}
+
+/* Loads the symbols of the Nova code. */
+static
+void cmd_load_symbols(struct debugger *dbg)
+{
+    const char *arg;
+
+    arg = (const char *) dbg->cmd_buf;
+    arg = &arg[strlen(arg) + 1];
+
+    if (arg[0] == '\0') {
+        symbol_map_clear(&dbg->syms);
+        printf("symbols cleared\n");
+        return;
+    }
+
+    if (symbol_map_load(&dbg->syms, arg)) {
+        printf("loaded %lu symbols\n",
+               (unsigned long) dbg->syms.num_symbols);
+    }
+}
+
+/* Prints the runtime statistics of the simulator. */
+static
+void print_stats(struct debugger *dbg)
+{
+    const struct sim_stats *stats;
+    uint64_t cycles;
+    double seconds;
+    unsigned int task;
+
+    stats = &dbg->sim->stats;
+    cycles = 0;
+    for (task = 0; task < TASK_NUM_TASKS; task++)
+        cycles += stats->task_cycles[task];
+
+    printf("cycles: %llu\n", (unsigned long long) cycles);
+    printf("TASK   CYCLES         %%CYCLES\n");
+    for (task = 0; task < TASK_NUM_TASKS; task++) {
+        if (stats->task_cycles[task] == 0) continue;
+        printf("%-6s %-14llu %6.2f\n",
+               TASK_NAMES[task] ? TASK_NAMES[task] : "?",
+               (unsigned long long) stats->task_cycles[task],
+               (100.0 * stats->task_cycles[task]) / cycles);
+    }
+
+    printf("task switches: %llu\n",
+           (unsigned long long) stats->task_switches);
+    printf("events: disk %llu, display %llu, ethernet %llu\n",
+           (unsigned long long) stats->disk_events,
+           (unsigned long long) stats->display_events,
+           (unsigned long long) stats->ethernet_events);
+    printf("memory stalls: %llu cycles (%.2f%%)\n",
+           (unsigned long long) stats->mem_stalls,
+           (cycles > 0) ? (100.0 * stats->mem_stalls) / cycles : 0.0);
+
+    seconds = (double) dbg->run_ticks;
+    seconds /= (double) SDL_GetPerformanceFrequency();
+    if (seconds > 0) {
+        printf("speed: %.3f MHz emulated in %.3f host seconds "
+               "(nominal %.3f MHz)\n", (cycles / seconds) / 1e6,
+               seconds, dbg->frequency / 1e6);
+    }
+}
+
+/* Controls the runtime statistics. */
+static
+void cmd_stats(struct debugger *dbg)
+{
+    const char *arg;
+
+    arg = (const char *) dbg->cmd_buf;
+    arg = &arg[strlen(arg) + 1];
+
+    if (strcmp(arg, "clear") == 0) {
+        debugger_clear_stats(dbg);
+        printf("statistics cleared\n");
+        return;
+    }
+
+    if (strcmp(arg, "save") == 0) {
+        arg = &arg[strlen(arg) + 1];
+        if (arg[0] == '\0') {
+            printf("please specify a filename\n");
+            return;
+        }
+        if (debugger_save_stats(dbg, arg))
+            printf("statistics saved to `%s`\n", arg);
+        return;
+    }
+
+    print_stats(dbg);
 }
 
 /* Restarts the simulation. */
@@ -1060,6 +1985,7 @@ void cmd_restart(struct debugger *dbg)
     struct simulator *sim;
     sim = dbg->sim;
     simulator_reset(sim);
+    clear_history(dbg);
     cmd_registers(dbg, FALSE);
 }
 
@@ -1092,6 +2018,8 @@ void cmd_help(struct debugger *dbg)
         printf("  s [cycles]       Step through the microcode\n");
         printf("  nt [task]        Step until switch task\n");
         printf("  nn [num]         Execute nova instructions\n");
+        printf("  rn [num]         Step back through the microcode\n");
+        printf("  rc               Continue execution backwards\n");
         printf("  bp specs         Add a breakpoint\n");
         printf("  bl               List breakpoints\n");
         printf("  be num           Enable a breakpoint\n");
@@ -1101,6 +2029,12 @@ void cmd_help(struct debugger *dbg)
         printf("  si num file      Save a disk drive image\n");
         printf("  ls file          Load the simulator state\n");
         printf("  ss file          Save the simulator state\n");
+        printf("  cp [file] [secs] Save periodic checkpoints\n");
+        printf("  lc file [num]    Load the checkpoints\n");
+        printf("  pf [args]        Control the microcode profiler\n");
+        printf("  np [args]        Control the nova profiler\n");
+        printf("  sym [file]       Load the nova symbols\n");
+        printf("  stats [args]     Print the runtime statistics\n");
         printf("  zs               Restart the simulation\n");
         printf("  h                Print this help\n");
         printf("  q                Quit the debugger\n");
@@ -1253,8 +2187,13 @@ void cmd_help(struct debugger *dbg)
         printf("  -f2 f2           To select the F2 of the MIR\n");
         printf("  -store           When F2=F2_STORE_MD\n");
         printf("  -no_constants    To disable F1 or F2 constants\n");
-        printf("  -watch address   To watch for memory activity\n");
+        printf("  -watch addr      To watch the reads and writes of MD\n");
+        printf("  -rwatch addr     To watch the reads of MD\n");
+        printf("  -wwatch addr     To watch the writes of MD\n");
+        printf("  -bank bank       To only watch the memory bank\n");
         printf("\n");
+        printf("The watched address can also be a range "
+               "(as in `first-last`).\n");
         printf("Note: numbers are parsed according to the current "
                "debugger basis.\n");
         return;
@@ -1290,6 +2229,25 @@ void cmd_help(struct debugger *dbg)
         return;
     }
 
+    if (strcmp(arg, "rn") == 0) {
+        printf("Go back a number of microcode steps using:\n");
+        printf("  rn [num]\n");
+        printf("The simulator goes back to the nearest snapshot of the "
+               "execution history\n");
+        printf("(taken every %llu steps) and executes again from "
+               "there.\n", (unsigned long long) dbg->history_interval);
+        printf("The inputs (including the network) are replayed from "
+               "the journal.\n");
+        return;
+    }
+
+    if (strcmp(arg, "rc") == 0) {
+        printf("Continue execution backwards until the last time a "
+               "breakpoint was hit.\n");
+        printf("See also `rn`.\n");
+        return;
+    }
+
     if (strcmp(arg, "li") == 0) {
         printf("Load the disk image from a file using:\n");
         printf("  li num file\n");
@@ -1324,6 +2282,86 @@ void cmd_help(struct debugger *dbg)
         return;
     }
 
+    if (strcmp(arg, "cp") == 0) {
+        printf("Save periodic incremental checkpoints using:\n");
+        printf("  cp file [secs]\n");
+        printf("The filename is specified in the parameter `file`.\n");
+        printf("A checkpoint is saved every `secs` seconds of "
+               "emulated time (default 5).\n");
+        printf("Only the changes since the last checkpoint are saved, "
+               "including the contents of the disk images.\n");
+        printf("Without arguments, the checkpoints are stopped.\n");
+        return;
+    }
+
+    if (strcmp(arg, "lc") == 0) {
+        printf("Load the simulator state from the checkpoints using:\n");
+        printf("  lc file [num]\n");
+        printf("The filename is specified in the parameter `file`.\n");
+        printf("The first `num` checkpoints are replayed (all of them "
+               "by default).\n");
+        return;
+    }
+
+    if (strcmp(arg, "pf") == 0) {
+        printf("Control the microcode profiler using:\n");
+        printf("  pf on            Start profiling\n");
+        printf("  pf off           Stop profiling (and discard the "
+               "profile)\n");
+        printf("  pf clear         Clear the profile\n");
+        printf("  pf save file     Save the profile to `file`\n");
+        printf("  pf [num]         Print the `num` microinstructions "
+               "with most cycles\n");
+        printf("The profile counts the executions and the cycles of "
+               "each microinstruction\n");
+        printf("(per task). The saved profile can annotate the listing "
+               "of pmu (see `pmu -p`).\n");
+        return;
+    }
+
+    if (strcmp(arg, "np") == 0) {
+        printf("Control the nova profiler using:\n");
+        printf("  np on            Start profiling\n");
+        printf("  np off           Stop profiling (and discard the "
+               "profile)\n");
+        printf("  np clear         Clear the profile\n");
+        printf("  np save file     Save the profile to `file` (folded "
+               "format)\n");
+        printf("  np [num]         Print the `num` addresses with most "
+               "instructions\n");
+        printf("The profile counts the nova instructions loaded from "
+               "each address (per bank).\n");
+        printf("The folded format can be used to draw flame graphs, and "
+               "it uses the symbols\n");
+        printf("loaded with `sym`.\n");
+        return;
+    }
+
+    if (strcmp(arg, "sym") == 0) {
+        printf("Load the symbols of the nova code using:\n");
+        printf("  sym [file]\n");
+        printf("Each line of `file` has an octal address (optionally "
+               "preceded by the bank,\n");
+        printf("as in `1:4000`) and the name of the symbol. "
+               "Without arguments, the symbols\n");
+        printf("are cleared.\n");
+        return;
+    }
+
+    if (strcmp(arg, "stats") == 0) {
+        printf("Control the runtime statistics using:\n");
+        printf("  stats            Print the statistics\n");
+        printf("  stats clear      Clear the statistics\n");
+        printf("  stats save file  Save the statistics to `file` "
+               "(one `key value` per line)\n");
+        printf("The statistics count the cycles of each task, the task "
+               "switches, the device\n");
+        printf("events, and the cycles waiting for the memory. The "
+               "emulated speed is measured\n");
+        printf("against the host time spent simulating.\n");
+        return;
+    }
+
     if (strcmp(arg, "zs") == 0) {
         printf("Reset the state of the simulator (but not of the "
                "disk drives).\n");
@@ -1503,6 +2541,22 @@ int debugger_debug(struct gui *ui)
             continue;
         }
 
+        if (strcmp(cmd, "rn") == 0) {
+            if (unlikely(!cmd_reverse_next(dbg))) {
+                ret = FALSE;
+                goto do_exit;
+            }
+            continue;
+        }
+
+        if (strcmp(cmd, "rc") == 0) {
+            if (unlikely(!cmd_reverse_continue(dbg))) {
+                ret = FALSE;
+                goto do_exit;
+            }
+            continue;
+        }
+
         if (strcmp(cmd, "bp") == 0) {
             cmd_add_breakpoint(dbg);
             continue;
@@ -1548,6 +2602,42 @@ int debugger_debug(struct gui *ui)
             continue;
         }
 
+        if (strcmp(cmd, "cp") == 0) {
+            cmd_checkpoints(dbg);
+            continue;
+        }
+
+        if (strcmp(cmd, "lc") == 0) {
+            cmd_load_checkpoint(dbg);
+            continue;
+        }
+
+        if (strcmp(cmd, "pf") == 0) {
+            if (unlikely(!cmd_profile(dbg))) {
+                ret = FALSE;
+                goto do_exit;
+            }
+            continue;
+        }
+
+        if (strcmp(cmd, "np") == 0) {
+            if (unlikely(!cmd_nova_profile(dbg))) {
+                ret = FALSE;
+                goto do_exit;
+            }
+            continue;
+        }
+
+        if (strcmp(cmd, "sym") == 0) {
+            cmd_load_symbols(dbg);
+            continue;
+        }
+
+        if (strcmp(cmd, "stats") == 0) {
+            cmd_stats(dbg);
+            continue;
+        }
+
         if (strcmp(cmd, "zs") == 0) {
             cmd_restart(dbg);
             continue;
@@ -1,10 +1,15 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <SDL.h>
 
 #include "debugger/debugger.h"
 #include "simulator/simulator.h"
+#include "simulator/snapshot.h"
+#include "simulator/checkpoint.h"
+#include "debugger/symbols.h"
 #include "gui/gui.h"
 #include "assembler/objfile.h"
 #include "common/allocator.h"
@@ -14,6 +19,8 @@
 /* Constants. */
 #define MAX_BREAKPOINTS                 1024
 #define BUFFER_SIZE                     8192
+#define HISTORY_SIZE                      64
+#define HISTORY_INTERVAL             1000000
 
 /* Functions. */
 
@@ -24,13 +31,23 @@ void debugger_initvar(struct debugger *dbg)
     objfile_initvar(&dbg->rom0f);
 
     dbg->bps = NULL;
+    dbg->bp_mpc_map = NULL;
     dbg->cmd_buf = NULL;
+    dbg->history = NULL;
+    dbg->history_size = 0;
 
     string_buffer_initvar(&dbg->output);
+    snapshot_initvar(&dbg->snap);
+    symbol_map_initvar(&dbg->syms);
+    checkpoint_initvar(&dbg->ckpt);
+    pacer_initvar(&dbg->pacer);
+    journal_initvar(&dbg->jn);
 }
 
 void debugger_destroy(struct debugger *dbg)
 {
+    unsigned int num;
+
     allocator_destroy(&dbg->salloc);
     allocator_destroy(&dbg->oalloc);
     objfile_destroy(&dbg->rom0f);
@@ -38,15 +55,33 @@ void debugger_destroy(struct debugger *dbg)
     if (dbg->bps) free((void *) dbg->bps);
     dbg->bps = NULL;
 
+    if (dbg->bp_mpc_map) free((void *) dbg->bp_mpc_map);
+    dbg->bp_mpc_map = NULL;
+
     if (dbg->cmd_buf) free((void *) dbg->cmd_buf);
     dbg->cmd_buf = NULL;
 
+    if (dbg->history) {
+        for (num = 0; num < dbg->history_size; num++) {
+            snapshot_destroy(&dbg->history[num].snap);
+        }
+        free((void *) dbg->history);
+    }
+    dbg->history = NULL;
+
     string_buffer_destroy(&dbg->output);
+    snapshot_destroy(&dbg->snap);
+    symbol_map_destroy(&dbg->syms);
+    checkpoint_destroy(&dbg->ckpt);
+    pacer_destroy(&dbg->pacer);
+    journal_destroy(&dbg->jn);
 }
 
 int debugger_create(struct debugger *dbg, int use_debugger,
                     struct simulator *sim, struct gui *ui)
 {
+    unsigned int num;
+
     debugger_initvar(dbg);
 
     if (unlikely(!allocator_create(&dbg->salloc, 0))) {
@@ -76,13 +111,15 @@ int debugger_create(struct debugger *dbg, int use_debugger,
 
     dbg->bps = (struct breakpoint *)
         malloc(dbg->max_breakpoints * sizeof(struct breakpoint));
+    dbg->bp_mpc_map = (uint8_t *) calloc(BP_MPC_MAP_SIZE, 1);
     dbg->cmd_buf = (char *) malloc(dbg->cmd_buf_size);
 
-    if (unlikely(!dbg->bps || !dbg->cmd_buf)) {
+    if (unlikely(!dbg->bps || !dbg->bp_mpc_map || !dbg->cmd_buf)) {
         report_error("debugger: create: memory exhausted");
         debugger_destroy(dbg);
         return FALSE;
     }
+    dbg->bp_check = 0;
 
     if (unlikely(!string_buffer_create(&dbg->output, BUFFER_SIZE))) {
         report_error("debugger: create: could not create string_buffer");
@@ -90,11 +127,73 @@ int debugger_create(struct debugger *dbg, int use_debugger,
         return FALSE;
     }
 
-    dbg->frequency = 6300000; /* 6.3 MHz */
+    if (unlikely(!snapshot_create(&dbg->snap))) {
+        report_error("debugger: create: could not create snapshot");
+        debugger_destroy(dbg);
+        return FALSE;
+    }
+
+    if (unlikely(!symbol_map_create(&dbg->syms))) {
+        report_error("debugger: create: could not create symbol map");
+        debugger_destroy(dbg);
+        return FALSE;
+    }
+
+    if (unlikely(!checkpoint_create(&dbg->ckpt))) {
+        report_error("debugger: create: could not create checkpoint");
+        debugger_destroy(dbg);
+        return FALSE;
+    }
+
+    if (unlikely(!journal_create(&dbg->jn))) {
+        report_error("debugger: create: could not create journal");
+        debugger_destroy(dbg);
+        return FALSE;
+    }
+
+    if (use_debugger) {
+        dbg->history = (struct history_entry *)
+            malloc(HISTORY_SIZE * sizeof(struct history_entry));
+        if (unlikely(!dbg->history)) {
+            report_error("debugger: create: memory exhausted");
+            debugger_destroy(dbg);
+            return FALSE;
+        }
+
+        for (num = 0; num < HISTORY_SIZE; num++) {
+            snapshot_initvar(&dbg->history[num].snap);
+        }
+        dbg->history_size = HISTORY_SIZE;
+
+        for (num = 0; num < HISTORY_SIZE; num++) {
+            if (unlikely(!snapshot_create(&dbg->history[num].snap))) {
+                report_error("debugger: create: "
+                             "could not create snapshot");
+                debugger_destroy(dbg);
+                return FALSE;
+            }
+        }
+    }
+
+    dbg->frequency = 5882353; /* 5.88 MHz (170 ns cycles) */
+    if (unlikely(!pacer_create(&dbg->pacer, (uint32_t) dbg->frequency))) {
+        report_error("debugger: create: could not create pacer");
+        debugger_destroy(dbg);
+        return FALSE;
+    }
+
     dbg->use_octal = TRUE;
     dbg->use_debugger = use_debugger;
     dbg->sim = sim;
     dbg->ui = ui;
+    dbg->ckpt_interval = 0;
+    dbg->ckpt_frames = 0;
+    dbg->steps = 0;
+    dbg->run_ticks = 0;
+    dbg->history_first = 0;
+    dbg->history_count = 0;
+    dbg->history_interval = HISTORY_INTERVAL;
+    dbg->history_next = 0;
 
     debugger_clear(dbg);
 
@@ -116,6 +215,91 @@ void debugger_clear(struct debugger *dbg)
     string_buffer_clear(&dbg->output);
 }
 
+int debugger_set_checkpoints(struct debugger *dbg, const char *filename,
+                             unsigned int seconds)
+{
+    dbg->ckpt_interval = 0;
+    dbg->ckpt_frames = 0;
+    checkpoint_close(&dbg->ckpt);
+    if (!filename) return TRUE;
+
+    if (unlikely(!checkpoint_open(&dbg->ckpt, filename))) {
+        report_error("debugger: set_checkpoints: could not open file");
+        return FALSE;
+    }
+
+    if (unlikely(!checkpoint_save(&dbg->ckpt, dbg->sim))) {
+        report_error("debugger: set_checkpoints: "
+                     "could not save checkpoint");
+        checkpoint_close(&dbg->ckpt);
+        return FALSE;
+    }
+
+    /* There are 60 frames per second. */
+    dbg->ckpt_interval = 60 * MAX(seconds, 1);
+    return TRUE;
+}
+
+int debugger_set_speed(struct debugger *dbg, double speed)
+{
+    if (unlikely(!pacer_set_speed(&dbg->pacer, speed))) {
+        report_error("debugger: set_speed: could not set speed");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void debugger_clear_stats(struct debugger *dbg)
+{
+    simulator_clear_stats(dbg->sim);
+    dbg->run_ticks = 0;
+}
+
+int debugger_save_stats(const struct debugger *dbg, const char *filename)
+{
+    const struct sim_stats *stats;
+    uint64_t cycles;
+    double seconds;
+    unsigned int task;
+    FILE *fp;
+
+    fp = fopen(filename, "w");
+    if (unlikely(!fp)) {
+        report_error("debugger: save_stats: could not open `%s` "
+                     "for writing", filename);
+        return FALSE;
+    }
+
+    stats = &dbg->sim->stats;
+    cycles = 0;
+    for (task = 0; task < TASK_NUM_TASKS; task++) {
+        fprintf(fp, "task_cycles.%u %llu\n", task,
+                (unsigned long long) stats->task_cycles[task]);
+        cycles += stats->task_cycles[task];
+    }
+    fprintf(fp, "cycles %llu\n", (unsigned long long) cycles);
+    fprintf(fp, "task_switches %llu\n",
+            (unsigned long long) stats->task_switches);
+    fprintf(fp, "disk_events %llu\n",
+            (unsigned long long) stats->disk_events);
+    fprintf(fp, "display_events %llu\n",
+            (unsigned long long) stats->display_events);
+    fprintf(fp, "ethernet_events %llu\n",
+            (unsigned long long) stats->ethernet_events);
+    fprintf(fp, "mem_stalls %llu\n",
+            (unsigned long long) stats->mem_stalls);
+
+    seconds = (double) dbg->run_ticks;
+    seconds /= (double) SDL_GetPerformanceFrequency();
+    fprintf(fp, "host_seconds %.6f\n", seconds);
+    fprintf(fp, "emulated_mhz %.3f\n",
+            (seconds > 0) ? (cycles / seconds) / 1e6 : 0.0);
+    fprintf(fp, "nominal_mhz %.3f\n", dbg->frequency / 1e6);
+
+    fclose(fp);
+    return TRUE;
+}
+
 int debugger_load_binary(struct debugger *dbg,
                          const char *filename, uint8_t bank)
 {
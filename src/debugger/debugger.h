@@ -5,12 +5,27 @@
 #include <stddef.h>
 #include <stdint.h>
 #include "simulator/simulator.h"
+#include "simulator/snapshot.h"
+#include "simulator/checkpoint.h"
+#include "simulator/journal.h"
+#include "debugger/symbols.h"
 #include "gui/gui.h"
+#include "gui/pacer.h"
 #include "assembler/objfile.h"
 #include "microcode/microcode.h"
 #include "common/allocator.h"
 #include "common/string_buffer.h"
 
+/* Constants. */
+#define NUM_BP_MPCS \
+    (TASK_NUM_TASKS * NUM_MICROCODE_BANKS * MICROCODE_SIZE)
+#define BP_MPC_MAP_SIZE          (NUM_BP_MPCS / 8)
+
+/* Conditions that require checking the breakpoints. */
+#define BP_CHECK_ALWAYS                    1 /* At every step. */
+#define BP_CHECK_SWITCH                    2 /* At the task switches. */
+#define BP_CHECK_MPC                       4 /* At the MPCs in the bitmap. */
+
 /* Data structures and types. */
 
 /* Structure defining a breakpoint. */
@@ -28,8 +43,21 @@ struct breakpoint {
                                    * breakpoint.
                                    */
     int allow_constants;          /* To allow F1 or F2 constants in MIR. */
-    uint16_t addr;                /* Address watch. */
-    int watch;                    /* To watch an address. */
+    uint16_t addr;                /* First watched address. */
+    uint16_t addr_end;            /* Last watched address. */
+    uint8_t bank;                 /* The watched memory bank (or
+                                   * WATCH_ALL_BANKS).
+                                   */
+    unsigned int watch;           /* The memory accesses to watch
+                                   * (WATCH_READ or WATCH_WRITE).
+                                   */
+};
+
+/* A snapshot in the execution history (for reverse execution). */
+struct history_entry {
+    struct snapshot snap;         /* The snapshot. */
+    struct journal_mark mark;     /* The inputs after the snapshot. */
+    uint64_t step;                /* The step when it was taken. */
 };
 
 /* Internal structure for the palos simulator. */
@@ -41,10 +69,19 @@ struct debugger {
     struct objfile rom0f;         /* Object file for the ROM0. */
 
     int frequency;                /* The Alto cpu frequency. */
+    struct pacer pacer;           /* To run the simulation in real
+                                   * time (or at a multiple of it).
+                                   */
     int use_octal;                /* To print numbers in octal. */
 
     size_t max_breakpoints;       /* The maximum number of breakpoints. */
     struct breakpoint *bps;       /* The breakpoints. */
+    uint8_t *bp_mpc_map;          /* Bitmap of the (task, mpc) pairs
+                                   * that may hit a breakpoint.
+                                   */
+    unsigned int bp_check;        /* Other conditions to check the
+                                   * breakpoints (BP_CHECK_*).
+                                   */
 
     char *cmd_buf;                /* Buffer for command. */
     size_t cmd_buf_size;          /* Size of the command buffer. */
@@ -55,6 +92,35 @@ struct debugger {
     struct decoder dec;           /* Decoder used. */
     struct value_decoder vdecs[2]; /* Used by the decoder. */
     struct microcode mc;          /* The microcode used by the decoder. */
+
+    uint64_t script_cycles;       /* Cycles simulated by the last script. */
+    struct snapshot snap;         /* The snapshot used by the scripts. */
+
+    struct symbol_map syms;       /* Symbols of the Nova code (for the
+                                   * Nova profiler).
+                                   */
+    struct checkpoint ckpt;       /* For the periodic checkpoints. */
+    unsigned int ckpt_interval;   /* Frames between checkpoints (zero
+                                   * to disable them).
+                                   */
+    unsigned int ckpt_frames;     /* Frames since the last checkpoint. */
+
+    uint64_t steps;               /* Steps executed by the debugger. */
+    uint64_t run_ticks;           /* Host time spent simulating (in
+                                   * SDL performance counter ticks).
+                                   */
+    struct history_entry *history; /* Ring of periodic snapshots (only
+                                   * when using the debugger).
+                                   */
+    unsigned int history_size;    /* The size of the ring. */
+    unsigned int history_first;   /* The oldest snapshot in the ring. */
+    unsigned int history_count;   /* Number of snapshots in the ring. */
+    uint64_t history_interval;    /* Steps between the snapshots. */
+    uint64_t history_next;        /* Step of the next snapshot. */
+    struct journal jn;            /* The journal of the inputs for the
+                                   * execution history (when the
+                                   * simulator has no other journal).
+                                   */
 };
 
 /* Functions. */
@@ -104,6 +170,35 @@ void debugger_setup_value_decoder(struct debugger *dbg,
  */
 struct decoder *debugger_setup_decoder(struct debugger *dbg);
 
+/* Starts writing periodic checkpoints to the file named `filename`.
+ * A checkpoint is written immediately, and then every `seconds` of
+ * emulated time (as long as the simulation runs in the debugger).
+ * If `filename` is NULL, the periodic checkpoints are stopped.
+ * Returns TRUE on success.
+ */
+int debugger_set_checkpoints(struct debugger *dbg, const char *filename,
+                             unsigned int seconds);
+
+/* Sets the speed of the simulation to `speed` times the real time
+ * (of a cpu running at the debugger's frequency). If `speed` is zero,
+ * the simulation runs unthrottled.
+ * Returns TRUE on success.
+ */
+int debugger_set_speed(struct debugger *dbg, double speed);
+
+/* Clears the runtime statistics of the simulator, and the host time
+ * spent simulating.
+ */
+void debugger_clear_stats(struct debugger *dbg);
+
+/* Saves the runtime statistics to the file named `filename`, in a
+ * machine-readable format: one `key value` pair per line. The emulated
+ * speed (`emulated_mhz`) is measured against the host time spent
+ * simulating since the statistics were last cleared.
+ * Returns TRUE on success.
+ */
+int debugger_save_stats(const struct debugger *dbg, const char *filename);
+
 /* Disassembles the current microinstruction into the debugger's
  * output string buffer.
  */
@@ -121,5 +216,41 @@ void debugger_nova_disassemble(struct debugger *dbg);
  */
 int debugger_debug(struct gui *ui);
 
+/* Runs a script non-interactively.
+ * The script is read from the file named `filename`, and has one
+ * command per line (`#` starts a comment). Numbers follow the C
+ * conventions (0x for hexadecimal and a leading 0 for octal). The
+ * memory addresses are the ones seen by the emulator task. Commands:
+ *   load_disk drive file          Loads a disk image.
+ *   save_disk drive file          Saves a disk image.
+ *   load_state file               Loads the simulator state.
+ *   save_state file               Saves the simulator state.
+ *   reset                         Resets the simulator.
+ *   checkpoint_start file         Starts a chain of checkpoints (and
+ *                                 saves the first one).
+ *   checkpoint                    Appends an incremental checkpoint.
+ *   load_checkpoint file [count]  Replays a chain of checkpoints.
+ *   snapshot                      Takes an in-memory snapshot of the
+ *                                 simulator (including the disks).
+ *   restore                       Restores the snapshot (so that many
+ *                                 runs can branch from the same state).
+ *   write addr value              Writes a word to memory.
+ *   check addr value              Fails unless the word matches.
+ *   run cycles                    Runs for a number of cycles.
+ *   run_until_mem addr value cycles [mask]
+ *                                 Runs until the (masked) word at
+ *                                 `addr` equals `value`, failing if
+ *                                 this does not happen in time.
+ *   run_until_mpc task mpc cycles Same, until `task` reaches `mpc`.
+ *   dump_memory file [addr num]   Dumps the memory to a text file.
+ *   dump_registers file           Dumps the registers to a text file.
+ *   screenshot file               Saves the display (PGM format).
+ *   dump_stats file               Saves the runtime statistics (see
+ *                                 debugger_save_stats()).
+ * No output is produced while the simulation is running.
+ * Returns TRUE on success (when all commands and checks succeed).
+ */
+int debugger_run_script(struct debugger *dbg, const char *filename);
+
 
 #endif /* __DEBUGGER_DEBUGGER */
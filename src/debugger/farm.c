@@ -0,0 +1,391 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <SDL.h>
+
+#include "debugger/farm.h"
+#include "debugger/debugger.h"
+#include "simulator/simulator.h"
+#include "simulator/disk.h"
+#include "common/allocator.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define MAX_LINE_WORDS                    16
+
+/* Data structures and types. */
+
+/* The state shared by the worker threads. */
+struct farm_worker {
+    struct farm *fm;              /* The farm. */
+    SDL_atomic_t next;            /* The next instance to run. */
+};
+
+/* Functions. */
+
+void farm_initvar(struct farm *fm)
+{
+    allocator_initvar(&fm->salloc);
+    fm->instances = NULL;
+}
+
+void farm_destroy(struct farm *fm)
+{
+    allocator_destroy(&fm->salloc);
+
+    if (fm->instances) free((void *) fm->instances);
+    fm->instances = NULL;
+}
+
+int farm_create(struct farm *fm, enum system_type sys_type,
+                enum sim_engine engine, int idle_skip, int fast_nova,
+                const char *const_filename,
+                const char *mcode_filename)
+{
+    farm_initvar(fm);
+
+    if (unlikely(!allocator_create(&fm->salloc, 0))) {
+        report_error("farm: create: could not create string allocator");
+        farm_destroy(fm);
+        return FALSE;
+    }
+
+    fm->sys_type = sys_type;
+    fm->engine = engine;
+    fm->idle_skip = idle_skip;
+    fm->fast_nova = fast_nova;
+    fm->const_filename = const_filename;
+    fm->mcode_filename = mcode_filename;
+    fm->num_instances = 0;
+    fm->capacity = 0;
+    return TRUE;
+}
+
+/* Adds a new instance to the farm.
+ * Returns the new instance, or NULL on error.
+ */
+static
+struct farm_instance *add_instance(struct farm *fm)
+{
+    struct farm_instance *fi;
+    size_t capacity;
+
+    if (fm->num_instances == fm->capacity) {
+        capacity = (fm->capacity == 0) ? 64 : 2 * fm->capacity;
+        fi = (struct farm_instance *)
+            realloc(fm->instances, capacity * sizeof(*fi));
+        if (unlikely(!fi)) {
+            report_error("farm: add_instance: memory exhausted");
+            return NULL;
+        }
+        fm->instances = fi;
+        fm->capacity = capacity;
+    }
+
+    fi = &fm->instances[fm->num_instances++];
+    memset(fi, 0, sizeof(*fi));
+    return fi;
+}
+
+/* Parses one line of the list of instances.
+ * The contents of the line are in `line`.
+ * Returns TRUE on success.
+ */
+static
+int parse_line(struct farm *fm, const char *line)
+{
+    struct farm_instance *fi;
+    const char *words[MAX_LINE_WORDS];
+    const char *start;
+    unsigned int i, num_words;
+
+    num_words = 0;
+    while (TRUE) {
+        while (*line && isspace((unsigned char) *line)) line++;
+        if (*line == '\0' || *line == '#') break;
+
+        start = line;
+        while (*line && !isspace((unsigned char) *line)) line++;
+
+        if (unlikely(num_words == MAX_LINE_WORDS)) {
+            report_error("farm: parse_line: too many words");
+            return FALSE;
+        }
+        words[num_words] = allocator_dup(&fm->salloc, start,
+                                         line - start);
+        if (unlikely(!words[num_words])) {
+            report_error("farm: parse_line: memory exhausted");
+            return FALSE;
+        }
+        num_words++;
+    }
+
+    if (num_words == 0) return TRUE;
+    if (unlikely(num_words < 2)) {
+        report_error("farm: parse_line: please specify the script");
+        return FALSE;
+    }
+
+    fi = add_instance(fm);
+    if (unlikely(!fi)) return FALSE;
+
+    fi->name = words[0];
+    fi->script_filename = words[1];
+    for (i = 2; i < num_words; i += 2) {
+        if (unlikely(i + 1 == num_words)) {
+            report_error("farm: parse_line: missing argument for `%s`",
+                         words[i]);
+            return FALSE;
+        }
+
+        if (strcmp(words[i], "-1") == 0) {
+            fi->disk1_filename = words[i + 1];
+        } else if (strcmp(words[i], "-2") == 0) {
+            fi->disk2_filename = words[i + 1];
+        } else if (strcmp(words[i], "-s") == 0) {
+            fi->state_filename = words[i + 1];
+        } else {
+            report_error("farm: parse_line: invalid option `%s`",
+                         words[i]);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+int farm_load(struct farm *fm, const char *filename)
+{
+    char line[1024];
+    unsigned int line_num;
+    FILE *fp;
+
+    fp = fopen(filename, "r");
+    if (unlikely(!fp)) {
+        report_error("farm: load: could not open `%s`", filename);
+        return FALSE;
+    }
+
+    line_num = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_num++;
+        if (unlikely(!parse_line(fm, line))) {
+            report_error("farm: load: %s:%u: invalid line",
+                         filename, line_num);
+            fclose(fp);
+            return FALSE;
+        }
+    }
+
+    fclose(fp);
+    return TRUE;
+}
+
+/* Prepares the simulator `sim` for the instance `fi`.
+ * Returns TRUE on success.
+ */
+static
+int setup_instance(const struct farm *fm, const struct farm_instance *fi,
+                   struct simulator *sim)
+{
+    if (fm->const_filename) {
+        if (unlikely(!simulator_load_constant_rom(sim,
+                                                  fm->const_filename))) {
+            return FALSE;
+        }
+    }
+
+    if (fm->mcode_filename) {
+        if (unlikely(!simulator_load_microcode_rom(sim,
+                                                   fm->mcode_filename,
+                                                   0))) {
+            return FALSE;
+        }
+    }
+
+    if (fi->disk1_filename) {
+        if (unlikely(!disk_load_image(&sim->dsk, 0, fi->disk1_filename)))
+            return FALSE;
+    }
+
+    if (fi->disk2_filename) {
+        if (unlikely(!disk_load_image(&sim->dsk, 1, fi->disk2_filename)))
+            return FALSE;
+    }
+
+    simulator_reset(sim);
+
+    if (fi->state_filename) {
+        if (unlikely(!simulator_load_state(sim, fi->state_filename)))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Runs the instance `fi` of the farm `fm`.
+ * The results are stored in `fi`.
+ */
+static
+void run_instance(const struct farm *fm, struct farm_instance *fi)
+{
+    struct simulator sim;
+    struct debugger dbg;
+    uint64_t start;
+
+    simulator_initvar(&sim);
+    debugger_initvar(&dbg);
+
+    fi->success = FALSE;
+    fi->cycles = 0;
+    fi->seconds = 0;
+
+    if (unlikely(!simulator_create(&sim, fm->sys_type, fm->engine))) {
+        report_error("farm: %s: could not create simulator", fi->name);
+        goto do_exit;
+    }
+
+    if (fm->idle_skip) {
+        if (unlikely(!simulator_set_idle_skip(&sim, TRUE))) {
+            report_error("farm: %s: could not enable idle skip", fi->name);
+            goto do_exit;
+        }
+    }
+    simulator_set_nova_fast_path(&sim, fm->fast_nova);
+
+    if (unlikely(!debugger_create(&dbg, FALSE, &sim, NULL))) {
+        report_error("farm: %s: could not create debugger", fi->name);
+        goto do_exit;
+    }
+
+    if (unlikely(!setup_instance(fm, fi, &sim))) {
+        report_error("farm: %s: could not set up instance", fi->name);
+        goto do_exit;
+    }
+
+    start = SDL_GetPerformanceCounter();
+    fi->success = debugger_run_script(&dbg, fi->script_filename);
+    fi->seconds = (double) (SDL_GetPerformanceCounter() - start);
+    fi->seconds /= (double) SDL_GetPerformanceFrequency();
+    fi->cycles = dbg.script_cycles;
+
+    if (unlikely(!fi->success)) {
+        report_error("farm: %s: script failed", fi->name);
+    }
+
+do_exit:
+    debugger_destroy(&dbg);
+    simulator_destroy(&sim);
+}
+
+/* Function of the worker threads. */
+static
+int worker_main(void *arg)
+{
+    struct farm_worker *fw;
+    struct farm *fm;
+    size_t idx;
+
+    fw = (struct farm_worker *) arg;
+    fm = fw->fm;
+    while (TRUE) {
+        idx = (size_t) SDL_AtomicAdd(&fw->next, 1);
+        if (idx >= fm->num_instances) break;
+        run_instance(fm, &fm->instances[idx]);
+    }
+    return 0;
+}
+
+/* Prints the report of the farm to `fp`.
+ * The total (wall clock) running time is given by `seconds`.
+ * Returns the number of failed instances.
+ */
+static
+size_t print_report(const struct farm *fm, FILE *fp, double seconds)
+{
+    const struct farm_instance *fi;
+    uint64_t total_cycles;
+    size_t i, num_failed;
+
+    total_cycles = 0;
+    num_failed = 0;
+
+    fprintf(fp, "%-20s %-6s %14s %10s %10s\n",
+            "INSTANCE", "STATUS", "CYCLES", "SECONDS", "MHZ");
+    for (i = 0; i < fm->num_instances; i++) {
+        fi = &fm->instances[i];
+        fprintf(fp, "%-20s %-6s %14llu %10.3f %10.3f\n",
+                fi->name, (fi->success) ? "OK" : "FAIL",
+                (unsigned long long) fi->cycles, fi->seconds,
+                (fi->seconds > 0)
+                    ? ((double) fi->cycles) / (1e6 * fi->seconds) : 0.0);
+        total_cycles += fi->cycles;
+        if (!fi->success) num_failed++;
+    }
+
+    fprintf(fp, "%-20s %-6s %14llu %10.3f %10.3f\n",
+            "TOTAL", (num_failed == 0) ? "OK" : "FAIL",
+            (unsigned long long) total_cycles, seconds,
+            (seconds > 0) ? ((double) total_cycles) / (1e6 * seconds) : 0.0);
+    fprintf(fp, "%lu of %lu instances failed\n",
+            (unsigned long) num_failed, (unsigned long) fm->num_instances);
+    return num_failed;
+}
+
+int farm_run(struct farm *fm, unsigned int num_threads)
+{
+    struct farm_worker fw;
+    SDL_Thread **threads;
+    uint64_t start;
+    double seconds;
+    unsigned int i;
+
+    if (num_threads == 0) {
+        num_threads = (unsigned int) SDL_GetCPUCount();
+        if (num_threads == 0) num_threads = 1;
+    }
+    if (num_threads > fm->num_instances) {
+        num_threads = (unsigned int) fm->num_instances;
+    }
+
+    threads = (SDL_Thread **) calloc(MAX(num_threads, 1),
+                                     sizeof(SDL_Thread *));
+    if (unlikely(!threads)) {
+        report_error("farm: run: memory exhausted");
+        return FALSE;
+    }
+
+    fw.fm = fm;
+    SDL_AtomicSet(&fw.next, 0);
+
+    start = SDL_GetPerformanceCounter();
+    for (i = 0; i < num_threads; i++) {
+        threads[i] = SDL_CreateThread(&worker_main, "farm_worker", &fw);
+        if (unlikely(!threads[i])) {
+            report_error("farm: run: could not create thread "
+                         "(SDL_Error: %s)", SDL_GetError());
+            break;
+        }
+    }
+
+    /* The instances are shared by the threads that were created,
+     * or run in this thread if none could be created.
+     */
+    if (i == 0) {
+        worker_main(&fw);
+    }
+
+    for (i = 0; i < num_threads; i++) {
+        if (threads[i]) SDL_WaitThread(threads[i], NULL);
+    }
+    free((void *) threads);
+
+    seconds = (double) (SDL_GetPerformanceCounter() - start);
+    seconds /= (double) SDL_GetPerformanceFrequency();
+
+    return (print_report(fm, stdout, seconds) == 0);
+}
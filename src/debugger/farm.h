@@ -0,0 +1,85 @@
+
+#ifndef __DEBUGGER_FARM_H
+#define __DEBUGGER_FARM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "simulator/simulator.h"
+#include "common/allocator.h"
+
+/* Data structures and types. */
+
+/* A simulator instance of the farm. */
+struct farm_instance {
+    const char *name;             /* The name of the instance. */
+    const char *script_filename;  /* The script to run. */
+    const char *disk1_filename;   /* Disk 1 image file (or NULL). */
+    const char *disk2_filename;   /* Disk 2 image file (or NULL). */
+    const char *state_filename;   /* Initial state file (or NULL). */
+
+    int success;                  /* If the script succeeded. */
+    uint64_t cycles;              /* Number of simulated cycles. */
+    double seconds;               /* The (wall clock) running time. */
+};
+
+/* Runs many independent simulator instances in parallel. */
+struct farm {
+    struct allocator salloc;      /* Allocator for strings. */
+    enum system_type sys_type;    /* The system type of the instances. */
+    enum sim_engine engine;       /* The execution engine. */
+    int idle_skip;                /* To skip the idle loops. */
+    int fast_nova;                /* To execute the common Nova
+                                   * instructions directly.
+                                   */
+    const char *const_filename;   /* The name of the constant rom. */
+    const char *mcode_filename;   /* The name of the microcode rom. */
+
+    struct farm_instance *instances; /* The instances. */
+    size_t num_instances;         /* Number of instances. */
+    size_t capacity;              /* Capacity of the instances array. */
+};
+
+/* Functions. */
+
+/* Initializes the farm variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void farm_initvar(struct farm *fm);
+
+/* Destroys the farm object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void farm_destroy(struct farm *fm);
+
+/* Creates a new farm object.
+ * This obeys the initvar / destroy / create protocol.
+ * All instances use the system type `sys_type` and the execution
+ * engine `engine`. If `idle_skip` is set, the idle loops of the
+ * emulator task are skipped, and if `fast_nova` is set, the common
+ * Nova instructions are executed directly. The ROMs are loaded from
+ * `const_filename` and `mcode_filename`, if they are not NULL.
+ * Returns TRUE on success.
+ */
+int farm_create(struct farm *fm, enum system_type sys_type,
+                enum sim_engine engine, int idle_skip, int fast_nova,
+                const char *const_filename,
+                const char *mcode_filename);
+
+/* Loads the list of instances from the file named `filename`.
+ * Each line describes one instance, with the name of the instance,
+ * the name of the script (see debugger_run_script()), and the
+ * optional arguments `-1 disk1`, `-2 disk2` and `-s state`.
+ * Returns TRUE on success.
+ */
+int farm_load(struct farm *fm, const char *filename);
+
+/* Runs all instances using `num_threads` threads (if zero, one
+ * thread per host core is used), and prints a report with the
+ * results and the throughput of each instance.
+ * Returns TRUE if all the instances succeeded.
+ */
+int farm_run(struct farm *fm, unsigned int num_threads);
+
+#endif /* __DEBUGGER_FARM_H */
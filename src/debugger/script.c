@@ -0,0 +1,570 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <SDL.h>
+
+#include "debugger/debugger.h"
+#include "simulator/simulator.h"
+#include "simulator/disk.h"
+#include "simulator/display.h"
+#include "simulator/ethernet.h"
+#include "simulator/intr.h"
+#include "simulator/snapshot.h"
+#include "simulator/checkpoint.h"
+#include "microcode/microcode.h"
+#include "common/string_buffer.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define MAX_RUN_CYCLES          0x10000000 /* Cycles per simulator_run(). */
+
+/* Data structures and types. */
+
+/* The conditions to stop the simulation in the run commands. */
+enum stop_condition {
+    STOP_NEVER,                   /* Only stop at the cycle budget. */
+    STOP_MEMORY,                  /* Stop when a memory word matches. */
+    STOP_MPC,                     /* Stop when the MPC matches. */
+};
+
+/* Functions. */
+
+/* Splits the line `line` into words, which are stored in `dbg->cmd_buf`
+ * in the same format used by the interactive debugger: the words are
+ * separated by a NUL character, and the last word is ended with two
+ * consecutive NUL characters. Comments start with a `#` character.
+ * Returns TRUE on success.
+ */
+static
+int split_line(struct debugger *dbg, const char *line)
+{
+    size_t i;
+    int c, last_is_space;
+
+    i = 0;
+    last_is_space = TRUE;
+    for (; *line; line++) {
+        c = (unsigned char) *line;
+        if (c == '#') break;
+
+        if (isspace(c)) {
+            if (last_is_space) continue;
+            last_is_space = TRUE;
+            c = '\0';
+        } else {
+            last_is_space = FALSE;
+        }
+
+        if (i + 2 >= dbg->cmd_buf_size) return FALSE;
+        dbg->cmd_buf[i++] = (char) c;
+    }
+
+    if (!last_is_space) {
+        dbg->cmd_buf[i++] = '\0';
+    }
+    dbg->cmd_buf[i++] = '\0';
+    dbg->cmd_buf[i] = '\0';
+    return TRUE;
+}
+
+/* Returns the argument following `arg` in the command buffer. */
+static
+const char *next_arg(const char *arg)
+{
+    if (arg[0] == '\0') return arg;
+    return &arg[strlen(arg) + 1];
+}
+
+/* Parses a number in `arg` (using the C conventions for octal and
+ * hexadecimal numbers). The number is returned in `num`.
+ * Returns TRUE on success.
+ */
+static
+int parse_number(const char *arg, uint64_t *num)
+{
+    const char *end;
+
+    if (arg[0] == '\0') return FALSE;
+    *num = (uint64_t) strtoull(arg, (char **) &end, 0);
+    return (end[0] == '\0');
+}
+
+/* Parses a task in `arg`, given either by its number or its name.
+ * The task is returned in `task`.
+ * Returns TRUE on success.
+ */
+static
+int parse_task(const char *arg, uint8_t *task)
+{
+    uint64_t num;
+    uint8_t t;
+
+    for (t = 0; t < TASK_NUM_TASKS; t++) {
+        if (TASK_NAMES[t] && strcmp(arg, TASK_NAMES[t]) == 0) {
+            *task = t;
+            return TRUE;
+        }
+    }
+
+    if (!parse_number(arg, &num)) return FALSE;
+    if (num >= TASK_NUM_TASKS) return FALSE;
+    *task = (uint8_t) num;
+    return TRUE;
+}
+
+/* Runs the simulation without any terminal I/O.
+ * The simulation runs for at most `max_cycles` cycles, or until the
+ * condition `cond` holds. For STOP_MEMORY, the condition holds when
+ * the memory word at `addr` (masked by `mask`) is equal to `value`
+ * (it is checked before running, and then after every write to the
+ * word). For STOP_MPC, the condition holds when the task `task` is
+ * about to execute the microinstruction at `addr`.
+ * The parameter `hit` returns TRUE if the condition was satisfied.
+ * Returns TRUE on success.
+ */
+static
+int run_simulation(struct debugger *dbg, uint64_t max_cycles,
+                   enum stop_condition cond, uint8_t task,
+                   uint16_t addr, uint16_t value, uint16_t mask,
+                   int *hit)
+{
+    struct simulator *sim;
+    uint64_t cycles, start;
+    int32_t prev_cycle;
+    uint32_t num_cycles;
+    unsigned int stop_mask, reason;
+    uint16_t val;
+    int ret;
+
+    sim = dbg->sim;
+    *hit = FALSE;
+
+    /* The conditions are checked by simulator_run(): the memory word
+     * is watched (and only compared when written), and the MPC is
+     * its stop MPC.
+     */
+    stop_mask = 0;
+    switch (cond) {
+    case STOP_NEVER:
+        break;
+    case STOP_MEMORY:
+        val = simulator_read(sim, addr, TASK_EMULATOR, FALSE);
+        if ((val & mask) == value) {
+            *hit = TRUE;
+            return TRUE;
+        }
+
+        if (unlikely(!simulator_watch(sim, WATCH_ALL_BANKS, addr, addr,
+                                      WATCH_WRITE))) {
+            report_error("debugger: run_simulation: "
+                         "could not watch memory");
+            return FALSE;
+        }
+        sim->watch_hit = 0;
+        stop_mask = RUN_WATCH;
+        break;
+    case STOP_MPC:
+        simulator_set_stop_mpc(sim, task, addr);
+        stop_mask = RUN_MPC;
+        break;
+    }
+
+    start = SDL_GetPerformanceCounter();
+    cycles = 0;
+    ret = TRUE;
+    while (cycles < max_cycles) {
+        num_cycles = (uint32_t) MIN(max_cycles - cycles,
+                                    (uint64_t) MAX_RUN_CYCLES);
+        prev_cycle = sim->cycle;
+        reason = simulator_run(sim, num_cycles, stop_mask);
+        cycles += (uint64_t) INTR_CYCLE(sim->cycle - prev_cycle);
+
+        if (unlikely(reason == RUN_ERROR)) {
+            report_error("debugger: run_simulation: simulation error");
+            ret = FALSE;
+            break;
+        }
+
+        if (reason == RUN_MPC) {
+            *hit = TRUE;
+            break;
+        }
+
+        if (reason == RUN_WATCH) {
+            /* The word may have been written in another bank. */
+            sim->watch_hit = 0;
+            val = simulator_read(sim, addr, TASK_EMULATOR, FALSE);
+            if ((val & mask) == value) {
+                *hit = TRUE;
+                break;
+            }
+        }
+    }
+
+    if (cond == STOP_MEMORY) simulator_clear_watches(sim);
+
+    /* Also counted on errors, for the statistics. */
+    dbg->run_ticks += SDL_GetPerformanceCounter() - start;
+    dbg->script_cycles += cycles;
+    return ret;
+}
+
+/* Writes the contents of the output buffer of the debugger to `fp`.
+ * Returns TRUE on success.
+ */
+static
+int write_output(struct debugger *dbg, FILE *fp)
+{
+    return (fprintf(fp, "%s\n", string_buffer_string(&dbg->output)) >= 0);
+}
+
+/* Dumps the registers of the simulator and of the controllers to the
+ * file named `filename`.
+ * Returns TRUE on success.
+ */
+static
+int dump_registers(struct debugger *dbg, const char *filename)
+{
+    struct simulator *sim;
+    struct decoder *dec;
+    FILE *fp;
+    int ret;
+
+    fp = fopen(filename, "w");
+    if (unlikely(!fp)) {
+        report_error("debugger: dump_registers: could not open `%s` "
+                     "for writing", filename);
+        return FALSE;
+    }
+
+    sim = dbg->sim;
+
+    debugger_disassemble(dbg);
+    ret = write_output(dbg, fp);
+
+    dec = debugger_setup_decoder(dbg);
+    simulator_print_registers(sim, dec);
+    ret = ret && write_output(dbg, fp);
+
+    dec = debugger_setup_decoder(dbg);
+    simulator_print_extra_registers(sim, dec);
+    ret = ret && write_output(dbg, fp);
+
+    debugger_nova_disassemble(dbg);
+    ret = ret && write_output(dbg, fp);
+
+    dec = debugger_setup_decoder(dbg);
+    simulator_print_nova_registers(sim, dec);
+    ret = ret && write_output(dbg, fp);
+
+    dec = debugger_setup_decoder(dbg);
+    disk_print_registers(&sim->dsk, dec);
+    ret = ret && write_output(dbg, fp);
+
+    dec = debugger_setup_decoder(dbg);
+    display_print_registers(&sim->displ, dec);
+    ret = ret && write_output(dbg, fp);
+
+    dec = debugger_setup_decoder(dbg);
+    ethernet_print_registers(&sim->ether, dec);
+    ret = ret && write_output(dbg, fp);
+
+    fclose(fp);
+    if (unlikely(!ret)) {
+        report_error("debugger: dump_registers: "
+                     "error while writing `%s`", filename);
+    }
+    return ret;
+}
+
+/* Dumps `num` words of memory starting at address `addr` (as seen by
+ * the emulator task) to the file named `filename`.
+ * Returns TRUE on success.
+ */
+static
+int dump_memory(struct debugger *dbg, const char *filename,
+                uint16_t addr, uint32_t num)
+{
+    struct decoder *dec;
+    uint16_t val;
+    FILE *fp;
+    int ret;
+
+    fp = fopen(filename, "w");
+    if (unlikely(!fp)) {
+        report_error("debugger: dump_memory: could not open `%s` "
+                     "for writing", filename);
+        return FALSE;
+    }
+
+    ret = TRUE;
+    dec = debugger_setup_decoder(dbg);
+    while (num-- > 0) {
+        val = simulator_read(dbg->sim, addr, TASK_EMULATOR, FALSE);
+        string_buffer_clear(dec->output);
+        decode_value(dec->vdec, DECODE_MEMORY, addr);
+        string_buffer_print(dec->output, ": ");
+        decode_value(dec->vdec, DECODE_VALUE, val);
+        if (unlikely(!write_output(dbg, fp))) {
+            ret = FALSE;
+            break;
+        }
+        addr++;
+    }
+
+    fclose(fp);
+    if (unlikely(!ret)) {
+        report_error("debugger: dump_memory: error while writing `%s`",
+                     filename);
+    }
+    return ret;
+}
+
+/* Executes the command in `dbg->cmd_buf`.
+ * Returns TRUE on success.
+ */
+static
+int execute_command(struct debugger *dbg)
+{
+    struct simulator *sim;
+    const char *cmd, *arg1, *arg2, *arg3, *arg4;
+    enum stop_condition cond;
+    uint64_t num1, num2, num3, num4;
+    uint8_t task;
+    int hit;
+
+    sim = dbg->sim;
+
+    cmd = (const char *) dbg->cmd_buf;
+    if (cmd[0] == '\0') return TRUE;
+
+    arg1 = next_arg(cmd);
+    arg2 = next_arg(arg1);
+    arg3 = next_arg(arg2);
+    arg4 = next_arg(arg3);
+
+    if (strcmp(cmd, "load_disk") == 0 || strcmp(cmd, "save_disk") == 0) {
+        if (!parse_number(arg1, &num1) || num1 >= NUM_DISK_DRIVES
+            || arg2[0] == '\0') {
+            report_error("debugger: run_script: "
+                         "usage: %s drive filename", cmd);
+            return FALSE;
+        }
+        if (cmd[0] == 'l') {
+            return disk_load_image(&sim->dsk, (unsigned int) num1, arg2);
+        }
+        return disk_save_image(&sim->dsk, (unsigned int) num1, arg2);
+    }
+
+    if (strcmp(cmd, "load_state") == 0 || strcmp(cmd, "save_state") == 0) {
+        if (arg1[0] == '\0') {
+            report_error("debugger: run_script: "
+                         "usage: %s filename", cmd);
+            return FALSE;
+        }
+        if (cmd[0] == 'l') {
+            return simulator_load_state(sim, arg1);
+        }
+        return simulator_save_state(sim, arg1);
+    }
+
+    if (strcmp(cmd, "reset") == 0) {
+        simulator_reset(sim);
+        return TRUE;
+    }
+
+    if (strcmp(cmd, "checkpoint_start") == 0) {
+        if (arg1[0] == '\0') {
+            report_error("debugger: run_script: "
+                         "usage: checkpoint_start filename");
+            return FALSE;
+        }
+        return checkpoint_open(&dbg->ckpt, arg1)
+            && checkpoint_save(&dbg->ckpt, sim);
+    }
+
+    if (strcmp(cmd, "checkpoint") == 0) {
+        return checkpoint_save(&dbg->ckpt, sim);
+    }
+
+    if (strcmp(cmd, "load_checkpoint") == 0) {
+        num1 = 0;
+        if (arg1[0] == '\0'
+            || (arg2[0] != '\0' && !parse_number(arg2, &num1))) {
+            report_error("debugger: run_script: "
+                         "usage: load_checkpoint filename [count]");
+            return FALSE;
+        }
+        return checkpoint_load(sim, arg1, (unsigned int) num1, NULL);
+    }
+
+    if (strcmp(cmd, "snapshot") == 0) {
+        /* Shares the unmodified pages with the previous snapshot. */
+        return snapshot_take(&dbg->snap, sim, &dbg->snap);
+    }
+
+    if (strcmp(cmd, "restore") == 0) {
+        return snapshot_restore(&dbg->snap, sim);
+    }
+
+    if (strcmp(cmd, "write") == 0 || strcmp(cmd, "check") == 0) {
+        if (!parse_number(arg1, &num1) || !parse_number(arg2, &num2)) {
+            report_error("debugger: run_script: "
+                         "usage: %s address value", cmd);
+            return FALSE;
+        }
+        if (cmd[0] == 'w') {
+            simulator_write(sim, (uint16_t) num1, (uint16_t) num2,
+                            TASK_EMULATOR, FALSE);
+            return TRUE;
+        }
+
+        num3 = simulator_read(sim, (uint16_t) num1, TASK_EMULATOR, FALSE);
+        if (num3 != (uint16_t) num2) {
+            report_error("debugger: run_script: check failed at %06o: "
+                         "expected %06o, got %06o",
+                         (unsigned int) (uint16_t) num1,
+                         (unsigned int) (uint16_t) num2,
+                         (unsigned int) num3);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    if (strcmp(cmd, "run") == 0) {
+        if (!parse_number(arg1, &num1)) {
+            report_error("debugger: run_script: usage: run cycles");
+            return FALSE;
+        }
+        return run_simulation(dbg, num1, STOP_NEVER, 0, 0, 0, 0, &hit);
+    }
+
+    if (strcmp(cmd, "run_until_mem") == 0
+        || strcmp(cmd, "run_until_mpc") == 0) {
+        if (strcmp(cmd, "run_until_mem") == 0) {
+            cond = STOP_MEMORY;
+            task = TASK_EMULATOR;
+            num4 = 0xFFFF;
+            if (!parse_number(arg1, &num1) || !parse_number(arg2, &num2)
+                || !parse_number(arg3, &num3)
+                || (arg4[0] != '\0' && !parse_number(arg4, &num4))) {
+                report_error("debugger: run_script: "
+                             "usage: %s address value cycles [mask]", cmd);
+                return FALSE;
+            }
+        } else {
+            cond = STOP_MPC;
+            num2 = 0;
+            num4 = 0;
+            if (!parse_task(arg1, &task) || !parse_number(arg2, &num1)
+                || !parse_number(arg3, &num3)) {
+                report_error("debugger: run_script: "
+                             "usage: %s task mpc cycles", cmd);
+                return FALSE;
+            }
+        }
+
+        if (unlikely(!run_simulation(dbg, num3, cond, task,
+                                     (uint16_t) num1, (uint16_t) num2,
+                                     (uint16_t) num4, &hit))) {
+            return FALSE;
+        }
+
+        if (!hit) {
+            report_error("debugger: run_script: condition of %s "
+                         "not satisfied "
+                         "after %llu cycles", cmd,
+                         (unsigned long long) num3);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    if (strcmp(cmd, "dump_memory") == 0) {
+        num1 = 0;
+        num2 = MEMORY_SIZE;
+        if (arg1[0] == '\0'
+            || (arg2[0] != '\0' && !parse_number(arg2, &num1))
+            || (arg3[0] != '\0' && !parse_number(arg3, &num2))) {
+            report_error("debugger: run_script: "
+                         "usage: dump_memory filename [address count]");
+            return FALSE;
+        }
+        return dump_memory(dbg, arg1, (uint16_t) num1,
+                           (uint32_t) MIN(num2, MEMORY_SIZE));
+    }
+
+    if (strcmp(cmd, "dump_registers") == 0) {
+        if (arg1[0] == '\0') {
+            report_error("debugger: run_script: "
+                         "usage: dump_registers filename");
+            return FALSE;
+        }
+        return dump_registers(dbg, arg1);
+    }
+
+    if (strcmp(cmd, "screenshot") == 0) {
+        if (arg1[0] == '\0') {
+            report_error("debugger: run_script: "
+                         "usage: screenshot filename");
+            return FALSE;
+        }
+        return display_save_screenshot(&sim->displ, arg1);
+    }
+
+    if (strcmp(cmd, "dump_stats") == 0) {
+        if (arg1[0] == '\0') {
+            report_error("debugger: run_script: "
+                         "usage: dump_stats filename");
+            return FALSE;
+        }
+        return debugger_save_stats(dbg, arg1);
+    }
+
+    report_error("debugger: run_script: invalid command `%s`", cmd);
+    return FALSE;
+}
+
+int debugger_run_script(struct debugger *dbg, const char *filename)
+{
+    char line[1024];
+    unsigned int line_num;
+    FILE *fp;
+    int ret;
+
+    fp = fopen(filename, "r");
+    if (unlikely(!fp)) {
+        report_error("debugger: run_script: could not open `%s`",
+                     filename);
+        return FALSE;
+    }
+
+    dbg->script_cycles = 0;
+
+    ret = TRUE;
+    line_num = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_num++;
+        if (unlikely(!split_line(dbg, line))) {
+            report_error("debugger: run_script: %s:%u: line too long",
+                         filename, line_num);
+            ret = FALSE;
+            break;
+        }
+
+        if (unlikely(!execute_command(dbg))) {
+            report_error("debugger: run_script: %s:%u: "
+                         "could not execute command",
+                         filename, line_num);
+            ret = FALSE;
+            break;
+        }
+    }
+
+    fclose(fp);
+    return ret;
+}
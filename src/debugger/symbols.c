@@ -0,0 +1,223 @@
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "debugger/symbols.h"
+#include "microcode/microcode.h"
+#include "common/allocator.h"
+#include "common/utils.h"
+
+/* Functions. */
+
+void symbol_map_initvar(struct symbol_map *sm)
+{
+    allocator_initvar(&sm->salloc);
+    sm->symbols = NULL;
+}
+
+void symbol_map_destroy(struct symbol_map *sm)
+{
+    allocator_destroy(&sm->salloc);
+
+    if (sm->symbols) free((void *) sm->symbols);
+    sm->symbols = NULL;
+}
+
+int symbol_map_create(struct symbol_map *sm)
+{
+    symbol_map_initvar(sm);
+
+    if (unlikely(!allocator_create(&sm->salloc, 0))) {
+        report_error("symbols: create: could not create string allocator");
+        symbol_map_destroy(sm);
+        return FALSE;
+    }
+
+    sm->num_symbols = 0;
+    sm->capacity = 0;
+    return TRUE;
+}
+
+void symbol_map_clear(struct symbol_map *sm)
+{
+    allocator_clear(&sm->salloc);
+    sm->num_symbols = 0;
+}
+
+/* Adds a new symbol named `name` (with length `len`) at `address`.
+ * Returns TRUE on success.
+ */
+static
+int add_symbol(struct symbol_map *sm, const char *name, size_t len,
+               uint32_t address)
+{
+    struct symbol *sym;
+    size_t capacity;
+
+    if (sm->num_symbols == sm->capacity) {
+        capacity = (sm->capacity == 0) ? 256 : 2 * sm->capacity;
+        sym = (struct symbol *)
+            realloc(sm->symbols, capacity * sizeof(*sym));
+        if (unlikely(!sym)) {
+            report_error("symbols: add_symbol: memory exhausted");
+            return FALSE;
+        }
+        sm->symbols = sym;
+        sm->capacity = capacity;
+    }
+
+    sym = &sm->symbols[sm->num_symbols];
+    sym->name = allocator_dup(&sm->salloc, name, len);
+    if (unlikely(!sym->name)) {
+        report_error("symbols: add_symbol: memory exhausted");
+        return FALSE;
+    }
+    sym->address = address;
+    sm->num_symbols++;
+    return TRUE;
+}
+
+/* Parses one line of the symbols file.
+ * The contents of the line are in `line`.
+ * Returns TRUE on success.
+ */
+static
+int parse_line(struct symbol_map *sm, const char *line)
+{
+    const char *start;
+    unsigned long bank, address;
+    char *end;
+
+    while (*line && isspace((unsigned char) *line)) line++;
+    if (*line == '\0' || *line == '#') return TRUE;
+
+    bank = 0;
+    address = strtoul(line, &end, 8);
+    if (*end == ':') {
+        bank = address;
+        line = end + 1;
+        address = strtoul(line, &end, 8);
+    }
+    if (unlikely(end == line || !isspace((unsigned char) *end)
+                 || bank >= NUM_MEMORY_BANKS || address >= MEMORY_SIZE)) {
+        report_error("symbols: parse_line: invalid address");
+        return FALSE;
+    }
+
+    line = end;
+    while (*line && isspace((unsigned char) *line)) line++;
+    start = line;
+    while (*line && !isspace((unsigned char) *line)) line++;
+    if (unlikely(line == start)) {
+        report_error("symbols: parse_line: missing symbol name");
+        return FALSE;
+    }
+
+    return add_symbol(sm, start, line - start,
+                      (uint32_t) (bank * MEMORY_SIZE + address));
+}
+
+/* Compares two symbols by address (for qsort()). */
+static
+int compare_symbols(const void *p1, const void *p2)
+{
+    const struct symbol *sym1, *sym2;
+
+    sym1 = (const struct symbol *) p1;
+    sym2 = (const struct symbol *) p2;
+    if (sym1->address != sym2->address)
+        return (sym1->address < sym2->address) ? -1 : 1;
+    return 0;
+}
+
+int symbol_map_load(struct symbol_map *sm, const char *filename)
+{
+    char line[1024];
+    unsigned int line_num;
+    FILE *fp;
+
+    fp = fopen(filename, "r");
+    if (unlikely(!fp)) {
+        report_error("symbols: load: could not open `%s`", filename);
+        return FALSE;
+    }
+
+    symbol_map_clear(sm);
+
+    line_num = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_num++;
+        if (unlikely(!parse_line(sm, line))) {
+            report_error("symbols: load: %s:%u: invalid line",
+                         filename, line_num);
+            fclose(fp);
+            symbol_map_clear(sm);
+            return FALSE;
+        }
+    }
+
+    fclose(fp);
+    qsort(sm->symbols, sm->num_symbols, sizeof(struct symbol),
+          &compare_symbols);
+    return TRUE;
+}
+
+const struct symbol *symbol_map_lookup(const struct symbol_map *sm,
+                                       uint32_t address)
+{
+    const struct symbol *sym;
+    size_t lo, hi, mid;
+
+    /* Finds the first symbol after the address. */
+    lo = 0;
+    hi = sm->num_symbols;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (sm->symbols[mid].address <= address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == 0) return NULL;
+    sym = &sm->symbols[lo - 1];
+    if (sym->address / MEMORY_SIZE != address / MEMORY_SIZE) return NULL;
+    return sym;
+}
+
+int symbol_map_save_folded(const struct symbol_map *sm,
+                           const uint64_t *counts, const char *filename)
+{
+    const struct symbol *sym;
+    uint32_t address;
+    FILE *fp;
+
+    fp = fopen(filename, "w");
+    if (unlikely(!fp)) {
+        report_error("symbols: save_folded: could not open `%s` "
+                     "for writing", filename);
+        return FALSE;
+    }
+
+    for (address = 0; address < NUM_MEMORY_BANKS * MEMORY_SIZE;
+         address++) {
+        if (counts[address] == 0) continue;
+
+        fprintf(fp, "bank%u;", address / MEMORY_SIZE);
+        sym = symbol_map_lookup(sm, address);
+        if (sym) {
+            fprintf(fp, "%s;", sym->name);
+        }
+        fprintf(fp, "%06o %llu\n", address % MEMORY_SIZE,
+                (unsigned long long) counts[address]);
+    }
+
+    fclose(fp);
+    return TRUE;
+}
@@ -0,0 +1,75 @@
+#ifndef __DEBUGGER_SYMBOLS_H
+#define __DEBUGGER_SYMBOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "common/allocator.h"
+
+/* Data structures and types. */
+
+/* A symbol of the Nova code (such as a BCPL routine). */
+struct symbol {
+    const char *name;             /* The name of the symbol. */
+    uint32_t address;             /* The address (bank * MEMORY_SIZE
+                                   * + address).
+                                   */
+};
+
+/* A table of symbols, sorted by address. */
+struct symbol_map {
+    struct allocator salloc;      /* Allocator for strings. */
+    struct symbol *symbols;       /* The symbols. */
+    size_t num_symbols;           /* Number of symbols. */
+    size_t capacity;              /* Capacity of the symbols array. */
+};
+
+/* Functions. */
+
+/* Initializes the symbol_map variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void symbol_map_initvar(struct symbol_map *sm);
+
+/* Destroys the symbol_map object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void symbol_map_destroy(struct symbol_map *sm);
+
+/* Creates a new (empty) symbol_map object.
+ * This obeys the initvar / destroy / create protocol.
+ * Returns TRUE on success.
+ */
+int symbol_map_create(struct symbol_map *sm);
+
+/* Removes all the symbols. */
+void symbol_map_clear(struct symbol_map *sm);
+
+/* Loads the symbols from the file named `filename` (replacing the
+ * current ones). Each line has the address (in octal, optionally
+ * preceded by the memory bank and a colon, such as in `1:4000`) and
+ * the name of a symbol. Empty lines and lines starting with `#` are
+ * ignored.
+ * Returns TRUE on success.
+ */
+int symbol_map_load(struct symbol_map *sm, const char *filename);
+
+/* Finds the symbol containing the `address` (bank * MEMORY_SIZE +
+ * address), that is, the last symbol of the same bank that is not
+ * after `address`.
+ * Returns the symbol, or NULL if there is none.
+ */
+const struct symbol *symbol_map_lookup(const struct symbol_map *sm,
+                                       uint32_t address);
+
+/* Saves the Nova profile `counts` (see the `nova_prof` field of the
+ * simulator) to the file named `filename`, in the folded format used
+ * by the flame graph tools. Each line has the frames `bank;symbol;
+ * address` (the symbol is omitted when unknown), followed by the count.
+ * Returns TRUE on success.
+ */
+int symbol_map_save_folded(const struct symbol_map *sm,
+                           const uint64_t *counts, const char *filename);
+
+#endif /* __DEBUGGER_SYMBOLS_H */
@@ -2,34 +2,85 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdio.h>
 #include <SDL.h>
 #include <signal.h>
 
 #include "gui/gui.h"
+#include "gui/video.h"
 #include "simulator/display.h"
 #include "simulator/keyboard.h"
 #include "simulator/mouse.h"
 #include "common/utils.h"
 
+/* Constants. */
+#define NUM_FRAMES                         3
+#define FRAME_INDEX                        3
+#define FRAME_FRESH                        4
+
 /* Data structures and types. */
 
+/* A frame of the display, exchanged between the threads. */
+struct gui_frame {
+    uint32_t seq;                 /* The number of the display frame. */
+    uint16_t data[DISPLAY_DATA_SIZE]; /* The display pixels (packed). */
+    uint32_t dirty[DISPLAY_DIRTY_SIZE]; /* The scanlines that changed
+                                         * since the last frame taken
+                                         * by the renderer.
+                                         */
+    uint32_t stale[DISPLAY_DIRTY_SIZE]; /* The scanlines of `data` that
+                                         * changed in the frames
+                                         * published since this one
+                                         * (only used by the simulation
+                                         * thread).
+                                         */
+};
+
 /* Internal structure for the user interface. */
 struct gui_internal {
     int initialized;              /* If this structure was initialized. */
+    int headless;                 /* Running without a window. */
     int running;                  /* If the GUI is running. */
     int stop_sim;                 /* A request to stop the simulation
                                    * was issued.
                                    */
 
-    uint8_t *display_data;        /* The display pixels. */
+    uint16_t *display_data;       /* The display pixels (packed), as
+                                   * last copied by the simulation
+                                   * thread.
+                                   */
+    struct gui_frame *frames;     /* The frames of the triple buffer. */
+    unsigned int back;            /* The frame being written by the
+                                   * simulation thread.
+                                   */
+    unsigned int front;           /* The frame being drawn. */
+    SDL_atomic_t frame_state;     /* The frame in the middle (between
+                                   * the two threads), with FRAME_FRESH
+                                   * set if it was not taken yet.
+                                   */
+    uint32_t seq;                 /* Number of frames published. */
+    struct video *video;          /* The video being recorded by the
+                                   * thread that takes the frames
+                                   * (or NULL).
+                                   */
+    uint8_t *host_pixels;         /* The display pixels (one byte per
+                                   * pixel, as in the texture).
+                                   */
+    int redraw;                   /* To present the screen even if no
+                                   * scanline changed.
+                                   */
+    uint8_t expand[256][8];       /* The host pixels for each byte of
+                                   * the packed display pixels.
+                                   */
     struct keyboard keyb;         /* The (fake) keyboard. */
     struct mouse mous;            /* The (fake) mouse. */
     SDL_mutex *mutex;             /* Mutex for synchronization between
                                    * threads of the keyboard, mouse
                                    * and the screen pixels.
                                    */
-    SDL_cond *frame_cond;         /* A condition that signals
-                                   * that a new frame is being drawn.
+    SDL_cond *frame_cond;         /* Signaled when a frame is published
+                                   * or taken while recording the video
+                                   * in headless mode (with `mutex`).
                                    */
 
     SDL_Window *window;           /* The interface window. */
@@ -38,6 +89,10 @@ struct gui_internal {
     int mouse_captured;           /* Mouse is captured. */
     int skip_next_mouse_move;     /* To skip the next mouse move event. */
 
+    const char *dump_filename;    /* Where to dump the display. */
+    unsigned int dump_interval;   /* Interval (in frames) between dumps. */
+    unsigned int frame;           /* The frame counter (headless mode). */
+
     struct gui_internal *next;    /* To chain the objects together
                                    * for the signal handler.
                                    */
@@ -319,49 +374,150 @@ int gui_process_events(struct gui *ui)
 
             gui_process_event(ui, &e);
             break;
+
+        case SDL_WINDOWEVENT:
+            /* The window may have been exposed or resized. */
+            iui->redraw = TRUE;
+            break;
         }
     }
 
     return TRUE;
 }
 
-/* Updates the gui state and screen.
+/* Expands the packed pixels `data` of a scanline to the host pixels
+ * (one byte per pixel) in `line`, which has room for DISPLAY_STRIDE
+ * pixels.
+ */
+static
+void expand_line(const struct gui_internal *iui, const uint16_t *data,
+                 uint8_t *line)
+{
+    unsigned int i;
+
+    for (i = 0; i < DISPLAY_LINE_WORDS; i++) {
+        memcpy(&line[16 * i], iui->expand[data[i] >> 8], 8);
+        memcpy(&line[16 * i + 8], iui->expand[data[i] & 0xFF], 8);
+    }
+}
+
+/* Uploads the scanlines `first` to `last - 1` of the host pixels
+ * to the texture.
+ * Returns TRUE on success.
+ */
+static
+int upload_lines(struct gui_internal *iui, int first, int last)
+{
+    SDL_Rect rect;
+    int ret;
+
+    rect.x = 0;
+    rect.y = first;
+    rect.w = DISPLAY_WIDTH;
+    rect.h = last - first;
+    ret = SDL_UpdateTexture(iui->texture, &rect,
+                            &iui->host_pixels[DISPLAY_WIDTH * first],
+                            DISPLAY_WIDTH);
+    if (unlikely(ret < 0)) {
+        report_error("gui: upload_lines: "
+                     "could not update texture (SDL_Error(%d): %s)",
+                     ret, SDL_GetError());
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Takes the latest frame published by the simulation thread (see
+ * gui_update()), if there is a new one.
+ * Returns the frame, or NULL if there is no new frame.
+ */
+static
+struct gui_frame *take_frame(struct gui_internal *iui)
+{
+    int state;
+
+    /* Only the simulation thread sets FRAME_FRESH, so the frame
+     * exchanged below is fresh.
+     */
+    state = SDL_AtomicGet(&iui->frame_state);
+    if (!(state & FRAME_FRESH)) return NULL;
+
+    SDL_MemoryBarrierRelease();
+    state = SDL_AtomicSet(&iui->frame_state, (int) iui->front);
+    SDL_MemoryBarrierAcquire();
+
+    iui->front = (unsigned int) (state & FRAME_INDEX);
+    return &iui->frames[iui->front];
+}
+
+/* Records the frame `frame` taken from the simulation thread (if
+ * recording a video). The parameter `frame` can be NULL.
+ * Returns TRUE on success.
+ */
+static
+int record_frame(struct gui_internal *iui, const struct gui_frame *frame)
+{
+    if (!iui->video || !frame) return TRUE;
+
+    if (unlikely(!video_add_frame(iui->video, frame->seq,
+                                  frame->data, frame->dirty))) {
+        report_error("gui: record_frame: could not record frame");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Updates the gui state and screen. Only the scanlines that changed
+ * are uploaded to the texture, and the screen is not presented again
+ * if nothing changed.
  * Returns TRUE on success.
  */
 static
 int gui_update_screen(struct gui *ui)
 {
     struct gui_internal *iui;
-    void *pixels;
-    int i, stride, ret;
+    struct gui_frame *frame;
+    uint8_t line[DISPLAY_STRIDE];
+    int i, first, changed, ret;
 
     iui = (struct gui_internal *) ui->internal;
-    ret = SDL_LockTexture(iui->texture, NULL, &pixels, &stride);
-    if (unlikely(ret < 0)) {
-        report_error("gui: update_screen: "
-                     "could not lock texture (SDL_Error(%d): %s)",
-                     ret, SDL_GetError());
+
+    changed = FALSE;
+    frame = take_frame(iui);
+    if (unlikely(!record_frame(iui, frame))) {
+        report_error("gui: update_screen: could not record frame");
+        return FALSE;
     }
 
-    if (SDL_LockMutex(iui->mutex) == 0) {
-        uint8_t *pixels8;
-        pixels8 = (uint8_t *) pixels;
+    if (frame) {
         for (i = 0; i < DISPLAY_HEIGHT; i++) {
-            memcpy(&pixels8[stride * i],
-                   &iui->display_data[DISPLAY_STRIDE * i],
+            if (!(frame->dirty[i / 32] & (1U << (i % 32)))) continue;
+            expand_line(iui, &frame->data[DISPLAY_LINE_WORDS * i], line);
+            memcpy(&iui->host_pixels[DISPLAY_WIDTH * i], line,
                    DISPLAY_WIDTH * sizeof(uint8_t));
+            changed = TRUE;
         }
+    }
 
-        /* Signal the condition for a new frame. */
-        SDL_CondSignal(iui->frame_cond);
+    if (!changed && !iui->redraw) return TRUE;
+    iui->redraw = FALSE;
 
-        SDL_UnlockMutex(iui->mutex);
-    } else {
-        memset(pixels, -1, ((size_t) stride) * DISPLAY_HEIGHT);
+    /* Each run of consecutive dirty scanlines is uploaded at once. */
+    first = -1;
+    for (i = 0; changed && i <= DISPLAY_HEIGHT; i++) {
+        if (i < DISPLAY_HEIGHT
+            && (frame->dirty[i / 32] & (1U << (i % 32)))) {
+            if (first < 0) first = i;
+            continue;
+        }
+        if (first < 0) continue;
+        if (unlikely(!upload_lines(iui, first, i))) {
+            report_error("gui: update_screen: could not upload scanlines");
+            return FALSE;
+        }
+        first = -1;
     }
 
-    SDL_UnlockTexture(iui->texture);
-
     ret = SDL_RenderCopy(iui->renderer, iui->texture,
                          NULL, NULL);
     if (unlikely(ret < 0)) {
@@ -388,6 +544,132 @@ int other_thread_main(void *arg)
     return 0;
 }
 
+/* Dumps the display to a file.
+ * If `frame` is not zero, it is appended to the name of the file.
+ * Returns TRUE on success.
+ */
+static
+int gui_dump_frame(struct gui *ui, unsigned int frame)
+{
+    struct gui_internal *iui;
+    char filename[1024];
+
+    iui = (struct gui_internal *) ui->internal;
+    if (frame == 0) {
+        snprintf(filename, sizeof(filename), "%s", iui->dump_filename);
+    } else {
+        snprintf(filename, sizeof(filename), "%s.%u",
+                 iui->dump_filename, frame);
+    }
+
+    if (unlikely(!display_save_screenshot(&ui->sim->displ, filename))) {
+        report_error("gui: dump_frame: could not save display");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Function of the thread that records the video in headless mode.
+ * Every frame published by the simulation thread is recorded, as the
+ * simulation thread waits for the previous frame to be taken before
+ * publishing the next one (see handoff_frame()). This way, the video
+ * only depends on the simulation. If the video cannot be recorded,
+ * the user interface is stopped.
+ */
+static
+int video_thread_main(void *arg)
+{
+    struct gui *ui;
+    struct gui_internal *iui;
+    struct gui_frame *frame;
+    int ret, running;
+
+    ui = (struct gui *) arg;
+    iui = (struct gui_internal *) ui->internal;
+    while (TRUE) {
+        ret = SDL_LockMutex(iui->mutex);
+        if (unlikely(ret != 0)) {
+            report_error("gui: video_thread_main: could no acquire lock "
+                         "(SDLError(%d): %s)", ret, SDL_GetError());
+            gui_stop(ui);
+            return 1;
+        }
+
+        while (iui->running
+               && !(SDL_AtomicGet(&iui->frame_state) & FRAME_FRESH)) {
+            SDL_CondWait(iui->frame_cond, iui->mutex);
+        }
+        running = iui->running;
+        frame = take_frame(iui);
+        SDL_CondBroadcast(iui->frame_cond);
+        SDL_UnlockMutex(iui->mutex);
+
+        /* The last frame is also taken after stopping. */
+        if (!frame) {
+            if (!running) break;
+            continue;
+        }
+
+        if (unlikely(!record_frame(iui, frame))) {
+            gui_stop(ui);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Runs the user interface in headless mode. */
+static
+int gui_run_headless(struct gui *ui)
+{
+    struct gui_internal *iui;
+    SDL_Thread *thread;
+    int ret, status;
+
+    iui = (struct gui_internal *) ui->internal;
+
+    iui->running = TRUE;
+    iui->stop_sim = FALSE;
+    iui->frame = 0;
+
+    thread = NULL;
+    if (iui->video) {
+        thread = SDL_CreateThread(&video_thread_main,
+                                  "gui_video_thread", ui);
+        if (unlikely(!thread)) {
+            report_error("gui: run_headless: "
+                         "could not create thread (SDL_Error: %s)",
+                         SDL_GetError());
+            iui->running = FALSE;
+            return FALSE;
+        }
+    }
+
+    ret = (other_thread_main(ui) == 0);
+
+    if (iui->dump_filename) {
+        if (unlikely(!gui_dump_frame(ui, 0))) {
+            report_error("gui: run_headless: could not dump frame");
+            ret = FALSE;
+        }
+    }
+
+    if (unlikely(!gui_stop(ui))) {
+        report_error("gui: run_headless: could not stop");
+        ret = FALSE;
+    }
+
+    if (thread) {
+        SDL_WaitThread(thread, &status);
+        if (unlikely(status != 0)) {
+            report_error("gui: run_headless: could not record video");
+            ret = FALSE;
+        }
+    }
+
+    return ret;
+}
+
 /* Runs the user interface. */
 static
 int gui_run(struct gui *ui)
@@ -560,21 +842,31 @@ void gui_destroy(struct gui *ui)
 
     iui->running = FALSE;
 
-    if (iui->mutex) {
-        SDL_DestroyMutex(iui->mutex);
-    }
-    iui->mutex = NULL;
-
     if (iui->frame_cond) {
         SDL_DestroyCond(iui->frame_cond);
     }
     iui->frame_cond = NULL;
 
+    if (iui->mutex) {
+        SDL_DestroyMutex(iui->mutex);
+    }
+    iui->mutex = NULL;
+
     if (iui->display_data) {
         free((void *) iui->display_data);
     }
     iui->display_data = NULL;
 
+    if (iui->host_pixels) {
+        free((void *) iui->host_pixels);
+    }
+    iui->host_pixels = NULL;
+
+    if (iui->frames) {
+        free((void *) iui->frames);
+    }
+    iui->frames = NULL;
+
     keyboard_destroy(&iui->keyb);
     mouse_destroy(&iui->mous);
 
@@ -605,10 +897,11 @@ void gui_destroy(struct gui *ui)
     }
 }
 
-int gui_create(struct gui *ui, struct simulator *sim,
+int gui_create(struct gui *ui, struct simulator *sim, int headless,
                gui_thread_cb thread_cb, void *arg)
 {
     struct gui_internal *iui;
+    unsigned int i, j;
     int ret;
 
     gui_initvar(ui);
@@ -621,7 +914,15 @@ int gui_create(struct gui *ui, struct simulator *sim,
     }
 
     iui->initialized = FALSE;
+    iui->headless = headless;
+    iui->running = FALSE;
+    iui->dump_filename = NULL;
+    iui->dump_interval = 0;
+    iui->frame = 0;
     iui->display_data = NULL;
+    iui->host_pixels = NULL;
+    iui->frames = NULL;
+    iui->video = NULL;
     keyboard_initvar(&iui->keyb);
     mouse_initvar(&iui->mous);
     iui->mutex = NULL;
@@ -633,16 +934,43 @@ int gui_create(struct gui *ui, struct simulator *sim,
     iui->prev = NULL;
 
     ui->internal = iui;
-    iui->display_data = (uint8_t *)
-        malloc(DISPLAY_DATA_SIZE * sizeof(uint8_t));
-
-    if (unlikely(!iui->display_data)) {
+    iui->display_data = (uint16_t *)
+        malloc(DISPLAY_DATA_SIZE * sizeof(uint16_t));
+    iui->host_pixels = (uint8_t *)
+        malloc(DISPLAY_WIDTH * DISPLAY_HEIGHT * sizeof(uint8_t));
+    iui->frames = (struct gui_frame *)
+        malloc(NUM_FRAMES * sizeof(struct gui_frame));
+
+    if (unlikely(!iui->display_data || !iui->host_pixels
+                 || !iui->frames)) {
         report_error("gui: create: "
                      "memory exhausted");
         gui_destroy(ui);
         return FALSE;
     }
 
+    /* The white pixels are 0xFF and the black ones are 0x00 (in the
+     * RGB332 format of the texture).
+     */
+    for (i = 0; i < 256; i++) {
+        for (j = 0; j < 8; j++) {
+            iui->expand[i][j] = (i & (0x80 >> j)) ? 0xFF : 0x00;
+        }
+    }
+
+    /* The frames start black and clean (the first update of the
+     * simulator gives all the scanlines as dirty).
+     */
+    memset(iui->display_data, 0, DISPLAY_DATA_SIZE * sizeof(uint16_t));
+    memset(iui->host_pixels, 0,
+           DISPLAY_WIDTH * DISPLAY_HEIGHT * sizeof(uint8_t));
+    memset(iui->frames, 0, NUM_FRAMES * sizeof(struct gui_frame));
+    iui->back = 0;
+    iui->front = 1;
+    SDL_AtomicSet(&iui->frame_state, 2);
+    iui->seq = 0;
+    iui->redraw = TRUE;
+
     if (unlikely(!keyboard_create(&iui->keyb))) {
         report_error("gui: create: "
                      "could not create keyboard");
@@ -662,8 +990,10 @@ int gui_create(struct gui *ui, struct simulator *sim,
     ui->arg = arg;
 
     if (gui_ref_count == 0) {
-        /* Initialize the SDL when it is the first object created. */
-        ret = SDL_Init(SDL_INIT_VIDEO);
+        /* Initialize the SDL when it is the first object created.
+         * The headless mode only uses the threading primitives.
+         */
+        ret = SDL_Init((headless) ? 0 : SDL_INIT_VIDEO);
         if (unlikely(ret < 0)) {
             report_error("gui: create: "
                          "could not initialize SDL (SDL_Error(%d): %s)",
@@ -718,6 +1048,30 @@ int gui_create(struct gui *ui, struct simulator *sim,
     return TRUE;
 }
 
+int gui_set_frame_dump(struct gui *ui, const char *filename,
+                       unsigned int interval)
+{
+    struct gui_internal *iui;
+
+    iui = (struct gui_internal *) ui->internal;
+    if (unlikely(!iui->headless)) {
+        report_error("gui: set_frame_dump: only in headless mode");
+        return FALSE;
+    }
+
+    iui->dump_filename = filename;
+    iui->dump_interval = (filename) ? interval : 0;
+    return TRUE;
+}
+
+void gui_set_video(struct gui *ui, struct video *vid)
+{
+    struct gui_internal *iui;
+
+    iui = (struct gui_internal *) ui->internal;
+    iui->video = vid;
+}
+
 int gui_start(struct gui *ui)
 {
     struct gui_internal *iui;
@@ -728,6 +1082,14 @@ int gui_start(struct gui *ui)
         return FALSE;
     }
 
+    if (iui->headless) {
+        if (unlikely(!gui_run_headless(ui))) {
+            report_error("gui: start: could not start");
+            return FALSE;
+        }
+        return TRUE;
+    }
+
     if (unlikely(!gui_run(ui))) {
         report_error("gui: start: could not start");
         return FALSE;
@@ -750,6 +1112,7 @@ int gui_stop(struct gui *ui)
     }
 
     iui->running = FALSE;
+    SDL_CondBroadcast(iui->frame_cond);
     SDL_UnlockMutex(iui->mutex);
     return TRUE;
 }
@@ -775,57 +1138,147 @@ int gui_running(struct gui *ui, int *running, int *stop_sim)
     return TRUE;
 }
 
-int gui_update(struct gui *ui)
+/* Publishes the frame written by the simulation thread, so that the
+ * renderer can take it (without waiting for it).
+ */
+static
+void publish_frame(struct gui_internal *iui)
 {
-    struct gui_internal *iui;
-    int ret;
+    struct gui_frame *frame, *prev;
+    unsigned int i, j, line;
+    uint32_t bits;
+    size_t offset;
+    int state;
+
+    frame = &iui->frames[iui->back];
+    frame->seq = ++iui->seq;
+
+    /* The scanlines that changed are now stale in the other frames,
+     * and only the stale scanlines of this frame are copied.
+     */
+    for (j = 0; j < NUM_FRAMES; j++) {
+        if (j == iui->back) continue;
+        for (i = 0; i < DISPLAY_DIRTY_SIZE; i++) {
+            iui->frames[j].stale[i] |= frame->dirty[i];
+        }
+    }
 
-    if (unlikely(!ui->sim)) {
-        report_error("gui: update: no simulator object");
-        return FALSE;
+    for (i = 0; i < DISPLAY_DIRTY_SIZE; i++) {
+        bits = frame->dirty[i] | frame->stale[i];
+        frame->stale[i] = 0;
+        for (line = 32 * i; bits; line++, bits >>= 1) {
+            if (!(bits & 1) || line >= DISPLAY_HEIGHT) continue;
+            offset = line * DISPLAY_LINE_WORDS;
+            memcpy(&frame->data[offset], &iui->display_data[offset],
+                   DISPLAY_LINE_WORDS * sizeof(uint16_t));
+        }
     }
 
-    iui = (struct gui_internal *) ui->internal;
+    /* When the previous frame was not taken by the renderer yet, its
+     * dirty scanlines are carried over to this frame (if the renderer
+     * takes it in the meantime, a few scanlines are drawn again).
+     */
+    state = SDL_AtomicGet(&iui->frame_state);
+    if (state & FRAME_FRESH) {
+        prev = &iui->frames[state & FRAME_INDEX];
+        for (i = 0; i < DISPLAY_DIRTY_SIZE; i++) {
+            frame->dirty[i] |= prev->dirty[i];
+        }
+    }
+
+    SDL_MemoryBarrierRelease();
+    state = SDL_AtomicSet(&iui->frame_state, (int) (iui->back | FRAME_FRESH));
+    SDL_MemoryBarrierAcquire();
+
+    iui->back = (unsigned int) (state & FRAME_INDEX);
+    memset(iui->frames[iui->back].dirty, 0,
+           DISPLAY_DIRTY_SIZE * sizeof(uint32_t));
+}
+
+/* Publishes the frame written by the simulation thread when recording
+ * the video in headless mode. Unlike publish_frame(), it waits for the
+ * previous frame to be taken by the thread that records the video (see
+ * video_thread_main()), so that no frame is lost.
+ * Returns TRUE on success.
+ */
+static
+int handoff_frame(struct gui_internal *iui)
+{
+    int ret;
+
     ret = SDL_LockMutex(iui->mutex);
     if (unlikely(ret != 0)) {
-        report_error("gui: update: could no acquire lock "
+        report_error("gui: handoff_frame: could no acquire lock "
                      "(SDLError(%d): %s)", ret, SDL_GetError());
         return FALSE;
     }
 
-    ret = simulator_update(ui->sim, &iui->keyb, &iui->mous,
-                           iui->display_data);
-    if (unlikely(!ret)) {
-        report_error("gui: update: could not update state");
-        SDL_UnlockMutex(iui->mutex);
-        return FALSE;
+    /* Nothing takes the frames after stopping. */
+    while (iui->running
+           && (SDL_AtomicGet(&iui->frame_state) & FRAME_FRESH)) {
+        SDL_CondWait(iui->frame_cond, iui->mutex);
     }
 
+    publish_frame(iui);
+    SDL_CondBroadcast(iui->frame_cond);
     SDL_UnlockMutex(iui->mutex);
     return TRUE;
 }
 
-int gui_wait_frame(struct gui *ui)
+int gui_update(struct gui *ui)
 {
     struct gui_internal *iui;
     int ret;
 
+    if (unlikely(!ui->sim)) {
+        report_error("gui: update: no simulator object");
+        return FALSE;
+    }
+
     iui = (struct gui_internal *) ui->internal;
+    if (iui->headless) {
+        /* There is nothing to draw, but the frames may be recorded
+         * (by another thread), and the display may be dumped.
+         */
+        if (iui->video) {
+            ret = simulator_update(ui->sim, NULL, NULL, iui->display_data,
+                                   iui->frames[iui->back].dirty);
+            if (unlikely(!ret)) {
+                report_error("gui: update: could not update state");
+                return FALSE;
+            }
+
+            if (unlikely(!handoff_frame(iui))) {
+                report_error("gui: update: could not hand off frame");
+                return FALSE;
+            }
+        }
+
+        iui->frame++;
+        if (iui->dump_interval == 0) return TRUE;
+        if ((iui->frame % iui->dump_interval) != 0) return TRUE;
+        return gui_dump_frame(ui, iui->frame);
+    }
+
+    /* The mutex only protects the keyboard and the mouse. */
     ret = SDL_LockMutex(iui->mutex);
     if (unlikely(ret != 0)) {
-        report_error("gui: wait_next_frame: could no acquire lock "
+        report_error("gui: update: could no acquire lock "
                      "(SDLError(%d): %s)", ret, SDL_GetError());
         return FALSE;
     }
 
-    ret = SDL_CondWait(iui->frame_cond, iui->mutex);
-    if (unlikely(ret != 0)) {
-        report_error("gui: wait_next_frame: could wait condition "
-                     "(SDLError(%d): %s)", ret, SDL_GetError());
+    ret = simulator_update(ui->sim, &iui->keyb, &iui->mous,
+                           iui->display_data,
+                           iui->frames[iui->back].dirty);
+    if (unlikely(!ret)) {
+        report_error("gui: update: could not update state");
         SDL_UnlockMutex(iui->mutex);
         return FALSE;
     }
 
     SDL_UnlockMutex(iui->mutex);
+
+    publish_frame(iui);
     return TRUE;
 }
@@ -3,6 +3,7 @@
 #define __GUI_GUI_H
 
 #include "simulator/simulator.h"
+#include "gui/video.h"
 
 /* Data structures and types. */
 
@@ -37,14 +38,39 @@ void gui_destroy(struct gui *ui);
 /* Creates a new gui object.
  * This obeys the initvar / destroy / create protocol.
  * The parameter `sim` is a reference to the simulator.
+ * If `headless` is TRUE, no window is created: the callback
+ * `thread_cb` runs in the thread that calls gui_start(), and the
+ * frames are only copied when recording a video.
  * The parameter `thread_cb` is a callback to be run in a separate thread,
  * and the argument `arg` is an extra argument to be used by this thread
  * (via ui->arg). If `thread_cb` is NULL, no separate thread is created.
  * Returns TRUE on success.
  */
-int gui_create(struct gui *ui, struct simulator *sim,
+int gui_create(struct gui *ui, struct simulator *sim, int headless,
                gui_thread_cb thread_cb, void *arg);
 
+/* Configures the dumping of the display contents (in PGM format).
+ * The display is saved to `filename` when the user interface stops.
+ * If `interval` is not zero, the display is also saved every
+ * `interval` frames, to files named `filename` followed by a dot and
+ * the frame number. Only available in headless mode.
+ * Returns TRUE on success.
+ */
+int gui_set_frame_dump(struct gui *ui, const char *filename,
+                       unsigned int interval);
+
+/* Records the frames of the display to the video `vid` (which must be
+ * open), or stops recording if `vid` is NULL. The frames are recorded
+ * by the thread that draws them (or by a separate thread in headless
+ * mode), not by the simulation thread. With a window, when the
+ * simulation runs faster than the frames are recorded, only the latest
+ * frame is recorded. In headless mode, every frame is recorded (the
+ * simulation waits for the recording), so the video only depends on
+ * the simulation.
+ * This must be called before gui_start().
+ */
+void gui_set_video(struct gui *ui, struct video *vid);
+
 /* Starts the user interface.
  * Returns TRUE on success.
  */
@@ -64,15 +90,14 @@ int gui_stop(struct gui *ui);
  */
 int gui_running(struct gui *ui, int *running, int *stop_sim);
 
-/* Updates the user interface.
+/* Updates the user interface. This is called by the simulation
+ * thread, and it publishes the current frame of the display to the
+ * renderer without waiting for it (the renderer always draws the
+ * latest frame published). In headless mode, it waits for the previous
+ * frame to be taken when recording a video.
  * Returns TRUE on success.
  */
 int gui_update(struct gui *ui);
 
-/* Waits until the next frame is drawn.
- * Returns TRUE on success.
- */
-int gui_wait_frame(struct gui *ui);
-
 
 #endif /* __GUI_GUI_H */
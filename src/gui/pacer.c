@@ -0,0 +1,91 @@
+#include <stdint.h>
+#include <SDL.h>
+
+#include "gui/pacer.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define SLEEP_QUANTUM                      2 /* In milliseconds. */
+#define MAX_LAG                          100 /* In milliseconds. */
+
+/* Functions. */
+
+void pacer_initvar(struct pacer *pc)
+{
+    UNUSED(pc);
+}
+
+void pacer_destroy(struct pacer *pc)
+{
+    UNUSED(pc);
+}
+
+int pacer_create(struct pacer *pc, uint32_t frequency)
+{
+    pacer_initvar(pc);
+
+    pc->frequency = frequency;
+    pc->speed = 1.0;
+    pc->host_frequency = SDL_GetPerformanceFrequency();
+    pacer_reset(pc);
+    return TRUE;
+}
+
+void pacer_set_frequency(struct pacer *pc, uint32_t frequency)
+{
+    pc->frequency = frequency;
+    pacer_reset(pc);
+}
+
+int pacer_set_speed(struct pacer *pc, double speed)
+{
+    if (unlikely(speed < 0)) {
+        report_error("pacer: set_speed: invalid speed");
+        return FALSE;
+    }
+
+    pc->speed = speed;
+    pacer_reset(pc);
+    return TRUE;
+}
+
+void pacer_reset(struct pacer *pc)
+{
+    pc->start = SDL_GetPerformanceCounter();
+    pc->cycles = 0;
+}
+
+void pacer_wait(struct pacer *pc, uint32_t cycles)
+{
+    uint64_t now, target, max_lag, ms;
+    double ticks;
+
+    if (pc->speed == 0 || pc->frequency == 0) return;
+
+    /* The host time when the emulated cycles should end. It is kept
+     * relative to the start, so that the errors of the sleeps do not
+     * accumulate.
+     */
+    pc->cycles += cycles;
+    ticks = ((double) pc->cycles) * ((double) pc->host_frequency);
+    ticks /= ((double) pc->frequency) * pc->speed;
+    target = pc->start + (uint64_t) ticks;
+
+    now = SDL_GetPerformanceCounter();
+    max_lag = (MAX_LAG * pc->host_frequency) / 1000;
+    if (now > target + max_lag) {
+        pacer_reset(pc);
+        return;
+    }
+
+    /* The sleeps are short, to absorb the jitter of the host. What
+     * is left (less than a millisecond) is made up in the next wait.
+     */
+    while (now < target) {
+        ms = ((target - now) * 1000) / pc->host_frequency;
+        if (ms == 0) break;
+
+        SDL_Delay((uint32_t) MIN(ms, SLEEP_QUANTUM));
+        now = SDL_GetPerformanceCounter();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef __GUI_PACER_H
+#define __GUI_PACER_H
+
+#include <stdint.h>
+
+/* Data structures and types. */
+
+/* Structure to pace the simulation against the host clock. The
+ * emulated cycles are accounted as they are simulated, and the pacer
+ * sleeps until the host clock catches up with them (at `speed` times
+ * the real time of a cpu running at `frequency`).
+ */
+struct pacer {
+    uint32_t frequency;           /* The real cpu frequency (in Hz). */
+    double speed;                 /* The multiple of the real time (or
+                                   * zero to run unthrottled).
+                                   */
+    uint64_t host_frequency;      /* The frequency of the host clock. */
+    uint64_t start;               /* The host time of the start. */
+    uint64_t cycles;              /* Emulated cycles since the start. */
+};
+
+/* Functions. */
+
+/* Initializes the pacer variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void pacer_initvar(struct pacer *pc);
+
+/* Destroys the pacer object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void pacer_destroy(struct pacer *pc);
+
+/* Creates a new pacer object, running in real time for a cpu at
+ * `frequency` Hz.
+ * This obeys the initvar / destroy / create protocol.
+ * Returns TRUE on success.
+ */
+int pacer_create(struct pacer *pc, uint32_t frequency);
+
+/* Sets the real cpu frequency to `frequency` Hz. */
+void pacer_set_frequency(struct pacer *pc, uint32_t frequency);
+
+/* Sets the speed to `speed` times the real time (if zero, the
+ * simulation runs unthrottled).
+ * Returns TRUE on success.
+ */
+int pacer_set_speed(struct pacer *pc, double speed);
+
+/* Restarts the pacing from the current host time (this should be
+ * called when the simulation resumes after a pause).
+ */
+void pacer_reset(struct pacer *pc);
+
+/* Accounts for `cycles` more emulated cycles, and sleeps until the
+ * host clock catches up with them. When the simulation is too far
+ * behind the host clock, the pacing restarts instead of trying to
+ * catch up.
+ */
+void pacer_wait(struct pacer *pc, uint32_t cycles);
+
+#endif /* __GUI_PACER_H */
@@ -0,0 +1,397 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gui/video.h"
+#include "simulator/display.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define VIDEO_MAGIC               0x50564944 /* "PVID" */
+#define VIDEO_VERSION                      1
+#define HEADER_SIZE                       12
+#define MIN_FILL                           3
+
+/* The maximum size of the encoding of a frame (and of a scanline). */
+#define MAX_LINE_SIZE       (8 + 6 * DISPLAY_LINE_WORDS)
+#define MAX_FRAME_SIZE      (16 + DISPLAY_HEIGHT * MAX_LINE_SIZE)
+
+/* Functions. */
+
+void video_initvar(struct video *vid)
+{
+    vid->fp = NULL;
+    vid->prev = NULL;
+    vid->buf = NULL;
+}
+
+void video_destroy(struct video *vid)
+{
+    video_close(vid);
+
+    if (vid->prev) free((void *) vid->prev);
+    vid->prev = NULL;
+
+    if (vid->buf) free((void *) vid->buf);
+    vid->buf = NULL;
+}
+
+int video_create(struct video *vid)
+{
+    video_initvar(vid);
+
+    vid->prev = (uint16_t *) malloc(DISPLAY_DATA_SIZE * sizeof(uint16_t));
+    vid->buf = (uint8_t *) malloc(MAX_FRAME_SIZE);
+    if (unlikely(!vid->prev || !vid->buf)) {
+        report_error("video: create: memory exhausted");
+        video_destroy(vid);
+        return FALSE;
+    }
+
+    vid->last_seq = 0;
+    vid->num_frames = 0;
+    return TRUE;
+}
+
+int video_open(struct video *vid, const char *filename)
+{
+    uint8_t header[HEADER_SIZE];
+
+    video_close(vid);
+
+    vid->fp = fopen(filename, "wb");
+    if (unlikely(!vid->fp)) {
+        report_error("video: open: could not open `%s`", filename);
+        return FALSE;
+    }
+
+    memset(header, 0, sizeof(header));
+    header[0] = (uint8_t) (VIDEO_MAGIC >> 24);
+    header[1] = (uint8_t) (VIDEO_MAGIC >> 16);
+    header[2] = (uint8_t) (VIDEO_MAGIC >> 8);
+    header[3] = (uint8_t) VIDEO_MAGIC;
+    header[4] = VIDEO_VERSION;
+    header[6] = (uint8_t) (DISPLAY_WIDTH >> 8);
+    header[7] = (uint8_t) DISPLAY_WIDTH;
+    header[8] = (uint8_t) (DISPLAY_HEIGHT >> 8);
+    header[9] = (uint8_t) DISPLAY_HEIGHT;
+    header[10] = (uint8_t) (DISPLAY_LINE_WORDS >> 8);
+    header[11] = (uint8_t) DISPLAY_LINE_WORDS;
+    if (unlikely(fwrite(header, 1, HEADER_SIZE, vid->fp) != HEADER_SIZE)) {
+        report_error("video: open: could not write header");
+        fclose(vid->fp);
+        vid->fp = NULL;
+        return FALSE;
+    }
+
+    memset(vid->prev, 0, DISPLAY_DATA_SIZE * sizeof(uint16_t));
+    vid->last_seq = 0;
+    vid->num_frames = 0;
+    return TRUE;
+}
+
+int video_close(struct video *vid)
+{
+    int ret;
+
+    ret = TRUE;
+    if (vid->fp) {
+        if (unlikely(fclose(vid->fp) != 0)) {
+            report_error("video: close: could not write video");
+            ret = FALSE;
+        }
+    }
+    vid->fp = NULL;
+    return ret;
+}
+
+int video_recording(const struct video *vid)
+{
+    return (vid->fp != NULL);
+}
+
+/* Encodes `value` as a variable length integer (7 bits per byte,
+ * least significant first) to `buf`.
+ * Returns the number of bytes used.
+ */
+static
+size_t put_varint(uint8_t *buf, uint32_t value)
+{
+    size_t len;
+
+    len = 0;
+    while (value >= 0x80) {
+        buf[len++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    buf[len++] = (uint8_t) value;
+    return len;
+}
+
+/* Returns the number of consecutive words of `line` equal to the word
+ * at `pos`.
+ */
+static
+unsigned int fill_length(const uint16_t *line, unsigned int pos)
+{
+    unsigned int end;
+
+    end = pos + 1;
+    while (end < DISPLAY_LINE_WORDS && line[end] == line[pos]) end++;
+    return end - pos;
+}
+
+/* Encodes the scanline `line` against the previous contents `prev` of
+ * the same scanline to `buf`.
+ * Returns the number of bytes used.
+ */
+static
+size_t encode_line(uint8_t *buf, const uint16_t *line, const uint16_t *prev)
+{
+    unsigned int pos, start, count, num_runs, i;
+    size_t len;
+    int fill;
+
+    /* The number of runs is at most DISPLAY_LINE_WORDS, so it fits
+     * in a single byte (written at the end).
+     */
+    len = 1;
+    num_runs = 0;
+    pos = 0;
+    while (TRUE) {
+        start = pos;
+        while (pos < DISPLAY_LINE_WORDS && line[pos] == prev[pos]) pos++;
+        if (pos == DISPLAY_LINE_WORDS) break;
+        len += put_varint(&buf[len], pos - start);
+
+        start = pos;
+        count = fill_length(line, pos);
+        fill = (count >= MIN_FILL);
+        if (fill) {
+            pos += count;
+        } else {
+            /* The literal words end at an unchanged word or where
+             * a fill would start.
+             */
+            while (pos < DISPLAY_LINE_WORDS && line[pos] != prev[pos]
+                   && (pos == start || fill_length(line, pos) < MIN_FILL))
+                pos++;
+            count = pos - start;
+        }
+
+        len += put_varint(&buf[len], (count << 1) | (fill ? 1 : 0));
+        for (i = 0; i < (fill ? 1 : count); i++) {
+            buf[len++] = (uint8_t) (line[start + i] >> 8);
+            buf[len++] = (uint8_t) line[start + i];
+        }
+        num_runs++;
+    }
+
+    buf[0] = (uint8_t) num_runs;
+    return len;
+}
+
+int video_add_frame(struct video *vid, uint32_t seq,
+                    const uint16_t *data, const uint32_t *dirty)
+{
+    const uint16_t *line;
+    uint16_t *prev;
+    unsigned int i, next, num_lines;
+    size_t len, hlen;
+    uint8_t header[16];
+
+    if (!vid->fp) return TRUE;
+
+    len = 0;
+    next = 0;
+    num_lines = 0;
+    for (i = 0; i < DISPLAY_HEIGHT; i++) {
+        /* Only the dirty scanlines may have changed, except in the
+         * first frame (which is compared against a black frame).
+         */
+        if (vid->num_frames > 0 && dirty
+            && !(dirty[i / 32] & (1U << (i % 32))))
+            continue;
+
+        line = &data[i * DISPLAY_LINE_WORDS];
+        prev = &vid->prev[i * DISPLAY_LINE_WORDS];
+        if (memcmp(line, prev, DISPLAY_LINE_WORDS * sizeof(uint16_t)) == 0)
+            continue;
+
+        len += put_varint(&vid->buf[len], i - next);
+        len += encode_line(&vid->buf[len], line, prev);
+        memcpy(prev, line, DISPLAY_LINE_WORDS * sizeof(uint16_t));
+        next = i + 1;
+        num_lines++;
+    }
+
+    if (vid->num_frames > 0 && num_lines == 0) return TRUE;
+
+    hlen = put_varint(header, seq - vid->last_seq);
+    hlen += put_varint(&header[hlen], num_lines);
+    if (unlikely(fwrite(header, 1, hlen, vid->fp) != hlen
+                 || fwrite(vid->buf, 1, len, vid->fp) != len)) {
+        report_error("video: add_frame: could not write frame");
+        return FALSE;
+    }
+
+    vid->last_seq = seq;
+    vid->num_frames++;
+    return TRUE;
+}
+
+/* Reads a variable length integer from `fp` to `value`.
+ * Returns TRUE on success.
+ */
+static
+int read_varint(FILE *fp, uint32_t *value)
+{
+    unsigned int shift;
+    int c;
+
+    *value = 0;
+    shift = 0;
+    do {
+        c = getc(fp);
+        if (c == EOF || shift >= 32) return FALSE;
+        *value |= ((uint32_t) (c & 0x7F)) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return TRUE;
+}
+
+/* Reads a (big endian) word from `fp` to `value`.
+ * Returns TRUE on success.
+ */
+static
+int read_word(FILE *fp, uint16_t *value)
+{
+    int hi, lo;
+
+    hi = getc(fp);
+    lo = getc(fp);
+    if (hi == EOF || lo == EOF) return FALSE;
+    *value = (uint16_t) ((hi << 8) | lo);
+    return TRUE;
+}
+
+/* Decodes a scanline from `fp` to `line` (which has the previous
+ * contents of the scanline).
+ * Returns TRUE on success.
+ */
+static
+int decode_line(FILE *fp, uint16_t *line)
+{
+    uint32_t num_runs, skip, count, i;
+    unsigned int pos;
+    uint16_t value;
+    int fill;
+
+    if (!read_varint(fp, &num_runs)) return FALSE;
+
+    value = 0;
+    pos = 0;
+    while (num_runs-- > 0) {
+        if (!read_varint(fp, &skip)) return FALSE;
+        if (!read_varint(fp, &count)) return FALSE;
+        fill = (count & 1);
+        count >>= 1;
+
+        if (skip > DISPLAY_LINE_WORDS - pos) return FALSE;
+        pos += skip;
+        if (count > DISPLAY_LINE_WORDS - pos) return FALSE;
+
+        for (i = 0; i < count; i++) {
+            if (!fill || i == 0) {
+                if (!read_word(fp, &value)) return FALSE;
+            }
+            line[pos++] = value;
+        }
+    }
+    return TRUE;
+}
+
+int video_convert(const char *filename, const char *prefix)
+{
+    char name[1024];
+    uint8_t header[HEADER_SIZE];
+    uint16_t *data;
+    uint32_t magic, seq, delta, num_lines, line, next;
+    FILE *fp;
+    int c;
+
+    fp = fopen(filename, "rb");
+    if (unlikely(!fp)) {
+        report_error("video: convert: could not open `%s`", filename);
+        return FALSE;
+    }
+
+    magic = 0;
+    if (fread(header, 1, HEADER_SIZE, fp) == HEADER_SIZE) {
+        magic = (((uint32_t) header[0]) << 24)
+            | (((uint32_t) header[1]) << 16)
+            | (((uint32_t) header[2]) << 8)
+            | ((uint32_t) header[3]);
+    }
+    if (unlikely(magic != VIDEO_MAGIC
+                 || header[4] != VIDEO_VERSION
+                 || header[6] != (uint8_t) (DISPLAY_WIDTH >> 8)
+                 || header[7] != (uint8_t) DISPLAY_WIDTH
+                 || header[8] != (uint8_t) (DISPLAY_HEIGHT >> 8)
+                 || header[9] != (uint8_t) DISPLAY_HEIGHT
+                 || header[10] != (uint8_t) (DISPLAY_LINE_WORDS >> 8)
+                 || header[11] != (uint8_t) DISPLAY_LINE_WORDS)) {
+        report_error("video: convert: invalid video `%s`", filename);
+        fclose(fp);
+        return FALSE;
+    }
+
+    data = (uint16_t *) malloc(DISPLAY_DATA_SIZE * sizeof(uint16_t));
+    if (unlikely(!data)) {
+        report_error("video: convert: memory exhausted");
+        fclose(fp);
+        return FALSE;
+    }
+    memset(data, 0, DISPLAY_DATA_SIZE * sizeof(uint16_t));
+
+    seq = 0;
+    while ((c = getc(fp)) != EOF) {
+        ungetc(c, fp);
+        if (unlikely(!read_varint(fp, &delta)
+                     || !read_varint(fp, &num_lines)))
+            goto corrupted;
+
+        next = 0;
+        while (num_lines-- > 0) {
+            if (unlikely(!read_varint(fp, &line)))
+                goto corrupted;
+            line += next;
+            if (unlikely(line >= DISPLAY_HEIGHT
+                         || !decode_line(fp,
+                                         &data[line * DISPLAY_LINE_WORDS])))
+                goto corrupted;
+            next = line + 1;
+        }
+
+        seq += delta;
+        snprintf(name, sizeof(name), "%s.%u", prefix, (unsigned int) seq);
+        if (unlikely(!display_save_image(data, name))) {
+            report_error("video: convert: could not save frame");
+            free((void *) data);
+            fclose(fp);
+            return FALSE;
+        }
+    }
+
+    free((void *) data);
+    fclose(fp);
+    return TRUE;
+
+corrupted:
+    report_error("video: convert: corrupted video `%s`", filename);
+    free((void *) data);
+    fclose(fp);
+    return FALSE;
+}
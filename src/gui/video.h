@@ -0,0 +1,84 @@
+#ifndef __GUI_VIDEO_H
+#define __GUI_VIDEO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Data structures and types. */
+
+/* Structure to record the display to a file, as a stream of frames.
+ * Each frame only has the scanlines that changed since the previous
+ * frame recorded, and each scanline is encoded against the previous
+ * one: runs of unchanged words are skipped, and the changed words are
+ * stored either literally or (when repeated) as a fill.
+ *
+ * The file has a header followed by the frames. Each frame has the
+ * number of display frames since the previous one (as a variable
+ * length integer), the number of scanlines, and the scanlines. Each
+ * scanline has its distance from the previous scanline of the frame,
+ * the number of runs, and the runs. Each run has the number of words
+ * skipped, the number of words (shifted left by one, with the lowest
+ * bit set for a fill), and the words (big endian).
+ */
+struct video {
+    FILE *fp;                     /* The file being recorded. */
+    uint16_t *prev;               /* The last frame recorded (packed). */
+    uint8_t *buf;                 /* The buffer to encode a frame. */
+    uint32_t last_seq;            /* The sequence number of the last
+                                   * frame recorded.
+                                   */
+    unsigned int num_frames;      /* Number of frames recorded. */
+};
+
+/* Functions. */
+
+/* Initializes the video variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void video_initvar(struct video *vid);
+
+/* Destroys the video object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void video_destroy(struct video *vid);
+
+/* Creates a new video object.
+ * This obeys the initvar / destroy / create protocol.
+ * Returns TRUE on success.
+ */
+int video_create(struct video *vid);
+
+/* Starts recording to the file named `filename`.
+ * Returns TRUE on success.
+ */
+int video_open(struct video *vid, const char *filename);
+
+/* Stops recording (and closes the file).
+ * Returns TRUE on success.
+ */
+int video_close(struct video *vid);
+
+/* Checks if the video is being recorded. */
+int video_recording(const struct video *vid);
+
+/* Records the frame `data` (the packed display pixels, see struct
+ * display), with the sequence number `seq` (the number of the display
+ * frame). Only the scanlines in the bitmap `dirty` (as given by
+ * simulator_update()) are considered as changed, unless `dirty` is
+ * NULL. Frames without changes are not recorded (except the first).
+ * Returns TRUE on success.
+ */
+int video_add_frame(struct video *vid, uint32_t seq,
+                    const uint16_t *data, const uint32_t *dirty);
+
+/* Converts the video in the file named `filename` to a sequence of
+ * images (in PGM format), one for each frame recorded. The images
+ * are named `prefix.N`, where N is the sequence number of the frame.
+ * Returns TRUE on success.
+ */
+int video_convert(const char *filename, const char *prefix);
+
+#endif /* __GUI_VIDEO_H */
@@ -1,15 +1,18 @@
 ASSEMBLER_OBJS := assembler/assembler.o assembler/objfile.o
 COMMON_OBJS := common/allocator.o common/table.o common/serdes.o \
  common/string_buffer.o common/utils.o
-DEBUGGER_OBJS := debugger/debugger.o debugger/cmd.o
+DEBUGGER_OBJS := debugger/debugger.o debugger/cmd.o debugger/farm.o \
+ debugger/script.o debugger/symbols.o
 FS_OBJS := fs/basic.o fs/check.o fs/dir.o fs/disk.o fs/file.o fs/fs.o \
  fs/meta.o fs/scan.o fs/print.o
-GUI_OBJS := gui/gui.o gui/udp_transport.o
+GUI_OBJS := gui/gui.o gui/pacer.o gui/udp_transport.o gui/video.o
 MICROCODE_OBJS := microcode/microcode.o microcode/nova.o
 PARSER_OBJS := parser/parser.o parser/lexer.o
 SIMULATOR_OBJS := simulator/simulator.o simulator/disk.o \
  simulator/display.o simulator/ethernet.o simulator/keyboard.o \
- simulator/mouse.o simulator/intr.o simulator/rom.o
+ simulator/mouse.o simulator/intr.o simulator/rom.o \
+ simulator/snapshot.o simulator/checkpoint.o simulator/journal.o \
+ simulator/fingerprint.o
 
 
 PMU_OBJS := $(ASSEMBLER_OBJS) $(COMMON_OBJS) $(PARSER_OBJS) \
@@ -17,9 +20,11 @@ PMU_OBJS := $(ASSEMBLER_OBJS) $(COMMON_OBJS) $(PARSER_OBJS) \
 PAR_OBJS := $(FS_OBJS) common/utils.o par.o
 PALOS_OBJS := $(COMMON_OBJS) $(DEBUGGER_OBJS) $(GUI_OBJS) $(MICROCODE_OBJS) \
  $(SIMULATOR_OBJS) assembler/objfile.o palos.o
+PBENCH_OBJS := $(ASSEMBLER_OBJS) $(COMMON_OBJS) $(FS_OBJS) \
+ $(MICROCODE_OBJS) $(PARSER_OBJS) $(SIMULATOR_OBJS) pbench.o
 OBJS := $(ASSEMBLER_OBJS) $(COMMON_OBJS) $(DEBUGGER_OBJS) $(FS_OBJS) \
  $(GUI_OBJS) $(MICROCODE_OBJS) $(PARSER_OBJS) $(SIMULATOR_OBJS) \
- pmu.o par.o palos.o
+ pmu.o par.o palos.o pbench.o
 
 
 assembler/assembler.o: assembler/assembler.c assembler/assembler.h \
@@ -37,21 +42,45 @@ common/table.o: common/table.c common/table.h common/utils.h
 common/utils.o: common/utils.c common/utils.h
 debugger/cmd.o: debugger/cmd.c assembler/objfile.h common/allocator.h \
  common/serdes.h common/string_buffer.h common/table.h common/utils.h \
- debugger/debugger.h gui/gui.h microcode/microcode.h  microcode/nova.h \
- simulator/display.h simulator/disk.h simulator/ethernet.h simulator/intr.h \
-  simulator/keyboard.h simulator/mouse.h simulator/simulator.h
+ debugger/debugger.h debugger/symbols.h gui/gui.h microcode/microcode.h \
+ microcode/nova.h simulator/display.h simulator/disk.h simulator/ethernet.h \
+ simulator/intr.h simulator/keyboard.h simulator/mouse.h \
+ simulator/simulator.h simulator/checkpoint.h simulator/snapshot.h \
+ gui/pacer.h gui/video.h
 debugger/debugger.o: debugger/debugger.c assembler/objfile.h \
  common/allocator.h common/serdes.h common/string_buffer.h common/table.h \
- common/utils.h debugger/debugger.h gui/gui.h microcode/microcode.h \
- microcode/nova.h simulator/display.h simulator/disk.h  simulator/ethernet.h \
- simulator/keyboard.h simulator/mouse.h simulator/simulator.h
+ common/utils.h debugger/debugger.h debugger/symbols.h gui/gui.h \
+ microcode/microcode.h microcode/nova.h simulator/display.h simulator/disk.h \
+ simulator/ethernet.h simulator/keyboard.h simulator/mouse.h \
+ simulator/simulator.h simulator/checkpoint.h simulator/snapshot.h \
+ simulator/intr.h gui/pacer.h gui/video.h
+debugger/farm.o: debugger/farm.c assembler/objfile.h common/allocator.h \
+ common/serdes.h common/string_buffer.h common/table.h common/utils.h \
+ debugger/debugger.h debugger/farm.h debugger/symbols.h gui/gui.h \
+ microcode/microcode.h microcode/nova.h simulator/display.h simulator/disk.h \
+ simulator/ethernet.h simulator/keyboard.h simulator/mouse.h \
+ simulator/simulator.h simulator/checkpoint.h simulator/snapshot.h \
+ simulator/intr.h gui/pacer.h gui/video.h
+debugger/symbols.o: debugger/symbols.c common/allocator.h common/utils.h \
+ debugger/symbols.h microcode/microcode.h
+debugger/script.o: debugger/script.c assembler/objfile.h \
+ common/allocator.h common/serdes.h common/string_buffer.h common/table.h \
+ common/utils.h debugger/debugger.h debugger/symbols.h gui/gui.h \
+ microcode/microcode.h microcode/nova.h simulator/display.h simulator/disk.h \
+ simulator/ethernet.h simulator/intr.h simulator/keyboard.h simulator/mouse.h \
+ simulator/simulator.h simulator/snapshot.h \
+ simulator/checkpoint.h gui/pacer.h gui/video.h
 gui/gui.o: gui/gui.c common/serdes.h common/string_buffer.h common/utils.h \
  gui/gui.h microcode/microcode.h microcode/nova.h simulator/display.h \
  simulator/disk.h simulator/ethernet.h simulator/keyboard.h simulator/mouse.h \
- simulator/simulator.h
+ simulator/simulator.h simulator/intr.h gui/video.h
+gui/pacer.o: gui/pacer.c common/utils.h gui/pacer.h
 gui/udp_transport.o: gui/udp_transport.c common/serdes.h \
  common/string_buffer.h common/utils.h gui/udp_transport.h \
- microcode/microcode.h simulator/ethernet.h
+ microcode/microcode.h simulator/ethernet.h simulator/intr.h
+gui/video.o: gui/video.c common/serdes.h common/string_buffer.h \
+ common/utils.h gui/video.h microcode/microcode.h simulator/display.h \
+ simulator/intr.h
 fs/basic.o: fs/basic.c common/utils.h fs/fs.h fs/fs_internal.h
 fs/check.o: fs/check.c common/utils.h fs/fs.h fs/fs_internal.h
 fs/dir.o: fs/dir.c common/utils.h fs/fs.h fs/fs_internal.h
@@ -85,16 +114,46 @@ simulator/mouse.o: simulator/mouse.c common/serdes.h common/string_buffer.h \
  common/utils.h microcode/microcode.h simulator/mouse.h
 simulator/rom.o: simulator/rom.c common/string_buffer.h \
  common/string_buffer.h microcode/microcode.h simulator/rom.h
+simulator/snapshot.o: simulator/snapshot.c common/serdes.h \
+ common/string_buffer.h common/utils.h microcode/microcode.h \
+ microcode/nova.h simulator/display.h simulator/disk.h simulator/ethernet.h \
+ simulator/keyboard.h simulator/mouse.h simulator/simulator.h \
+ simulator/snapshot.h simulator/intr.h
+simulator/checkpoint.o: simulator/checkpoint.c common/serdes.h \
+ common/string_buffer.h common/utils.h microcode/microcode.h \
+ microcode/nova.h simulator/checkpoint.h simulator/display.h \
+ simulator/disk.h simulator/ethernet.h simulator/keyboard.h \
+ simulator/mouse.h simulator/simulator.h simulator/intr.h
+simulator/fingerprint.o: simulator/fingerprint.c common/serdes.h \
+ common/string_buffer.h common/utils.h microcode/microcode.h \
+ microcode/nova.h simulator/display.h simulator/disk.h \
+ simulator/ethernet.h simulator/fingerprint.h simulator/intr.h \
+ simulator/keyboard.h simulator/mouse.h simulator/simulator.h
+simulator/journal.o: simulator/journal.c common/serdes.h \
+ common/string_buffer.h common/utils.h microcode/microcode.h \
+ microcode/nova.h simulator/display.h simulator/disk.h \
+ simulator/ethernet.h simulator/intr.h simulator/journal.h \
+ simulator/keyboard.h simulator/mouse.h simulator/simulator.h
 simulator/simulator.o: simulator/simulator.c common/serdes.h \
  common/string_buffer.h common/utils.h microcode/microcode.h microcode/nova.h \
  simulator/display.h simulator/disk.h simulator/ethernet.h simulator/intr.h \
- simulator/keyboard.h simulator/mouse.h simulator/rom.h simulator/simulator.h
+ simulator/keyboard.h simulator/mouse.h simulator/rom.h simulator/simulator.h \
+ simulator/journal.h simulator/fingerprint.h
 palos.o: palos.c assembler/objfile.h common/allocator.h common/serdes.h \
  common/string_buffer.h common/table.h common/utils.h debugger/debugger.h \
+ debugger/farm.h debugger/symbols.h \
  gui/gui.h gui/udp_transport.h microcode/microcode.h microcode/nova.h \
  simulator/display.h simulator/disk.h simulator/ethernet.h \
- simulator/keyboard.h simulator/mouse.h simulator/simulator.h
+ simulator/keyboard.h simulator/mouse.h simulator/simulator.h \
+ simulator/checkpoint.h simulator/snapshot.h simulator/intr.h \
+ simulator/journal.h simulator/fingerprint.h gui/pacer.h gui/video.h
 par.o: par.c common/utils.h fs/fs.h
+pbench.o: pbench.c assembler/assembler.h assembler/objfile.h \
+ common/allocator.h common/serdes.h common/string_buffer.h common/table.h \
+ common/utils.h fs/fs.h microcode/microcode.h microcode/nova.h \
+ parser/lexer.h parser/parser.h simulator/display.h simulator/disk.h \
+ simulator/ethernet.h simulator/intr.h simulator/keyboard.h \
+ simulator/mouse.h simulator/simulator.h
 pmu.o: pmu.c assembler/assembler.h assembler/objfile.h common/allocator.h \
  common/serdes.h common/string_buffer.h common/table.h common/utils.h \
  microcode/microcode.h parser/parser.h parser/lexer.h \
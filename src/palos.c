@@ -7,25 +7,80 @@
 #include "simulator/simulator.h"
 #include "simulator/disk.h"
 #include "simulator/ethernet.h"
+#include "simulator/checkpoint.h"
+#include "simulator/journal.h"
+#include "simulator/fingerprint.h"
 #include "gui/gui.h"
 #include "gui/udp_transport.h"
+#include "gui/video.h"
 #include "debugger/debugger.h"
+#include "debugger/farm.h"
 #include "common/utils.h"
 
 /* Data structures and types. */
 
-/* Internal structure for the palos simulator. */
-struct palos {
+/* The options of the palos simulator (given in the command line).
+ * The filenames are NULL when not given.
+ */
+struct palos_options {
+    enum system_type sys_type;    /* The system type. */
+    enum sim_engine engine;       /* The execution engine. */
+    int idle_skip;                /* To skip the idle loops of the
+                                   * emulator task.
+                                   */
+    int fast_nova;                /* To execute the common Nova
+                                   * instructions directly.
+                                   */
+    int use_debugger;             /* To use the debugger. */
+    int headless;                 /* To run without a window. */
+    double speed;                 /* The multiple of the real time (zero
+                                   * to run unthrottled, or negative
+                                   * for the default).
+                                   */
+    uint16_t address;             /* The ethernet address. */
+
     const char *const_filename;   /* The name of the constant rom. */
     const char *mcode_filename;   /* The name of the microcode rom. */
     const char *binary_filename;  /* The name of the binary code file. */
     const char *disk1_filename;   /* Disk 1 image file. */
     const char *disk2_filename;   /* Disk 2 image file. */
+    const char *script_filename;  /* The script to run instead of the
+                                   * user interface.
+                                   */
+    const char *farm_filename;    /* The instances to run in parallel. */
+    unsigned int num_jobs;        /* The threads of the farm (zero for
+                                   * all cores).
+                                   */
+    const char *dump_filename;    /* The file to dump the display to
+                                   * at the end (when headless).
+                                   */
+    unsigned int dump_interval;   /* Frames between the dumps (or zero
+                                   * to only dump at the end).
+                                   */
+    const char *ckpt_filename;    /* The file for the checkpoints. */
+    unsigned int ckpt_interval;   /* Seconds between checkpoints. */
+    const char *resume_filename;  /* The checkpoints to resume from. */
+    const char *record_filename;  /* The journal to record. */
+    const char *replay_filename;  /* The journal to replay. */
+    const char *fprint_filename;  /* The file for the fingerprints. */
+    uint32_t fprint_interval;     /* Cycles between fingerprints. */
+    const char *video_filename;   /* The file for the video. */
+    const char *video_prefix;     /* The prefix of the images to convert
+                                   * the video to.
+                                   */
+};
+
+/* Internal structure for the palos simulator. */
+struct palos {
+    struct palos_options opts;    /* The options. */
 
     struct gui ui;                /* The user input. */
     struct udp_transport utrp;    /* The UDP transport. */
     struct simulator sim;         /* The simulator. */
     struct debugger dbg;          /* The debugger. */
+    struct journal jn;            /* The journal of the inputs. */
+    struct fingerprint fpr;       /* The fingerprints of the state. */
+    struct video vid;             /* The video of the display. */
 };
 
 /* Functions. */
@@ -41,6 +96,9 @@ void palos_initvar(struct palos *ps)
     udp_transport_initvar(&ps->utrp);
     simulator_initvar(&ps->sim);
     debugger_initvar(&ps->dbg);
+    journal_initvar(&ps->jn);
+    fingerprint_initvar(&ps->fpr);
+    video_initvar(&ps->vid);
 }
 
 /* Destroys the palos object
@@ -50,70 +108,98 @@ void palos_initvar(struct palos *ps)
 static
 void palos_destroy(struct palos *ps)
 {
+    journal_destroy(&ps->jn);
+    debugger_destroy(&ps->dbg);
+    fingerprint_destroy(&ps->fpr);
+    video_destroy(&ps->vid);
     gui_destroy(&ps->ui);
     udp_transport_destroy(&ps->utrp);
     simulator_destroy(&ps->sim);
-    debugger_destroy(&ps->dbg);
 }
 
-/* Creates a new palos object.
+/* Creates a new palos object, with the options `opts` (see
+ * struct palos_options).
  * This obeys the initvar / destroy / create protocol.
- * The `sys_type` variable specifies the system type.
- * The `use_debugger` specifies whether or not to use the debugger.
- * The name of the several filenames to load related to the constant rom,
- * microcode rom, binary file, and disk images are given by the parameters:
- * `const_filename`, `mcode_filename`, `binary_filename`, `disk1_filename`,
- * and `disk2_filename`, respectively.
  * Returns TRUE on success.
  */
 static
-int palos_create(struct palos *ps,
-                 enum system_type sys_type,
-                 int use_debugger,
-                 const char *const_filename,
-                 const char *mcode_filename,
-                 const char *binary_filename,
-                 const char *disk1_filename,
-                 const char *disk2_filename,
-                 uint16_t address)
+int palos_create(struct palos *ps, const struct palos_options *opts)
 {
     palos_initvar(ps);
 
-    if (unlikely(!simulator_create(&ps->sim, sys_type))) {
+    if (unlikely(!simulator_create(&ps->sim, opts->sys_type,
+                                   opts->engine))) {
         report_error("palos: create: could not create simulator");
         palos_destroy(ps);
         return FALSE;
     }
 
-    if (unlikely(!gui_create(&ps->ui, &ps->sim,
+    if (opts->idle_skip) {
+        if (unlikely(!simulator_set_idle_skip(&ps->sim, TRUE))) {
+            report_error("palos: create: could not enable idle skip");
+            palos_destroy(ps);
+            return FALSE;
+        }
+    }
+    simulator_set_nova_fast_path(&ps->sim, opts->fast_nova);
+
+    if (unlikely(!gui_create(&ps->ui, &ps->sim, opts->headless,
                              &debugger_debug, &ps->dbg))) {
         report_error("palos: create: could not create user interface");
         palos_destroy(ps);
         return FALSE;
     }
 
+    if (opts->dump_filename) {
+        if (unlikely(!gui_set_frame_dump(&ps->ui, opts->dump_filename,
+                                         opts->dump_interval))) {
+            report_error("palos: create: could not set frame dump");
+            palos_destroy(ps);
+            return FALSE;
+        }
+    }
+
     if (unlikely(!udp_transport_create(&ps->utrp))) {
         report_error("palos: create: could not create UDP transport");
         palos_destroy(ps);
         return FALSE;
     }
 
-    if (unlikely(!debugger_create(&ps->dbg, use_debugger,
+    if (unlikely(!journal_create(&ps->jn))) {
+        report_error("palos: create: could not create journal");
+        palos_destroy(ps);
+        return FALSE;
+    }
+
+    if (unlikely(!fingerprint_create(&ps->fpr))) {
+        report_error("palos: create: could not create fingerprint");
+        palos_destroy(ps);
+        return FALSE;
+    }
+
+    if (unlikely(!video_create(&ps->vid))) {
+        report_error("palos: create: could not create video");
+        palos_destroy(ps);
+        return FALSE;
+    }
+
+    if (unlikely(!debugger_create(&ps->dbg, opts->use_debugger,
                                   &ps->sim, &ps->ui))) {
         report_error("palos: create: could not create debugger");
         palos_destroy(ps);
         return FALSE;
     }
 
-    ethernet_set_transport(&ps->sim.ether, &ps->utrp.trp);
-    ethernet_set_address(&ps->sim.ether, address);
+    if (unlikely(!debugger_set_speed(&ps->dbg, opts->speed))) {
+        report_error("palos: create: could not set speed");
+        palos_destroy(ps);
+        return FALSE;
+    }
 
-    ps->const_filename = const_filename;
-    ps->mcode_filename = mcode_filename;
-    ps->binary_filename = binary_filename;
-    ps->disk1_filename = disk1_filename;
-    ps->disk2_filename = disk2_filename;
+    ethernet_set_transport(&ps->sim.ether, &ps->utrp.trp);
+    ethernet_set_address(&ps->sim.ether, opts->address);
 
+    ps->opts = *opts;
     return TRUE;
 }
 
@@ -125,7 +211,7 @@ int palos_run(struct palos *ps)
 {
     const char *fn;
 
-    fn = ps->const_filename;
+    fn = ps->opts.const_filename;
     if (fn) {
         if (unlikely(!simulator_load_constant_rom(&ps->sim, fn))) {
             report_error("palos: run: could not load constant rom");
@@ -133,7 +219,7 @@ int palos_run(struct palos *ps)
         }
     }
 
-    fn = ps->mcode_filename;
+    fn = ps->opts.mcode_filename;
     if (fn) {
         if (unlikely(!simulator_load_microcode_rom(&ps->sim, fn, 0))) {
             report_error("palos: run: could not load microcode rom");
@@ -141,7 +227,7 @@ int palos_run(struct palos *ps)
         }
     }
 
-    fn = ps->binary_filename;
+    fn = ps->opts.binary_filename;
     if (fn) {
         if (unlikely(!debugger_load_binary(&ps->dbg, fn, 0))) {
             report_error("palos: run: could not load binary file");
@@ -149,7 +235,7 @@ int palos_run(struct palos *ps)
         }
     }
 
-    fn = ps->disk1_filename;
+    fn = ps->opts.disk1_filename;
     if (fn) {
         if (unlikely(!disk_load_image(&ps->sim.dsk, 0, fn))) {
             report_error("palos: run: could not load disk 1");
@@ -157,7 +243,7 @@ int palos_run(struct palos *ps)
         }
     }
 
-    fn = ps->disk2_filename;
+    fn = ps->opts.disk2_filename;
     if (fn) {
         if (unlikely(!disk_load_image(&ps->sim.dsk, 1, fn))) {
             report_error("palos: run: could not load disk 2");
@@ -167,14 +253,119 @@ int palos_run(struct palos *ps)
 
     simulator_reset(&ps->sim);
 
-    if (unlikely(!gui_start(&ps->ui))) {
-        report_error("palos: run: could not start user interface");
+    fn = ps->opts.resume_filename;
+    if (fn) {
+        if (unlikely(!checkpoint_load(&ps->sim, fn, 0, NULL))) {
+            report_error("palos: run: could not resume from checkpoints");
+            return FALSE;
+        }
+    }
+
+    fn = ps->opts.ckpt_filename;
+    if (fn) {
+        if (unlikely(!debugger_set_checkpoints(&ps->dbg, fn,
+                                               ps->opts.ckpt_interval))) {
+            report_error("palos: run: could not start checkpoints");
+            return FALSE;
+        }
+    }
+
+    fn = ps->opts.record_filename;
+    if (fn) {
+        if (unlikely(!journal_record(&ps->jn, &ps->sim, fn))) {
+            report_error("palos: run: could not record journal");
+            return FALSE;
+        }
+    }
+
+    fn = ps->opts.replay_filename;
+    if (fn) {
+        if (unlikely(!journal_replay(&ps->jn, &ps->sim, fn))) {
+            report_error("palos: run: could not replay journal");
+            return FALSE;
+        }
+    }
+
+    fn = ps->opts.fprint_filename;
+    if (fn) {
+        if (unlikely(!fingerprint_start(&ps->fpr, &ps->sim, fn,
+                                        ps->opts.fprint_interval))) {
+            report_error("palos: run: could not start fingerprints");
+            return FALSE;
+        }
+    }
+
+    fn = ps->opts.video_filename;
+    if (fn) {
+        if (unlikely(!video_open(&ps->vid, fn))) {
+            report_error("palos: run: could not record video");
+            return FALSE;
+        }
+        gui_set_video(&ps->ui, &ps->vid);
+    }
+
+    fn = ps->opts.script_filename;
+    if (fn) {
+        if (unlikely(!debugger_run_script(&ps->dbg, fn))) {
+            report_error("palos: run: script failed");
+            return FALSE;
+        }
+    } else {
+        if (unlikely(!gui_start(&ps->ui))) {
+            report_error("palos: run: could not start user interface");
+            return FALSE;
+        }
+    }
+
+    if (unlikely(!journal_close(&ps->jn))) {
+        report_error("palos: run: could not close journal");
+        return FALSE;
+    }
+
+    if (unlikely(!fingerprint_stop(&ps->fpr))) {
+        report_error("palos: run: could not stop fingerprints");
+        return FALSE;
+    }
+
+    gui_set_video(&ps->ui, NULL);
+    if (unlikely(!video_close(&ps->vid))) {
+        report_error("palos: run: could not close video");
         return FALSE;
     }
 
     return TRUE;
 }
 
+/* Runs the simulator instances listed in the file of the farm (see
+ * struct palos_options) in parallel, with the options `opts`.
+ * Returns the exit code for main().
+ */
+static
+int run_farm(const struct palos_options *opts)
+{
+    struct farm fm;
+    int ret;
+
+    if (unlikely(!farm_create(&fm, opts->sys_type, opts->engine,
+                              opts->idle_skip, opts->fast_nova,
+                              opts->const_filename,
+                              opts->mcode_filename))) {
+        report_error("main: could not create farm");
+        return 1;
+    }
+
+    ret = 0;
+    if (unlikely(!farm_load(&fm, opts->farm_filename))) {
+        report_error("main: could not load farm file");
+        ret = 1;
+    } else if (!farm_run(&fm, opts->num_jobs)) {
+        ret = 1;
+    }
+
+    farm_destroy(&fm);
+    return ret;
+}
+
 /* Print the program usage information. */
 static
 void usage(const char *prog_name)
@@ -192,32 +383,76 @@ void usage(const char *prog_name)
     printf("  -ii_2krom     Set system type to Alto II (2K rom)\n");
     printf("  -ii_3kram     Set system type to Alto II (3K ram)\n");
     printf("  -e addr       Set the ethernet address\n");
+    printf("  -engine name  Set the execution engine (interpreter,\n");
+    printf("                threaded, or differential)\n");
+    printf("  -idle         Skip the idle loops of the emulator\n");
+    printf("  -fast_nova    Execute the common Nova instructions "
+           "directly\n");
     printf("  -debug        To use the debugger\n");
+    printf("  -headless     Run without a window\n");
+    printf("  -script file  Run the script (implies -headless)\n");
+    printf("  -farm file    Run the instances listed in file in "
+           "parallel\n");
+    printf("  -jobs n       Number of threads for -farm (default: "
+           "all cores)\n");
+    printf("  -speed n      Run at n times the real time, or "
+           "unthrottled if n is 0\n");
+    printf("                (default: 1, or 0 when headless)\n");
+    printf("  -dump file    Save the display to file (PGM) at exit\n");
+    printf("  -dump_every n Also save the display every n frames\n");
+    printf("  -checkpoint file\n");
+    printf("                Save incremental checkpoints to file\n");
+    printf("  -checkpoint_every secs\n");
+    printf("                Seconds between checkpoints (default: 5)\n");
+    printf("  -resume file  Restore the state from the checkpoints\n");
+    printf("  -record file  Record the inputs to the journal file\n");
+    printf("  -replay file  Replay the inputs from the journal file\n");
+    printf("  -fingerprint file\n");
+    printf("                Write fingerprints of the state to file\n");
+    printf("  -fingerprint_every n\n");
+    printf("                Cycles between fingerprints "
+           "(default: 1000000)\n");
+    printf("  -video file   Record the display to the video file\n");
+    printf("  -video_pgm file prefix\n");
+    printf("                Convert the video file to images (PGM) "
+           "named prefix.N\n");
     printf("  --help        Print this help\n");
 }
 
 int main(int argc, char **argv)
 {
-    const char *const_filename;
-    const char *mcode_filename;
-    const char *binary_filename;
-    const char *disk1_filename;
-    const char *disk2_filename;
-    enum system_type sys_type;
+    struct palos_options opts;
     struct palos ps;
     int i, is_last;
-    uint16_t address;
-    int use_debugger;
 
     palos_initvar(&ps);
-    const_filename = NULL;
-    mcode_filename = NULL;
-    binary_filename = NULL;
-    disk1_filename = NULL;
-    disk2_filename = NULL;
-    sys_type = ALTO_II_3KRAM;
-    address = 100;
-    use_debugger = FALSE;
+    opts.sys_type = ALTO_II_3KRAM;
+    opts.engine = ENGINE_INTERPRETER;
+    opts.idle_skip = FALSE;
+    opts.fast_nova = FALSE;
+    opts.use_debugger = FALSE;
+    opts.headless = FALSE;
+    opts.speed = -1;
+    opts.address = 100;
+    opts.const_filename = NULL;
+    opts.mcode_filename = NULL;
+    opts.binary_filename = NULL;
+    opts.disk1_filename = NULL;
+    opts.disk2_filename = NULL;
+    opts.script_filename = NULL;
+    opts.farm_filename = NULL;
+    opts.num_jobs = 0;
+    opts.dump_filename = NULL;
+    opts.dump_interval = 0;
+    opts.ckpt_filename = NULL;
+    opts.ckpt_interval = 5;
+    opts.resume_filename = NULL;
+    opts.record_filename = NULL;
+    opts.replay_filename = NULL;
+    opts.fprint_filename = NULL;
+    opts.fprint_interval = 1000000;
+    opts.video_filename = NULL;
+    opts.video_prefix = NULL;
 
     for (i = 1; i < argc; i++) {
         is_last = (i + 1 == argc);
@@ -226,52 +461,194 @@ int main(int argc, char **argv)
                 report_error("main: please specify the constant rom file");
                 return 1;
             }
-            const_filename = argv[++i];
+            opts.const_filename = argv[++i];
         } else if (strcmp("-m", argv[i]) == 0) {
             if (is_last) {
                 report_error("main: please specify the microcode rom file");
                 return 1;
             }
-            mcode_filename = argv[++i];
+            opts.mcode_filename = argv[++i];
         } else if (strcmp("-b", argv[i]) == 0) {
             if (is_last) {
                 report_error("main: please specify the binary code file");
                 return 1;
             }
-            binary_filename = argv[++i];
+            opts.binary_filename = argv[++i];
         } else if (strcmp("-1", argv[i]) == 0) {
             if (is_last) {
                 report_error("main: please specify the disk 1 file");
                 return 1;
             }
-            disk1_filename = argv[++i];
+            opts.disk1_filename = argv[++i];
         } else if (strcmp("-2", argv[i]) == 0) {
             if (is_last) {
                 report_error("main: please specify the disk 2 file");
                 return 1;
             }
-            disk2_filename = argv[++i];
+            opts.disk2_filename = argv[++i];
         } else if (strcmp("-i", argv[i]) == 0) {
-            sys_type = ALTO_I;
+            opts.sys_type = ALTO_I;
         } else if (strcmp("-ii_1krom", argv[i]) == 0) {
-            sys_type = ALTO_II_1KROM;
+            opts.sys_type = ALTO_II_1KROM;
         } else if (strcmp("-ii_2krom", argv[i]) == 0) {
-            sys_type = ALTO_II_2KROM;
+            opts.sys_type = ALTO_II_2KROM;
         } else if (strcmp("-ii_3kram", argv[i]) == 0) {
-            sys_type = ALTO_II_3KRAM;
+            opts.sys_type = ALTO_II_3KRAM;
         } else if (strcmp("-e", argv[i]) == 0) {
             char *endptr;
             if (is_last) {
                 report_error("main: please specify the ethernet address");
                 return 1;
             }
-            address = strtoul(argv[++i], &endptr, 10);
+            opts.address = strtoul(argv[++i], &endptr, 10);
             if (endptr[0] != '\0') {
                 report_error("main: invalid address `%s`", argv[i]);
                 return 1;
             }
+        } else if (strcmp("-engine", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the engine");
+                return 1;
+            }
+            i++;
+            if (strcmp("interpreter", argv[i]) == 0) {
+                opts.engine = ENGINE_INTERPRETER;
+            } else if (strcmp("threaded", argv[i]) == 0) {
+                opts.engine = ENGINE_THREADED;
+            } else if (strcmp("differential", argv[i]) == 0) {
+                opts.engine = ENGINE_DIFFERENTIAL;
+            } else {
+                report_error("main: invalid engine `%s`", argv[i]);
+                return 1;
+            }
+        } else if (strcmp("-idle", argv[i]) == 0) {
+            opts.idle_skip = TRUE;
+        } else if (strcmp("-fast_nova", argv[i]) == 0) {
+            opts.fast_nova = TRUE;
         } else if (strcmp("-debug", argv[i]) == 0) {
-            use_debugger = TRUE;
+            opts.use_debugger = TRUE;
+        } else if (strcmp("-headless", argv[i]) == 0) {
+            opts.headless = TRUE;
+        } else if (strcmp("-script", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the script file");
+                return 1;
+            }
+            opts.script_filename = argv[++i];
+            opts.headless = TRUE;
+        } else if (strcmp("-farm", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the farm file");
+                return 1;
+            }
+            opts.farm_filename = argv[++i];
+        } else if (strcmp("-jobs", argv[i]) == 0) {
+            char *endptr;
+            if (is_last) {
+                report_error("main: please specify the number of jobs");
+                return 1;
+            }
+            opts.num_jobs = strtoul(argv[++i], &endptr, 10);
+            if (endptr[0] != '\0') {
+                report_error("main: invalid number of jobs `%s`", argv[i]);
+                return 1;
+            }
+        } else if (strcmp("-speed", argv[i]) == 0) {
+            char *endptr;
+            if (is_last) {
+                report_error("main: please specify the speed");
+                return 1;
+            }
+            opts.speed = strtod(argv[++i], &endptr);
+            if (endptr[0] != '\0' || endptr == argv[i] || opts.speed < 0) {
+                report_error("main: invalid speed `%s`", argv[i]);
+                return 1;
+            }
+        } else if (strcmp("-dump", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the dump file");
+                return 1;
+            }
+            opts.dump_filename = argv[++i];
+        } else if (strcmp("-dump_every", argv[i]) == 0) {
+            char *endptr;
+            if (is_last) {
+                report_error("main: please specify the dump interval");
+                return 1;
+            }
+            opts.dump_interval = strtoul(argv[++i], &endptr, 10);
+            if (endptr[0] != '\0') {
+                report_error("main: invalid interval `%s`", argv[i]);
+                return 1;
+            }
+        } else if (strcmp("-checkpoint", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the checkpoint file");
+                return 1;
+            }
+            opts.ckpt_filename = argv[++i];
+        } else if (strcmp("-checkpoint_every", argv[i]) == 0) {
+            char *endptr;
+            if (is_last) {
+                report_error("main: please specify the checkpoint "
+                             "interval");
+                return 1;
+            }
+            opts.ckpt_interval = strtoul(argv[++i], &endptr, 10);
+            if (endptr[0] != '\0' || opts.ckpt_interval == 0) {
+                report_error("main: invalid interval `%s`", argv[i]);
+                return 1;
+            }
+        } else if (strcmp("-resume", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the checkpoint file");
+                return 1;
+            }
+            opts.resume_filename = argv[++i];
+        } else if (strcmp("-record", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the journal file");
+                return 1;
+            }
+            opts.record_filename = argv[++i];
+        } else if (strcmp("-replay", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the journal file");
+                return 1;
+            }
+            opts.replay_filename = argv[++i];
+        } else if (strcmp("-fingerprint", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the fingerprint file");
+                return 1;
+            }
+            opts.fprint_filename = argv[++i];
+        } else if (strcmp("-fingerprint_every", argv[i]) == 0) {
+            char *endptr;
+            if (is_last) {
+                report_error("main: please specify the fingerprint "
+                             "interval");
+                return 1;
+            }
+            opts.fprint_interval = strtoul(argv[++i], &endptr, 10);
+            if (endptr[0] != '\0' || opts.fprint_interval == 0) {
+                report_error("main: invalid interval `%s`", argv[i]);
+                return 1;
+            }
+        } else if (strcmp("-video", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the video file");
+                return 1;
+            }
+            opts.video_filename = argv[++i];
+        } else if (strcmp("-video_pgm", argv[i]) == 0) {
+            if (i + 2 >= argc) {
+                report_error("main: please specify the video file "
+                             "and the prefix of the images");
+                return 1;
+            }
+            opts.video_filename = argv[++i];
+            opts.video_prefix = argv[++i];
         } else if (strcmp("--help", argv[i]) == 0
                    || strcmp("-h", argv[i]) == 0) {
             usage(argv[0]);
@@ -281,14 +658,49 @@ int main(int argc, char **argv)
                 report_error("main: invalid disk1 filename `%s`", argv[i]);
                 return 1;
             }
-            disk1_filename = argv[i];
+            opts.disk1_filename = argv[i];
         }
     }
 
-    if (unlikely(!palos_create(&ps, sys_type, use_debugger,
-                               const_filename, mcode_filename,
-                               binary_filename, disk1_filename,
-                               disk2_filename, address))) {
+    if (opts.video_prefix) {
+        return video_convert(opts.video_filename, opts.video_prefix) ? 0 : 1;
+    }
+
+    if (opts.farm_filename) {
+        /* The scripts of the instances always run unthrottled. */
+        if (opts.speed >= 0) {
+            report_error("main: -speed is not available with -farm");
+            return 1;
+        }
+        return run_farm(&opts);
+    }
+
+    if (opts.record_filename && opts.replay_filename) {
+        report_error("main: -record and -replay are exclusive");
+        return 1;
+    }
+
+    if (opts.video_filename && opts.script_filename) {
+        report_error("main: -video is not available with -script");
+        return 1;
+    }
+
+    if (opts.dump_filename && !opts.headless) {
+        report_error("main: -dump requires -headless");
+        return 1;
+    }
+
+    if (opts.dump_interval != 0 && !opts.dump_filename) {
+        report_error("main: -dump_every requires -dump");
+        return 1;
+    }
+
+    /* By default, only the window runs in real time. */
+    if (opts.speed < 0) {
+        opts.speed = (opts.headless) ? 0 : 1;
+    }
+
+    if (unlikely(!palos_create(&ps, &opts))) {
         report_error("main: could not create palos object");
         return 1;
     }
@@ -0,0 +1,742 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL.h>
+
+#include "assembler/assembler.h"
+#include "fs/fs.h"
+#include "parser/parser.h"
+#include "simulator/simulator.h"
+#include "simulator/disk.h"
+#include "simulator/display.h"
+#include "simulator/intr.h"
+#include "microcode/microcode.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define DEFAULT_REPEATS                    5
+#define DEFAULT_SIM_CYCLES          20000000
+#define MAX_RUN_CYCLES             0x1000000 /* Cycles per simulator_run(). */
+#define DISPLAY_FIELDS                   300
+#define DISK_SECTORS                   20000
+#define FS_LOADS                          10
+#define FS_CHECKS                        100
+#define ASSEMBLER_RUNS                   100
+
+/* The options of the simulator benchmarks. */
+#define SIM_RUN                            1 /* Use simulator_run(). */
+#define SIM_IDLE_SKIP                      2 /* Skip the idle loops. */
+#define SIM_NOVA_FAST_PATH                 4 /* Use the Nova fast path. */
+
+/* The generated microcode source and disk pack. */
+#define SOURCE_CONSTANTS                 200
+#define SOURCE_INSTRUCTIONS             1000
+#define PACK_FILES                        64
+
+/* Data structures and types. */
+
+/* The inputs of the benchmarks. */
+struct bench {
+    const char *disk_filename;    /* The disk booted by the simulator
+                                   * benchmarks.
+                                   */
+    const char *pack_filename;    /* The disk pack of the fs and disk
+                                   * benchmarks.
+                                   */
+    const char *source_filename;  /* The microcode source of the
+                                   * assembler benchmark.
+                                   */
+    uint64_t sim_cycles;          /* Cycles of the simulator benchmarks. */
+};
+
+/* Runs one iteration of a benchmark. The amount of work done is
+ * returned in `work` and the time it took (excluding the setup) in
+ * `seconds`.
+ * Returns TRUE on success.
+ */
+typedef int (*bench_func)(const struct bench *b, uint64_t *work,
+                          double *seconds);
+
+/* Functions. */
+
+/* Returns the current time in seconds (for measuring intervals). */
+static
+double now(void)
+{
+    return ((double) SDL_GetPerformanceCounter())
+        / ((double) SDL_GetPerformanceFrequency());
+}
+
+/* Returns the geometry of a Diablo 31 disk pack. */
+static
+struct geometry pack_geometry(void)
+{
+    struct geometry dg;
+
+    dg.num_disks = 1;
+    dg.num_cylinders = 203;
+    dg.num_heads = 2;
+    dg.num_sectors = 12;
+    dg.sector_words = 256;
+    return dg;
+}
+
+/* Writes a microcode source with many constants and instructions to
+ * the file named `filename`. Only the syntax that does not depend on
+ * the definitions of the Alto microcode is used.
+ * Returns TRUE on success.
+ */
+static
+int write_source(const char *filename)
+{
+    unsigned int i;
+    FILE *fp;
+
+    fp = fopen(filename, "w");
+    if (unlikely(!fp)) {
+        report_error("main: write_source: could not open `%s` "
+                     "for writing", filename);
+        return FALSE;
+    }
+
+    fprintf(fp, "!1,1,L0;\n");
+    for (i = 0; i < SOURCE_CONSTANTS; i++) {
+        fprintf(fp, "$C%u $%o;\n", i, (i * 037) & 0xFFFF);
+    }
+    fprintf(fp, "!1,2,A0,B0;\n");
+    for (i = 0; i < SOURCE_INSTRUCTIONS; i++) {
+        fprintf(fp, "L%u: :L%u;\n", i, (i + 1) % SOURCE_INSTRUCTIONS);
+    }
+    fprintf(fp, "X: :A0;\nA0: :B0;\nB0: :L0;\n");
+
+    if (unlikely(fclose(fp) != 0)) {
+        report_error("main: write_source: error while writing `%s`",
+                     filename);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Writes a freshly formatted disk pack with PACK_FILES copies of the
+ * file named `source_filename` to the file named `filename`.
+ * Returns TRUE on success.
+ */
+static
+int write_pack(const char *filename, const char *source_filename)
+{
+    struct fs fs;
+    char name[NAME_LENGTH];
+    unsigned int i;
+    int error;
+
+    fs_initvar(&fs);
+    if (unlikely(!fs_create(&fs, pack_geometry()))) {
+        report_error("main: write_pack: could not create disk");
+        goto error;
+    }
+
+    fs_wipe_disk(&fs);
+    if (unlikely(!fs_format(&fs, &error))) {
+        report_error("main: write_pack: could not format: %s",
+                     fs_error(error));
+        goto error;
+    }
+
+    /* The freshly formatted disk is consistent, and the integrity
+     * check below needs the disk descriptor (written at the end).
+     */
+    fs.checked = TRUE;
+    for (i = 0; i < PACK_FILES; i++) {
+        snprintf(name, sizeof(name), "Bench%u.mu.", i);
+        if (unlikely(!fs_insert_file(&fs, source_filename, name))) {
+            report_error("main: write_pack: could not insert `%s`", name);
+            goto error;
+        }
+    }
+
+    if (unlikely(!fs_update_disk_descriptor(&fs, &error))) {
+        report_error("main: write_pack: could not update disk "
+                     "descriptor: %s", fs_error(error));
+        goto error;
+    }
+
+    if (unlikely(!fs_check_integrity(&fs))) {
+        report_error("main: write_pack: invalid disk");
+        goto error;
+    }
+
+    if (unlikely(!fs_save_image(&fs, filename, 0, FALSE))) {
+        report_error("main: write_pack: could not save disk image");
+        goto error;
+    }
+
+    fs_destroy(&fs);
+    return TRUE;
+
+error:
+    fs_destroy(&fs);
+    return FALSE;
+}
+
+/* Common part of the simulator benchmarks: runs the boot workload
+ * (from a reset) for `b->sim_cycles` cycles, using the engine
+ * `engine`. The `options` (SIM_RUN, ...) select between running step
+ * by step or with simulator_run(), and the optimizations enabled.
+ * Returns TRUE on success.
+ */
+static
+int bench_simulator(const struct bench *b, enum sim_engine engine,
+                    unsigned int options, uint64_t *work, double *seconds)
+{
+    struct simulator sim;
+    uint64_t cycles;
+    uint32_t num_cycles;
+    int32_t prev_cycle;
+    double start;
+
+    simulator_initvar(&sim);
+    if (unlikely(!simulator_create(&sim, ALTO_II_3KRAM, engine))) {
+        report_error("main: bench_simulator: could not create simulator");
+        goto error;
+    }
+
+    if (unlikely(!disk_load_image(&sim.dsk, 0, b->disk_filename))) {
+        report_error("main: bench_simulator: could not load disk");
+        goto error;
+    }
+    simulator_reset(&sim);
+
+    if (options & SIM_IDLE_SKIP) {
+        if (unlikely(!simulator_set_idle_skip(&sim, TRUE)))
+            goto error;
+    }
+    if (options & SIM_NOVA_FAST_PATH)
+        simulator_set_nova_fast_path(&sim, TRUE);
+
+    cycles = 0;
+    start = now();
+    if (options & SIM_RUN) {
+        while (cycles < b->sim_cycles) {
+            num_cycles = (uint32_t) MIN(b->sim_cycles - cycles,
+                                        (uint64_t) MAX_RUN_CYCLES);
+            prev_cycle = sim.cycle;
+            if (unlikely(simulator_run(&sim, num_cycles, 0) == RUN_ERROR))
+                break;
+            cycles += (uint64_t) INTR_CYCLE(sim.cycle - prev_cycle);
+        }
+    } else {
+        while (cycles < b->sim_cycles) {
+            prev_cycle = sim.cycle;
+            simulator_step(&sim);
+            if (unlikely(sim.error)) break;
+            cycles += (uint64_t) INTR_CYCLE(sim.cycle - prev_cycle);
+        }
+    }
+    *seconds = now() - start;
+    *work = cycles;
+
+    if (unlikely(sim.error)) {
+        report_error("main: bench_simulator: simulation error");
+        goto error;
+    }
+
+    simulator_destroy(&sim);
+    return TRUE;
+
+error:
+    simulator_destroy(&sim);
+    return FALSE;
+}
+
+/* Benchmarks simulator_step() with the interpreter. */
+static
+int bench_sim_step(const struct bench *b, uint64_t *work, double *seconds)
+{
+    return bench_simulator(b, ENGINE_INTERPRETER, 0, work, seconds);
+}
+
+/* Benchmarks simulator_run() with the interpreter. */
+static
+int bench_sim_run(const struct bench *b, uint64_t *work, double *seconds)
+{
+    return bench_simulator(b, ENGINE_INTERPRETER, SIM_RUN, work, seconds);
+}
+
+/* Benchmarks simulator_run() with the threaded engine. */
+static
+int bench_sim_threaded(const struct bench *b, uint64_t *work,
+                       double *seconds)
+{
+    return bench_simulator(b, ENGINE_THREADED, SIM_RUN, work, seconds);
+}
+
+/* Benchmarks simulator_run() with the threaded engine, skipping the
+ * idle loops of the emulator task.
+ */
+static
+int bench_sim_idle(const struct bench *b, uint64_t *work, double *seconds)
+{
+    return bench_simulator(b, ENGINE_THREADED, SIM_RUN | SIM_IDLE_SKIP,
+                           work, seconds);
+}
+
+/* Benchmarks simulator_run() with the threaded engine, executing the
+ * common Nova instructions directly.
+ */
+static
+int bench_sim_nova_fast(const struct bench *b, uint64_t *work,
+                        double *seconds)
+{
+    return bench_simulator(b, ENGINE_THREADED, SIM_RUN | SIM_NOVA_FAST_PATH,
+                           work, seconds);
+}
+
+/* Benchmarks display_interrupt() by rendering DISPLAY_FIELDS fields.
+ * The display word task is played by the benchmark, which fills the
+ * FIFO with a pattern whenever the task is woken up.
+ */
+static
+int bench_display(const struct bench *b, uint64_t *work, double *seconds)
+{
+    struct scheduler sched;
+    struct display displ;
+    enum intr_event ev;
+    unsigned int fields;
+    uint64_t events;
+    uint16_t pattern;
+    int32_t cycle;
+    double start;
+
+    UNUSED(b);
+
+    scheduler_clear(&sched, 0);
+    display_initvar(&displ);
+    if (unlikely(!display_create(&displ, &sched))) {
+        report_error("main: bench_display: could not create display");
+        return FALSE;
+    }
+
+    fields = 0;
+    events = 0;
+    pattern = 0;
+    start = now();
+    while (fields < DISPLAY_FIELDS) {
+        cycle = sched.intr_cycle;
+        ev = scheduler_pop(&sched, cycle);
+        if (unlikely(!display_interrupt(&displ, ev, cycle)))
+            break;
+        events++;
+
+        while (displ.pending & (1 << TASK_DISPLAY_WORD)) {
+            if (unlikely(!display_load_ddr(&displ, pattern))) {
+                report_error("main: bench_display: could not load DDR");
+                display_destroy(&displ);
+                return FALSE;
+            }
+            pattern = (pattern << 1) | (1 & ~(pattern >> 15));
+        }
+
+        if (displ.pending & (1 << TASK_DISPLAY_VERTICAL))
+            fields++;
+        displ.pending &= (1 << TASK_DISPLAY_WORD);
+    }
+    *seconds = now() - start;
+    *work = events;
+
+    display_destroy(&displ);
+    return (fields == DISPLAY_FIELDS);
+}
+
+/* Benchmarks disk_interrupt() (mostly the sector and word events)
+ * by reading DISK_SECTORS sectors of the disk pack. The disk tasks
+ * are played by the benchmark, which only blocks them.
+ */
+static
+int bench_disk(const struct bench *b, uint64_t *work, double *seconds)
+{
+    struct scheduler sched;
+    struct disk dsk;
+    enum intr_event ev;
+    unsigned int sectors;
+    uint64_t events;
+    int32_t cycle;
+    double start;
+
+    scheduler_clear(&sched, 0);
+    disk_initvar(&dsk);
+    if (unlikely(!disk_create(&dsk, &sched))) {
+        report_error("main: bench_disk: could not create disk");
+        return FALSE;
+    }
+
+    if (unlikely(!disk_load_image(&dsk, 0, b->pack_filename))) {
+        disk_destroy(&dsk);
+        return FALSE;
+    }
+    disk_reset(&dsk);
+
+    sectors = 0;
+    events = 0;
+    start = now();
+    while (sectors < DISK_SECTORS) {
+        cycle = sched.intr_cycle;
+        ev = scheduler_pop(&sched, cycle);
+        if (unlikely(!disk_interrupt(&dsk, ev, cycle)))
+            break;
+        events++;
+
+        if (dsk.pending & (1 << TASK_DISK_SECTOR)) {
+            disk_on_switch_task(&dsk, TASK_DISK_SECTOR);
+            disk_block_task(&dsk, TASK_DISK_SECTOR);
+            sectors++;
+        }
+        if (dsk.pending & (1 << TASK_DISK_WORD))
+            disk_block_task(&dsk, TASK_DISK_WORD);
+    }
+    *seconds = now() - start;
+    *work = events;
+
+    disk_destroy(&dsk);
+    return (sectors == DISK_SECTORS);
+}
+
+/* Benchmarks fs_load_image() by loading the disk pack FS_LOADS
+ * times.
+ */
+static
+int bench_fs_load(const struct bench *b, uint64_t *work, double *seconds)
+{
+    struct fs fs;
+    unsigned int i;
+    double start;
+    int ret;
+
+    fs_initvar(&fs);
+    if (unlikely(!fs_create(&fs, pack_geometry()))) {
+        report_error("main: bench_fs_load: could not create disk");
+        return FALSE;
+    }
+
+    ret = TRUE;
+    start = now();
+    for (i = 0; i < FS_LOADS; i++) {
+        if (unlikely(!fs_load_image(&fs, b->pack_filename, 0, FALSE))) {
+            ret = FALSE;
+            break;
+        }
+    }
+    *seconds = now() - start;
+    *work = i;
+
+    fs_destroy(&fs);
+    return ret;
+}
+
+/* Benchmarks fs_check_integrity() by checking the disk pack
+ * FS_CHECKS times.
+ */
+static
+int bench_fs_check(const struct bench *b, uint64_t *work, double *seconds)
+{
+    struct fs fs;
+    unsigned int i;
+    double start;
+    int ret;
+
+    fs_initvar(&fs);
+    if (unlikely(!fs_create(&fs, pack_geometry()))) {
+        report_error("main: bench_fs_check: could not create disk");
+        return FALSE;
+    }
+
+    if (unlikely(!fs_load_image(&fs, b->pack_filename, 0, FALSE))) {
+        fs_destroy(&fs);
+        return FALSE;
+    }
+
+    ret = TRUE;
+    start = now();
+    for (i = 0; i < FS_CHECKS; i++) {
+        if (unlikely(!fs_check_integrity(&fs))) {
+            report_error("main: bench_fs_check: invalid disk");
+            ret = FALSE;
+            break;
+        }
+    }
+    *seconds = now() - start;
+    *work = i;
+
+    fs_destroy(&fs);
+    return ret;
+}
+
+/* Benchmarks the assembler (parsing, resolving and assembling) on
+ * the microcode source, ASSEMBLER_RUNS times.
+ */
+static
+int bench_assembler(const struct bench *b, uint64_t *work,
+                    double *seconds)
+{
+    struct assembler as;
+    unsigned int i;
+    double start;
+    int ret;
+
+    ret = TRUE;
+    *seconds = 0;
+    for (i = 0; i < ASSEMBLER_RUNS; i++) {
+        assembler_initvar(&as);
+        if (unlikely(!assembler_create(&as))) {
+            report_error("main: bench_assembler: "
+                         "could not create assembler");
+            ret = FALSE;
+            break;
+        }
+
+        start = now();
+        if (unlikely(parser_parse(&as.p, b->source_filename) == ERROR)) {
+            parser_report_errors(&as.p);
+            ret = FALSE;
+        } else if (unlikely(!assembler_resolve_constants(&as)
+                            || !assembler_resolve_labels(&as)
+                            || !assembler_assemble(&as))) {
+            ret = FALSE;
+        }
+        *seconds += now() - start;
+
+        assembler_destroy(&as);
+        if (unlikely(!ret)) {
+            report_error("main: bench_assembler: could not assemble");
+            break;
+        }
+    }
+    *work = i;
+    return ret;
+}
+
+/* Compares two times (for qsort()). */
+static
+int compare_seconds(const void *p1, const void *p2)
+{
+    double s1, s2;
+
+    s1 = *((const double *) p1);
+    s2 = *((const double *) p2);
+    if (s1 != s2) return (s1 < s2) ? -1 : 1;
+    return 0;
+}
+
+/* Runs the benchmark `func` named `name` `repeats` times, and writes
+ * one line of the report to `fp`. The work of the benchmark is
+ * measured in `unit`.
+ * Returns TRUE on success.
+ */
+static
+int run_benchmark(const struct bench *b, const char *name,
+                  const char *unit, bench_func func,
+                  unsigned int repeats, FILE *fp)
+{
+    double *times;
+    double median;
+    uint64_t work;
+    unsigned int i;
+
+    times = (double *) malloc(repeats * sizeof(double));
+    if (unlikely(!times)) {
+        report_error("main: run_benchmark: memory exhausted");
+        return FALSE;
+    }
+
+    for (i = 0; i < repeats; i++) {
+        if (unlikely(!func(b, &work, &times[i]))) {
+            report_error("main: run_benchmark: `%s` failed", name);
+            free((void *) times);
+            return FALSE;
+        }
+    }
+
+    qsort(times, repeats, sizeof(double), &compare_seconds);
+    median = times[repeats / 2];
+    fprintf(fp, "%-14s %-8s %-12llu %-10.6f %-10.6f %.1f\n",
+            name, unit, (unsigned long long) work,
+            times[0], median, (median > 0) ? work / median : 0.0);
+    fflush(fp);
+
+    free((void *) times);
+    return TRUE;
+}
+
+/* Prints the usage information to the console output. */
+static
+void usage(const char *prog_name)
+{
+    printf("Usage:\n");
+    printf(" %s [options]\n", prog_name);
+    printf("where:\n");
+    printf("  -1 disk       The disk booted by the simulator benchmarks "
+           "(required)\n");
+    printf("  -u source     The microcode source of the assembler "
+           "benchmark\n");
+    printf("  -o report     The output report file (default stdout)\n");
+    printf("  -t dir        Directory for the generated inputs "
+           "(default .)\n");
+    printf("  -c cycles     Cycles of the simulator benchmarks\n");
+    printf("  -r repeats    Number of repetitions (default %u)\n",
+           DEFAULT_REPEATS);
+    printf("  --help        Print this help\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *disk_filename;
+    const char *source_filename;
+    const char *report_filename;
+    const char *tmp_dir;
+    char gen_pack[1024];
+    char gen_source[1024];
+    struct bench b;
+    unsigned int repeats;
+    uint64_t sim_cycles;
+    char *end;
+    FILE *fp;
+    int i, is_last, ret;
+
+    disk_filename = NULL;
+    source_filename = NULL;
+    report_filename = NULL;
+    tmp_dir = ".";
+    repeats = DEFAULT_REPEATS;
+    sim_cycles = DEFAULT_SIM_CYCLES;
+
+    for (i = 1; i < argc; i++) {
+        is_last = (i + 1 == argc);
+        if (strcmp("-1", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the disk file");
+                return 1;
+            }
+            disk_filename = argv[++i];
+        } else if (strcmp("-u", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the microcode source");
+                return 1;
+            }
+            source_filename = argv[++i];
+        } else if (strcmp("-o", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the report file");
+                return 1;
+            }
+            report_filename = argv[++i];
+        } else if (strcmp("-t", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the directory");
+                return 1;
+            }
+            tmp_dir = argv[++i];
+        } else if (strcmp("-c", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the number of cycles");
+                return 1;
+            }
+            sim_cycles = strtoull(argv[++i], &end, 10);
+            if (end[0] != '\0' || sim_cycles == 0) {
+                report_error("main: invalid number of cycles `%s`",
+                             argv[i]);
+                return 1;
+            }
+        } else if (strcmp("-r", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the repetitions");
+                return 1;
+            }
+            repeats = (unsigned int) strtoul(argv[++i], &end, 10);
+            if (end[0] != '\0' || repeats == 0) {
+                report_error("main: invalid repetitions `%s`", argv[i]);
+                return 1;
+            }
+        } else if (strcmp("--help", argv[i]) == 0
+                   || strcmp("-h", argv[i]) == 0) {
+            usage(argv[0]);
+            return 0;
+        } else {
+            report_error("main: invalid argument `%s`", argv[i]);
+            return 1;
+        }
+    }
+
+    /* The simulator benchmarks boot from a disk, so that they
+     * exercise the disk and boot path of a fixed workload.
+     */
+    if (!disk_filename) {
+        report_error("main: please specify the disk to boot (-1)");
+        return 1;
+    }
+
+    /* The other inputs are generated (unless given), so that the
+     * results are reproducible.
+     */
+    snprintf(gen_source, sizeof(gen_source), "%s/bench_source.mu", tmp_dir);
+    snprintf(gen_pack, sizeof(gen_pack), "%s/bench_pack.dsk", tmp_dir);
+    if (unlikely(!write_source(gen_source)))
+        return 1;
+
+    b.disk_filename = disk_filename;
+    b.pack_filename = gen_pack;
+    b.source_filename = (source_filename) ? source_filename : gen_source;
+    b.sim_cycles = sim_cycles;
+    if (unlikely(!write_pack(gen_pack, gen_source))) {
+        remove(gen_source);
+        return 1;
+    }
+
+    fp = stdout;
+    if (report_filename) {
+        fp = fopen(report_filename, "w");
+        if (unlikely(!fp)) {
+            report_error("main: could not open `%s` for writing",
+                         report_filename);
+            ret = FALSE;
+            goto do_exit;
+        }
+    }
+
+    fprintf(fp, "# disk: %s\n", disk_filename);
+    fprintf(fp, "# pack: generated\n");
+    fprintf(fp, "# source: %s\n", (source_filename) ? source_filename
+            : "generated");
+    fprintf(fp, "# repeats: %u\n", repeats);
+    fprintf(fp, "# NAME UNIT WORK MIN_SECONDS MEDIAN_SECONDS "
+            "UNITS_PER_SECOND\n");
+
+    ret = run_benchmark(&b, "sim_step", "cycles",
+                        &bench_sim_step, repeats, fp)
+        && run_benchmark(&b, "sim_run", "cycles",
+                         &bench_sim_run, repeats, fp)
+        && run_benchmark(&b, "sim_threaded", "cycles",
+                         &bench_sim_threaded, repeats, fp)
+        && run_benchmark(&b, "sim_idle", "cycles",
+                         &bench_sim_idle, repeats, fp)
+        && run_benchmark(&b, "sim_nova_fast", "cycles",
+                         &bench_sim_nova_fast, repeats, fp)
+        && run_benchmark(&b, "display_intr", "events",
+                         &bench_display, repeats, fp)
+        && run_benchmark(&b, "disk_intr", "events",
+                         &bench_disk, repeats, fp)
+        && run_benchmark(&b, "fs_load_image", "loads",
+                         &bench_fs_load, repeats, fp)
+        && run_benchmark(&b, "fs_check", "checks",
+                         &bench_fs_check, repeats, fp)
+        && run_benchmark(&b, "assembler", "runs",
+                         &bench_assembler, repeats, fp);
+
+    if (report_filename) fclose(fp);
+
+do_exit:
+    remove(gen_source);
+    remove(gen_pack);
+    return (ret) ? 0 : 1;
+}
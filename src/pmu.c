@@ -5,9 +5,65 @@
 
 #include "assembler/assembler.h"
 #include "assembler/objfile.h"
+#include "microcode/microcode.h"
 #include "parser/parser.h"
 #include "common/utils.h"
 
+/* Loads the microcode profile saved by the debugger from the file
+ * named `filename`, to annotate the listing in `prof`. Only the
+ * addresses in the microcode bank `bank` are considered (summing over
+ * all tasks), and they are stored in `steps` and `cycles`, which have
+ * MICROCODE_SIZE entries each.
+ * Returns TRUE on success.
+ */
+static
+int load_profile(const char *filename, unsigned int bank,
+                 uint64_t *steps, uint64_t *cycles,
+                 struct listing_profile *prof)
+{
+    FILE *fp;
+    char line[256];
+    unsigned int task, address;
+    unsigned long long num_steps, num_cycles;
+    unsigned int line_num;
+
+    fp = fopen(filename, "r");
+    if (unlikely(!fp)) {
+        report_error("main: load_profile: could not open `%s`", filename);
+        return FALSE;
+    }
+
+    memset(steps, 0, MICROCODE_SIZE * sizeof(uint64_t));
+    memset(cycles, 0, MICROCODE_SIZE * sizeof(uint64_t));
+    prof->steps = steps;
+    prof->cycles = cycles;
+    prof->total_cycles = 0;
+
+    line_num = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_num++;
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        if (sscanf(line, "%o %o %llu %llu", &task, &address,
+                   &num_steps, &num_cycles) != 4
+            || task >= TASK_NUM_TASKS
+            || address >= NUM_MICROCODE_BANKS * MICROCODE_SIZE) {
+            report_error("main: load_profile: invalid line %u of `%s`",
+                         line_num, filename);
+            fclose(fp);
+            return FALSE;
+        }
+
+        prof->total_cycles += num_cycles;
+        if (address / MICROCODE_SIZE != bank) continue;
+        steps[address % MICROCODE_SIZE] += num_steps;
+        cycles[address % MICROCODE_SIZE] += num_cycles;
+    }
+
+    fclose(fp);
+    return TRUE;
+}
+
 static
 void usage(const char *prog_name)
 {
@@ -18,6 +74,8 @@ void usage(const char *prog_name)
     printf("  -o binary     Specify the output binary file\n");
     printf("  -c constant   Specify the constant rom file\n");
     printf("  -m microcode  Specify the microcode rom file\n");
+    printf("  -p profile    Annotate the listing with the profile\n");
+    printf("  -k bank       Microcode bank of the profile (default 0)\n");
     printf("  --help        Print this help\n");
 }
 
@@ -28,9 +86,16 @@ int main(int argc, char **argv)
     const char *binary_filename;
     const char *constant_filename;
     const char *microcode_filename;
+    const char *profile_filename;
     const char *fn;
     struct assembler as;
     struct objfile objf;
+    struct listing_profile prof;
+    const struct listing_profile *lprof;
+    uint64_t prof_steps[MICROCODE_SIZE];
+    uint64_t prof_cycles[MICROCODE_SIZE];
+    unsigned int bank;
+    char *end;
     int i, is_last;
 
     input_filename = NULL;
@@ -38,6 +103,9 @@ int main(int argc, char **argv)
     binary_filename = NULL;
     constant_filename = NULL;
     microcode_filename = NULL;
+    profile_filename = NULL;
+    lprof = NULL;
+    bank = 0;
 
     for (i = 1; i < argc; i++) {
         is_last = (i + 1 == argc);
@@ -65,6 +133,22 @@ int main(int argc, char **argv)
                 return 1;
             }
             microcode_filename = argv[++i];
+        } else if (strcmp("-p", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the profile file");
+                return 1;
+            }
+            profile_filename = argv[++i];
+        } else if (strcmp("-k", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the microcode bank");
+                return 1;
+            }
+            bank = (unsigned int) strtoul(argv[++i], &end, 10);
+            if (end[0] != '\0' || bank >= NUM_MICROCODE_BANKS) {
+                report_error("main: invalid microcode bank `%s`", argv[i]);
+                return 1;
+            }
         } else if (strcmp("--help", argv[i]) == 0
                    || strcmp("-h", argv[i]) == 0) {
             usage(argv[0]);
@@ -83,6 +167,11 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    if (profile_filename && !listing_filename) {
+        report_error("main: -p requires -l");
+        return 1;
+    }
+
     assembler_initvar(&as);
     objfile_initvar(&objf);
 
@@ -152,9 +241,19 @@ int main(int argc, char **argv)
         }
     }
 
+    fn = profile_filename;
+    if (fn) {
+        if (unlikely(!load_profile(fn, bank, prof_steps,
+                                   prof_cycles, &prof))) {
+            report_error("main: could not load profile");
+            goto error;
+        }
+        lprof = &prof;
+    }
+
     fn = listing_filename;
     if (fn) {
-        if (unlikely(!assembler_print_listing(&as, fn))) {
+        if (unlikely(!assembler_print_listing(&as, fn, lprof))) {
             report_error("main: could not write listing file");
             goto error;
         }
@@ -0,0 +1,324 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "simulator/checkpoint.h"
+#include "simulator/simulator.h"
+#include "simulator/disk.h"
+#include "microcode/microcode.h"
+#include "common/serdes.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define BUFFER_SIZE                    65536
+#define CHECKPOINT_MAGIC          0x50434B50 /* "PCKP" */
+#define HEADER_SIZE                        8
+
+/* The flags of a checkpoint. */
+#define CP_FULL                            1
+
+/* Functions. */
+
+void checkpoint_initvar(struct checkpoint *cp)
+{
+    serdes_initvar(&cp->sd);
+    cp->fp = NULL;
+}
+
+void checkpoint_destroy(struct checkpoint *cp)
+{
+    checkpoint_close(cp);
+    serdes_destroy(&cp->sd);
+}
+
+int checkpoint_create(struct checkpoint *cp)
+{
+    checkpoint_initvar(cp);
+
+    if (unlikely(!serdes_create(&cp->sd, BUFFER_SIZE, TRUE))) {
+        report_error("checkpoint: create: could not create serializer");
+        checkpoint_destroy(cp);
+        return FALSE;
+    }
+
+    cp->num_records = 0;
+    cp->sim = NULL;
+    cp->epoch = 0;
+    return TRUE;
+}
+
+int checkpoint_open(struct checkpoint *cp, const char *filename)
+{
+    checkpoint_close(cp);
+
+    cp->fp = fopen(filename, "wb");
+    if (unlikely(!cp->fp)) {
+        report_error("checkpoint: open: could not open `%s`", filename);
+        return FALSE;
+    }
+
+    /* The next checkpoint will contain the whole state. */
+    cp->num_records = 0;
+    cp->sim = NULL;
+    cp->epoch = 0;
+    return TRUE;
+}
+
+void checkpoint_close(struct checkpoint *cp)
+{
+    if (cp->fp) fclose(cp->fp);
+    cp->fp = NULL;
+}
+
+/* Serializes the disk drive `dd` to `sd`. Only the sectors modified
+ * after `epoch` are included, unless `full` is set.
+ */
+static
+void serialize_drive(const struct disk_drive *dd, struct serdes *sd,
+                     uint32_t epoch, int full)
+{
+    const struct disk_sector *ds;
+    uint16_t i, num_sectors;
+
+    serdes_put_bool(sd, dd->loaded);
+    if (!dd->loaded) return;
+
+    num_sectors = 0;
+    for (i = 0; i < dd->length; i++) {
+        if (full || dd->sector_epoch[i] > epoch) num_sectors++;
+    }
+
+    serdes_put16(sd, dd->length);
+    serdes_put16(sd, num_sectors);
+    for (i = 0; i < dd->length; i++) {
+        if (!full && dd->sector_epoch[i] <= epoch) continue;
+        ds = &dd->sectors[i];
+        serdes_put16(sd, i);
+        serdes_put16_array(sd, ds->header, DS_HEADER_DSIZE);
+        serdes_put16_array(sd, ds->label, DS_LABEL_DSIZE);
+        serdes_put16_array(sd, ds->data, DS_DATA_DSIZE);
+    }
+}
+
+int checkpoint_save(struct checkpoint *cp, struct simulator *sim)
+{
+    struct serdes *sd;
+    unsigned int page, num_pages, parts, dnum;
+    uint32_t epoch;
+    size_t size;
+    int full;
+
+    if (unlikely(!cp->fp)) {
+        report_error("checkpoint: save: no checkpoint file");
+        return FALSE;
+    }
+
+    full = (cp->sim != sim);
+    epoch = cp->epoch;
+    parts = 0;
+    if (full || sim->rom_epoch > epoch) parts |= STATE_ROMS;
+
+    num_pages = 0;
+    for (page = 0; page < NUM_MEMORY_PAGES; page++) {
+        if (full || sim->page_epoch[page] > epoch) num_pages++;
+    }
+
+    sd = &cp->sd;
+    serdes_rewind(sd);
+    serdes_put32(sd, CHECKPOINT_MAGIC);
+    serdes_put32(sd, 0); /* The size is written later. */
+    serdes_put8(sd, (full) ? CP_FULL : 0);
+    serdes_put8(sd, (uint8_t) parts);
+    simulator_serialize_parts(sim, sd, parts);
+    /* The MIR is only serialized in part (16 bits). */
+    serdes_put32(sd, sim->mir);
+
+    serdes_put32(sd, num_pages);
+    for (page = 0; page < NUM_MEMORY_PAGES; page++) {
+        if (!full && sim->page_epoch[page] <= epoch) continue;
+        serdes_put16(sd, (uint16_t) page);
+        serdes_put16_array(sd, &sim->mem[page << MEMORY_PAGE_SHIFT],
+                           MEMORY_PAGE_SIZE);
+    }
+
+    for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
+        serialize_drive(&sim->dsk.drives[dnum], sd, epoch, full);
+    }
+
+    if (unlikely(!serdes_verify(sd))) {
+        report_error("checkpoint: save: could not serialize");
+        return FALSE;
+    }
+
+    size = sd->pos;
+    sd->pos = 4;
+    serdes_put32(sd, (uint32_t) (size - HEADER_SIZE));
+    sd->pos = size;
+
+    if (unlikely(fwrite(sd->buffer, 1, size, cp->fp) != size
+                 || fflush(cp->fp) != 0)) {
+        report_error("checkpoint: save: could not write to file");
+        return FALSE;
+    }
+
+    cp->num_records++;
+    cp->sim = sim;
+    cp->epoch = simulator_next_epoch(sim);
+    return TRUE;
+}
+
+/* Deserializes the disk drive `dd` from `sd`.
+ * Returns TRUE on success.
+ */
+static
+int deserialize_drive(struct disk_drive *dd, struct serdes *sd,
+                      uint32_t epoch)
+{
+    struct disk_sector *ds;
+    uint16_t i, length, num_sectors, idx;
+
+    dd->loaded = serdes_get_bool(sd);
+    if (!dd->loaded) return TRUE;
+
+    length = serdes_get16(sd);
+    if (unlikely(length != dd->length)) {
+        report_error("checkpoint: load: invalid disk geometry");
+        return FALSE;
+    }
+
+    num_sectors = serdes_get16(sd);
+    for (i = 0; i < num_sectors; i++) {
+        idx = serdes_get16(sd);
+        if (unlikely(idx >= dd->length)) {
+            report_error("checkpoint: load: invalid sector %u", idx);
+            return FALSE;
+        }
+        ds = &dd->sectors[idx];
+        serdes_get16_array(sd, ds->header, DS_HEADER_DSIZE);
+        serdes_get16_array(sd, ds->label, DS_LABEL_DSIZE);
+        serdes_get16_array(sd, ds->data, DS_DATA_DSIZE);
+        dd->sector_epoch[idx] = epoch;
+    }
+    return TRUE;
+}
+
+/* Applies the checkpoint in `sd` to the simulator `sim`.
+ * The `first` parameter indicates that this is the first
+ * checkpoint to be applied.
+ * Returns TRUE on success.
+ */
+static
+int apply_checkpoint(struct simulator *sim, struct serdes *sd, int first)
+{
+    unsigned int flags, parts, dnum;
+    uint32_t i, num_pages;
+    uint16_t page;
+
+    flags = serdes_get8(sd);
+    if (unlikely(first && !(flags & CP_FULL))) {
+        report_error("checkpoint: load: missing the initial checkpoint");
+        return FALSE;
+    }
+
+    parts = serdes_get8(sd);
+    if (unlikely(parts & STATE_MEMORY)) {
+        report_error("checkpoint: load: invalid checkpoint");
+        return FALSE;
+    }
+
+    simulator_deserialize_parts(sim, sd, parts);
+    sim->mir = serdes_get32(sd);
+
+    num_pages = serdes_get32(sd);
+    for (i = 0; i < num_pages; i++) {
+        page = serdes_get16(sd);
+        if (unlikely(page >= NUM_MEMORY_PAGES)) {
+            report_error("checkpoint: load: invalid page %u", page);
+            return FALSE;
+        }
+        serdes_get16_array(sd, &sim->mem[page << MEMORY_PAGE_SHIFT],
+                           MEMORY_PAGE_SIZE);
+        sim->page_epoch[page] = sim->epoch;
+    }
+
+    for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
+        if (unlikely(!deserialize_drive(&sim->dsk.drives[dnum], sd,
+                                        sim->dsk.epoch))) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+int checkpoint_load(struct simulator *sim, const char *filename,
+                    unsigned int max_records, unsigned int *num_records)
+{
+    struct serdes sd;
+    uint32_t size;
+    unsigned int count;
+    FILE *fp;
+    int ret;
+
+    fp = fopen(filename, "rb");
+    if (unlikely(!fp)) {
+        report_error("checkpoint: load: could not open `%s`", filename);
+        return FALSE;
+    }
+
+    if (unlikely(!serdes_create(&sd, BUFFER_SIZE, TRUE))) {
+        report_error("checkpoint: load: could not create deserializer");
+        fclose(fp);
+        return FALSE;
+    }
+
+    ret = FALSE;
+    count = 0;
+    while (max_records == 0 || count < max_records) {
+        /* Stops at the first incomplete checkpoint. */
+        if (fread(sd.buffer, 1, HEADER_SIZE, fp) != HEADER_SIZE) break;
+
+        serdes_rewind(&sd);
+        if (unlikely(serdes_get32(&sd) != CHECKPOINT_MAGIC)) {
+            report_error("checkpoint: load: invalid checkpoint file `%s`",
+                         filename);
+            goto do_exit;
+        }
+
+        size = serdes_get32(&sd);
+        if (size > sd.size) {
+            if (unlikely(!serdes_extend(&sd, size))) {
+                report_error("checkpoint: load: could not extend "
+                             "deserializer");
+                goto do_exit;
+            }
+        }
+
+        if (fread(sd.buffer, 1, size, fp) != size) break;
+
+        serdes_rewind(&sd);
+        if (unlikely(!apply_checkpoint(sim, &sd, count == 0))) {
+            goto do_exit;
+        }
+
+        if (unlikely(sd.pos != size)) {
+            report_error("checkpoint: load: invalid checkpoint %u "
+                         "in `%s`", count, filename);
+            goto do_exit;
+        }
+        count++;
+    }
+
+    if (unlikely(count == 0)) {
+        report_error("checkpoint: load: no checkpoint in `%s`", filename);
+        goto do_exit;
+    }
+
+    if (num_records) *num_records = count;
+    ret = TRUE;
+
+do_exit:
+    serdes_destroy(&sd);
+    fclose(fp);
+    return ret;
+}
@@ -0,0 +1,78 @@
+#ifndef __SIMULATOR_CHECKPOINT_H
+#define __SIMULATOR_CHECKPOINT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "simulator/simulator.h"
+#include "common/serdes.h"
+
+/* Data structures and types. */
+
+/* Structure to write a chain of incremental checkpoints to a file.
+ * The first checkpoint in the file contains the whole state of the
+ * simulator (including the disk packs), and each of the following
+ * ones contains only the memory pages and disk sectors modified since
+ * the previous checkpoint (along with the registers and the state of
+ * the controllers).
+ */
+struct checkpoint {
+    struct serdes sd;             /* Buffer for the checkpoints. */
+    FILE *fp;                     /* The checkpoint file. */
+    unsigned int num_records;     /* Number of checkpoints written. */
+
+    const struct simulator *sim;  /* The simulator of the last
+                                   * checkpoint.
+                                   */
+    uint32_t epoch;               /* The epoch of the simulator when the
+                                   * last checkpoint was written.
+                                   */
+};
+
+/* Functions. */
+
+/* Initializes the checkpoint variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void checkpoint_initvar(struct checkpoint *cp);
+
+/* Destroys the checkpoint object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void checkpoint_destroy(struct checkpoint *cp);
+
+/* Creates a new checkpoint object.
+ * This obeys the initvar / destroy / create protocol.
+ * Returns TRUE on success.
+ */
+int checkpoint_create(struct checkpoint *cp);
+
+/* Starts a new chain of checkpoints in the file named `filename`
+ * (the previous contents of the file are discarded).
+ * Returns TRUE on success.
+ */
+int checkpoint_open(struct checkpoint *cp, const char *filename);
+
+/* Closes the checkpoint file. */
+void checkpoint_close(struct checkpoint *cp);
+
+/* Appends a checkpoint of the simulator `sim` to the file. Only the
+ * changes since the previous checkpoint are written, unless this is
+ * the first checkpoint of the simulator in the file.
+ * Returns TRUE on success.
+ */
+int checkpoint_save(struct checkpoint *cp, struct simulator *sim);
+
+/* Restores the state of the simulator `sim` from a chain of
+ * checkpoints in the file named `filename`. At most `max_records`
+ * checkpoints are replayed (all of them if zero). An incomplete
+ * checkpoint at the end of the file (from a crash, for example) is
+ * ignored. The number of replayed checkpoints is stored in
+ * `num_records` (if not NULL).
+ * Returns TRUE on success.
+ */
+int checkpoint_load(struct simulator *sim, const char *filename,
+                    unsigned int max_records, unsigned int *num_records);
+
+#endif /* __SIMULATOR_CHECKPOINT_H */
@@ -84,6 +84,7 @@ void disk_initvar(struct disk *dsk)
 
     for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
         dsk->drives[dnum].sectors = NULL;
+        dsk->drives[dnum].sector_epoch = NULL;
     }
 }
 
@@ -97,24 +98,32 @@ void disk_destroy(struct disk *dsk)
         if (dd->sectors)
             free((void *) dd->sectors);
         dd->sectors = NULL;
+
+        if (dd->sector_epoch)
+            free((void *) dd->sector_epoch);
+        dd->sector_epoch = NULL;
     }
 }
 
-int disk_create(struct disk *dsk)
+int disk_create(struct disk *dsk, struct scheduler *sched)
 {
     struct disk_drive *dd;
     unsigned int dnum;
 
     disk_initvar(dsk);
 
+    dsk->sched = sched;
+
     for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
         dd = &dsk->drives[dnum];
 
         dd->size = MAX_SECTORS;
         dd->sectors = (struct disk_sector *)
             malloc(MAX_SECTORS * sizeof(struct disk_sector));
+        dd->sector_epoch = (uint32_t *)
+            calloc(MAX_SECTORS, sizeof(uint32_t));
 
-        if (unlikely(!dd->sectors)) {
+        if (unlikely(!dd->sectors || !dd->sector_epoch)) {
             report_error("disk: create: memory exhausted");
             disk_destroy(dsk);
             return FALSE;
@@ -136,6 +145,7 @@ int disk_create(struct disk *dsk)
         dd->loaded = FALSE;
     }
 
+    dsk->epoch = 1;
     disk_reset(dsk);
     return TRUE;
 }
@@ -196,6 +206,7 @@ int disk_load_image(struct disk *dsk, unsigned int drive_num,
         if (c == EOF) goto error;
 
         ds = &dd->sectors[i];
+        dd->sector_epoch[i] = dsk->epoch;
         wptrs[0] = &ds->header[0];
         wptrs[1] = &ds->label[0];
         wptrs[2] = &ds->data[0];
@@ -355,12 +366,13 @@ void disk_reset(struct disk *dsk)
     dsk->sync_word_written = FALSE;
     dsk->bitclk_enable = FALSE;
     dsk->wdinit = FALSE;
+    dsk->seclate_enable = FALSE;
 
-    dsk->intr_cycle = 1;
-    dsk->ds_intr_cycle = 1;
-    dsk->dw_intr_cycle = -1;
-    dsk->seek_intr_cycle = -1;
-    dsk->seclate_intr_cycle = -1;
+    dsk->intr_cycle = -1;
+    scheduler_post(dsk->sched, EVENT_DISK_SECTOR, 1);
+    scheduler_post(dsk->sched, EVENT_DISK_WORD, -1);
+    scheduler_post(dsk->sched, EVENT_DISK_SEEK, -1);
+    scheduler_post(dsk->sched, EVENT_DISK_SECLATE, -1);
     dsk->pending = 0;
 }
 
@@ -587,7 +599,8 @@ int disk_func_strobe(struct disk *dsk, int32_t cycle)
 
     dd->target_cylinder = cylinder;
 
-    dsk->seek_intr_cycle = INTR_CYCLE(cycle + SEEK_DURATION);
+    scheduler_post(dsk->sched, EVENT_DISK_SEEK,
+                   INTR_CYCLE(cycle + SEEK_DURATION));
     return TRUE;
 }
 
@@ -744,16 +757,16 @@ void ds_interrupt(struct disk *dsk)
         dsk->seclate_enable = TRUE;
         dsk->kstat &= ~(KSTAT_LATE);
 
-        dsk->dw_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + WORD_DURATION);
+        scheduler_post(dsk->sched, EVENT_DISK_WORD,
+                       INTR_CYCLE(dsk->intr_cycle + WORD_DURATION));
 
-        dsk->ds_intr_cycle = -1;
+        scheduler_post(dsk->sched, EVENT_DISK_SECTOR, -1);
 
-        dsk->seclate_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + SECLATE_DURATION);
+        scheduler_post(dsk->sched, EVENT_DISK_SECLATE,
+                       INTR_CYCLE(dsk->intr_cycle + SECLATE_DURATION));
     } else {
-        dsk->ds_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + SECTOR_DURATION);
+        scheduler_post(dsk->sched, EVENT_DISK_SECTOR,
+                       INTR_CYCLE(dsk->intr_cycle + SECTOR_DURATION));
     }
 }
 
@@ -876,6 +889,7 @@ void dw_interrupt(struct disk *dsk)
                 if (dsk->sync_word_written) {
                     if (w) {
                         *w = dsk->kdata;
+                        dd->sector_epoch[vda] = dsk->epoch;
                     }
                 }
             }
@@ -909,13 +923,13 @@ void dw_interrupt(struct disk *dsk)
     }
 
     if (dd->sector_word < DS_END) {
-        dsk->dw_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + WORD_DURATION);
+        scheduler_post(dsk->sched, EVENT_DISK_WORD,
+                       INTR_CYCLE(dsk->intr_cycle + WORD_DURATION));
     } else {
-        dsk->dw_intr_cycle = -1;
+        scheduler_post(dsk->sched, EVENT_DISK_WORD, -1);
 
-        dsk->ds_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + 1);
+        scheduler_post(dsk->sched, EVENT_DISK_SECTOR,
+                       INTR_CYCLE(dsk->intr_cycle + 1));
     }
 }
 
@@ -936,10 +950,10 @@ void seek_interrupt(struct disk *dsk)
     if (dd->cylinder == dd->target_cylinder) {
         dsk->kstat &= ~KSTAT_SEEKING;
         dsk->restore = FALSE;
-        dsk->seek_intr_cycle = -1;
+        scheduler_post(dsk->sched, EVENT_DISK_SEEK, -1);
     } else {
-        dsk->seek_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + SEEK_DURATION);
+        scheduler_post(dsk->sched, EVENT_DISK_SEEK,
+                       INTR_CYCLE(dsk->intr_cycle + SEEK_DURATION));
     }
 }
 
@@ -950,50 +964,32 @@ void seclate_interrupt(struct disk *dsk)
     if (dsk->seclate_enable) {
         dsk->kstat |= KSTAT_LATE;
     }
-    dsk->seclate_intr_cycle = -1;
+    scheduler_post(dsk->sched, EVENT_DISK_SECLATE, -1);
 }
 
-/* Updates the intr_cycle.
- * Returns TRUE on success.
- */
-static
-int update_intr_cycle(struct disk *dsk)
+int disk_interrupt(struct disk *dsk, enum intr_event ev, int32_t cycle)
 {
-    int32_t intr_cycles[4];
-
-    intr_cycles[0] = dsk->ds_intr_cycle;
-    intr_cycles[1] = dsk->dw_intr_cycle;
-    intr_cycles[2] = dsk->seek_intr_cycle;
-    intr_cycles[3] = dsk->seclate_intr_cycle;
-
-    if (unlikely(!compute_intr_cycle(dsk->intr_cycle, TRUE,
-                                     4, intr_cycles,
-                                     &dsk->intr_cycle))) {
-        report_error("disk: update_intr_cycle: "
-                     "error in computing interrupt cycle");
+    dsk->intr_cycle = cycle;
+    switch (ev) {
+    case EVENT_DISK_SECTOR:
+        ds_interrupt(dsk);
+        break;
+    case EVENT_DISK_WORD:
+        dw_interrupt(dsk);
+        break;
+    case EVENT_DISK_SEEK:
+        seek_interrupt(dsk);
+        break;
+    case EVENT_DISK_SECLATE:
+        seclate_interrupt(dsk);
+        break;
+    default:
+        report_error("disk: interrupt: invalid event %d", (int) ev);
         return FALSE;
     }
-
     return TRUE;
 }
 
-int disk_interrupt(struct disk *dsk)
-{
-    int has_ds, has_dw, has_seek, has_seclate;
-
-    has_ds = (dsk->intr_cycle == dsk->ds_intr_cycle);
-    has_dw = (dsk->intr_cycle == dsk->dw_intr_cycle);
-    has_seek = (dsk->intr_cycle == dsk->seek_intr_cycle);
-    has_seclate = (dsk->intr_cycle == dsk->seclate_intr_cycle);
-
-    if (has_ds) ds_interrupt(dsk);
-    if (has_dw) dw_interrupt(dsk);
-    if (has_seek) seek_interrupt(dsk);
-    if (has_seclate) seclate_interrupt(dsk);
-
-    return update_intr_cycle(dsk);
-}
-
 void disk_on_switch_task(struct disk *dsk, uint8_t task)
 {
     /* According to the ContrAlto source:
@@ -1117,16 +1113,16 @@ void disk_print_registers(const struct disk *dsk,
     decode_tagged_value(dec->vdec, "PEND", DECODE_VALUE, dsk->pending);
     decode_tagged_value(dec->vdec, "ICYC",
                         DECODE_SVALUE32, dsk->intr_cycle);
-    decode_tagged_value(dec->vdec, "DS_ICYC",
-                        DECODE_SVALUE32, dsk->ds_intr_cycle);
-    decode_tagged_value(dec->vdec, "DW_ICYC",
-                        DECODE_SVALUE32, dsk->dw_intr_cycle);
+    decode_tagged_value(dec->vdec, "DS_ICYC", DECODE_SVALUE32,
+                        dsk->sched->cycles[EVENT_DISK_SECTOR]);
+    decode_tagged_value(dec->vdec, "DW_ICYC", DECODE_SVALUE32,
+                        dsk->sched->cycles[EVENT_DISK_WORD]);
     string_buffer_print(output, "\n");
 
-    decode_tagged_value(dec->vdec, "SK_ICYC",
-                        DECODE_SVALUE32, dsk->seek_intr_cycle);
-    decode_tagged_value(dec->vdec, "SL_ICYC",
-                        DECODE_SVALUE32, dsk->seclate_intr_cycle);
+    decode_tagged_value(dec->vdec, "SK_ICYC", DECODE_SVALUE32,
+                        dsk->sched->cycles[EVENT_DISK_SEEK]);
+    decode_tagged_value(dec->vdec, "SL_ICYC", DECODE_SVALUE32,
+                        dsk->sched->cycles[EVENT_DISK_SECLATE]);
     string_buffer_print(output, "\n");
 }
 
@@ -1149,10 +1145,10 @@ void disk_serialize(const struct disk *dsk, struct serdes *sd)
     serdes_put_bool(sd, dsk->wdinit);
     serdes_put_bool(sd, dsk->seclate_enable);
     serdes_put32(sd, dsk->intr_cycle);
-    serdes_put32(sd, dsk->ds_intr_cycle);
-    serdes_put32(sd, dsk->dw_intr_cycle);
-    serdes_put32(sd, dsk->seek_intr_cycle);
-    serdes_put32(sd, dsk->seclate_intr_cycle);
+    serdes_put32(sd, dsk->sched->cycles[EVENT_DISK_SECTOR]);
+    serdes_put32(sd, dsk->sched->cycles[EVENT_DISK_WORD]);
+    serdes_put32(sd, dsk->sched->cycles[EVENT_DISK_SEEK]);
+    serdes_put32(sd, dsk->sched->cycles[EVENT_DISK_SECLATE]);
     serdes_put16(sd, dsk->pending);
 
     for (drive_num = 0; drive_num < NUM_DISK_DRIVES; drive_num++) {
@@ -1186,10 +1182,10 @@ void disk_deserialize(struct disk *dsk, struct serdes *sd)
     dsk->wdinit = serdes_get_bool(sd);
     dsk->seclate_enable = serdes_get_bool(sd);
     dsk->intr_cycle = serdes_get32(sd);
-    dsk->ds_intr_cycle = serdes_get32(sd);
-    dsk->dw_intr_cycle = serdes_get32(sd);
-    dsk->seek_intr_cycle = serdes_get32(sd);
-    dsk->seclate_intr_cycle = serdes_get32(sd);
+    scheduler_post(dsk->sched, EVENT_DISK_SECTOR, serdes_get32(sd));
+    scheduler_post(dsk->sched, EVENT_DISK_WORD, serdes_get32(sd));
+    scheduler_post(dsk->sched, EVENT_DISK_SEEK, serdes_get32(sd));
+    scheduler_post(dsk->sched, EVENT_DISK_SECLATE, serdes_get32(sd));
     dsk->pending = serdes_get16(sd);
 
     for (drive_num = 0; drive_num < NUM_DISK_DRIVES; drive_num++) {
@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 
+#include "simulator/intr.h"
 #include "microcode/microcode.h"
 #include "common/serdes.h"
 #include "common/string_buffer.h"
@@ -51,6 +52,9 @@ struct disk_sector {
 struct disk_drive {
     struct disk_geometry dg;      /* The disk geometry. */
     struct disk_sector *sectors;  /* The disk sectors. */
+    uint32_t *sector_epoch;       /* The epoch of the last write to each
+                                   * sector (see simulator_next_epoch()).
+                                   */
     uint16_t length;              /* Total length of the disk in sectors. */
     uint16_t size;                /* Total allocated size (in sectors). */
 
@@ -82,12 +86,11 @@ struct disk {
     int wdinit;                   /* WDINIT bit used by task. */
     int seclate_enable;           /* To enable SECLATE. */
 
-    int32_t intr_cycle;           /* Cycle of the next interrupt. */
-    int32_t ds_intr_cycle;        /* Disk sector interrupt cycle. */
-    int32_t dw_intr_cycle;        /* Disk word interrupt cycle. */
-    int32_t seek_intr_cycle;      /* Seek interrupt cycle. */
-    int32_t seclate_intr_cycle;   /* SECLATE interrupt cycle. */
+    struct scheduler *sched;      /* The scheduler of the events. */
+    int32_t intr_cycle;           /* Cycle of the current interrupt. */
     uint16_t pending;             /* The task pending mask. */
+
+    uint32_t epoch;               /* The current epoch. */
 };
 
 /* Functions. */
@@ -105,10 +108,11 @@ void disk_initvar(struct disk *dsk);
 void disk_destroy(struct disk *dsk);
 
 /* Creates a new disk object.
+ * The events of the disk are posted to the scheduler `sched`.
  * This obeys the initvar / destroy / create protocol.
  * Returns TRUE on success.
  */
-int disk_create(struct disk *dsk);
+int disk_create(struct disk *dsk, struct scheduler *sched);
 
 /* Reads the contents of the disk from a disk pack file named `filename`.
  * Returns TRUE on success.
@@ -263,10 +267,10 @@ uint16_t disk_func_strobon(const struct disk *dsk, uint8_t task);
  */
 void disk_block_task(struct disk *dsk, uint8_t task);
 
-/* Processes the disk interrupts.
+/* Processes the disk event `ev`, which happens at `cycle`.
  * Returns TRUE on success.
  */
-int disk_interrupt(struct disk *dsk);
+int disk_interrupt(struct disk *dsk, enum intr_event ev, int32_t cycle);
 
 /* Callback for when the simulation switches to a disk task.
  * The new task is given by `task`.
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "simulator/display.h"
 #include "simulator/intr.h"
@@ -58,13 +59,15 @@ void display_destroy(struct display *displ)
     displ->fifo = NULL;
 }
 
-int display_create(struct display *displ)
+int display_create(struct display *displ, struct scheduler *sched)
 {
     display_initvar(displ);
 
+    displ->sched = sched;
+
     displ->fifo = (uint16_t *) malloc(FIFO_SIZE * sizeof(uint16_t));
-    displ->display_data = (uint8_t *)
-        malloc(DISPLAY_DATA_SIZE * sizeof(uint8_t));
+    displ->display_data = (uint16_t *)
+        malloc(DISPLAY_DATA_SIZE * sizeof(uint16_t));
 
     if (unlikely(!displ->fifo || !displ->display_data)) {
         report_error("display: create: memory exhausted");
@@ -72,6 +75,10 @@ int display_create(struct display *displ)
         return FALSE;
     }
 
+    /* Initially all the scanlines are black and dirty. */
+    memset(displ->display_data, 0, DISPLAY_DATA_SIZE * sizeof(uint16_t));
+    memset(displ->dirty, 0xFF, sizeof(displ->dirty));
+
     display_reset(displ);
     return TRUE;
 }
@@ -84,6 +91,7 @@ void display_reset(struct display *displ)
     displ->hblank = FALSE;
     displ->scanline = 0;
     displ->word = 0;
+    memset(displ->line, 0, sizeof(displ->line));
 
     displ->cursor_x = 0;
     displ->cursor_data = 0;
@@ -99,9 +107,10 @@ void display_reset(struct display *displ)
     displ->dw_blocked = FALSE;
     displ->cur_blocked = FALSE;
 
-    displ->dw_intr_cycle = 0xFFFFFFFFU;
-    displ->dhl_intr_cycle = SCANLINE_VISIBLE_DURATION;
-    displ->intr_cycle = displ->dhl_intr_cycle;
+    displ->intr_cycle = -1;
+    scheduler_post(displ->sched, EVENT_DISPLAY_HALF_LINE,
+                   SCANLINE_VISIBLE_DURATION);
+    scheduler_post(displ->sched, EVENT_DISPLAY_WORD, -1);
     displ->pending = 0;
 }
 
@@ -232,8 +241,9 @@ void dhl_interrupt(struct display *displ)
         displ->wob_latched = displ->wob;
 
         displ->hblank = FALSE;
-        displ->dhl_intr_cycle =
-            INTR_CYCLE(displ->intr_cycle + SCANLINE_VISIBLE_DURATION);
+        scheduler_post(displ->sched, EVENT_DISPLAY_HALF_LINE,
+                       INTR_CYCLE(displ->intr_cycle
+                                  + SCANLINE_VISIBLE_DURATION));
     } else {
          /* Wakup the memory refresh task (and possibly the
           * ethernet task).
@@ -249,8 +259,8 @@ void dhl_interrupt(struct display *displ)
         displ->dw_blocked = FALSE;
 
         displ->hblank = TRUE;
-        displ->dhl_intr_cycle =
-            INTR_CYCLE(displ->intr_cycle + HBLANK_DURATION);
+        scheduler_post(displ->sched, EVENT_DISPLAY_HALF_LINE,
+                       INTR_CYCLE(displ->intr_cycle + HBLANK_DURATION));
     }
 
     /* Check if the word task should be awakened. */
@@ -270,25 +280,44 @@ void dhl_interrupt(struct display *displ)
          * pluts the time of the first word to be displayed.
          */
         if (displ->low_res_latched) {
-            displ->dw_intr_cycle =
-                INTR_CYCLE(displ->intr_cycle + 4 * WORD_DURATION);
+            scheduler_post(displ->sched, EVENT_DISPLAY_WORD,
+                           INTR_CYCLE(displ->intr_cycle
+                                      + 4 * WORD_DURATION));
         } else {
-            displ->dw_intr_cycle =
-                INTR_CYCLE(displ->intr_cycle + 2 * WORD_DURATION);
+            scheduler_post(displ->sched, EVENT_DISPLAY_WORD,
+                           INTR_CYCLE(displ->intr_cycle
+                                      + 2 * WORD_DURATION));
         }
     }
 }
 
 
+/* Doubles each bit of `d` (for the low resolution mode).
+ * Returns the 32 bits.
+ */
+static
+uint32_t double_bits(uint16_t d)
+{
+    uint32_t x;
+
+    x = (uint32_t) d;
+    x = (x | (x << 8)) & 0x00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F;
+    x = (x | (x << 2)) & 0x33333333;
+    x = (x | (x << 1)) & 0x55555555;
+    return x | (x << 1);
+}
+
 /* Display word interrupt routine. */
 static
 void dw_interrupt(struct display *displ)
 {
     uint16_t adj_scanline;
-    uint16_t to_display, d;
-    uint16_t x_offset, x;
-    uint8_t *data, data1;
-    int i, almost_full;
+    uint16_t to_display, x;
+    uint16_t *data, *row, hi, lo;
+    uint32_t bits;
+    int32_t dw_intr_cycle;
+    int almost_full;
 
     if (displ->even_field) {
         adj_scanline = 2 * (displ->scanline - VBLANK_SCANLINES_EVEN);
@@ -316,88 +345,128 @@ void dw_interrupt(struct display *displ)
     if (!displ->wob_latched)
         to_display = ~to_display;
 
-    x_offset = displ->word * 16;
-    if (displ->low_res_latched)
-        x_offset *= 2;
+    /* The scanline is drawn in `line`, starting from the current
+     * contents of the scanline.
+     */
+    data = displ->line;
+    row = &displ->display_data[adj_scanline * DISPLAY_LINE_WORDS];
+    if (displ->word == 0) {
+        memcpy(data, row, DISPLAY_LINE_WORDS * sizeof(uint16_t));
+    }
 
     /* Display the to_display word. */
-    data = &displ->display_data[adj_scanline * DISPLAY_STRIDE];
-    x = x_offset;
-    d = to_display;
-    for (i = 0; i < 16; i++) {
-        data1 = (d & 0x8000) ? 0xFF : 0x00;
-        data[x++] = data1;
-        if (displ->low_res_latched) {
-            data[x++] = data1;
-        }
-        d <<= 1;
+    if (displ->low_res_latched) {
+        x = 2 * displ->word;
+        bits = double_bits(to_display);
+        if (x < DISPLAY_LINE_WORDS)
+            data[x] = (uint16_t) (bits >> 16);
+        if (x + 1 < DISPLAY_LINE_WORDS)
+            data[x + 1] = (uint16_t) bits;
+    } else {
+        x = displ->word;
+        if (x < DISPLAY_LINE_WORDS)
+            data[x] = to_display;
     }
 
     displ->word++;
     if (!(displ->hblank)) {
         /* More words to process. */
-        displ->dw_intr_cycle = displ->intr_cycle;
-        displ->dw_intr_cycle += (displ->low_res_latched)
+        dw_intr_cycle = displ->intr_cycle;
+        dw_intr_cycle += (displ->low_res_latched)
             ? 2 * WORD_DURATION : WORD_DURATION;
-        displ->dw_intr_cycle = INTR_CYCLE(displ->dw_intr_cycle);
+        scheduler_post(displ->sched, EVENT_DISPLAY_WORD,
+                       INTR_CYCLE(dw_intr_cycle));
         return;
     }
 
     /* We are the end of a scanline. */
-    displ->dw_intr_cycle = -1;
+    scheduler_post(displ->sched, EVENT_DISPLAY_WORD, -1);
 
     if (displ->cursor_x_latched < DISPLAY_STRIDE) {
-        /* Draw cursor. */
-        x = displ->cursor_x_latched;
-        d = displ->cursor_data_latched;
-        for (i = 0; i < 16; i++) {
-            data1 = (d & 0x8000) ? 0xFF : 0x00;
-            if (displ->wob_latched) {
-                data[x++] |= data1;
-            } else {
-                data[x++] &= ~data1;
-            }
-            if (x >= DISPLAY_STRIDE) break;
-            d <<= 1;
+        /* Draw cursor (which may straddle two words). */
+        x = displ->cursor_x_latched / 16;
+        bits = ((uint32_t) displ->cursor_data_latched) << 16;
+        bits >>= displ->cursor_x_latched % 16;
+        hi = (uint16_t) (bits >> 16);
+        lo = (uint16_t) bits;
+        if (displ->wob_latched) {
+            data[x] |= hi;
+            if (x + 1 < DISPLAY_LINE_WORDS) data[x + 1] |= lo;
+        } else {
+            data[x] &= ~hi;
+            if (x + 1 < DISPLAY_LINE_WORDS) data[x + 1] &= ~lo;
         }
     }
 
+    /* Only the scanlines that changed are marked as dirty. */
+    if (memcmp(row, data, DISPLAY_LINE_WORDS * sizeof(uint16_t)) != 0) {
+        memcpy(row, data, DISPLAY_LINE_WORDS * sizeof(uint16_t));
+        displ->dirty[adj_scanline / 32] |= 1U << (adj_scanline % 32);
+    }
+
     /* Clear the buffers here. */
     displ->fifo_start = displ->fifo_end = 0;
 }
 
-/* Updates the intr_cycle.
- * Returns TRUE on success.
- */
-static
-int update_intr_cycle(struct display *displ)
+int display_interrupt(struct display *displ, enum intr_event ev,
+                      int32_t cycle)
 {
-    int32_t intr_cycles[2];
-
-    intr_cycles[0] = displ->dhl_intr_cycle;
-    intr_cycles[1] = displ->dw_intr_cycle;
-
-    if (unlikely(!compute_intr_cycle(displ->intr_cycle, TRUE,
-                                     2, intr_cycles,
-                                     &displ->intr_cycle))) {
-        report_error("display: update_intr_cycle: "
-                     "error in computing interrupt cycle");
+    displ->intr_cycle = cycle;
+    switch (ev) {
+    case EVENT_DISPLAY_HALF_LINE:
+        dhl_interrupt(displ);
+        break;
+    case EVENT_DISPLAY_WORD:
+        dw_interrupt(displ);
+        break;
+    default:
+        report_error("display: interrupt: invalid event %d", (int) ev);
         return FALSE;
     }
     return TRUE;
 }
 
-int display_interrupt(struct display *displ)
+void display_skip_words(struct display *displ)
 {
-    int has_dhl, has_dw;
+    int32_t dw_intr_cycle, distance, step;
+    uint16_t value, x;
+    uint32_t count;
+
+    if (displ->hblank || !is_fifo_empty(displ)
+        || !(displ->dh_blocked || displ->dw_blocked))
+        return;
 
-    has_dhl = (displ->intr_cycle == displ->dhl_intr_cycle);
-    has_dw = (displ->intr_cycle == displ->dw_intr_cycle);
+    dw_intr_cycle = displ->sched->cycles[EVENT_DISPLAY_WORD];
+    if (dw_intr_cycle < 0) return;
 
-    if (has_dhl) dhl_interrupt(displ);
-    if (has_dw) dw_interrupt(displ);
+    /* The word events up to the end of the visible part of the
+     * scanline (at the next half-line event) are drawn at once. The
+     * last one still happens before the half-line event.
+     */
+    distance = INTR_CYCLE(displ->sched->cycles[EVENT_DISPLAY_HALF_LINE]
+                          - dw_intr_cycle);
+    if (distance <= 0 || distance > SCANLINE_DURATION) return;
 
-    return update_intr_cycle(displ);
+    step = (displ->low_res_latched) ? 2 * WORD_DURATION : WORD_DURATION;
+    count = (uint32_t) ((distance - 1) / step);
+    if (count == 0) return;
+
+    /* The same as in dw_interrupt() for an empty FIFO. */
+    value = (displ->wob_latched) ? 0 : 0xFFFF;
+    while (count-- > 0) {
+        if (displ->low_res_latched) {
+            x = 2 * displ->word;
+            if (x < DISPLAY_LINE_WORDS) displ->line[x] = value;
+            if (x + 1 < DISPLAY_LINE_WORDS) displ->line[x + 1] = value;
+        } else {
+            x = displ->word;
+            if (x < DISPLAY_LINE_WORDS) displ->line[x] = value;
+        }
+        displ->word++;
+        dw_intr_cycle += step;
+    }
+    scheduler_post(displ->sched, EVENT_DISPLAY_WORD,
+                   INTR_CYCLE(dw_intr_cycle));
 }
 
 void display_on_switch_task(struct display *displ, uint8_t task)
@@ -409,6 +478,51 @@ void display_on_switch_task(struct display *displ, uint8_t task)
     displ->pending &= ~(1 << task);
 }
 
+int display_save_image(const uint16_t *display_data,
+                       const char *filename)
+{
+    uint8_t pixels[DISPLAY_WIDTH];
+    const uint16_t *data;
+    unsigned int i, j;
+    FILE *fp;
+
+    fp = fopen(filename, "wb");
+    if (unlikely(!fp)) {
+        report_error("display: save_image: could not open `%s` "
+                     "for writing", filename);
+        return FALSE;
+    }
+
+    if (fprintf(fp, "P5\n%d %d\n255\n",
+                DISPLAY_WIDTH, DISPLAY_HEIGHT) < 0)
+        goto error;
+
+    for (i = 0; i < DISPLAY_HEIGHT; i++) {
+        data = &display_data[i * DISPLAY_LINE_WORDS];
+        for (j = 0; j < DISPLAY_WIDTH; j++) {
+            pixels[j] = (data[j / 16] & (0x8000 >> (j % 16))) ? 0xFF : 0x00;
+        }
+        if (fwrite(pixels, sizeof(uint8_t), DISPLAY_WIDTH, fp)
+            != DISPLAY_WIDTH)
+            goto error;
+    }
+
+    fclose(fp);
+    return TRUE;
+
+error:
+    report_error("display: save_image: error while writing `%s`",
+                 filename);
+    fclose(fp);
+    return FALSE;
+}
+
+int display_save_screenshot(const struct display *displ,
+                            const char *filename)
+{
+    return display_save_image(displ->display_data, filename);
+}
+
 void display_print_registers(const struct display *displ,
                              struct decoder *dec)
 {
@@ -458,10 +572,10 @@ void display_print_registers(const struct display *displ,
 
     decode_tagged_value(dec->vdec, "ICYC",
                         DECODE_SVALUE32, displ->intr_cycle);
-    decode_tagged_value(dec->vdec, "DHL_ICYC",
-                        DECODE_SVALUE32, displ->dhl_intr_cycle);
-    decode_tagged_value(dec->vdec, "DW_ICYC",
-                        DECODE_SVALUE32, displ->dw_intr_cycle);
+    decode_tagged_value(dec->vdec, "DHL_ICYC", DECODE_SVALUE32,
+                        displ->sched->cycles[EVENT_DISPLAY_HALF_LINE]);
+    decode_tagged_value(dec->vdec, "DW_ICYC", DECODE_SVALUE32,
+                        displ->sched->cycles[EVENT_DISPLAY_WORD]);
     string_buffer_print(output, "\n");
 
     decode_tagged_value(dec->vdec, "FIFO_ST",
@@ -489,6 +603,7 @@ void display_serialize(const struct display *displ, struct serdes *sd)
     serdes_put_bool(sd, displ->hblank);
     serdes_put16(sd, displ->scanline);
     serdes_put16(sd, displ->word);
+    serdes_put16_array(sd, displ->line, DISPLAY_LINE_WORDS);
     serdes_put16(sd, displ->cursor_x);
     serdes_put16(sd, displ->cursor_data);
     serdes_put16(sd, displ->cursor_x_latched);
@@ -501,8 +616,8 @@ void display_serialize(const struct display *displ, struct serdes *sd)
     serdes_put_bool(sd, displ->dw_blocked);
     serdes_put_bool(sd, displ->cur_blocked);
     serdes_put32(sd, displ->intr_cycle);
-    serdes_put32(sd, displ->dhl_intr_cycle);
-    serdes_put32(sd, displ->dw_intr_cycle);
+    serdes_put32(sd, displ->sched->cycles[EVENT_DISPLAY_HALF_LINE]);
+    serdes_put32(sd, displ->sched->cycles[EVENT_DISPLAY_WORD]);
     serdes_put16(sd, displ->pending);
 }
 
@@ -515,6 +630,7 @@ void display_deserialize(struct display *displ, struct serdes *sd)
     displ->hblank = serdes_get_bool(sd);
     displ->scanline = serdes_get16(sd);
     displ->word = serdes_get16(sd);
+    serdes_get16_array(sd, displ->line, DISPLAY_LINE_WORDS);
     displ->cursor_x = serdes_get16(sd);
     displ->cursor_data = serdes_get16(sd);
     displ->cursor_x_latched = serdes_get16(sd);
@@ -527,7 +643,8 @@ void display_deserialize(struct display *displ, struct serdes *sd)
     displ->dw_blocked = serdes_get_bool(sd);
     displ->cur_blocked = serdes_get_bool(sd);
     displ->intr_cycle = serdes_get32(sd);
-    displ->dhl_intr_cycle = serdes_get32(sd);
-    displ->dw_intr_cycle = serdes_get32(sd);
+    scheduler_post(displ->sched, EVENT_DISPLAY_HALF_LINE,
+                   serdes_get32(sd));
+    scheduler_post(displ->sched, EVENT_DISPLAY_WORD, serdes_get32(sd));
     displ->pending = serdes_get16(sd);
 }
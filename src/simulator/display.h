@@ -4,6 +4,7 @@
 
 #include <stdint.h>
 
+#include "simulator/intr.h"
 #include "microcode/microcode.h"
 #include "common/serdes.h"
 #include "common/string_buffer.h"
@@ -12,17 +13,31 @@
 #define DISPLAY_WIDTH                    606
 #define DISPLAY_HEIGHT                   808
 #define DISPLAY_STRIDE                   608
-#define DISPLAY_DATA_SIZE (DISPLAY_STRIDE * DISPLAY_HEIGHT)
+#define DISPLAY_LINE_WORDS  (DISPLAY_STRIDE / 16)
+#define DISPLAY_DATA_SIZE (DISPLAY_LINE_WORDS * DISPLAY_HEIGHT)
+#define DISPLAY_DIRTY_SIZE ((DISPLAY_HEIGHT + 31) / 32)
 
 /* Data structures and types. */
 
 /* The display controller structure used by the simulator. */
 struct display {
-    uint8_t *display_data;        /* The display pixels.
-                                   * Here we use bytes instead of
-                                   * bits because most graphics libraries
-                                   * do not suport 1BPP pixel formats.
+    uint16_t *display_data;       /* The display pixels, packed with
+                                   * one bit per pixel (as in the Alto
+                                   * memory), in DISPLAY_LINE_WORDS
+                                   * words per scanline. The most
+                                   * significant bit is the leftmost
+                                   * pixel, and a set bit is white.
                                    */
+    uint32_t dirty[DISPLAY_DIRTY_SIZE]; /* Bitmap of the scanlines of
+                                         * `display_data` that changed
+                                         * since they were last copied
+                                         * by simulator_update().
+                                         */
+    uint16_t line[DISPLAY_LINE_WORDS]; /* The scanline being drawn (it is
+                                        * copied to `display_data` at
+                                        * the end of the scanline, and
+                                        * is serialized with the state).
+                                        */
     uint16_t *fifo;               /* The data buffer implementing
                                    * the pixel FIFO.
                                    */
@@ -53,9 +68,8 @@ struct display {
     int dw_blocked;               /* Display word task blocked itself. */
     int cur_blocked;              /* Cursor task blocked itself. */
 
-    int32_t intr_cycle;           /* Cycle of the next interrupt. */
-    int32_t dhl_intr_cycle;       /* Display half-line interrupt cycle. */
-    int32_t dw_intr_cycle;        /* Display word interrupt cycle. */
+    struct scheduler *sched;      /* The scheduler of the events. */
+    int32_t intr_cycle;           /* Cycle of the current interrupt. */
     uint16_t pending;             /* The task pending mask. */
 };
 
@@ -74,10 +88,11 @@ void display_initvar(struct display *displ);
 void display_destroy(struct display *displ);
 
 /* Creates a new display object.
+ * The events of the display are posted to the scheduler `sched`.
  * This obeys the initvar / destroy / create protocol.
  * Returns TRUE on success.
  */
-int display_create(struct display *displ);
+int display_create(struct display *displ, struct scheduler *sched);
 
 /* Resets the display controller. */
 void display_reset(struct display *displ);
@@ -117,10 +132,22 @@ uint16_t display_set_mode(struct display *displ, uint16_t bus);
  */
 void display_block_task(struct display *displ, uint8_t task);
 
-/* Processes the display interrupts.
+/* Processes the display event `ev`, which happens at `cycle`.
  * Returns TRUE on success.
  */
-int display_interrupt(struct display *displ);
+int display_interrupt(struct display *displ, enum intr_event ev,
+                      int32_t cycle);
+
+/* Draws the words of the current scanline that would be drawn by the
+ * next display word events, up to the end of the visible part, when
+ * they are known in advance: the display word task is blocked, and
+ * the FIFO is empty. The events themselves are skipped (except for
+ * the last one). This must only be called right after a display word
+ * event, when the display word task cannot run (and load the FIFO)
+ * before the end of the visible part, that is, when it is neither
+ * the current task nor the next one.
+ */
+void display_skip_words(struct display *displ);
 
 /* Callback for when the simulation switches to a display task.
  * The new task is given by `task`.
@@ -133,6 +160,22 @@ void display_on_switch_task(struct display *displ, uint8_t task);
 void display_print_registers(const struct display *displ,
                              struct decoder *dec);
 
+/* Saves the packed display pixels `display_data` (see struct display)
+ * in a file. The image is written in the binary PGM format to the
+ * file whose name is given by `filename`.
+ * Returns TRUE on success.
+ */
+int display_save_image(const uint16_t *display_data,
+                       const char *filename);
+
+/* Saves the current contents of the display in a file.
+ * The image is written in the binary PGM format to the file whose
+ * name is given by `filename`.
+ * Returns TRUE on success.
+ */
+int display_save_screenshot(const struct display *displ,
+                            const char *filename);
+
 /* Serializes the display object to `sd`. */
 void display_serialize(const struct display *displ, struct serdes *sd);
 
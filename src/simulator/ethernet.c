@@ -40,10 +40,12 @@ void ethernet_destroy(struct ethernet *ether)
     ether->fifo = NULL;
 }
 
-int ethernet_create(struct ethernet *ether)
+int ethernet_create(struct ethernet *ether, struct scheduler *sched)
 {
     ethernet_initvar(ether);
 
+    ether->sched = sched;
+
     ether->fifo =
         (uint16_t *) malloc(FIFO_SIZE * sizeof(uint16_t));
 
@@ -110,57 +112,16 @@ int reset_interface(struct ethernet *ether)
     return TRUE;
 }
 
-/* Updates the intr_cycle. The parameter `cycle` specifies the current
- * cycle. The parameter `must_advance` is passed to the compute_intr_cycle()
- * function.
- * Returns TRUE on success.
- */
-static
-int update_intr_cycle(struct ethernet *ether,
-                      int32_t cycle, int must_advance)
-{
-    int32_t intr_cycles[2];
-    int32_t diff;
-
-    intr_cycles[0] = ether->tx_intr_cycle;
-    intr_cycles[1] = ether->rx_intr_cycle;
-
-    /* If the current interrupt cycle is set, use the minimum
-     * between intr_cycle and cycle.
-     */
-    if (ether->intr_cycle >= 0) {
-        diff = INTR_CYCLE(cycle - ether->intr_cycle);
-        if (!INTR_DIFF_NEG(diff)) {
-            cycle = ether->intr_cycle;
-        }
-    }
-
-    if (unlikely(!compute_intr_cycle(cycle, must_advance,
-                                     2, intr_cycles,
-                                     &ether->intr_cycle))) {
-        report_error("ethernet: update_intr_cycle: "
-                     "error in computing interrupt cycle");
-        return FALSE;
-    }
-    return TRUE;
-}
-
 /* Starts the transmission of the FIFO data by starting the TX interrupt.
  * The `cycle` parameter indicates the current cycle, and `end_tx` indicates
  * to end the current transmission.
- * Returns TRUE on success.
  */
 static
-int transmit_fifo(struct ethernet *ether, int32_t cycle, int end_tx)
+void transmit_fifo(struct ethernet *ether, int32_t cycle, int end_tx)
 {
-    ether->tx_intr_cycle = INTR_CYCLE(cycle + TX_DURATION);
+    scheduler_post(ether->sched, EVENT_ETHERNET_TX,
+                   INTR_CYCLE(cycle + TX_DURATION));
     ether->end_tx = end_tx;
-    if (unlikely(!update_intr_cycle(ether, cycle, FALSE))) {
-        report_error("ethernet: transmit_fifo: "
-                     "could not update the interrupt cycle");
-        return FALSE;
-    }
-    return TRUE;
 }
 
 /* Obtains a word from the input fifo.
@@ -220,11 +181,7 @@ int write_output_fifo(struct ethernet *ether, uint16_t bus,
 
     if (ether->fifo_end >= ether->fifo_start + FIFO_SIZE - 1) {
         if (ether->out_busy) {
-            if (unlikely(!transmit_fifo(ether, cycle, FALSE))) {
-                report_error("ethernet: write_output_fifo: "
-                             "could not update the interrupt cycle");
-                return FALSE;
-            }
+            transmit_fifo(ether, cycle, FALSE);
         }
         ether->pending &= ~(1 << TASK_ETHERNET);
     }
@@ -249,8 +206,8 @@ int ethernet_reset(struct ethernet *ether)
     }
 
     ether->intr_cycle = -1;
-    ether->tx_intr_cycle = -1;
-    ether->rx_intr_cycle = -1;
+    scheduler_post(ether->sched, EVENT_ETHERNET_TX, -1);
+    scheduler_post(ether->sched, EVENT_ETHERNET_RX, -1);
 
     if (unlikely(!reset_interface(ether))) {
         report_error("ethernet: reset: "
@@ -326,11 +283,7 @@ uint16_t ethernet_erbfct(struct ethernet *ether)
 
 int ethernet_eefct(struct ethernet *ether, int32_t cycle)
 {
-    if (unlikely(!transmit_fifo(ether, cycle, TRUE))) {
-        report_error("ethernet: eefct: "
-                     "could not transmit FIFO");
-        return FALSE;
-    }
+    transmit_fifo(ether, cycle, TRUE);
     ether->pending &= ~(1 << TASK_ETHERNET);
     return TRUE;
 }
@@ -379,14 +332,9 @@ int ethernet_eisfct(struct ethernet *ether, int32_t cycle)
     ether->in_busy = TRUE;
 
     ether->pending &= ~(1 << TASK_ETHERNET);
-    if (ether->rx_intr_cycle < 0) {
-        ether->rx_intr_cycle = INTR_CYCLE(cycle + RX_DURATION);
-        ret = update_intr_cycle(ether, cycle, FALSE);
-        if (unlikely(!ret)) {
-            report_error("ethernet: eisfct: "
-                         "could not update the interrupt cycle");
-            return FALSE;
-        }
+    if (ether->sched->cycles[EVENT_ETHERNET_RX] < 0) {
+        scheduler_post(ether->sched, EVENT_ETHERNET_RX,
+                       INTR_CYCLE(cycle + RX_DURATION));
     }
     return TRUE;
 }
@@ -403,7 +351,7 @@ int tx_interrupt(struct ethernet *ether)
     uint16_t data;
     int ret;
 
-    ether->tx_intr_cycle = -1;
+    scheduler_post(ether->sched, EVENT_ETHERNET_TX, -1);
     if (!ether->out_busy) return TRUE;
 
     while (ether->fifo_start != ether->fifo_end) {
@@ -527,37 +475,28 @@ int rx_interrupt(struct ethernet *ether)
     }
 
     if (is_active) {
-        ether->rx_intr_cycle =
-            INTR_CYCLE(ether->intr_cycle + RX_DURATION);
+        scheduler_post(ether->sched, EVENT_ETHERNET_RX,
+                       INTR_CYCLE(ether->intr_cycle + RX_DURATION));
     } else {
-        ether->rx_intr_cycle = -1;
+        scheduler_post(ether->sched, EVENT_ETHERNET_RX, -1);
     }
 
     return TRUE;
 }
 
-int ethernet_interrupt(struct ethernet *ether)
+int ethernet_interrupt(struct ethernet *ether, enum intr_event ev,
+                       int32_t cycle)
 {
-    int has_tx, has_rx;
-
-    has_tx = (ether->intr_cycle == ether->tx_intr_cycle);
-    has_rx = (ether->intr_cycle == ether->rx_intr_cycle);
-
-    if (has_tx) {
-        if (unlikely(!tx_interrupt(ether)))
-            return FALSE;
-    }
-    if (has_rx) {
-        if (unlikely(!rx_interrupt(ether)))
-            return FALSE;
-    }
-
-    if (unlikely(!update_intr_cycle(ether, ether->intr_cycle, TRUE))) {
-        report_error("ethernet: interrupt: "
-                     "could not update the interrupt cycle");
+    ether->intr_cycle = cycle;
+    switch (ev) {
+    case EVENT_ETHERNET_TX:
+        return tx_interrupt(ether);
+    case EVENT_ETHERNET_RX:
+        return rx_interrupt(ether);
+    default:
+        report_error("ethernet: interrupt: invalid event %d", (int) ev);
         return FALSE;
     }
-    return TRUE;
 }
 
 void ethernet_before_step(struct ethernet *ether)
@@ -610,10 +549,10 @@ void ethernet_print_registers(const struct ethernet *ether,
                         DECODE_SVALUE32, ether->intr_cycle);
     string_buffer_print(output, "\n");
 
-    decode_tagged_value(dec->vdec, "TX_ICYC",
-                        DECODE_SVALUE32, ether->tx_intr_cycle);
-    decode_tagged_value(dec->vdec, "RX_ICYC",
-                        DECODE_SVALUE32, ether->rx_intr_cycle);
+    decode_tagged_value(dec->vdec, "TX_ICYC", DECODE_SVALUE32,
+                        ether->sched->cycles[EVENT_ETHERNET_TX]);
+    decode_tagged_value(dec->vdec, "RX_ICYC", DECODE_SVALUE32,
+                        ether->sched->cycles[EVENT_ETHERNET_RX]);
     string_buffer_print(output, "\n");
 }
 
@@ -636,8 +575,8 @@ void ethernet_serialize(const struct ethernet *ether, struct serdes *sd)
     serdes_put_bool(sd, ether->countdown_wakeup);
     serdes_put_bool(sd, ether->end_tx);
     serdes_put32(sd, ether->intr_cycle);
-    serdes_put32(sd, ether->tx_intr_cycle);
-    serdes_put32(sd, ether->rx_intr_cycle);
+    serdes_put32(sd, ether->sched->cycles[EVENT_ETHERNET_TX]);
+    serdes_put32(sd, ether->sched->cycles[EVENT_ETHERNET_RX]);
     serdes_put16(sd, ether->pending);
 }
 
@@ -660,7 +599,7 @@ void ethernet_deserialize(struct ethernet *ether, struct serdes *sd)
     ether->countdown_wakeup = serdes_get_bool(sd);
     ether->end_tx = serdes_get_bool(sd);
     ether->intr_cycle = serdes_get32(sd);
-    ether->tx_intr_cycle = serdes_get32(sd);
-    ether->rx_intr_cycle = serdes_get32(sd);
+    scheduler_post(ether->sched, EVENT_ETHERNET_TX, serdes_get32(sd));
+    scheduler_post(ether->sched, EVENT_ETHERNET_RX, serdes_get32(sd));
     ether->pending = serdes_get16(sd);
 }
@@ -4,6 +4,7 @@
 
 #include <stdint.h>
 
+#include "simulator/intr.h"
 #include "microcode/microcode.h"
 #include "common/serdes.h"
 #include "common/string_buffer.h"
@@ -82,9 +83,8 @@ struct ethernet {
                                    */
     int end_tx;                   /* To end the current transmission. */
 
-    int32_t intr_cycle;           /* Cycle of the next interrupt. */
-    int32_t tx_intr_cycle;        /* Cycle of the next transmission. */
-    int32_t rx_intr_cycle;        /* Cycle of the next receive. */
+    struct scheduler *sched;      /* The scheduler of the events. */
+    int32_t intr_cycle;           /* Cycle of the current interrupt. */
     uint16_t pending;             /* The task pending mask. */
 };
 
@@ -103,10 +103,11 @@ void ethernet_initvar(struct ethernet *ether);
 void ethernet_destroy(struct ethernet *ether);
 
 /* Creates a new ethernet object.
+ * The events of the ethernet are posted to the scheduler `sched`.
  * This obeys the initvar / destroy / create protocol.
  * Returns TRUE on success.
  */
-int ethernet_create(struct ethernet *ether);
+int ethernet_create(struct ethernet *ether, struct scheduler *sched);
 
 /* Sets the transport object.
  * The transport object is given by `trp`.
@@ -196,10 +197,11 @@ int ethernet_eisfct(struct ethernet *ether, int32_t cycle);
  */
 void ethernet_block_task(struct ethernet *ether, uint8_t task);
 
-/* Processes the ethernet interrupts.
+/* Processes the ethernet event `ev`, which happens at `cycle`.
  * Returns TRUE on success.
  */
-int ethernet_interrupt(struct ethernet *ether);
+int ethernet_interrupt(struct ethernet *ether, enum intr_event ev,
+                       int32_t cycle);
 
 /* Runs this before every microinstruction. */
 void ethernet_before_step(struct ethernet *ether);
@@ -0,0 +1,241 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "simulator/fingerprint.h"
+#include "simulator/simulator.h"
+#include "simulator/intr.h"
+#include "microcode/microcode.h"
+#include "common/serdes.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define BUFFER_SIZE                     4096
+#define HASH_SEED         0x84222325CBF29CE4ULL
+#define HASH_MULT         0x9E3779B97F4A7C15ULL
+
+/* Functions. */
+
+void fingerprint_initvar(struct fingerprint *fpr)
+{
+    serdes_initvar(&fpr->sd);
+    fpr->page_hashes = NULL;
+    fpr->sim = NULL;
+    fpr->fp = NULL;
+}
+
+void fingerprint_destroy(struct fingerprint *fpr)
+{
+    fingerprint_stop(fpr);
+    serdes_destroy(&fpr->sd);
+    if (fpr->page_hashes) free((void *) fpr->page_hashes);
+    fpr->page_hashes = NULL;
+}
+
+int fingerprint_create(struct fingerprint *fpr)
+{
+    fingerprint_initvar(fpr);
+
+    if (unlikely(!serdes_create(&fpr->sd, BUFFER_SIZE, TRUE))) {
+        report_error("fingerprint: create: could not create serializer");
+        fingerprint_destroy(fpr);
+        return FALSE;
+    }
+
+    fpr->page_hashes = (uint64_t *)
+        malloc(NUM_MEMORY_PAGES * sizeof(uint64_t));
+    if (unlikely(!fpr->page_hashes)) {
+        report_error("fingerprint: create: memory exhausted");
+        fingerprint_destroy(fpr);
+        return FALSE;
+    }
+
+    fpr->rom_hash = 0;
+    fpr->hashed = NULL;
+    fpr->epoch = 0;
+    fpr->num_fingerprints = 0;
+    return TRUE;
+}
+
+/* Mixes the 64-bit `value` into the hash `h`.
+ * Returns the new hash.
+ */
+static
+uint64_t mix(uint64_t h, uint64_t value)
+{
+    h ^= value;
+    h *= HASH_MULT;
+    h ^= h >> 29;
+    return h;
+}
+
+/* Hashes the `num` words in `words`, starting from the hash `h`.
+ * Returns the new hash.
+ */
+static
+uint64_t hash_words(uint64_t h, const uint16_t *words, size_t num)
+{
+    uint64_t value;
+    size_t i;
+
+    /* The words are mixed four at a time. */
+    value = 0;
+    for (i = 0; i < num; i++) {
+        value = (value << 16) | ((uint64_t) words[i]);
+        if ((i & 3) == 3) {
+            h = mix(h, value);
+            value = 0;
+        }
+    }
+    if (num & 3) h = mix(h, value);
+    return h;
+}
+
+/* Hashes the `num` bytes in `bytes`, starting from the hash `h`.
+ * Returns the new hash.
+ */
+static
+uint64_t hash_bytes(uint64_t h, const uint8_t *bytes, size_t num)
+{
+    uint64_t value;
+    size_t i;
+
+    /* The bytes are mixed eight at a time. */
+    value = 0;
+    for (i = 0; i < num; i++) {
+        value = (value << 8) | ((uint64_t) bytes[i]);
+        if ((i & 7) == 7) {
+            h = mix(h, value);
+            value = 0;
+        }
+    }
+    if (num & 7) h = mix(h, value);
+    return h;
+}
+
+/* Computes the hash of the ROMs and of the microcode RAM. */
+static
+uint64_t hash_roms(const struct simulator *sim)
+{
+    uint64_t h;
+    size_t i;
+
+    h = hash_bytes(HASH_SEED, sim->acs_rom, ACSROM_SIZE);
+    h = hash_words(h, sim->consts, CONSTANT_SIZE);
+    for (i = 0; i < NUM_MICROCODE_BANKS * MICROCODE_SIZE; i += 2) {
+        h = mix(h, ((uint64_t) sim->microcode[i])
+                | (((uint64_t) sim->microcode[i + 1]) << 32));
+    }
+    return h;
+}
+
+uint64_t fingerprint_compute(struct fingerprint *fpr,
+                             struct simulator *sim)
+{
+    uint64_t h;
+    unsigned int page;
+    int same;
+
+    /* Only the pages (and the ROMs) modified since the last
+     * fingerprint of the same simulator are hashed again.
+     */
+    same = (fpr->hashed == sim);
+    for (page = 0; page < NUM_MEMORY_PAGES; page++) {
+        if (same && sim->page_epoch[page] <= fpr->epoch) continue;
+        fpr->page_hashes[page] =
+            hash_words(mix(HASH_SEED, page),
+                       &sim->mem[page << MEMORY_PAGE_SHIFT],
+                       MEMORY_PAGE_SIZE);
+    }
+    if (!same || sim->rom_epoch > fpr->epoch) {
+        fpr->rom_hash = hash_roms(sim);
+    }
+    fpr->hashed = sim;
+    fpr->epoch = simulator_next_epoch(sim);
+
+    serdes_rewind(&fpr->sd);
+    simulator_serialize_parts(sim, &fpr->sd, 0);
+
+    h = hash_bytes(HASH_SEED, fpr->sd.buffer, fpr->sd.pos);
+    h = mix(h, fpr->rom_hash);
+    for (page = 0; page < NUM_MEMORY_PAGES; page++) {
+        h = mix(h, fpr->page_hashes[page]);
+    }
+    return mix(h, h >> 32);
+}
+
+int fingerprint_start(struct fingerprint *fpr, struct simulator *sim,
+                      const char *filename, uint32_t interval)
+{
+    fingerprint_stop(fpr);
+
+    if (unlikely(interval == 0)) {
+        report_error("fingerprint: start: invalid interval");
+        return FALSE;
+    }
+
+    fpr->fp = fopen(filename, "w");
+    if (unlikely(!fpr->fp)) {
+        report_error("fingerprint: start: could not open `%s`", filename);
+        return FALSE;
+    }
+
+    fpr->sim = sim;
+    fpr->interval = interval;
+    fpr->time = 0;
+    fpr->next_time = 0;
+    fpr->last_cycle = sim->cycle;
+    fpr->num_fingerprints = 0;
+    sim->fprint = fpr;
+    return TRUE;
+}
+
+int fingerprint_stop(struct fingerprint *fpr)
+{
+    int ret;
+
+    ret = TRUE;
+    if (fpr->sim) fpr->sim->fprint = NULL;
+    fpr->sim = NULL;
+
+    if (fpr->fp) {
+        if (unlikely(fclose(fpr->fp) != 0)) {
+            report_error("fingerprint: stop: could not write fingerprints");
+            ret = FALSE;
+        }
+    }
+    fpr->fp = NULL;
+    return ret;
+}
+
+uint32_t fingerprint_update(struct fingerprint *fpr, uint32_t max_cycles)
+{
+    struct simulator *sim;
+    uint64_t h, remaining;
+    int32_t cycle;
+
+    sim = fpr->sim;
+    cycle = sim->cycle;
+    fpr->time += (uint64_t) INTR_CYCLE(cycle - fpr->last_cycle);
+    fpr->last_cycle = cycle;
+
+    if (fpr->time >= fpr->next_time) {
+        h = fingerprint_compute(fpr, sim);
+        if (unlikely(fprintf(fpr->fp, "%llu %016llx\n",
+                             (unsigned long long) fpr->time,
+                             (unsigned long long) h) < 0)) {
+            report_error("fingerprint: update: "
+                         "could not write fingerprint");
+            sim->error = TRUE;
+            return max_cycles;
+        }
+        fpr->num_fingerprints++;
+
+        /* The fingerprints are kept at multiples of the interval. */
+        fpr->next_time = (fpr->time / fpr->interval + 1) * fpr->interval;
+    }
+
+    remaining = fpr->next_time - fpr->time;
+    return (remaining < max_cycles) ? (uint32_t) remaining : max_cycles;
+}
@@ -0,0 +1,95 @@
+#ifndef __SIMULATOR_FINGERPRINT_H
+#define __SIMULATOR_FINGERPRINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "common/serdes.h"
+#include "simulator/simulator.h"
+
+/* Data structures and types. */
+
+/* Structure to compute fingerprints (hashes) of the architectural
+ * state of the simulator: the registers, the task MPCs, the ROMs and
+ * the microcode RAM, the memory, and the registers of the controllers
+ * (as serialized by simulator_serialize()). The hashes of the memory
+ * pages are cached, so that only the pages written since the last
+ * fingerprint need to be hashed again.
+ *
+ * The fingerprints can also be written to a file every `interval`
+ * cycles, one per line, with the number of cycles since the start and
+ * the fingerprint. Comparing the files of two runs (with different
+ * engines, for instance) gives the first cycle window where they
+ * diverged.
+ */
+struct fingerprint {
+    struct serdes sd;             /* To serialize the registers. */
+    uint64_t *page_hashes;        /* The cached hash of each memory page. */
+    uint64_t rom_hash;            /* The cached hash of the ROMs and of
+                                   * the microcode RAM.
+                                   */
+    const struct simulator *hashed; /* The simulator of the cached hashes
+                                     * (or NULL if none).
+                                     */
+    uint32_t epoch;               /* The epoch of the cached hashes. */
+
+    struct simulator *sim;        /* The simulator (if writing to a file). */
+    FILE *fp;                     /* The file for the fingerprints. */
+    uint32_t interval;            /* Cycles between fingerprints. */
+    uint64_t time;                /* Cycles since the start. */
+    uint64_t next_time;           /* Time of the next fingerprint. */
+    int32_t last_cycle;           /* The cycle of the simulator at
+                                   * `time`.
+                                   */
+    uint64_t num_fingerprints;    /* Number of fingerprints written. */
+};
+
+/* Functions. */
+
+/* Initializes the fingerprint variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void fingerprint_initvar(struct fingerprint *fpr);
+
+/* Destroys the fingerprint object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void fingerprint_destroy(struct fingerprint *fpr);
+
+/* Creates a new fingerprint object.
+ * This obeys the initvar / destroy / create protocol.
+ * Returns TRUE on success.
+ */
+int fingerprint_create(struct fingerprint *fpr);
+
+/* Computes the fingerprint of the current state of the simulator
+ * `sim`. This starts a new epoch of the simulator (see
+ * simulator_next_epoch()).
+ * Returns the fingerprint.
+ */
+uint64_t fingerprint_compute(struct fingerprint *fpr,
+                             struct simulator *sim);
+
+/* Starts writing the fingerprints of the simulator `sim` to the file
+ * named `filename`, every `interval` cycles (starting with the
+ * current state).
+ * Returns TRUE on success.
+ */
+int fingerprint_start(struct fingerprint *fpr, struct simulator *sim,
+                      const char *filename, uint32_t interval);
+
+/* Stops writing the fingerprints (and detaches from the simulator).
+ * Returns TRUE on success.
+ */
+int fingerprint_stop(struct fingerprint *fpr);
+
+/* Writes the fingerprint if it is due (this is called by the
+ * simulator). In case of errors, the simulator is put in error state.
+ * Returns the number of cycles until the next fingerprint (but at
+ * most `max_cycles`), so that the simulator can stop there.
+ */
+uint32_t fingerprint_update(struct fingerprint *fpr, uint32_t max_cycles);
+
+#endif /* __SIMULATOR_FINGERPRINT_H */
@@ -1,4 +1,3 @@
-
 #include <stdint.h>
 
 #include "simulator/intr.h"
@@ -6,36 +5,135 @@
 
 /* Functions. */
 
-/* Computes the next interrupt cycle. */
-int compute_intr_cycle(int32_t cycle, int must_advance,
-                       int n, const int32_t *intr_cycles,
-                       int32_t *intr_cycle)
-{
-    int32_t diff, tmp;
-    int i;
-
-    diff = -1;
-    for (i = 0; i < n; i++) {
-        if (intr_cycles[i] >= 0) {
-            tmp = INTR_CYCLE(intr_cycles[i] - cycle);
-            /* Some error must have happened. */
-            if (unlikely(((tmp == 0) && must_advance)
-                         || (INTR_DIFF_NEG(tmp)))) {
-                report_error("intr: compute_intr_cycle: "
-                             "entry %d has value %d, cycle is %d",
-                             i, intr_cycles[i], cycle);
-                return FALSE;
-            }
-            diff = INTR_CYCLE(diff);
-            diff = MIN(diff, tmp);
+void scheduler_clear(struct scheduler *sch, int32_t cycle)
+{
+    unsigned int ev;
+
+    for (ev = 0; ev < NUM_INTR_EVENTS; ev++)
+        sch->cycles[ev] = -1;
+
+    sch->num_events = 0;
+    sch->base_cycle = INTR_CYCLE(cycle);
+    sch->intr_cycle = -1;
+}
+
+/* Tests if the event `a` happens before the event `b`.
+ * Returns TRUE if so.
+ */
+static
+int event_before(const struct scheduler *sch, unsigned int a,
+                 unsigned int b)
+{
+    int32_t diff_a, diff_b;
+
+    diff_a = INTR_CYCLE(sch->cycles[a] - sch->base_cycle);
+    diff_b = INTR_CYCLE(sch->cycles[b] - sch->base_cycle);
+    if (diff_a != diff_b) return (diff_a < diff_b);
+    return (a < b);
+}
+
+/* Places the event `ev` at the position `pos` of the heap. */
+static
+void place_event(struct scheduler *sch, unsigned int pos, unsigned int ev)
+{
+    sch->heap[pos] = (uint8_t) ev;
+    sch->pos[ev] = (uint8_t) pos;
+}
+
+/* Moves the event at position `pos` up in the heap. */
+static
+void sift_up(struct scheduler *sch, unsigned int pos)
+{
+    unsigned int ev, parent;
+
+    ev = sch->heap[pos];
+    while (pos > 0) {
+        parent = (pos - 1) >> 1;
+        if (!event_before(sch, ev, sch->heap[parent])) break;
+        place_event(sch, pos, sch->heap[parent]);
+        pos = parent;
+    }
+    place_event(sch, pos, ev);
+}
+
+/* Moves the event at position `pos` down in the heap. */
+static
+void sift_down(struct scheduler *sch, unsigned int pos)
+{
+    unsigned int ev, child;
+
+    ev = sch->heap[pos];
+    while (TRUE) {
+        child = 2 * pos + 1;
+        if (child >= sch->num_events) break;
+        if (child + 1 < sch->num_events
+            && event_before(sch, sch->heap[child + 1], sch->heap[child])) {
+            child++;
         }
+        if (!event_before(sch, sch->heap[child], ev)) break;
+        place_event(sch, pos, sch->heap[child]);
+        pos = child;
     }
+    place_event(sch, pos, ev);
+}
+
+/* Removes the event at position `pos` from the heap. */
+static
+void remove_event(struct scheduler *sch, unsigned int pos)
+{
+    unsigned int last;
+
+    sch->cycles[sch->heap[pos]] = -1;
+    sch->num_events--;
+    if (pos == sch->num_events) return;
+
+    last = sch->heap[sch->num_events];
+    place_event(sch, pos, last);
+    sift_up(sch, pos);
+    if (sch->pos[last] == pos) sift_down(sch, pos);
+}
 
-    if (diff < 0) {
-        *intr_cycle = -1;
+/* Updates the cycle of the next event. */
+static
+void update_intr_cycle(struct scheduler *sch)
+{
+    if (sch->num_events == 0) {
+        sch->intr_cycle = -1;
     } else {
-        *intr_cycle = INTR_CYCLE(diff + cycle);
+        sch->intr_cycle = sch->cycles[sch->heap[0]];
     }
+}
+
+void scheduler_post(struct scheduler *sch, enum intr_event ev,
+                    int32_t cycle)
+{
+    unsigned int pos;
+
+    if (sch->cycles[ev] >= 0) {
+        remove_event(sch, sch->pos[ev]);
+    }
+
+    if (cycle >= 0) {
+        sch->cycles[ev] = cycle;
+        pos = sch->num_events++;
+        place_event(sch, pos, ev);
+        sift_up(sch, pos);
+    }
+
+    update_intr_cycle(sch);
+}
+
+enum intr_event scheduler_pop(struct scheduler *sch, int32_t cycle)
+{
+    unsigned int ev;
+
+    if (sch->intr_cycle < 0 || sch->intr_cycle != cycle)
+        return NUM_INTR_EVENTS;
 
-    return TRUE;
+    /* All the remaining events happen at or after `cycle`. */
+    sch->base_cycle = cycle;
+    ev = sch->heap[0];
+    remove_event(sch, 0);
+    update_intr_cycle(sch);
+    return (enum intr_event) ev;
 }
@@ -1,4 +1,3 @@
-
 #ifndef __SIMULATOR_INTR_H
 #define __SIMULATOR_INTR_H
 
@@ -8,26 +7,63 @@
 #define INTR_CYCLE(x) ((x) & 0x7FFFFFFF)
 #define INTR_DIFF_NEG(x) ((x) & 0x40000000)
 
+/* Data structures and types. */
+
+/* The events of the devices. The events that happen at the same
+ * cycle are dispatched in this order.
+ */
+enum intr_event {
+    EVENT_DISK_SECTOR,            /* Disk sector (ds) interrupt. */
+    EVENT_DISK_WORD,              /* Disk word (dw) interrupt. */
+    EVENT_DISK_SEEK,              /* Seek interrupt. */
+    EVENT_DISK_SECLATE,           /* SECLATE interrupt. */
+    EVENT_DISPLAY_HALF_LINE,      /* Display half-line (dhl) interrupt. */
+    EVENT_DISPLAY_WORD,           /* Display word (dw) interrupt. */
+    EVENT_ETHERNET_TX,            /* Ethernet transmission. */
+    EVENT_ETHERNET_RX,            /* Ethernet reception. */
+    NUM_INTR_EVENTS               /* Number of events. */
+};
+
+/* Structure representing the scheduler of the device events.
+ * The pending events are kept in a binary heap, ordered by the
+ * distance of their cycles to a base cycle (and then by the event
+ * number), so that the most imminent event is always at the top.
+ * The base cycle is the cycle of the last dispatched event, and all
+ * the pending events must happen after it.
+ */
+struct scheduler {
+    int32_t cycles[NUM_INTR_EVENTS]; /* The cycle of each event
+                                      * (negative if not scheduled).
+                                      */
+    uint8_t heap[NUM_INTR_EVENTS];   /* The heap of pending events. */
+    uint8_t pos[NUM_INTR_EVENTS];    /* The position of each event in
+                                      * the heap.
+                                      */
+    unsigned int num_events;      /* Number of pending events. */
+    int32_t base_cycle;           /* The base cycle. */
+    int32_t intr_cycle;           /* Cycle of the next event
+                                   * (or negative if there is none).
+                                   */
+};
+
 /* Functions. */
 
-/* Computes the next interrupt cycle.
- * The `cycle` parameters specifies the current cycle. The `must_advance`
- * is for validation. This is to ensure that the resulting output
- * (the next interrupt cycle) is after the current cycle in `cycle`.
- * The `n` parameter specifies the length of the array `intr_cycles`.
- * The array `intr_cycles` specifies the possible interrupt cycles and
- * the result of this function is the most imminent interrupt cycle
- * among all the valid values (i.e., non-negative) in this array.
- * The monst imminent interrupt cycle is the one closest to `cycle`.
- * A negative value in `intr_cycles` means to ignore the value.
- * When all the values in `intr_cycles` are negative, the resulting
- * value is negative as well. The output of the function, i.e., the
- * next interrupt cycle is returned via the parameter `intr_cycle`.
- * Returns TRUE if the computation was successful.
+/* Removes all the events from the scheduler `sch`. The parameter
+ * `cycle` specifies the new base cycle.
+ */
+void scheduler_clear(struct scheduler *sch, int32_t cycle);
+
+/* Schedules the event `ev` to happen at `cycle`, replacing the
+ * previous schedule of the event. A negative `cycle` cancels the event.
+ * The cycle must not be before the base cycle.
  */
-int compute_intr_cycle(int32_t cycle, int must_advance,
-                       int n, const int32_t *intr_cycles,
-                       int32_t *intr_cycle);
+void scheduler_post(struct scheduler *sch, enum intr_event ev,
+                    int32_t cycle);
 
+/* Removes the next event from the scheduler `sch`, if it happens at
+ * `cycle` (in which case the base cycle is also moved to `cycle`).
+ * Returns the event, or NUM_INTR_EVENTS if there is no such event.
+ */
+enum intr_event scheduler_pop(struct scheduler *sch, int32_t cycle);
 
 #endif /* __SIMULATOR_INTR_H */
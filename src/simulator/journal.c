@@ -0,0 +1,860 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simulator/journal.h"
+#include "simulator/simulator.h"
+#include "simulator/intr.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define JOURNAL_MAGIC             0x504A4E4C /* "PJNL" */
+#define JOURNAL_VERSION                    1
+#define HEADER_SIZE                        8
+#define MAX_RECORD_HEADER                 16
+#define MAX_PACKET_WORDS               65536
+
+/* The flags of a journal. */
+#define JF_ETHERNET                        1
+
+/* The types of the records. */
+#define JR_KEYBOARD                        1
+#define JR_MOUSE                           2
+#define JR_PACKET                          3
+
+/* Functions. */
+
+void journal_initvar(struct journal *jn)
+{
+    jn->mode = JOURNAL_OFF;
+    jn->sim = NULL;
+    jn->wrapped = FALSE;
+    jn->rewound = FALSE;
+    jn->fp = NULL;
+    jn->filename = NULL;
+    jn->data = NULL;
+    jn->rx_data = NULL;
+}
+
+void journal_destroy(struct journal *jn)
+{
+    journal_close(jn);
+    if (jn->rx_data) free((void *) jn->rx_data);
+    jn->rx_data = NULL;
+}
+
+/* The callbacks of the transport given to the ethernet controller. */
+
+static
+void trp_clear_tx(void *arg)
+{
+    struct journal *jn;
+
+    jn = (struct journal *) arg;
+    if (jn->mode == JOURNAL_RECORD && jn->inner) {
+        (*jn->inner->clear_tx)(jn->inner->arg);
+    }
+}
+
+static
+int trp_append_tx(void *arg, uint16_t data)
+{
+    struct journal *jn;
+
+    jn = (struct journal *) arg;
+    if (jn->mode == JOURNAL_RECORD && jn->inner) {
+        return (*jn->inner->append_tx)(jn->inner->arg, data);
+    }
+    return TRUE;
+}
+
+static
+int trp_send(void *arg)
+{
+    struct journal *jn;
+
+    jn = (struct journal *) arg;
+    if (jn->mode == JOURNAL_RECORD && jn->inner) {
+        return (*jn->inner->send)(jn->inner->arg);
+    }
+    return TRUE;
+}
+
+static
+int trp_enable_rx(void *arg, int enable)
+{
+    struct journal *jn;
+
+    jn = (struct journal *) arg;
+    if (jn->mode == JOURNAL_RECORD && jn->inner) {
+        return (*jn->inner->enable_rx)(jn->inner->arg, enable);
+    }
+    return TRUE;
+}
+
+static
+void trp_clear_rx(void *arg)
+{
+    struct journal *jn;
+
+    jn = (struct journal *) arg;
+    jn->rx_len = 0;
+    jn->rx_pos = 0;
+    if (jn->mode == JOURNAL_RECORD && jn->inner) {
+        (*jn->inner->clear_rx)(jn->inner->arg);
+    }
+}
+
+static
+uint16_t trp_get_rx_data(void *arg)
+{
+    struct journal *jn;
+
+    jn = (struct journal *) arg;
+    if (jn->rx_pos >= jn->rx_len) return 0;
+    return jn->rx_data[jn->rx_pos++];
+}
+
+static
+size_t trp_has_rx_data(void *arg)
+{
+    struct journal *jn;
+
+    jn = (struct journal *) arg;
+    return 2 * (jn->rx_len - jn->rx_pos);
+}
+
+/* Updates the current time of the journal from the cycle of the
+ * simulator.
+ */
+static
+void update_time(struct journal *jn)
+{
+    int32_t cycle;
+
+    cycle = jn->sim->cycle;
+    jn->time += (uint64_t) INTR_CYCLE(cycle - jn->last_cycle);
+    jn->last_cycle = cycle;
+}
+
+/* Encodes `value` as a variable length integer (7 bits per byte,
+ * least significant first) to `buf`.
+ * Returns the number of bytes used.
+ */
+static
+size_t put_varint(uint8_t *buf, uint64_t value)
+{
+    size_t len;
+
+    len = 0;
+    while (value >= 0x80) {
+        buf[len++] = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    buf[len++] = (uint8_t) value;
+    return len;
+}
+
+/* Decodes a variable length integer at `*pos` of `data` (of size
+ * `size`) to `value`, and advances `*pos`.
+ * Returns TRUE on success.
+ */
+static
+int get_varint(const uint8_t *data, size_t size, size_t *pos,
+               uint64_t *value)
+{
+    unsigned int shift;
+    uint8_t b;
+
+    *value = 0;
+    shift = 0;
+    do {
+        if (*pos >= size || shift >= 64) return FALSE;
+        b = data[(*pos)++];
+        *value |= ((uint64_t) (b & 0x7F)) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return TRUE;
+}
+
+/* Makes room for `len` more bytes in the contents of the journal.
+ * Returns TRUE on success.
+ */
+static
+int reserve(struct journal *jn, size_t len)
+{
+    uint8_t *data;
+    size_t capacity;
+
+    if (jn->size + len <= jn->capacity) return TRUE;
+
+    capacity = (jn->capacity == 0) ? 4096 : 2 * jn->capacity;
+    while (capacity < jn->size + len) capacity *= 2;
+    data = (uint8_t *) realloc(jn->data, capacity);
+    if (unlikely(!data)) {
+        report_error("journal: reserve: memory exhausted");
+        return FALSE;
+    }
+    jn->data = data;
+    jn->capacity = capacity;
+    return TRUE;
+}
+
+/* Writes a record of type `type` with the payload `payload` (with
+ * `len` bytes) to the journal, keyed to the current time. The words
+ * in `words` (with `num_words` words) are appended to the payload.
+ * Returns TRUE on success.
+ */
+static
+int write_record(struct journal *jn, uint8_t type,
+                 const uint8_t *payload, size_t len,
+                 const uint16_t *words, size_t num_words)
+{
+    uint8_t *buf;
+    size_t i, hlen, total;
+
+    update_time(jn);
+
+    total = MAX_RECORD_HEADER + len + 2 * num_words;
+    if (unlikely(!reserve(jn, total))) {
+        report_error("journal: write_record: could not write record");
+        return FALSE;
+    }
+
+    buf = &jn->data[jn->size];
+    buf[0] = type;
+    hlen = 1 + put_varint(&buf[1], jn->time - jn->last_time);
+    if (type == JR_PACKET) {
+        jn->rx_record = jn->size + hlen;
+    }
+
+    memcpy(&buf[hlen], payload, len);
+    total = hlen + len;
+    for (i = 0; i < num_words; i++) {
+        buf[total++] = (uint8_t) (words[i] >> 8);
+        buf[total++] = (uint8_t) words[i];
+    }
+
+    if (jn->fp) {
+        if (unlikely(fwrite(buf, 1, total, jn->fp) != total)) {
+            report_error("journal: write_record: could not write record");
+            return FALSE;
+        }
+    }
+
+    jn->size += total;
+    jn->last_time = jn->time;
+    jn->num_records++;
+    return TRUE;
+}
+
+/* Appends the word `data` to the received packet.
+ * Returns TRUE on success.
+ */
+static
+int append_rx(struct journal *jn, uint16_t data)
+{
+    uint16_t *rx_data;
+    size_t capacity;
+
+    if (jn->rx_len == jn->rx_capacity) {
+        capacity = (jn->rx_capacity == 0) ? 1024 : 2 * jn->rx_capacity;
+        rx_data = (uint16_t *)
+            realloc(jn->rx_data, capacity * sizeof(uint16_t));
+        if (unlikely(!rx_data)) {
+            report_error("journal: append_rx: memory exhausted");
+            return FALSE;
+        }
+        jn->rx_data = rx_data;
+        jn->rx_capacity = capacity;
+    }
+    jn->rx_data[jn->rx_len++] = data;
+    return TRUE;
+}
+
+/* Receives a new packet from the inner transport, and writes it to
+ * the journal.
+ * Returns TRUE on success.
+ */
+static
+int record_packet(struct journal *jn)
+{
+    uint8_t payload[MAX_RECORD_HEADER];
+    size_t len;
+
+    if (!jn->inner) return TRUE;
+    if (unlikely(!(*jn->inner->receive)(jn->inner->arg, &len)))
+        return FALSE;
+    if (len == 0) return TRUE;
+
+    while ((*jn->inner->has_rx_data)(jn->inner->arg) > 0
+           && jn->rx_len < MAX_PACKET_WORDS) {
+        if (unlikely(!append_rx(jn,
+                                (*jn->inner->get_rx_data)(jn->inner->arg))))
+            return FALSE;
+    }
+    if (jn->rx_len == 0) return TRUE;
+
+    len = put_varint(payload, jn->rx_len);
+    return write_record(jn, JR_PACKET, payload, len,
+                        jn->rx_data, jn->rx_len);
+}
+
+/* Finds the record after the current one of the cursor `cur` whose
+ * type is in the bit mask `types` (1 << type), and updates the
+ * cursor. If there is none, the type of the cursor is set to zero.
+ * Returns TRUE on success (or FALSE if the journal is corrupted).
+ */
+static
+int next_record(const struct journal *jn, struct journal_cursor *cur,
+                unsigned int types)
+{
+    uint64_t delta, value;
+    size_t pos;
+    uint8_t type;
+
+    pos = cur->next;
+    while (pos < jn->size) {
+        type = jn->data[pos++];
+        if (unlikely(!get_varint(jn->data, jn->size, &pos, &delta)))
+            return FALSE;
+        cur->time += delta;
+        cur->pos = pos;
+
+        switch (type) {
+        case JR_KEYBOARD:
+            pos += 8;
+            break;
+        case JR_MOUSE:
+            if (unlikely(!get_varint(jn->data, jn->size, &pos, &value)
+                         || !get_varint(jn->data, jn->size, &pos, &value)
+                         || !get_varint(jn->data, jn->size, &pos, &value)))
+                return FALSE;
+            break;
+        case JR_PACKET:
+            if (unlikely(!get_varint(jn->data, jn->size, &pos, &value)
+                         || value == 0 || value > MAX_PACKET_WORDS))
+                return FALSE;
+            pos += 2 * (size_t) value;
+            break;
+        default:
+            return FALSE;
+        }
+        if (unlikely(pos > jn->size)) return FALSE;
+
+        cur->next = pos;
+        if (types & (1U << type)) {
+            cur->type = type;
+            return TRUE;
+        }
+    }
+
+    cur->type = 0;
+    cur->next = pos;
+    return TRUE;
+}
+
+/* Loads the packet of the record whose payload is at `pos` as the
+ * received packet.
+ * Returns TRUE on success.
+ */
+static
+int load_packet(struct journal *jn, size_t pos)
+{
+    uint64_t value;
+    size_t i;
+
+    jn->rx_record = pos;
+    jn->rx_len = 0;
+    jn->rx_pos = 0;
+
+    /* The journal was validated when loaded (or written). */
+    get_varint(jn->data, jn->size, &pos, &value);
+    for (i = 0; i < (size_t) value; i++, pos += 2) {
+        if (unlikely(!append_rx(jn, (((uint16_t) jn->data[pos]) << 8)
+                                | ((uint16_t) jn->data[pos + 1]))))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/* Loads the next replayed packet (if it is due) as the received
+ * packet.
+ */
+static
+void replay_packet(struct journal *jn)
+{
+    if (jn->packets.type != JR_PACKET) return;
+    update_time(jn);
+    if (jn->packets.time > jn->time) return;
+
+    load_packet(jn, jn->packets.pos);
+    next_record(jn, &jn->packets, 1U << JR_PACKET);
+}
+
+static
+int trp_receive(void *arg, size_t *len)
+{
+    struct journal *jn;
+
+    jn = (struct journal *) arg;
+    if (jn->rx_len == 0) {
+        if (jn->mode == JOURNAL_RECORD) {
+            if (unlikely(!record_packet(jn))) {
+                report_error("journal: receive: could not record packet");
+                *len = 0;
+                return FALSE;
+            }
+        } else {
+            replay_packet(jn);
+        }
+    }
+
+    *len = 2 * jn->rx_len;
+    return TRUE;
+}
+
+int journal_create(struct journal *jn)
+{
+    journal_initvar(jn);
+
+    jn->num_records = 0;
+    jn->size = 0;
+    jn->capacity = 0;
+    jn->rx_len = 0;
+    jn->rx_pos = 0;
+    jn->rx_capacity = 0;
+    jn->rx_record = 0;
+
+    jn->trp.clear_tx = &trp_clear_tx;
+    jn->trp.append_tx = &trp_append_tx;
+    jn->trp.send = &trp_send;
+    jn->trp.enable_rx = &trp_enable_rx;
+    jn->trp.clear_rx = &trp_clear_rx;
+    jn->trp.get_rx_data = &trp_get_rx_data;
+    jn->trp.has_rx_data = &trp_has_rx_data;
+    jn->trp.receive = &trp_receive;
+    jn->trp.arg = jn;
+    jn->inner = NULL;
+    return TRUE;
+}
+
+/* Attaches the journal to the simulator `sim`, and replaces the
+ * transport of the ethernet controller if `wrap` is set.
+ */
+static
+void attach(struct journal *jn, struct simulator *sim, int wrap)
+{
+    jn->sim = sim;
+    jn->time = 0;
+    jn->last_cycle = sim->cycle;
+    jn->last_time = 0;
+    jn->num_records = 0;
+    jn->rx_len = 0;
+    jn->rx_pos = 0;
+    jn->rewound = FALSE;
+
+    jn->inner = sim->ether.trp;
+    jn->wrapped = wrap;
+    if (wrap) {
+        ethernet_set_transport(&sim->ether, &jn->trp);
+    }
+    sim->journal = jn;
+}
+
+int journal_record(struct journal *jn, struct simulator *sim,
+                   const char *filename)
+{
+    uint8_t *header;
+
+    journal_close(jn);
+
+    if (unlikely(!reserve(jn, HEADER_SIZE))) {
+        report_error("journal: record: could not create header");
+        return FALSE;
+    }
+
+    header = jn->data;
+    memset(header, 0, HEADER_SIZE);
+    header[0] = (uint8_t) (JOURNAL_MAGIC >> 24);
+    header[1] = (uint8_t) (JOURNAL_MAGIC >> 16);
+    header[2] = (uint8_t) (JOURNAL_MAGIC >> 8);
+    header[3] = (uint8_t) JOURNAL_MAGIC;
+    header[4] = JOURNAL_VERSION;
+    header[5] = (sim->ether.trp) ? JF_ETHERNET : 0;
+    jn->size = HEADER_SIZE;
+
+    if (filename) {
+        jn->filename = (char *) malloc(strlen(filename) + 1);
+        if (unlikely(!jn->filename)) {
+            report_error("journal: record: memory exhausted");
+            journal_close(jn);
+            return FALSE;
+        }
+        strcpy(jn->filename, filename);
+
+        jn->fp = fopen(filename, "wb");
+        if (unlikely(!jn->fp)) {
+            report_error("journal: record: could not open `%s`", filename);
+            journal_close(jn);
+            return FALSE;
+        }
+
+        if (unlikely(fwrite(header, 1, HEADER_SIZE, jn->fp)
+                     != HEADER_SIZE)) {
+            report_error("journal: record: could not write header");
+            journal_close(jn);
+            return FALSE;
+        }
+    }
+
+    jn->mode = JOURNAL_RECORD;
+    attach(jn, sim, (sim->ether.trp != NULL));
+    return TRUE;
+}
+
+/* Loads the contents of the file named `filename` into `data`.
+ * Returns TRUE on success.
+ */
+static
+int load_file(struct journal *jn, const char *filename)
+{
+    FILE *fp;
+    long length;
+
+    fp = fopen(filename, "rb");
+    if (unlikely(!fp)) {
+        report_error("journal: replay: could not open `%s`", filename);
+        return FALSE;
+    }
+
+    if (unlikely(fseek(fp, 0, SEEK_END) != 0
+                 || (length = ftell(fp)) < 0
+                 || fseek(fp, 0, SEEK_SET) != 0)) {
+        report_error("journal: replay: could not get size of `%s`",
+                     filename);
+        fclose(fp);
+        return FALSE;
+    }
+
+    jn->size = (size_t) length;
+    jn->data = (uint8_t *) malloc((jn->size > 0) ? jn->size : 1);
+    if (unlikely(!jn->data)) {
+        report_error("journal: replay: memory exhausted");
+        fclose(fp);
+        return FALSE;
+    }
+    jn->capacity = jn->size;
+
+    if (unlikely(fread(jn->data, 1, jn->size, fp) != jn->size)) {
+        report_error("journal: replay: could not read `%s`", filename);
+        fclose(fp);
+        return FALSE;
+    }
+
+    fclose(fp);
+    return TRUE;
+}
+
+int journal_replay(struct journal *jn, struct simulator *sim,
+                   const char *filename)
+{
+    struct journal_cursor cur;
+    uint32_t magic;
+
+    journal_close(jn);
+
+    if (unlikely(!load_file(jn, filename))) {
+        journal_close(jn);
+        return FALSE;
+    }
+
+    magic = 0;
+    if (jn->size >= HEADER_SIZE) {
+        magic = (((uint32_t) jn->data[0]) << 24)
+            | (((uint32_t) jn->data[1]) << 16)
+            | (((uint32_t) jn->data[2]) << 8)
+            | ((uint32_t) jn->data[3]);
+    }
+    if (unlikely(magic != JOURNAL_MAGIC
+                 || jn->data[4] != JOURNAL_VERSION)) {
+        report_error("journal: replay: invalid journal `%s`", filename);
+        journal_close(jn);
+        return FALSE;
+    }
+
+    /* Validates all the records, so that they can be parsed later
+     * without checking for errors.
+     */
+    memset(&cur, 0, sizeof(cur));
+    cur.next = HEADER_SIZE;
+    if (unlikely(!next_record(jn, &cur, 0))) {
+        report_error("journal: replay: corrupted journal `%s`", filename);
+        journal_close(jn);
+        return FALSE;
+    }
+
+    memset(&jn->inputs, 0, sizeof(jn->inputs));
+    jn->inputs.next = HEADER_SIZE;
+    next_record(jn, &jn->inputs, (1U << JR_KEYBOARD) | (1U << JR_MOUSE));
+
+    memset(&jn->packets, 0, sizeof(jn->packets));
+    jn->packets.next = HEADER_SIZE;
+    next_record(jn, &jn->packets, 1U << JR_PACKET);
+
+    jn->mode = JOURNAL_REPLAY;
+    attach(jn, sim, (jn->data[5] & JF_ETHERNET));
+    return TRUE;
+}
+
+int journal_close(struct journal *jn)
+{
+    int ret;
+
+    ret = TRUE;
+    if (jn->sim) {
+        if (jn->wrapped) {
+            ethernet_set_transport(&jn->sim->ether, jn->inner);
+        }
+        jn->sim->journal = NULL;
+    }
+    jn->sim = NULL;
+    jn->inner = NULL;
+    jn->wrapped = FALSE;
+
+    if (jn->fp) {
+        if (unlikely(fclose(jn->fp) != 0)) {
+            report_error("journal: close: could not write journal");
+            ret = FALSE;
+        }
+    }
+    jn->fp = NULL;
+
+    if (jn->filename) free((void *) jn->filename);
+    jn->filename = NULL;
+
+    if (jn->data) free((void *) jn->data);
+    jn->data = NULL;
+    jn->size = 0;
+    jn->capacity = 0;
+
+    jn->mode = JOURNAL_OFF;
+    jn->rewound = FALSE;
+    return ret;
+}
+
+/* Encodes the signed `value` (in zigzag encoding) as a variable length
+ * integer to `buf`.
+ * Returns the number of bytes used.
+ */
+static
+size_t put_signed(uint8_t *buf, int16_t value)
+{
+    uint64_t v;
+
+    v = (value < 0) ? ((((uint64_t) -(int32_t) value) << 1) - 1)
+        : (((uint64_t) value) << 1);
+    return put_varint(buf, v);
+}
+
+/* Decodes a zigzag encoded `value`. */
+static
+int16_t get_signed(uint64_t value)
+{
+    if (value & 1) return (int16_t) -(int32_t) ((value + 1) >> 1);
+    return (int16_t) (value >> 1);
+}
+
+int journal_update(struct journal *jn, const struct keyboard *keyb,
+                   const struct mouse *mous)
+{
+    uint8_t payload[3 * MAX_RECORD_HEADER];
+    struct simulator *sim;
+    size_t len;
+    unsigned int i;
+
+    if (jn->mode != JOURNAL_RECORD) return TRUE;
+    sim = jn->sim;
+
+    if (keyb && memcmp(keyb->keys, sim->keyb.keys,
+                       sizeof(keyb->keys)) != 0) {
+        for (i = 0; i < 4; i++) {
+            payload[2 * i] = (uint8_t) (keyb->keys[i] >> 8);
+            payload[2 * i + 1] = (uint8_t) keyb->keys[i];
+        }
+        if (unlikely(!write_record(jn, JR_KEYBOARD, payload, 8, NULL, 0)))
+            return FALSE;
+    }
+
+    if (mous && (mous->buttons != sim->mous.buttons
+                 || mous->dx != 0 || mous->dy != 0)) {
+        len = put_varint(payload, mous->buttons);
+        len += put_signed(&payload[len], mous->dx);
+        len += put_signed(&payload[len], mous->dy);
+        if (unlikely(!write_record(jn, JR_MOUSE, payload, len, NULL, 0)))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Applies the current input record of the journal. */
+static
+void apply_input(struct journal *jn)
+{
+    struct keyboard keyb;
+    struct mouse mous;
+    uint64_t value;
+    const uint8_t *data;
+    size_t pos;
+    unsigned int i;
+
+    data = jn->data;
+    pos = jn->inputs.pos;
+    if (jn->inputs.type == JR_KEYBOARD) {
+        for (i = 0; i < 4; i++, pos += 2) {
+            keyb.keys[i] = (((uint16_t) data[pos]) << 8)
+                | ((uint16_t) data[pos + 1]);
+        }
+        keyboard_update_from(&jn->sim->keyb, &keyb);
+    } else {
+        get_varint(data, jn->size, &pos, &value);
+        mous.buttons = (uint16_t) value;
+        get_varint(data, jn->size, &pos, &value);
+        mous.dx = get_signed(value);
+        get_varint(data, jn->size, &pos, &value);
+        mous.dy = get_signed(value);
+        mous.dir_x = 0;
+        mouse_update_from(&jn->sim->mous, &mous);
+    }
+}
+
+uint32_t journal_inject(struct journal *jn, uint32_t max_cycles)
+{
+    uint64_t remaining;
+
+    if (jn->mode != JOURNAL_REPLAY) return max_cycles;
+
+    update_time(jn);
+    while (jn->inputs.type != 0 && jn->inputs.time <= jn->time) {
+        apply_input(jn);
+        next_record(jn, &jn->inputs,
+                    (1U << JR_KEYBOARD) | (1U << JR_MOUSE));
+    }
+
+    if (jn->inputs.type == 0) return max_cycles;
+    remaining = jn->inputs.time - jn->time;
+    return (remaining < max_cycles) ? (uint32_t) remaining : max_cycles;
+}
+
+void journal_mark(struct journal *jn, struct journal_mark *mark)
+{
+    update_time(jn);
+    mark->time = jn->time;
+
+    if (jn->mode == JOURNAL_RECORD) {
+        /* The records after the mark are not written yet. */
+        memset(&mark->inputs, 0, sizeof(mark->inputs));
+        mark->inputs.next = jn->size;
+        mark->inputs.time = jn->last_time;
+        mark->packets = mark->inputs;
+    } else {
+        mark->inputs = jn->inputs;
+        mark->packets = jn->packets;
+    }
+
+    mark->rx_record = (jn->rx_len > 0) ? jn->rx_record : 0;
+    mark->rx_pos = jn->rx_pos;
+}
+
+int journal_rewind(struct journal *jn, const struct journal_mark *mark)
+{
+    jn->time = mark->time;
+    jn->last_cycle = jn->sim->cycle;
+
+    /* While rewound, the transport of the journal does not pass
+     * anything to the inner transport.
+     */
+    if (jn->mode == JOURNAL_RECORD) {
+        jn->mode = JOURNAL_REPLAY;
+        jn->rewound = TRUE;
+    }
+    if (jn->rewound) {
+        jn->base = mark->inputs;
+    }
+
+    jn->inputs = mark->inputs;
+    if (jn->inputs.type == 0) {
+        next_record(jn, &jn->inputs,
+                    (1U << JR_KEYBOARD) | (1U << JR_MOUSE));
+    }
+
+    jn->packets = mark->packets;
+    if (jn->packets.type == 0) {
+        next_record(jn, &jn->packets, 1U << JR_PACKET);
+    }
+
+    jn->rx_len = 0;
+    jn->rx_pos = 0;
+    if (mark->rx_record != 0) {
+        if (unlikely(!load_packet(jn, mark->rx_record))) {
+            report_error("journal: rewind: could not load packet");
+            return FALSE;
+        }
+        jn->rx_pos = mark->rx_pos;
+    }
+    return TRUE;
+}
+
+int journal_resume(struct journal *jn)
+{
+    struct journal_cursor cur;
+    uint64_t last_time;
+    size_t end;
+
+    if (!jn->rewound) return TRUE;
+
+    /* When recording, the inputs that are due were already given to
+     * the simulator.
+     */
+    journal_inject(jn, 0);
+
+    /* The packets that are due were already received (the execution
+     * is the same as when recording), so the records after the
+     * current time are the first that were not replayed.
+     */
+    cur = jn->base;
+    end = cur.next;
+    last_time = cur.time;
+    while (TRUE) {
+        next_record(jn, &cur, (1U << JR_KEYBOARD) | (1U << JR_MOUSE)
+                    | (1U << JR_PACKET));
+        if (cur.type == 0 || cur.time > jn->time) break;
+        end = cur.next;
+        last_time = cur.time;
+    }
+
+    jn->mode = JOURNAL_RECORD;
+    jn->rewound = FALSE;
+    jn->last_time = last_time;
+    if (end == jn->size) return TRUE;
+    jn->size = end;
+
+    /* The file is written again without the discarded records. */
+    if (jn->fp) {
+        jn->fp = freopen(jn->filename, "wb", jn->fp);
+        if (unlikely(!jn->fp)) {
+            report_error("journal: resume: could not open `%s`",
+                         jn->filename);
+            return FALSE;
+        }
+
+        if (unlikely(fwrite(jn->data, 1, jn->size, jn->fp) != jn->size)) {
+            report_error("journal: resume: could not write journal");
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
@@ -0,0 +1,182 @@
+#ifndef __SIMULATOR_JOURNAL_H
+#define __SIMULATOR_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "simulator/simulator.h"
+#include "simulator/ethernet.h"
+#include "simulator/keyboard.h"
+#include "simulator/mouse.h"
+
+/* Data structures and types. */
+
+/* The modes of the journal. */
+enum journal_mode {
+    JOURNAL_OFF,                  /* Not attached to a simulator. */
+    JOURNAL_RECORD,               /* Recording the inputs. */
+    JOURNAL_REPLAY,               /* Replaying the inputs. */
+};
+
+/* A position in the journal being replayed. */
+struct journal_cursor {
+    size_t pos;                   /* The payload of the current record. */
+    size_t next;                  /* The position of the next record. */
+    uint64_t time;                /* The time of the current record. */
+    uint8_t type;                 /* The type of the current record
+                                   * (zero if there are no more records).
+                                   */
+};
+
+/* A point of the journal to rewind to (see journal_mark()). */
+struct journal_mark {
+    uint64_t time;                /* The time of the mark. */
+    struct journal_cursor inputs; /* The next keyboard or mouse record
+                                   * (or, if its type is zero, where to
+                                   * look for it).
+                                   */
+    struct journal_cursor packets; /* The same for the packet record. */
+    size_t rx_record;             /* The payload of the record of the
+                                   * packet being received (or zero).
+                                   */
+    size_t rx_pos;                /* Next word of that packet. */
+};
+
+/* Structure to record (or replay) the external inputs of the
+ * simulator, so that a run can be reproduced exactly. The inputs are
+ * the keyboard and the mouse (as given to simulator_update()) and the
+ * packets received by the ethernet controller. Each input is keyed to
+ * its time, which is the number of cycles since the journal started.
+ *
+ * The journal is a compact binary file, with a header followed by the
+ * records. Each record has its type (one byte), the time since the
+ * previous record (as a variable length integer) and the payload.
+ * The records are also kept in memory while recording, so that the
+ * journal can be rewound to replay the inputs since a mark.
+ */
+struct journal {
+    enum journal_mode mode;       /* The mode of the journal. */
+    struct simulator *sim;        /* The simulator (if not off). */
+    uint64_t time;                /* The current time (in cycles). */
+    int32_t last_cycle;           /* The cycle of the simulator at
+                                   * `time`.
+                                   */
+
+    FILE *fp;                     /* The file being recorded. */
+    char *filename;               /* The name of that file. */
+    uint64_t last_time;           /* Time of the last record written. */
+    unsigned int num_records;     /* Number of records written. */
+
+    uint8_t *data;                /* The contents of the journal (being
+                                   * recorded or replayed).
+                                   */
+    size_t size;                  /* The size of `data`. */
+    size_t capacity;              /* The capacity of `data`. */
+    struct journal_cursor inputs; /* The next keyboard or mouse record. */
+    struct journal_cursor packets; /* The next packet record. */
+
+    uint16_t *rx_data;            /* The words of the received packet. */
+    size_t rx_len;                /* Number of words of the packet. */
+    size_t rx_pos;                /* Next word of the packet. */
+    size_t rx_capacity;           /* Capacity of `rx_data`. */
+    size_t rx_record;             /* The payload of the record of the
+                                   * received packet.
+                                   */
+
+    int rewound;                  /* If the recording was suspended by
+                                   * journal_rewind().
+                                   */
+    struct journal_cursor base;   /* Where the records after the mark
+                                   * start (when rewound).
+                                   */
+
+    struct transport trp;         /* The transport given to the
+                                   * ethernet controller.
+                                   */
+    struct transport *inner;      /* The transport of the ethernet
+                                   * controller before the journal.
+                                   */
+    int wrapped;                  /* If the transport was replaced. */
+};
+
+/* Functions. */
+
+/* Initializes the journal variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void journal_initvar(struct journal *jn);
+
+/* Destroys the journal object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void journal_destroy(struct journal *jn);
+
+/* Creates a new journal object.
+ * This obeys the initvar / destroy / create protocol.
+ * Returns TRUE on success.
+ */
+int journal_create(struct journal *jn);
+
+/* Starts recording the inputs of the simulator `sim` to the file
+ * named `filename` (or only in memory if `filename` is NULL). The
+ * time of the journal starts at zero, so the recording should start
+ * from a known state (such as after a reset).
+ * Returns TRUE on success.
+ */
+int journal_record(struct journal *jn, struct simulator *sim,
+                   const char *filename);
+
+/* Starts replaying the inputs recorded in the file named `filename`
+ * into the simulator `sim`, which must be in the same state as when
+ * the recording started. While replaying, the inputs given to
+ * simulator_update() are ignored, and the simulator is disconnected
+ * from the network. The commands of the debugger (such as a reset)
+ * are not part of the journal.
+ * Returns TRUE on success.
+ */
+int journal_replay(struct journal *jn, struct simulator *sim,
+                   const char *filename);
+
+/* Stops recording (or replaying) the journal, and detaches it from
+ * the simulator.
+ * Returns TRUE on success.
+ */
+int journal_close(struct journal *jn);
+
+/* Processes the inputs given to simulator_update() (either can be
+ * NULL). When recording, the inputs that changed are written to the
+ * journal.
+ * Returns TRUE on success.
+ */
+int journal_update(struct journal *jn, const struct keyboard *keyb,
+                   const struct mouse *mous);
+
+/* Injects the keyboard and mouse inputs that are due, when replaying.
+ * Returns the number of cycles until the next input (but at most
+ * `max_cycles`), so that the simulator can stop there.
+ */
+uint32_t journal_inject(struct journal *jn, uint32_t max_cycles);
+
+/* Marks the current point of the journal in `mark`, to rewind to it
+ * later (after the simulator is restored to its current state).
+ */
+void journal_mark(struct journal *jn, struct journal_mark *mark);
+
+/* Rewinds the journal to `mark`, after the simulator was restored to
+ * the state it had at the mark. Until journal_resume() is called, the
+ * inputs since the mark are replayed, and the simulator is
+ * disconnected from the network. It can be rewound again meanwhile.
+ * Returns TRUE on success.
+ */
+int journal_rewind(struct journal *jn, const struct journal_mark *mark);
+
+/* Resumes the journal after journal_rewind(). When recording, the
+ * records after the current time are discarded (they belong to the
+ * execution that was rewound), and the recording continues from here.
+ * Returns TRUE on success.
+ */
+int journal_resume(struct journal *jn);
+
+#endif /* __SIMULATOR_JOURNAL_H */
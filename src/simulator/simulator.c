@@ -6,6 +6,8 @@
 
 #include "simulator/simulator.h"
 #include "simulator/intr.h"
+#include "simulator/journal.h"
+#include "simulator/fingerprint.h"
 #include "microcode/microcode.h"
 #include "microcode/nova.h"
 #include "simulator/rom.h"
@@ -16,6 +18,7 @@
 
 /* For the memory. */
 #define MEMORY_TOP                    0xFE00
+#define WATCH_MAP_SIZE     ((2 * NUM_MEMORY_BANKS * MEMORY_SIZE) / 8)
 #define XM_BANK_START                 0xFFE0
 #define XM_BANK_END (XM_BANK_START + TASK_NUM_TASKS)
 
@@ -26,8 +29,170 @@
 #define MA_EXTENDED                        1
 #define MA_WORD_BIT                        2
 
+/* The number of entries in the predecoded microcode cache. */
+#define MC_CACHE_SIZE \
+    (TASK_NUM_TASKS * NUM_MICROCODE_BANKS * MICROCODE_SIZE)
+
 /* The state size when serializing. */
-#define STATE_SIZE                    542419
+#define STATE_SIZE                    542495
+
+/* The header of the state files (the magic and the version). The
+ * version must be incremented whenever the serialized state changes.
+ * The first state files had no header (version 1).
+ */
+#define STATE_MAGIC               0x50535441 /* "PSTA" */
+#define STATE_VERSION                      2
+#define STATE_HEADER_SIZE                  8
+
+/* The maximum number of writes logged by the differential engine
+ * in a single step.
+ */
+#define MAX_LOGGED_WRITES                  4
+
+/* The maximum number of cycles of an iteration of an idle loop. */
+#define MAX_IDLE_PERIOD                 1024
+
+/* For the Nova fast path (in the emulator microcode of ROM0). */
+#define NOVA_START                      0020 /* Fetches the instruction. */
+#define NOVA_START_NEXT                 0525 /* Follows NOVA_START. */
+#define NOVA_MAX_CYCLES                   32 /* Cycles per instruction. */
+#define NOVA_MAX_ALU_CYCLES               16 /* Same for ALU instructions. */
+
+/* Data structures and types. */
+
+/* The handlers used by the threaded engine. These have the same
+ * parameters as read_bus(), compute_alu(), do_shift(), do_f1() and
+ * do_f2(), respectively. The microinstructions without a handler
+ * are executed by the interpreter (so that these generic functions
+ * are only called, and inlined, there).
+ */
+typedef uint16_t (*bus_cb)(struct simulator *sim,
+                           const struct microcode *mc,
+                           uint16_t modified_rsel);
+typedef uint16_t (*alu_cb)(struct simulator *sim,
+                           const struct microcode *mc,
+                           uint16_t bus, int *carry);
+typedef uint16_t (*shift_cb)(struct simulator *sim,
+                             const struct microcode *mc,
+                             int *load_r, int *nova_carry);
+typedef void (*f1_cb)(struct simulator *sim,
+                      const struct microcode *mc,
+                      uint16_t bus, uint16_t alu,
+                      uint8_t *nntask, int *swmode);
+typedef uint16_t (*f2_cb)(struct simulator *sim,
+                          const struct microcode *mc,
+                          uint16_t bus, uint16_t shifter_output,
+                          int nova_carry);
+
+/* Executes the current microinstruction (one per engine). */
+typedef void (*execute_cb)(struct simulator *sim);
+
+/* A microinstruction resolved into a chain of handlers. */
+struct threaded_code {
+    int resolved;                 /* If the handlers were resolved (this
+                                   * is cleared when the microcode is
+                                   * predecoded again).
+                                   */
+    bus_cb read_bus;              /* Computes the bus. */
+    alu_cb compute_alu;           /* Computes the ALU. */
+    shift_cb do_shift;            /* Computes the shifter output (or
+                                   * NULL to output L).
+                                   */
+    f1_cb do_f1;                  /* Performs the F1 function (or NULL
+                                   * if there is nothing to do).
+                                   */
+    f2_cb do_f2;                  /* Performs the F2 function (or NULL
+                                   * if there is nothing to do).
+                                   */
+    int interpret;                /* If some field has no handler, so
+                                   * the interpreter is used instead.
+                                   */
+    uint16_t rsel_mask;           /* The bits of RSEL modified by IR. */
+    uint8_t rsel_shift;           /* Where to get these bits from IR. */
+    int load_r;                   /* If the R register is loaded. */
+};
+
+/* A write logged by the differential engine. */
+struct logged_write {
+    int microcode;                /* If it was a write to the microcode
+                                   * RAM (instead of main memory).
+                                   */
+    uint16_t address;             /* The address of the write. */
+    uint8_t task;                 /* The task performing the write. */
+    int extended_memory;          /* If it was an extended memory write. */
+    uint32_t old_value;           /* The value before the write. */
+    uint32_t new_value;           /* The value written. */
+};
+
+/* Internal state of the differential engine. */
+struct differential {
+    struct serdes before;         /* The state before the step. */
+    struct serdes reference;      /* The state after the interpreter. */
+    struct serdes check;          /* The state after the threaded engine. */
+
+    unsigned int num_writes;      /* Number of writes in the log. */
+    struct logged_write writes[MAX_LOGGED_WRITES];
+
+    unsigned int ref_num_writes;  /* Number of writes by the interpreter. */
+    struct logged_write ref_writes[MAX_LOGGED_WRITES];
+};
+
+/* The state compared by the idle loop detection. This is everything
+ * that the emulator task can read or modify, except for the memory
+ * and the other devices (which are not modified without being counted
+ * in `num_writes`). Only the S register bank of the emulator task is
+ * kept, since the other tasks do not run during an idle loop.
+ */
+struct idle_state {
+    uint16_t r[NUM_R_REGISTERS];  /* The R registers. */
+    uint16_t s[NUM_S_REGISTERS];  /* The S registers of the emulator. */
+    uint16_t task_mpc[TASK_NUM_TASKS]; /* The MPC of each task. */
+    uint16_t xm_banks[TASK_NUM_TASKS]; /* The memory bank registers. */
+    uint8_t sreg_banks[TASK_NUM_TASKS]; /* The S register banks. */
+
+    uint32_t mir;                 /* The micro instruction register. */
+    uint16_t t, l, m;             /* The T, L, and M registers. */
+    uint16_t mar, ir, mpc;        /* The MAR, IR, and MPC. */
+    uint16_t rmr, cram_addr;      /* The RMR and the control RAM address. */
+    uint16_t mem_cycle;           /* The memory cycle. */
+    uint16_t mem_low, mem_high;   /* The latched memory values. */
+    uint16_t mem_status;          /* The status of memory operation. */
+    uint8_t mem_task;             /* The task of the memory operation. */
+    uint8_t ctask, ntask;         /* The current and next tasks. */
+    uint8_t flags;                /* The flags of the simulator (one bit
+                                   * per flag).
+                                   */
+
+    uint16_t dsk_pending;         /* The pending mask of the disk. */
+    uint16_t displ_pending;       /* The pending mask of the display. */
+    uint16_t ether_pending;       /* The pending mask of the ethernet. */
+    int countdown_wakeup;         /* The ethernet countdown wakeup. */
+    int mouse_dx, mouse_dy;       /* The pending mouse movement. */
+    int mouse_dir_x;              /* The direction of the mouse. */
+};
+
+/* Internal state of the idle loop detection. An idle loop is found
+ * when the emulator task reaches the same MPC twice, with the same
+ * state, and without any other task running in between.
+ */
+struct idle_loop {
+    uint16_t mpc;                 /* The MPC of the last visit. */
+    int32_t cycle;                /* The cycle of the last visit. */
+    int32_t task_cycle;           /* The emulator task cycle of the
+                                   * last visit.
+                                   */
+    uint64_t steps;               /* The steps of the last visit. */
+    uint64_t mem_stalls;          /* The memory stalls of the last
+                                   * visit.
+                                   */
+    uint32_t num_writes;          /* The writes of the last visit. */
+    uint16_t r[NUM_R_REGISTERS];  /* The R registers of the last visit. */
+    int has_state;                /* If `state` was saved in the last
+                                   * visit.
+                                   */
+    struct idle_state state;      /* The state of the last visit. */
+    struct idle_state check;      /* The current state. */
+};
 
 /* Functions. */
 
@@ -38,11 +203,22 @@ void simulator_initvar(struct simulator *sim)
     sim->acs_rom = NULL;
     sim->consts = NULL;
     sim->microcode = NULL;
+    sim->mc_cache = NULL;
+    sim->tcode = NULL;
+    sim->diff = NULL;
+    sim->idle = NULL;
+    sim->prof_steps = NULL;
+    sim->prof_cycles = NULL;
+    sim->nova_prof = NULL;
     sim->task_mpc = NULL;
     sim->task_cycle = NULL;
     sim->mem = NULL;
     sim->xm_banks = NULL;
     sim->sreg_banks = NULL;
+    sim->page_epoch = NULL;
+    sim->watch_map = NULL;
+    sim->journal = NULL;
+    sim->fprint = NULL;
 
     disk_initvar(&sim->dsk);
     display_initvar(&sim->displ);
@@ -74,6 +250,32 @@ void simulator_destroy(struct simulator *sim)
     if (sim->microcode) free((void *) sim->microcode);
     sim->microcode = NULL;
 
+    if (sim->mc_cache) free((void *) sim->mc_cache);
+    sim->mc_cache = NULL;
+
+    if (sim->tcode) free((void *) sim->tcode);
+    sim->tcode = NULL;
+
+    if (sim->diff) {
+        serdes_destroy(&sim->diff->before);
+        serdes_destroy(&sim->diff->reference);
+        serdes_destroy(&sim->diff->check);
+        free((void *) sim->diff);
+    }
+    sim->diff = NULL;
+
+    if (sim->idle) free((void *) sim->idle);
+    sim->idle = NULL;
+
+    if (sim->prof_steps) free((void *) sim->prof_steps);
+    sim->prof_steps = NULL;
+
+    if (sim->prof_cycles) free((void *) sim->prof_cycles);
+    sim->prof_cycles = NULL;
+
+    if (sim->nova_prof) free((void *) sim->nova_prof);
+    sim->nova_prof = NULL;
+
     if (sim->task_mpc) free((void *) sim->task_mpc);
     sim->task_mpc = NULL;
 
@@ -88,9 +290,78 @@ void simulator_destroy(struct simulator *sim)
 
     if (sim->sreg_banks) free((void *) sim->sreg_banks);
     sim->sreg_banks = NULL;
+
+    if (sim->page_epoch) free((void *) sim->page_epoch);
+    sim->page_epoch = NULL;
+
+    simulator_clear_watches(sim);
+}
+
+/* Predecodes the microinstruction at control store address `address`
+ * for every task, and stores the results in the predecoded microcode
+ * cache.
+ */
+static
+void predecode_address(struct simulator *sim, uint16_t address)
+{
+    struct microcode *mc;
+    size_t idx;
+    uint8_t task;
+
+    for (task = 0; task < TASK_NUM_TASKS; task++) {
+        idx = task * NUM_MICROCODE_BANKS * MICROCODE_SIZE + address;
+        mc = &sim->mc_cache[idx];
+        microcode_predecode(mc, sim->sys_type, address,
+                            sim->microcode[address], task);
+
+        /* The threaded engine resolves it again. */
+        if (sim->tcode) sim->tcode[idx].resolved = FALSE;
+    }
 }
 
-int simulator_create(struct simulator *sim, enum system_type sys_type)
+/* Rebuilds the whole predecoded microcode cache. This must be
+ * called every time the microcode (or the system type) is replaced.
+ */
+static
+void predecode_microcode(struct simulator *sim)
+{
+    uint16_t address;
+
+    for (address = 0;
+         address < NUM_MICROCODE_BANKS * MICROCODE_SIZE;
+         address++) {
+        predecode_address(sim, address);
+    }
+}
+
+/* Creates the state used by the differential engine.
+ * Returns TRUE on success.
+ */
+static
+int create_differential(struct simulator *sim)
+{
+    struct differential *diff;
+
+    diff = (struct differential *) malloc(sizeof(struct differential));
+    if (unlikely(!diff)) return FALSE;
+
+    serdes_initvar(&diff->before);
+    serdes_initvar(&diff->reference);
+    serdes_initvar(&diff->check);
+    diff->num_writes = 0;
+    diff->ref_num_writes = 0;
+    sim->diff = diff;
+
+    if (unlikely(!serdes_create(&diff->before, 4096, TRUE)
+                 || !serdes_create(&diff->reference, 4096, TRUE)
+                 || !serdes_create(&diff->check, 4096, TRUE))) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int simulator_create(struct simulator *sim, enum system_type sys_type,
+                     enum sim_engine engine)
 {
     simulator_initvar(sim);
 
@@ -102,6 +373,8 @@ int simulator_create(struct simulator *sim, enum system_type sys_type)
         malloc(CONSTANT_SIZE * sizeof(uint16_t));
     sim->microcode = (uint32_t *)
         malloc(NUM_MICROCODE_BANKS * MICROCODE_SIZE * sizeof(uint32_t));
+    sim->mc_cache = (struct microcode *)
+        malloc(MC_CACHE_SIZE * sizeof(struct microcode));
     sim->task_mpc = (uint16_t *)
         malloc(TASK_NUM_TASKS * sizeof(uint16_t));
     sim->task_cycle = (int32_t *)
@@ -112,17 +385,39 @@ int simulator_create(struct simulator *sim, enum system_type sys_type)
         malloc(TASK_NUM_TASKS * sizeof(uint16_t));
     sim->sreg_banks = (uint8_t *)
         malloc(TASK_NUM_TASKS * sizeof(uint8_t));
+    sim->page_epoch = (uint32_t *)
+        calloc(NUM_MEMORY_PAGES, sizeof(uint32_t));
 
     if (unlikely(!sim->r || !sim->s
                  || !sim->acs_rom || !sim->consts || !sim->microcode
-                 || !sim->task_mpc || !sim->task_cycle
+                 || !sim->mc_cache || !sim->task_mpc || !sim->task_cycle
                  || !sim->mem || !sim->xm_banks
-                 || !sim->sreg_banks)) {
+                 || !sim->sreg_banks || !sim->page_epoch)) {
         report_error("sim: create: could not allocate memory");
         simulator_destroy(sim);
         return FALSE;
     }
 
+    if (engine != ENGINE_INTERPRETER) {
+        /* The handlers are resolved on demand. */
+        sim->tcode = (struct threaded_code *)
+            calloc(MC_CACHE_SIZE, sizeof(struct threaded_code));
+        if (unlikely(!sim->tcode)) {
+            report_error("sim: create: could not allocate memory");
+            simulator_destroy(sim);
+            return FALSE;
+        }
+    }
+
+    if (engine == ENGINE_DIFFERENTIAL) {
+        if (unlikely(!create_differential(sim))) {
+            report_error("sim: create: could not create "
+                         "differential engine");
+            simulator_destroy(sim);
+            return FALSE;
+        }
+    }
+
     /* Copy the ROMs into the simulator.
      * Note:  the constant ROM and the microcode ROM can be overwritten
      * later with the functions simulator_load_constant_rom() and with
@@ -142,19 +437,20 @@ int simulator_create(struct simulator *sim, enum system_type sys_type)
         }
     }
 
-    if (unlikely(!disk_create(&sim->dsk))) {
+    scheduler_clear(&sim->sched, 0);
+    if (unlikely(!disk_create(&sim->dsk, &sim->sched))) {
         report_error("sim: create: could not create disk controller");
         simulator_destroy(sim);
         return FALSE;
     }
 
-    if (unlikely(!display_create(&sim->displ))) {
+    if (unlikely(!display_create(&sim->displ, &sim->sched))) {
         report_error("sim: create: could not create display controller");
         simulator_destroy(sim);
         return FALSE;
     }
 
-    if (unlikely(!ethernet_create(&sim->ether))) {
+    if (unlikely(!ethernet_create(&sim->ether, &sim->sched))) {
         report_error("sim: create: could not create ethernet controller");
         simulator_destroy(sim);
         return FALSE;
@@ -173,6 +469,21 @@ int simulator_create(struct simulator *sim, enum system_type sys_type)
     }
 
     sim->sys_type = sys_type;
+    sim->engine = engine;
+    sim->epoch = 1;
+    sim->rom_epoch = sim->epoch;
+    sim->dsk.epoch = sim->epoch;
+    sim->watch_hit = 0;
+    sim->watch_address = 0;
+    sim->stop_mpc = 0;
+    sim->stop_task = 0;
+    sim->num_writes = 0;
+    sim->steps = 0;
+    sim->idle_cycles = 0;
+    sim->nova_fast_path = FALSE;
+    sim->nova_fast_insns = 0;
+    simulator_clear_stats(sim);
+    predecode_microcode(sim);
     return TRUE;
 }
 
@@ -206,6 +517,7 @@ int simulator_load_constant_rom(struct simulator *sim,
     serdes_rewind(&sd);
     serdes_get16_array(&sd, sim->consts, CONSTANT_SIZE);
     serdes_destroy(&sd);
+    sim->rom_epoch = sim->epoch;
     return TRUE;
 }
 
@@ -248,44 +560,21 @@ int simulator_load_microcode_rom(struct simulator *sim,
     serdes_rewind(&sd);
     serdes_get32_array(&sd, &sim->microcode[offset], MICROCODE_SIZE);
     serdes_destroy(&sd);
+
+    predecode_microcode(sim);
+    sim->rom_epoch = sim->epoch;
     return TRUE;
 }
 
-/* Updates the intr_cycle.
- * The parameter `must_advance` is passed to compute_intr_cycle().
- * Returns TRUE on success.
- */
+/* Marks all the memory pages as written in the current epoch. */
 static
-int update_intr_cycle(struct simulator *sim, int must_advance)
+void touch_all_pages(struct simulator *sim)
 {
-    int32_t intr_cycles[3];
-    int32_t cycle, diff;
-
-    intr_cycles[0] = sim->dsk.intr_cycle;
-    intr_cycles[1] = sim->displ.intr_cycle;
-    intr_cycles[2] = sim->ether.intr_cycle;
-
-    /* If the current interrupt cycle is set, use the minimum
-     * between intr_cycle and cycle.
-     */
-    if (sim->intr_cycle >= 0) {
-        cycle = sim->intr_cycle;
-        diff = INTR_CYCLE(cycle - sim->cycle);
-        if (!INTR_DIFF_NEG(diff))
-            cycle = sim->cycle;
-    } else {
-        cycle = sim->cycle;
-    }
+    unsigned int page;
 
-    if (unlikely(!compute_intr_cycle(cycle, must_advance,
-                                     3, intr_cycles,
-                                     &sim->intr_cycle))) {
-        report_error("simulator: update_intr_cycle: "
-                     "error in computing interrupt cycle");
-        sim->error = TRUE;
-        return FALSE;
+    for (page = 0; page < NUM_MEMORY_PAGES; page++) {
+        sim->page_epoch[page] = sim->epoch;
     }
-    return TRUE;
 }
 
 void simulator_reset(struct simulator *sim)
@@ -295,6 +584,7 @@ void simulator_reset(struct simulator *sim)
     memset(sim->r, 0, NUM_R_REGISTERS * sizeof(uint16_t));
     memset(sim->s, 0, NUM_S_BANKS * NUM_S_REGISTERS * sizeof(uint16_t));
     memset(sim->mem, 0, NUM_MEMORY_BANKS * MEMORY_SIZE * sizeof(uint16_t));
+    touch_all_pages(sim);
     memset(sim->xm_banks, 0, TASK_NUM_TASKS * sizeof(uint16_t));
     memset(sim->sreg_banks, 0, TASK_NUM_TASKS * sizeof(uint8_t));
 
@@ -303,6 +593,7 @@ void simulator_reset(struct simulator *sim)
         sim->task_cycle[task] = 0;
     }
 
+    scheduler_clear(&sim->sched, 0);
     disk_reset(&sim->dsk);
     display_reset(&sim->displ);
     if (unlikely(!ethernet_reset(&sim->ether))) {
@@ -344,10 +635,6 @@ void simulator_reset(struct simulator *sim)
     sim->mem_low = 0xFFFFU;
     sim->mem_high = 0xFFFFU;
     sim->mem_status = 0;
-
-    /* Sets the next interrupt cycle. */
-    sim->intr_cycle = 0;
-    update_intr_cycle(sim, TRUE);
 }
 
 uint16_t simulator_read(const struct simulator *sim, uint16_t address,
@@ -414,6 +701,85 @@ void simulator_write(struct simulator *sim, uint16_t address,
             : ((sim->xm_banks[task] >> 2) & 0x3);
         base_mem = &sim->mem[bank_number * MEMORY_SIZE];
         base_mem[address] = data;
+        sim->page_epoch[(bank_number * MEMORY_SIZE + address)
+                        >> MEMORY_PAGE_SHIFT] = sim->epoch;
+        sim->num_writes++;
+    }
+}
+
+uint32_t simulator_next_epoch(struct simulator *sim)
+{
+    uint32_t epoch;
+
+    epoch = sim->epoch++;
+    sim->dsk.epoch = sim->epoch;
+    return epoch;
+}
+
+int simulator_watch(struct simulator *sim, uint8_t bank, uint16_t first,
+                    uint16_t last, unsigned int flags)
+{
+    uint32_t idx, address, bank_number;
+
+    if (!sim->watch_map) {
+        sim->watch_map = (uint8_t *)
+            calloc(WATCH_MAP_SIZE, sizeof(uint8_t));
+        if (unlikely(!sim->watch_map)) {
+            report_error("sim: watch: memory exhausted");
+            return FALSE;
+        }
+    }
+
+    for (bank_number = 0; bank_number < NUM_MEMORY_BANKS; bank_number++) {
+        if (bank != WATCH_ALL_BANKS && bank != bank_number) continue;
+
+        for (address = first; address <= last; address++) {
+            idx = (bank_number * MEMORY_SIZE + address) << 1;
+            if (flags & WATCH_READ) {
+                sim->watch_map[idx >> 3] |= (uint8_t) (1 << (idx & 7));
+            }
+            idx |= 1;
+            if (flags & WATCH_WRITE) {
+                sim->watch_map[idx >> 3] |= (uint8_t) (1 << (idx & 7));
+            }
+        }
+    }
+    return TRUE;
+}
+
+void simulator_clear_watches(struct simulator *sim)
+{
+    if (sim->watch_map) free((void *) sim->watch_map);
+    sim->watch_map = NULL;
+}
+
+void simulator_set_stop_mpc(struct simulator *sim, uint8_t task,
+                            uint16_t mpc)
+{
+    sim->stop_task = task;
+    sim->stop_mpc = mpc;
+}
+
+/* Checks if the access to memory (given by `flag`, either WATCH_READ
+ * or WATCH_WRITE) at `address` by the task `task` is being watched.
+ * The parameter `extended_memory` specifies if it is an extended
+ * memory access.
+ */
+static
+void check_watch(struct simulator *sim, uint16_t address, uint8_t task,
+                 int extended_memory, unsigned int flag)
+{
+    uint32_t idx, physical;
+    int bank_number;
+
+    bank_number = extended_memory
+        ? (sim->xm_banks[task] & 0x3)
+        : ((sim->xm_banks[task] >> 2) & 0x3);
+    physical = ((uint32_t) bank_number) * MEMORY_SIZE + address;
+    idx = (physical << 1) | ((flag == WATCH_WRITE) ? 1 : 0);
+    if (sim->watch_map[idx >> 3] & (1 << (idx & 7))) {
+        sim->watch_hit |= flag;
+        sim->watch_address = physical;
     }
 }
 
@@ -429,6 +795,7 @@ void update_cycles(struct simulator *sim)
     task = sim->ctask;
     sim->task_cycle[task]++;
     sim->task_cycle[task] = INTR_CYCLE(sim->task_cycle[task]);
+    sim->stats.task_cycles[task]++;
 
     /* Updates the memory cycle. */
     if (sim->mem_cycle != 0xFFFF) {
@@ -440,6 +807,18 @@ void update_cycles(struct simulator *sim)
     }
 }
 
+/* Waits (stalling the processor) until the memory cycle reaches
+ * `min_cycle`.
+ */
+static
+void wait_memory(struct simulator *sim, uint16_t min_cycle)
+{
+    while (sim->mem_cycle < min_cycle) {
+        update_cycles(sim);
+        sim->stats.mem_stalls++;
+    }
+}
+
 /* Obtains the RSEL value (which can be modified by F2_EMU_ACSOURCE,
  * F2_EMU_ACDEST, and F2_EMU_LOAD_DNS).
  * The current predecoded microcode is in `mc`.
@@ -473,6 +852,33 @@ uint16_t get_modified_rsel(struct simulator *sim,
     return rsel;
 }
 
+/* Logs a write performed in the current step, so that the differential
+ * engine can undo it. The parameter `microcode` tells if this is a write
+ * to the microcode RAM. The remaining parameters `address`, `task`,
+ * `extended_memory`, `old_value` and `new_value` describe the write.
+ */
+static
+void log_write(struct simulator *sim, int microcode, uint16_t address,
+               uint8_t task, int extended_memory,
+               uint32_t old_value, uint32_t new_value)
+{
+    struct logged_write *lw;
+
+    if (unlikely(sim->diff->num_writes >= MAX_LOGGED_WRITES)) {
+        report_error("simulator: step: too many writes to log");
+        sim->error = TRUE;
+        return;
+    }
+
+    lw = &sim->diff->writes[sim->diff->num_writes++];
+    lw->microcode = microcode;
+    lw->address = address;
+    lw->task = task;
+    lw->extended_memory = extended_memory;
+    lw->old_value = old_value;
+    lw->new_value = new_value;
+}
+
 /* Decodes an address to access the microcode RAM.
  * The parameter `low_half` specifies whether to read the lower
  * or the upper half of the word.
@@ -540,7 +946,8 @@ uint16_t do_rdram(struct simulator *sim)
     return val;
 }
 
-/* Performs any pending writes to the microcode RAM.
+/* Performs the pending write to the microcode RAM (the callers check
+ * `sim->wrtram`, so that the common case needs no call).
  * The value of the alu isin `alu`.
  */
 static
@@ -550,7 +957,6 @@ void do_wrtram(struct simulator *sim, uint16_t alu)
     uint16_t addr;
     int low_half;
 
-    if (!sim->wrtram) return;
     addr = decode_ram_address(sim, &low_half);
     if (sim->error) return;
 
@@ -558,8 +964,67 @@ void do_wrtram(struct simulator *sim, uint16_t alu)
     mcode |= alu;
     mcode ^= MC_INVERT_MASK;
 
+    if (unlikely(sim->diff != NULL)) {
+        log_write(sim, TRUE, addr, 0, FALSE, sim->microcode[addr], mcode);
+    }
+
     sim->microcode[addr] = mcode;
+    sim->rom_epoch = sim->epoch;
+    sim->num_writes++;
     sim->wrtram = FALSE;
+
+    /* Invalidates the predecoded microcode. */
+    predecode_address(sim, addr);
+}
+
+/* Reads the memory data (MD) latched by the last load of MAR.
+ * The current predecoded microcode is in `mc`.
+ * Returns the memory data.
+ */
+static
+uint16_t read_md(struct simulator *sim, const struct microcode *mc)
+{
+    uint16_t output;
+
+    /* Wait until cycle 5 to perform the read. */
+    wait_memory(sim, 5);
+
+    if (mc->sys_type == ALTO_I) {
+        if (sim->mem_cycle == 5) {
+            if (unlikely(sim->watch_map != NULL)) {
+                check_watch(sim, sim->mar, sim->mem_task,
+                            sim->mem_status & MA_EXTENDED, WATCH_READ);
+            }
+            return sim->mem_low;
+        } else if (sim->mem_cycle == 6) {
+            if (unlikely(sim->watch_map != NULL)) {
+                check_watch(sim, 1 | sim->mar, sim->mem_task,
+                            sim->mem_status & MA_EXTENDED, WATCH_READ);
+            }
+            return sim->mem_high;
+        }
+
+        report_error("simulator: step: "
+                     "unexpected read memory cycle");
+        sim->error = TRUE;
+        return 0;
+    }
+
+    /* Alto II. */
+    if (sim->mem_status & MA_WORD_BIT) {
+        output = sim->mem_high;
+    } else {
+        output = sim->mem_low;
+    }
+
+    if (unlikely(sim->watch_map != NULL)) {
+        check_watch(sim, (sim->mem_status & MA_WORD_BIT)
+                             ? (1 ^ sim->mar) : sim->mar,
+                    sim->mem_task, sim->mem_status & MA_EXTENDED,
+                    WATCH_READ);
+    }
+    sim->mem_status ^= MA_WORD_BIT;
+    return output;
 }
 
 /* Auxiliary function to obtain the value of the bus.
@@ -616,33 +1081,9 @@ uint16_t read_bus(struct simulator *sim, const struct microcode *mc,
     case BS_NONE:
         break;
     case BS_READ_MD:
-        /* Wait until cycle 5 to perform the read. */
-        while (sim->mem_cycle < 5) {
-            update_cycles(sim);
-        }
-
-        if (mc->sys_type == ALTO_I) {
-            if (sim->mem_cycle == 5) {
-                output &= sim->mem_low;
-            } else if (sim->mem_cycle == 6) {
-                output &= sim->mem_high;
-            } else {
-                report_error("simulator: step: "
-                             "unexpected read memory cycle");
-                sim->error = TRUE;
-                return 0;
-            }
-        } else {
-            /* Alto II. */
-            if (sim->mem_cycle >= 5) {
-                if (sim->mem_status & MA_WORD_BIT) {
-                    output &= sim->mem_high;
-                } else {
-                    output &= sim->mem_low;
-                }
-                sim->mem_status ^= MA_WORD_BIT;
-            }
-        }
+        t = read_md(sim, mc);
+        if (sim->error) return 0;
+        output &= t;
         break;
     case BS_READ_MOUSE:
         output &= mouse_poll_bits(&sim->mous);
@@ -693,6 +1134,121 @@ uint16_t read_bus(struct simulator *sim, const struct microcode *mc,
     return output;
 }
 
+/* The bus handlers used by the threaded engine. They have the same
+ * semantics as read_bus() for the particular bus source (including
+ * the constant ROM masking for bus sources >= 4), but do not handle
+ * RDRAM nor the F1 functions that modify the bus.
+ */
+
+static
+uint16_t bus_read_r(struct simulator *sim, const struct microcode *mc,
+                    uint16_t modified_rsel)
+{
+    UNUSED(mc);
+    return sim->r[modified_rsel];
+}
+
+static
+uint16_t bus_load_r(struct simulator *sim, const struct microcode *mc,
+                    uint16_t modified_rsel)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(modified_rsel);
+    return 0;
+}
+
+static
+uint16_t bus_none(struct simulator *sim, const struct microcode *mc,
+                  uint16_t modified_rsel)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(modified_rsel);
+    return 0xFFFFU;
+}
+
+static
+uint16_t bus_constant(struct simulator *sim, const struct microcode *mc,
+                      uint16_t modified_rsel)
+{
+    UNUSED(modified_rsel);
+    return sim->consts[mc->const_addr];
+}
+
+static
+uint16_t bus_read_md(struct simulator *sim, const struct microcode *mc,
+                     uint16_t modified_rsel)
+{
+    uint16_t output;
+
+    UNUSED(modified_rsel);
+    output = read_md(sim, mc);
+    if (sim->error) return 0;
+    return output & sim->consts[mc->const_addr];
+}
+
+static
+uint16_t bus_read_mouse(struct simulator *sim, const struct microcode *mc,
+                        uint16_t modified_rsel)
+{
+    UNUSED(modified_rsel);
+    return mouse_poll_bits(&sim->mous) & sim->consts[mc->const_addr];
+}
+
+static
+uint16_t bus_read_disp(struct simulator *sim, const struct microcode *mc,
+                       uint16_t modified_rsel)
+{
+    uint16_t t;
+
+    UNUSED(modified_rsel);
+    t = sim->ir & 0x00FFU;
+    if (((sim->ir & 0x300) != 0) && ((sim->ir & 0x80) != 0)) {
+        t |= 0xFF00U;
+    }
+    return t & sim->consts[mc->const_addr];
+}
+
+static
+uint16_t bus_read_s_location(struct simulator *sim,
+                             const struct microcode *mc,
+                             uint16_t modified_rsel)
+{
+    uint8_t rb;
+
+    UNUSED(modified_rsel);
+    /* Do not use modified_rsel here. */
+    if (mc->rsel == 0) return sim->m;
+    rb = sim->sreg_banks[mc->task];
+    return sim->s[rb * NUM_R_REGISTERS + mc->rsel];
+}
+
+static
+uint16_t bus_eidfct(struct simulator *sim, const struct microcode *mc,
+                    uint16_t modified_rsel)
+{
+    UNUSED(modified_rsel);
+    return ethernet_eidfct(&sim->ether) & sim->consts[mc->const_addr];
+}
+
+static
+uint16_t bus_read_kstat(struct simulator *sim, const struct microcode *mc,
+                        uint16_t modified_rsel)
+{
+    UNUSED(mc);
+    UNUSED(modified_rsel);
+    return disk_read_kstat(&sim->dsk);
+}
+
+static
+uint16_t bus_read_kdata(struct simulator *sim, const struct microcode *mc,
+                        uint16_t modified_rsel)
+{
+    UNUSED(modified_rsel);
+    return disk_read_kdata(&sim->dsk) & sim->consts[mc->const_addr];
+}
+
 /* Auxiliary function to perform the ALU computation.
  * The current predecoded microcode is in `mc`.
  * The value of the bus is in `bus`, and the carry output is written
@@ -762,53 +1318,203 @@ uint16_t compute_alu(struct simulator *sim, const struct microcode *mc,
     return (uint16_t) res;
 }
 
-/* Auxiliary function to perform the shift computation.
- * The current predecoded microcode is in `mc`.
- * This function might modify the value of `load_r`, in case it is
- * performing a NOVA style shift.
- * The value of the nova carry is given by `nova_carry`, and since it is
- * a pointer, it will be populated with the new value of the nova carry
- * on return.
- * Returns the value of the shifter.
+/* The ALU handlers used by the threaded engine. They have the same
+ * semantics as compute_alu() for the particular ALU function.
  */
+
 static
-uint16_t do_shift(struct simulator *sim, const struct microcode *mc,
-                  int *load_r, int *nova_carry)
+uint16_t alu_bus(struct simulator *sim, const struct microcode *mc,
+                 uint16_t bus, int *carry)
 {
-    uint16_t res;
-    int dns, has_magic;
-    int carry;
+    UNUSED(sim);
+    UNUSED(mc);
+    *carry = 0;
+    return bus;
+}
 
-    if (mc->task == TASK_EMULATOR) {
-        dns = (mc->f2 == F2_EMU_LOAD_DNS);
-        has_magic = (mc->f2 == F2_EMU_MAGIC);
-    } else {
-        dns = FALSE;
-        has_magic = FALSE;
-    }
+static
+uint16_t alu_t(struct simulator *sim, const struct microcode *mc,
+               uint16_t bus, int *carry)
+{
+    UNUSED(mc);
+    UNUSED(bus);
+    *carry = 0;
+    return sim->t;
+}
 
-    if (dns) {
-        if ((sim->ir & 0x0008) != 0)
-            *load_r = FALSE;
+static
+uint16_t alu_bus_or_t(struct simulator *sim, const struct microcode *mc,
+                      uint16_t bus, int *carry)
+{
+    UNUSED(mc);
+    *carry = 0;
+    return bus | sim->t;
+}
 
-        switch ((sim->ir >> 4) & 3) {
-        case 0: /* not affected. */
-            carry = sim->carry;
-            break;
-        case 1: /* Z */
-            carry = 0;
-            break;
-        case 2: /* O */
-            carry = 1;
-            break;
-        case 3: /* C */
-            carry = !(sim->carry);
-            break;
-        }
-        /* According to the schematics, aluC0 is always
-         * XORed into the carry bit when DNS is set.
-         */
-        if (sim->aluC0) carry = !carry;
+static
+uint16_t alu_bus_and_t(struct simulator *sim, const struct microcode *mc,
+                       uint16_t bus, int *carry)
+{
+    UNUSED(mc);
+    *carry = 0;
+    return bus & sim->t;
+}
+
+static
+uint16_t alu_bus_xor_t(struct simulator *sim, const struct microcode *mc,
+                       uint16_t bus, int *carry)
+{
+    UNUSED(mc);
+    *carry = 0;
+    return bus ^ sim->t;
+}
+
+static
+uint16_t alu_bus_and_not_t(struct simulator *sim,
+                           const struct microcode *mc,
+                           uint16_t bus, int *carry)
+{
+    UNUSED(mc);
+    *carry = 0;
+    return bus & (~sim->t);
+}
+
+static
+uint16_t alu_bus_plus_1(struct simulator *sim, const struct microcode *mc,
+                        uint16_t bus, int *carry)
+{
+    uint32_t res;
+
+    UNUSED(sim);
+    UNUSED(mc);
+    res = ((uint32_t) bus) + 1;
+    *carry = ((res & 0xFFFF0000) != 0) ? 1 : 0;
+    return (uint16_t) res;
+}
+
+static
+uint16_t alu_bus_minus_1(struct simulator *sim, const struct microcode *mc,
+                         uint16_t bus, int *carry)
+{
+    uint32_t res;
+
+    UNUSED(sim);
+    UNUSED(mc);
+    res = ((uint32_t) bus) + 0xFFFFU;
+    *carry = ((res & 0xFFFF0000) != 0) ? 1 : 0;
+    return (uint16_t) res;
+}
+
+static
+uint16_t alu_bus_plus_t(struct simulator *sim, const struct microcode *mc,
+                        uint16_t bus, int *carry)
+{
+    uint32_t res;
+
+    UNUSED(mc);
+    res = ((uint32_t) bus) + ((uint32_t) sim->t);
+    *carry = ((res & 0xFFFF0000) != 0) ? 1 : 0;
+    return (uint16_t) res;
+}
+
+static
+uint16_t alu_bus_minus_t(struct simulator *sim, const struct microcode *mc,
+                         uint16_t bus, int *carry)
+{
+    uint32_t res;
+
+    UNUSED(mc);
+    res = ((uint32_t) bus) + ((~((uint32_t) sim->t)) & 0xFFFFU) + 1;
+    *carry = ((res & 0xFFFF0000) != 0) ? 1 : 0;
+    return (uint16_t) res;
+}
+
+static
+uint16_t alu_bus_minus_t_minus_1(struct simulator *sim,
+                                 const struct microcode *mc,
+                                 uint16_t bus, int *carry)
+{
+    uint32_t res;
+
+    UNUSED(mc);
+    res = ((uint32_t) bus) + ((~((uint32_t) sim->t)) & 0xFFFFU);
+    *carry = ((res & 0xFFFF0000) != 0) ? 1 : 0;
+    return (uint16_t) res;
+}
+
+static
+uint16_t alu_bus_plus_t_plus_1(struct simulator *sim,
+                               const struct microcode *mc,
+                               uint16_t bus, int *carry)
+{
+    uint32_t res;
+
+    UNUSED(mc);
+    res = ((uint32_t) bus) + ((uint32_t) sim->t) + 1;
+    *carry = ((res & 0xFFFF0000) != 0) ? 1 : 0;
+    return (uint16_t) res;
+}
+
+static
+uint16_t alu_bus_plus_skip(struct simulator *sim,
+                           const struct microcode *mc,
+                           uint16_t bus, int *carry)
+{
+    uint32_t res;
+
+    UNUSED(mc);
+    res = ((uint32_t) bus) + ((uint32_t) (sim->skip ? 1 : 0));
+    *carry = ((res & 0xFFFF0000) != 0) ? 1 : 0;
+    return (uint16_t) res;
+}
+
+/* Auxiliary function to perform the shift computation.
+ * The current predecoded microcode is in `mc`.
+ * This function might modify the value of `load_r`, in case it is
+ * performing a NOVA style shift.
+ * The value of the nova carry is given by `nova_carry`, and since it is
+ * a pointer, it will be populated with the new value of the nova carry
+ * on return.
+ * Returns the value of the shifter.
+ */
+static
+uint16_t do_shift(struct simulator *sim, const struct microcode *mc,
+                  int *load_r, int *nova_carry)
+{
+    uint16_t res;
+    int dns, has_magic;
+    int carry;
+
+    if (mc->task == TASK_EMULATOR) {
+        dns = (mc->f2 == F2_EMU_LOAD_DNS);
+        has_magic = (mc->f2 == F2_EMU_MAGIC);
+    } else {
+        dns = FALSE;
+        has_magic = FALSE;
+    }
+
+    if (dns) {
+        if ((sim->ir & 0x0008) != 0)
+            *load_r = FALSE;
+
+        switch ((sim->ir >> 4) & 3) {
+        case 0: /* not affected. */
+            carry = sim->carry;
+            break;
+        case 1: /* Z */
+            carry = 0;
+            break;
+        case 2: /* O */
+            carry = 1;
+            break;
+        case 3: /* C */
+            carry = !(sim->carry);
+            break;
+        }
+        /* According to the schematics, aluC0 is always
+         * XORed into the carry bit when DNS is set.
+         */
+        if (sim->aluC0) carry = !carry;
     } else {
         carry = 0;
     }
@@ -847,6 +1553,50 @@ uint16_t do_shift(struct simulator *sim, const struct microcode *mc,
     return res;
 }
 
+/* The shifter handlers used by the threaded engine. They have the
+ * same semantics as do_shift() when neither DNS nor MAGIC are in effect.
+ */
+
+static
+uint16_t shift_none(struct simulator *sim, const struct microcode *mc,
+                    int *load_r, int *nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(load_r);
+    *nova_carry = 0;
+    return sim->l;
+}
+
+static
+uint16_t shift_llsh1(struct simulator *sim, const struct microcode *mc,
+                     int *load_r, int *nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(load_r);
+    *nova_carry = 0;
+    return sim->l << 1;
+}
+
+static
+uint16_t shift_lrsh1(struct simulator *sim, const struct microcode *mc,
+                     int *load_r, int *nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(load_r);
+    *nova_carry = 0;
+    return sim->l >> 1;
+}
+
+static
+uint16_t shift_llcy8(struct simulator *sim, const struct microcode *mc,
+                     int *load_r, int *nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(load_r);
+    *nova_carry = 0;
+    return (sim->l << 8) | (sim->l >> 8);
+}
+
 /* Obtains the pending tasks.
  * Returns a bitset of pending tasks.
  */
@@ -861,6 +1611,90 @@ uint16_t get_pending(const struct simulator *sim)
     return pending;
 }
 
+/* The F1 functions below are shared by do_f1() and the threaded
+ * engine, and they have the same parameters as do_f1().
+ */
+
+/* Nothing to do for this F1 function. */
+static
+void f1_none(struct simulator *sim, const struct microcode *mc,
+             uint16_t bus, uint16_t alu, uint8_t *nntask, int *swmode)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(alu);
+    UNUSED(nntask);
+    UNUSED(swmode);
+}
+
+/* Loads the MAR register (and starts the memory cycle). */
+static
+void f1_load_mar(struct simulator *sim, const struct microcode *mc,
+                 uint16_t bus, uint16_t alu, uint8_t *nntask, int *swmode)
+{
+    uint16_t addr;
+    uint16_t min_cycles;
+
+    UNUSED(bus);
+    UNUSED(nntask);
+    UNUSED(swmode);
+
+    min_cycles = (mc->sys_type == ALTO_I) ? 7 : 5;
+    wait_memory(sim, min_cycles);
+    sim->mar = alu;
+    sim->mem_cycle = 1;
+    sim->mem_task = mc->task;
+    sim->mem_status = 0;
+    if (mc->sys_type != ALTO_I && (mc->f2 == F2_STORE_MD)) {
+        sim->mem_status |= MA_EXTENDED;
+    }
+
+    /* Perform the reading now. */
+    addr = sim->mar;
+    sim->mem_low = simulator_read(sim, addr, sim->mem_task,
+                                  sim->mem_status & MA_EXTENDED);
+
+    addr = (mc->sys_type == ALTO_I) ? (1 | addr) : (1 ^ addr);
+    sim->mem_high = simulator_read(sim, addr, sim->mem_task,
+                                   sim->mem_status & MA_EXTENDED);
+
+    /* For TASK_MEMORY_REFRESH, loading MAR with RSEL = 037 performs
+     * a BLOCK.
+     */
+    if (mc->task == TASK_MEMORY_REFRESH) {
+        if ((mc->sys_type == ALTO_I) && (mc->rsel == 037)) {
+            sim->displ.pending &= ~(1 << mc->task);
+        }
+    }
+}
+
+/* Selects the next task to run (TASK function). */
+static
+void f1_task(struct simulator *sim, const struct microcode *mc,
+             uint16_t bus, uint16_t alu, uint8_t *nntask, int *swmode)
+{
+    uint16_t pending;
+    uint8_t tmp;
+
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(alu);
+    UNUSED(swmode);
+
+    /* Should we not prevent two consecutive switches? */
+    if (sim->task_switch) return;
+
+    /* Switch tasks. */
+    pending = get_pending(sim);
+    for (tmp = TASK_NUM_TASKS; tmp--;) {
+        if (pending & (1 << tmp)) {
+            *nntask = tmp;
+            break;
+        }
+    }
+}
+
 /* Performs the F1 function.
  * The current predecoded microcode is in `mc`.
  * The value of the bus is in `bus`, and of the alu in `alu`.
@@ -872,9 +1706,6 @@ static
 void do_f1(struct simulator *sim, const struct microcode *mc,
            uint16_t bus, uint16_t alu, uint8_t *nntask, int *swmode)
 {
-    uint16_t addr;
-    uint16_t pending;
-    uint16_t min_cycles;
     uint8_t tmp;
 
     *nntask = sim->ntask;
@@ -891,48 +1722,10 @@ void do_f1(struct simulator *sim, const struct microcode *mc,
         /* Already handled. */
         return;
     case F1_LOAD_MAR:
-        min_cycles = (mc->sys_type == ALTO_I) ? 7 : 5;
-        while (sim->mem_cycle < min_cycles) {
-            update_cycles(sim);
-        }
-        sim->mar = alu;
-        sim->mem_cycle = 1;
-        sim->mem_task = mc->task;
-        sim->mem_status = 0;
-        if (mc->sys_type != ALTO_I && (mc->f2 == F2_STORE_MD)) {
-            sim->mem_status |= MA_EXTENDED;
-        }
-
-        /* Perform the reading now. */
-        addr = sim->mar;
-        sim->mem_low = simulator_read(sim, addr, sim->mem_task,
-                                      sim->mem_status & MA_EXTENDED);
-
-        addr = (mc->sys_type == ALTO_I) ? (1 | addr) : (1 ^ addr);
-        sim->mem_high = simulator_read(sim, addr, sim->mem_task,
-                                       sim->mem_status & MA_EXTENDED);
-
-        /* For TASK_MEMORY_REFRESH, loading MAR with RSEL = 037 performs
-         * a BLOCK.
-         */
-        if (mc->task == TASK_MEMORY_REFRESH) {
-            if ((mc->sys_type == ALTO_I) && (mc->rsel == 037)) {
-                sim->displ.pending &= ~(1 << mc->task);
-            }
-        }
+        f1_load_mar(sim, mc, bus, alu, nntask, swmode);
         return;
     case F1_TASK:
-        /* Should we not prevent two consecutive switches? */
-        if (sim->task_switch) return;
-
-        /* Switch tasks. */
-        pending = get_pending(sim);
-        for (tmp = TASK_NUM_TASKS; tmp--;) {
-            if (pending & (1 << tmp)) {
-                *nntask = tmp;
-                break;
-            }
-        }
+        f1_task(sim, mc, bus, alu, nntask, swmode);
         return;
     case F1_BLOCK:
         if (mc->task == TASK_EMULATOR) {
@@ -992,6 +1785,8 @@ void do_f1(struct simulator *sim, const struct microcode *mc,
             /* Already handled. */
             break;
         case F1_EMU_STARTF:
+            /* Also counted as a write (for the idle loops). */
+            sim->num_writes++;
             if (bus & 0x8000) {
                 sim->soft_reset = TRUE;
             } else {
@@ -1094,89 +1889,316 @@ void do_f1(struct simulator *sim, const struct microcode *mc,
     }
 }
 
-/* Performs the F2 function.
- * The current predecoded microcode is in `mc`.
- * The value of the bus is in `bus`, the shifter is in `shifter_output`,
- * and the value of the nova style carry is in `nova_carry`.
- * Retuns the bits that should be modified for the NEXT part of the
- * following instruction.
+/* The F2 functions below are shared by do_f2() and the threaded
+ * engine, and they have the same parameters as do_f2().
  */
+
 static
-uint16_t do_f2(struct simulator *sim, const struct microcode *mc,
-               uint16_t bus, uint16_t shifter_output, int nova_carry)
+uint16_t f2_none(struct simulator *sim, const struct microcode *mc,
+                 uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return 0;
+}
+
+static
+uint16_t f2_buseq0(struct simulator *sim, const struct microcode *mc,
+                   uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return (bus == 0) ? 1 : 0;
+}
+
+static
+uint16_t f2_shlt0(struct simulator *sim, const struct microcode *mc,
+                  uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(nova_carry);
+    return (shifter_output & 0x8000) ? 1 : 0;
+}
+
+static
+uint16_t f2_sheq0(struct simulator *sim, const struct microcode *mc,
+                  uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(nova_carry);
+    return (shifter_output == 0) ? 1 : 0;
+}
+
+static
+uint16_t f2_bus(struct simulator *sim, const struct microcode *mc,
+                uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return (bus & MPC_ADDR_MASK);
+}
+
+static
+uint16_t f2_alucy(struct simulator *sim, const struct microcode *mc,
+                  uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return (sim->aluC0) ? 1 : 0;
+}
+
+/* Stores the bus in the memory (<-MD). */
+static
+uint16_t f2_store_md(struct simulator *sim, const struct microcode *mc,
+                     uint16_t bus, uint16_t shifter_output, int nova_carry)
 {
-    uint16_t next_extra;
     uint16_t addr;
+    int extended_memory;
 
-    /* Computes the F2 function. */
-    switch (mc->f2) {
-    case F2_NONE:
-        /* Nothing to do. */
-        return 0;
-    case F2_CONSTANT:
-        /* Already handled. */
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+
+    if (mc->f1 == F1_LOAD_MAR && mc->sys_type != ALTO_I) {
+        /* On Alto II MAR<- and <-MD in the same microinstruction
+         * becomes XMAR<-.
+         */
         return 0;
-    case F2_BUSEQ0:
-        return (bus == 0) ? 1 : 0;
-    case F2_SHLT0:
-        return (shifter_output & 0x8000) ? 1 : 0;
-    case F2_SHEQ0:
-        return (shifter_output == 0) ? 1 : 0;
-    case F2_BUS:
-        return (bus & MPC_ADDR_MASK);
-    case F2_ALUCY:
-        return (sim->aluC0) ? 1 : 0;
-    case F2_STORE_MD:
-        if (mc->f1 == F1_LOAD_MAR && mc->sys_type != ALTO_I) {
-            /* On Alto II MAR<- and <-MD in the same microinstruction
-             * becomes XMAR<-.
-             */
-            return 0;
-        }
+    }
 
-        addr = sim->mar;
-        if (mc->sys_type == ALTO_I) {
-            while (sim->mem_cycle < 5) {
-                update_cycles(sim);
-            }
-            if (sim->mem_cycle == 5) {
-                sim->mem_status ^= MA_WORD_BIT;
-            } else if (sim->mem_cycle == 6) {
-                if (!(sim->mem_status & MA_WORD_BIT)) {
-                    report_error("simulator: step: "
-                                 "first write on cycle 6");
-                    sim->error = TRUE;
-                    return 0;
-                }
-                addr |= 1;
-                sim->mem_status ^= MA_WORD_BIT;
-            } else {
+    addr = sim->mar;
+    if (mc->sys_type == ALTO_I) {
+        wait_memory(sim, 5);
+        if (sim->mem_cycle == 5) {
+            sim->mem_status ^= MA_WORD_BIT;
+        } else if (sim->mem_cycle == 6) {
+            if (!(sim->mem_status & MA_WORD_BIT)) {
                 report_error("simulator: step: "
-                             "unexpected write memory cycle");
+                             "first write on cycle 6");
                 sim->error = TRUE;
                 return 0;
             }
+            addr |= 1;
+            sim->mem_status ^= MA_WORD_BIT;
         } else {
-            while (sim->mem_cycle < 3) {
-                update_cycles(sim);
-            }
-            if (sim->mem_cycle == 3) {
-                sim->mem_status ^= MA_WORD_BIT;
-            } else if (sim->mem_cycle == 4) {
-                if (sim->mem_status & MA_WORD_BIT) {
-                    addr ^= 1;
-                }
-                sim->mem_status ^= MA_WORD_BIT;
-            } else {
-                report_error("simulator: step: "
-                             "unexpected write memory cycle");
-                sim->error = TRUE;
-                return 0;
-            }
+            report_error("simulator: step: "
+                         "unexpected write memory cycle");
+            sim->error = TRUE;
+            return 0;
         }
-        simulator_write(sim, addr, bus, sim->mem_task,
-                        sim->mem_status & MA_EXTENDED);
+    } else {
+        wait_memory(sim, 3);
+        if (sim->mem_cycle == 3) {
+            sim->mem_status ^= MA_WORD_BIT;
+        } else if (sim->mem_cycle == 4) {
+            if (sim->mem_status & MA_WORD_BIT) {
+                addr ^= 1;
+            }
+            sim->mem_status ^= MA_WORD_BIT;
+        } else {
+            report_error("simulator: step: "
+                         "unexpected write memory cycle");
+            sim->error = TRUE;
+            return 0;
+        }
+    }
+
+    extended_memory = sim->mem_status & MA_EXTENDED;
+    if (unlikely(sim->diff != NULL)) {
+        log_write(sim, FALSE, addr, sim->mem_task, extended_memory,
+                  simulator_read(sim, addr, sim->mem_task,
+                                 extended_memory),
+                  bus);
+    }
+
+    if (unlikely(sim->watch_map != NULL)) {
+        check_watch(sim, addr, sim->mem_task, extended_memory,
+                    WATCH_WRITE);
+    }
+
+    simulator_write(sim, addr, bus, sim->mem_task, extended_memory);
+    return 0;
+}
+
+static
+uint16_t f2_emu_busodd(struct simulator *sim, const struct microcode *mc,
+                       uint16_t bus, uint16_t shifter_output,
+                       int nova_carry)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return (bus & 1);
+}
+
+/* Loads the skip and carry according to the current NOVA instruction. */
+static
+uint16_t f2_emu_load_dns(struct simulator *sim, const struct microcode *mc,
+                         uint16_t bus, uint16_t shifter_output,
+                         int nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(bus);
+
+    switch (sim->ir & 7) {
+    case 0:
+        sim->skip = FALSE;
+        break;
+    case 1: /* SKP */
+        sim->skip = TRUE;
+        break;
+    case 2: /* SZC */
+        sim->skip = (!nova_carry);
+        break;
+    case 3: /* SNC */
+        sim->skip = nova_carry;
+        break;
+    case 4: /* SZR */
+        sim->skip = (shifter_output == 0);
+        break;
+    case 5: /* SNR */
+        sim->skip = (shifter_output != 0);
+        break;
+    case 6: /* SEZ */
+        sim->skip = (shifter_output == 0 || (!nova_carry));
+        break;
+    case 7: /* SBN */
+        sim->skip = (shifter_output != 0 && nova_carry);
+        break;
+    }
+    if ((sim->ir & 0x0008) == 0) {
+        sim->carry = nova_carry;
+    }
+    return 0;
+}
+
+/* Counts the Nova instruction being loaded into the IR in the Nova
+ * profile.
+ */
+static
+void update_nova_profile(struct simulator *sim)
+{
+    uint16_t address;
+    int bank_number;
+
+    address = sim->r[6] - 1;
+    bank_number = (sim->xm_banks[TASK_EMULATOR] >> 2) & 0x3;
+    sim->nova_prof[bank_number * MEMORY_SIZE + address]++;
+}
+
+/* Loads the instruction register (and dispatches on it). */
+static
+uint16_t f2_emu_load_ir(struct simulator *sim, const struct microcode *mc,
+                        uint16_t bus, uint16_t shifter_output,
+                        int nova_carry)
+{
+    uint16_t next_extra;
+
+    UNUSED(mc);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+
+    sim->ir = bus;
+    sim->skip = FALSE;
+    if (unlikely(sim->nova_prof != NULL)) update_nova_profile(sim);
+    next_extra = (bus >> 8) & 0x7;
+    if (bus & 0x8000) next_extra |= 0x8;
+    return next_extra;
+}
+
+static
+uint16_t f2_emu_idisp(struct simulator *sim, const struct microcode *mc,
+                      uint16_t bus, uint16_t shifter_output,
+                      int nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+
+    if (sim->ir & 0x8000) {
+        return 3 - ((sim->ir >> 6) & 3);
+    }
+    return sim->acs_rom[((sim->ir >> 8) & 0x7F) + 0x80];
+}
+
+static
+uint16_t f2_emu_acsource(struct simulator *sim, const struct microcode *mc,
+                         uint16_t bus, uint16_t shifter_output,
+                         int nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+
+    if (sim->ir & 0x8000) {
+        return 3 - ((sim->ir >> 6) & 3);
+    }
+    return sim->acs_rom[(sim->ir >> 8) & 0x7F];
+}
+
+static
+uint16_t f2_dw_load_ddr(struct simulator *sim, const struct microcode *mc,
+                        uint16_t bus, uint16_t shifter_output,
+                        int nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+
+    if (unlikely(!display_load_ddr(&sim->displ, bus))) {
+        report_error("simulator: step: "
+                     "could not load DDR register");
+        sim->error = TRUE;
+    }
+    return 0;
+}
+
+/* Performs the F2 function.
+ * The current predecoded microcode is in `mc`.
+ * The value of the bus is in `bus`, the shifter is in `shifter_output`,
+ * and the value of the nova style carry is in `nova_carry`.
+ * Retuns the bits that should be modified for the NEXT part of the
+ * following instruction.
+ */
+static
+uint16_t do_f2(struct simulator *sim, const struct microcode *mc,
+               uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    /* Computes the F2 function. */
+    switch (mc->f2) {
+    case F2_NONE:
+        /* Nothing to do. */
+        return 0;
+    case F2_CONSTANT:
+        /* Already handled. */
         return 0;
+    case F2_BUSEQ0:
+        return (bus == 0) ? 1 : 0;
+    case F2_SHLT0:
+        return (shifter_output & 0x8000) ? 1 : 0;
+    case F2_SHEQ0:
+        return (shifter_output == 0) ? 1 : 0;
+    case F2_BUS:
+        return (bus & MPC_ADDR_MASK);
+    case F2_ALUCY:
+        return (sim->aluC0) ? 1 : 0;
+    case F2_STORE_MD:
+        return f2_store_md(sim, mc, bus, shifter_output, nova_carry);
     }
 
     switch (mc->task) {
@@ -1189,56 +2211,14 @@ uint16_t do_f2(struct simulator *sim, const struct microcode *mc,
         case F2_EMU_BUSODD:
             return (bus & 1);
         case F2_EMU_LOAD_DNS:
-            switch (sim->ir & 7) {
-            case 0:
-                sim->skip = FALSE;
-                break;
-            case 1: /* SKP */
-                sim->skip = TRUE;
-                break;
-            case 2: /* SZC */
-                sim->skip = (!nova_carry);
-                break;
-            case 3: /* SNC */
-                sim->skip = nova_carry;
-                break;
-            case 4: /* SZR */
-                sim->skip = (shifter_output == 0);
-                break;
-            case 5: /* SNR */
-                sim->skip = (shifter_output != 0);
-                break;
-            case 6: /* SEZ */
-                sim->skip = (shifter_output == 0 || (!nova_carry));
-                break;
-            case 7: /* SBN */
-                sim->skip = (shifter_output != 0 && nova_carry);
-                break;
-            }
-            if ((sim->ir & 0x0008) == 0) {
-                sim->carry = nova_carry;
-            }
-            return 0;
+            return f2_emu_load_dns(sim, mc, bus, shifter_output, nova_carry);
         case F2_EMU_LOAD_IR:
-            sim->ir = bus;
-            sim->skip = FALSE;
-            next_extra = (bus >> 8) & 0x7;
-            if (bus & 0x8000) next_extra |= 0x8;
-            return next_extra;
+            return f2_emu_load_ir(sim, mc, bus, shifter_output, nova_carry);
         case F2_EMU_IDISP:
-            if (sim->ir & 0x8000) {
-                next_extra = 3 - ((sim->ir >> 6) & 3);
-            } else {
-                next_extra = sim->acs_rom[((sim->ir >> 8) & 0x7F) + 0x80];
-            }
-            return next_extra;
+            return f2_emu_idisp(sim, mc, bus, shifter_output, nova_carry);
         case F2_EMU_ACSOURCE:
-            if (sim->ir & 0x8000) {
-                next_extra = 3 - ((sim->ir >> 6) & 3);
-            } else {
-                next_extra = sim->acs_rom[(sim->ir >> 8) & 0x7F];
-            }
-            return next_extra;
+            return f2_emu_acsource(sim, mc, bus, shifter_output,
+                                   nova_carry);
         default:
             report_error("simulator: step: "
                          "invalid F2 function %03o for emulator",
@@ -1316,25 +2296,12 @@ uint16_t do_f2(struct simulator *sim, const struct microcode *mc,
             sim->error = TRUE;
             return 0;
         }
-        if (unlikely(!update_intr_cycle(sim, FALSE))) {
-            report_error("simulator: step: "
-                         "error in computing interrupt cycle "
-                         "after ethernet function");
-            return 0;
-        }
-
         break;
 
     case TASK_DISPLAY_WORD:
         switch (mc->f2) {
         case F2_DW_LOAD_DDR:
-            if (unlikely(!display_load_ddr(&sim->displ, bus))) {
-                report_error("simulator: step: "
-                             "could not load DDR register");
-                sim->error = TRUE;
-                return 0;
-            }
-            return 0;
+            return f2_dw_load_ddr(sim, mc, bus, shifter_output, nova_carry);
         default:
             report_error("simulator: step: "
                          "invalid F2 function %03o for display word",
@@ -1458,6 +2425,73 @@ void wb_registers(struct simulator *sim,
     }
 }
 
+/* Computes the bank of the next microinstruction after a SWMODE
+ * instruction, given the current bank `bank` and the address of the
+ * next microinstruction `next_addr`.
+ * Returns the new bank.
+ */
+static
+uint16_t switch_bank(const struct simulator *sim, uint16_t bank,
+                     uint16_t next_addr)
+{
+    switch (sim->sys_type) {
+    case ALTO_I:
+    case ALTO_II_1KROM:
+        bank ^= 1; /* ROM0 <-> RAM0 */
+        break;
+
+    case ALTO_II_2KROM:
+        switch (bank) {
+        case 0: /* ROM0 */
+            /* ROM1 or RAM0 */
+            bank = (next_addr & 0x100) ? 1 : 2; break;
+        case 1: /* ROM1 */
+            /* RAM0 or ROM0 */
+            bank = (next_addr & 0x100) ? 2 : 0; break;
+        case 2: /* RAM0 */
+            /* ROM1 or ROM0 */
+            bank = (next_addr & 0x100) ? 1 : 0; break;
+        }
+        break;
+
+    case ALTO_II_3KRAM:
+        if (next_addr & 0x100) {
+            switch (bank) {
+            case 0: /* ROM0 */
+                /* RAM0 or RAM1 */
+                bank = (next_addr & 0x80) ? 1 : 2;
+                break;
+            case 1: /* RAM0 */
+                bank = 2; /* RAM1 */
+                break;
+            case 2: /* RAM1 */
+            case 3: /* RAM2 */
+                bank = 1; /* RAM0 */
+                break;
+            }
+        } else {
+            switch (bank) {
+            case 0: /* ROM0 */
+                /* RAM2 or RAM0 */
+                bank = (next_addr & 0x80) ? 3 : 1;
+                break;
+            case 1: /* RAM0 */
+            case 2: /* RAM1 */
+                /* RAM2 or ROM0 */
+                bank = (next_addr & 0x80) ? 3 : 0;
+                break;
+            case 3: /* RAM2 */
+                /* RAM1 or ROM0 */
+                bank = (next_addr & 0x80) ? 2 : 0;
+                break;
+            }
+        }
+
+        break;
+    }
+    return bank;
+}
+
 /* Updates the micro program counter and the next task.
  * The bits that are to be modified in the NEXT field of the following
  * instruction are given by `next_extra`. The task following the next
@@ -1476,6 +2510,7 @@ void update_program_counters(struct simulator *sim,
 
     /* Updates the current task. */
     sim->task_switch = (sim->ctask != sim->ntask);
+    sim->stats.task_switches += sim->task_switch;
     sim->ctask = sim->ntask;
 
     /* Updates the MPC and MIR. */
@@ -1485,63 +2520,7 @@ void update_program_counters(struct simulator *sim,
 
     next_addr = MICROCODE_NEXT(mcode) | next_extra;
     bank = (mpc >> MPC_BANK_SHIFT) & MPC_BANK_MASK;
-    if (swmode) {
-        switch (sim->sys_type) {
-        case ALTO_I:
-        case ALTO_II_1KROM:
-            bank ^= 1; /* ROM0 <-> RAM0 */
-            break;
-
-        case ALTO_II_2KROM:
-            switch (bank) {
-            case 0: /* ROM0 */
-                /* ROM1 or RAM0 */
-                bank = (next_addr & 0x100) ? 1 : 2; break;
-            case 1: /* ROM1 */
-                /* RAM0 or ROM0 */
-                bank = (next_addr & 0x100) ? 2 : 0; break;
-            case 2: /* RAM0 */
-                /* ROM1 or ROM0 */
-                bank = (next_addr & 0x100) ? 1 : 0; break;
-            }
-            break;
-
-        case ALTO_II_3KRAM:
-            if (next_addr & 0x100) {
-                switch (bank) {
-                case 0: /* ROM0 */
-                    /* RAM0 or RAM1 */
-                    bank = (next_addr & 0x80) ? 1 : 2;
-                    break;
-                case 1: /* RAM0 */
-                    bank = 2; /* RAM1 */
-                    break;
-                case 2: /* RAM1 */
-                case 3: /* RAM2 */
-                    bank = 1; /* RAM0 */
-                    break;
-                }
-            } else {
-                switch (bank) {
-                case 0: /* ROM0 */
-                    /* RAM2 or RAM0 */
-                    bank = (next_addr & 0x80) ? 3 : 1;
-                    break;
-                case 1: /* RAM0 */
-                case 2: /* RAM1 */
-                    /* RAM2 or ROM0 */
-                    bank = (next_addr & 0x80) ? 3 : 0;
-                    break;
-                case 3: /* RAM2 */
-                    /* RAM1 or ROM0 */
-                    bank = (next_addr & 0x80) ? 2 : 0;
-                    break;
-                }
-            }
-
-            break;
-        }
-    }
+    if (unlikely(swmode)) bank = switch_bank(sim, bank, next_addr);
     sim->task_mpc[task] = (bank << MPC_BANK_SHIFT) | next_addr;
 
     sim->mir = mcode;
@@ -1617,66 +2596,131 @@ void do_soft_reset(struct simulator *sim)
 static
 void check_for_interrupts(struct simulator *sim, int32_t prev_cycle)
 {
-    int32_t diff, intr_diff;
+    enum intr_event events[NUM_INTR_EVENTS];
+    enum intr_event ev;
+    unsigned int i, num_events;
+    int32_t intr_cycle, diff, intr_diff;
 
     while (TRUE) {
-        if (sim->intr_cycle < 0) return;
+        intr_cycle = sim->sched.intr_cycle;
+        if (intr_cycle < 0) return;
 
         diff = INTR_CYCLE(sim->cycle - prev_cycle);
-        intr_diff = INTR_CYCLE(sim->intr_cycle - prev_cycle);
+        intr_diff = INTR_CYCLE(intr_cycle - prev_cycle);
         if (diff <= intr_diff) break;
 
         /* Updates prev_cycle to match the current interrupt time. */
-        prev_cycle = INTR_CYCLE(prev_cycle + intr_diff);
+        prev_cycle = intr_cycle;
 
-        /* Dispatch the interrupts. */
-        if (sim->intr_cycle == sim->dsk.intr_cycle) {
-            if (unlikely(!disk_interrupt(&sim->dsk))) {
-                report_error("simulator: step: "
-                             "could not process disk interrupt");
-                sim->error = TRUE;
-                return;
-            }
+        /* Removes all the events of this cycle from the scheduler
+         * before dispatching them, so that the events posted by the
+         * handlers are not dispatched in this same round.
+         */
+        num_events = 0;
+        while (TRUE) {
+            ev = scheduler_pop(&sim->sched, intr_cycle);
+            if (ev == NUM_INTR_EVENTS) break;
+            events[num_events++] = ev;
         }
-        if (sim->intr_cycle == sim->displ.intr_cycle) {
-            if (unlikely(!display_interrupt(&sim->displ))) {
-                report_error("simulator: step: "
-                             "could not process display interrupt");
-                sim->error = TRUE;
-                return;
-            }
 
-            /* Transfer the TASK_ETHERNET pending bit
-             * to the ethernet object.
-             */
-            if (sim->displ.pending & (1 << TASK_ETHERNET)) {
-                sim->displ.pending &= ~(1 << TASK_ETHERNET);
-                if (sim->ether.countdown_wakeup) {
-                    sim->ether.pending |= (1 << TASK_ETHERNET);
+        /* Dispatch the interrupts. */
+        for (i = 0; i < num_events; i++) {
+            ev = events[i];
+            switch (ev) {
+            case EVENT_DISK_SECTOR:
+            case EVENT_DISK_WORD:
+            case EVENT_DISK_SEEK:
+            case EVENT_DISK_SECLATE:
+                sim->stats.disk_events++;
+                if (unlikely(!disk_interrupt(&sim->dsk, ev, intr_cycle))) {
+                    report_error("simulator: step: "
+                                 "could not process disk interrupt");
+                    sim->error = TRUE;
+                    return;
                 }
-            }
-        }
-        if (sim->intr_cycle == sim->ether.intr_cycle) {
-            if (unlikely(!ethernet_interrupt(&sim->ether))) {
-                report_error("simulator: step: "
-                             "could not process ethernet interrupt");
-                sim->error = TRUE;
-                return;
+                break;
+            case EVENT_DISPLAY_HALF_LINE:
+            case EVENT_DISPLAY_WORD:
+                sim->stats.display_events++;
+                if (unlikely(!display_interrupt(&sim->displ, ev,
+                                                intr_cycle))) {
+                    report_error("simulator: step: "
+                                 "could not process display interrupt");
+                    sim->error = TRUE;
+                    return;
+                }
+
+                /* The words of a blank scanline need no events. */
+                if (ev == EVENT_DISPLAY_WORD
+                    && sim->ctask != TASK_DISPLAY_WORD
+                    && sim->ntask != TASK_DISPLAY_WORD)
+                    display_skip_words(&sim->displ);
+
+                /* Transfer the TASK_ETHERNET pending bit
+                 * to the ethernet object.
+                 */
+                if (sim->displ.pending & (1 << TASK_ETHERNET)) {
+                    sim->displ.pending &= ~(1 << TASK_ETHERNET);
+                    if (sim->ether.countdown_wakeup) {
+                        sim->ether.pending |= (1 << TASK_ETHERNET);
+                    }
+                }
+                break;
+            default:
+                sim->stats.ethernet_events++;
+                if (unlikely(!ethernet_interrupt(&sim->ether, ev,
+                                                 intr_cycle))) {
+                    report_error("simulator: step: "
+                                 "could not process ethernet interrupt");
+                    sim->error = TRUE;
+                    return;
+                }
+                break;
             }
         }
 
-        if (unlikely(!update_intr_cycle(sim, TRUE))) {
+        /* The handlers must schedule the events after this cycle. */
+        if (unlikely(sim->sched.intr_cycle == intr_cycle)) {
             report_error("simulator: step: "
-                         "error in computing interrupt cycle");
+                         "event scheduled at the current cycle %d",
+                         intr_cycle);
+            sim->error = TRUE;
             return;
         }
     }
 }
 
-void simulator_step(struct simulator *sim)
+/* Obtains the predecoded microinstruction for the current MIR.
+ * The `tmp_mc` is used as storage if the cached entry cannot be used.
+ * Returns the predecoded microinstruction.
+ */
+static
+const struct microcode *current_microcode(struct simulator *sim,
+                                          struct microcode *tmp_mc)
 {
-    struct microcode mc;
-    int32_t prev_cycle;
+    const struct microcode *mc;
+
+    mc = &sim->mc_cache[sim->ctask * NUM_MICROCODE_BANKS * MICROCODE_SIZE
+                        + sim->mpc];
+    if (likely(mc->mcode == sim->mir)) return mc;
+
+    /* The microcode was modified after it was loaded into the
+     * MIR, so the cached entry cannot be used.
+     */
+    microcode_predecode(tmp_mc,
+                        sim->sys_type,
+                        sim->mpc,
+                        sim->mir,
+                        sim->ctask);
+    return tmp_mc;
+}
+
+/* Executes the current microinstruction using the interpreter. */
+static
+void execute_interpreted(struct simulator *sim)
+{
+    const struct microcode *mc;
+    struct microcode tmp_mc;
     uint16_t modified_rsel;
     uint16_t bus;
     uint16_t alu;
@@ -1689,15 +2733,6 @@ void simulator_step(struct simulator *sim)
     int swmode;
     int soft_reset;
 
-    if (sim->error) {
-        report_error("simulator: step: "
-                     "simulator is in error state");
-        return;
-    }
-
-    /* Copy this to detect interrupts later. */
-    prev_cycle = sim->cycle;
-
     /* Updates the cycles. */
     update_cycles(sim);
 
@@ -1712,46 +2747,42 @@ void simulator_step(struct simulator *sim)
     soft_reset = sim->soft_reset;
     sim->soft_reset = FALSE;
 
-    microcode_predecode(&mc,
-                        sim->sys_type,
-                        sim->mpc,
-                        sim->mir,
-                        sim->ctask);
+    mc = current_microcode(sim, &tmp_mc);
 
-    load_r = (!mc.use_constant && mc.bs == BS_LOAD_R);
+    load_r = (!mc->use_constant && mc->bs == BS_LOAD_R);
 
     /* Obtain the rsel (which might be modified by some F2
      * functions when in the EMULATOR task.
      */
-    modified_rsel = get_modified_rsel(sim, &mc);
+    modified_rsel = get_modified_rsel(sim, mc);
 
     /* Compute the bus. */
-    bus = read_bus(sim, &mc, modified_rsel);
+    bus = read_bus(sim, mc, modified_rsel);
     if (sim->error) return;
 
     /* Compute the ALU. */
-    alu = compute_alu(sim, &mc, bus, &aluC0);
+    alu = compute_alu(sim, mc, bus, &aluC0);
     if (sim->error) return;
 
     /* Perform pending writes to the microcode RAM. */
-    do_wrtram(sim, alu);
+    if (unlikely(sim->wrtram)) do_wrtram(sim, alu);
 
     /* Compute the shifter output. */
-    shifter_output = do_shift(sim, &mc, &load_r, &nova_carry);
+    shifter_output = do_shift(sim, mc, &load_r, &nova_carry);
 
     /* Compute the F1 function. */
-    do_f1(sim, &mc, bus, alu, &nntask, &swmode);
+    do_f1(sim, mc, bus, alu, &nntask, &swmode);
     if (sim->error) return;
 
     /* Compute the F2 function. */
-    next_extra = do_f2(sim, &mc, bus, shifter_output, nova_carry);
+    next_extra = do_f2(sim, mc, bus, shifter_output, nova_carry);
     if (sim->error) return;
 
     /* Perform the BLOCK operation. */
-    if (mc.f1 == F1_BLOCK) do_block(sim, mc.task);
+    if (mc->f1 == F1_BLOCK) do_block(sim, mc->task);
 
     /* Write back the registers. */
-    wb_registers(sim, &mc, modified_rsel, load_r,
+    wb_registers(sim, mc, modified_rsel, load_r,
                  bus, alu, shifter_output, aluC0);
 
     /* Update the micro program counter and the next task. */
@@ -1759,30 +2790,1538 @@ void simulator_step(struct simulator *sim)
 
     /* Perform the soft reset. */
     if (soft_reset) do_soft_reset(sim);
-
-    check_for_interrupts(sim, prev_cycle);
 }
 
-int simulator_update(struct simulator *sim,
-                     const struct keyboard *keyb,
-                     const struct mouse *mous,
-                     uint8_t *display_data)
+/* Selects the bus handler for the predecoded microinstruction `mc`.
+ * This mirrors the logic in read_bus(), and returns NULL for the
+ * cases that modify the bus in other ways.
+ */
+static
+bus_cb resolve_bus(const struct microcode *mc)
 {
-    if (display_data) {
-        memcpy(display_data, sim->displ.display_data,
-               DISPLAY_DATA_SIZE * sizeof(uint8_t));
-    }
-    if (keyb) {
-        keyboard_update_from(&sim->keyb, keyb);
+    if (mc->task == TASK_EMULATOR && mc->f1 == F1_EMU_RSNF)
+        return NULL;
+    if (mc->task == TASK_ETHERNET
+        && (mc->f1 == F1_ETH_EILFCT || mc->f1 == F1_ETH_EPFCT))
+        return NULL;
+
+    if (mc->use_constant) return &bus_constant;
+
+    switch (mc->bs) {
+    case BS_READ_R: return &bus_read_r;
+    case BS_LOAD_R: return &bus_load_r;
+    case BS_NONE: return &bus_none;
+    case BS_READ_MD: return &bus_read_md;
+    case BS_READ_MOUSE: return &bus_read_mouse;
+    case BS_READ_DISP: return &bus_read_disp;
     }
-    if (mous) {
-        mouse_update_from(&sim->mous, mous);
+
+    if (mc->ram_task) {
+        if (mc->bs == BS_RAM_READ_S_LOCATION) return &bus_read_s_location;
+        if (mc->bs == BS_RAM_LOAD_S_LOCATION) return &bus_constant;
+    } else if (mc->task == TASK_ETHERNET && mc->bs == BS_ETH_EIDFCT) {
+        return &bus_eidfct;
+    } else if ((mc->task == TASK_DISK_SECTOR)
+               || (mc->task == TASK_DISK_WORD)) {
+        if (mc->bs == BS_DSK_READ_KSTAT) return &bus_read_kstat;
+        if (mc->bs == BS_DSK_READ_KDATA) return &bus_read_kdata;
     }
-    return TRUE;
+
+    /* Let read_bus() report the error. */
+    return NULL;
 }
 
-void simulator_predecode(const struct simulator *sim,
-                         struct microcode *mc)
+/* Selects the ALU handler for the predecoded microinstruction `mc`. */
+static
+alu_cb resolve_alu(const struct microcode *mc)
+{
+    switch (mc->aluf) {
+    case ALU_BUS: return &alu_bus;
+    case ALU_T: return &alu_t;
+    case ALU_BUS_OR_T: return &alu_bus_or_t;
+    case ALU_BUS_AND_T: return &alu_bus_and_t;
+    case ALU_BUS_AND_T_WB: return &alu_bus_and_t;
+    case ALU_BUS_XOR_T: return &alu_bus_xor_t;
+    case ALU_BUS_PLUS_1: return &alu_bus_plus_1;
+    case ALU_BUS_MINUS_1: return &alu_bus_minus_1;
+    case ALU_BUS_PLUS_T: return &alu_bus_plus_t;
+    case ALU_BUS_MINUS_T: return &alu_bus_minus_t;
+    case ALU_BUS_MINUS_T_MINUS_1: return &alu_bus_minus_t_minus_1;
+    case ALU_BUS_PLUS_T_PLUS_1: return &alu_bus_plus_t_plus_1;
+    case ALU_BUS_PLUS_SKIP: return &alu_bus_plus_skip;
+    case ALU_BUS_AND_NOT_T: return &alu_bus_and_not_t;
+    }
+
+    /* Let compute_alu() report the error. */
+    return NULL;
+}
+
+/* Selects the shifter handler for the predecoded microinstruction `mc`. */
+static
+shift_cb resolve_shift(const struct microcode *mc)
+{
+    if (mc->task == TASK_EMULATOR) {
+        if (mc->f2 == F2_EMU_LOAD_DNS || mc->f2 == F2_EMU_MAGIC)
+            return NULL;
+    }
+
+    switch (mc->f1) {
+    case F1_LLSH1: return &shift_llsh1;
+    case F1_LRSH1: return &shift_lrsh1;
+    case F1_LLCY8: return &shift_llcy8;
+    }
+    return &shift_none;
+}
+
+/* Selects the F1 handler for the predecoded microinstruction `mc`. */
+static
+f1_cb resolve_f1(const struct microcode *mc)
+{
+    switch (mc->f1) {
+    case F1_NONE:
+    case F1_CONSTANT:
+    case F1_LLSH1:
+    case F1_LRSH1:
+    case F1_LLCY8:
+        return &f1_none;
+    case F1_LOAD_MAR:
+        return &f1_load_mar;
+    case F1_TASK:
+        return &f1_task;
+    case F1_BLOCK:
+        if (mc->task != TASK_EMULATOR) return &f1_none;
+        break;
+    }
+    return NULL;
+}
+
+/* Selects the F2 handler for the predecoded microinstruction `mc`. */
+static
+f2_cb resolve_f2(const struct microcode *mc)
+{
+    switch (mc->f2) {
+    case F2_NONE:
+    case F2_CONSTANT:
+        return &f2_none;
+    case F2_BUSEQ0: return &f2_buseq0;
+    case F2_SHLT0: return &f2_shlt0;
+    case F2_SHEQ0: return &f2_sheq0;
+    case F2_BUS: return &f2_bus;
+    case F2_ALUCY: return &f2_alucy;
+    case F2_STORE_MD: return &f2_store_md;
+    }
+
+    if (mc->task == TASK_EMULATOR) {
+        switch (mc->f2) {
+        case F2_EMU_MAGIC:
+        case F2_EMU_ACDEST:
+            return &f2_none;
+        case F2_EMU_BUSODD: return &f2_emu_busodd;
+        case F2_EMU_LOAD_DNS: return &f2_emu_load_dns;
+        case F2_EMU_LOAD_IR: return &f2_emu_load_ir;
+        case F2_EMU_IDISP: return &f2_emu_idisp;
+        case F2_EMU_ACSOURCE: return &f2_emu_acsource;
+        }
+    } else if (mc->task == TASK_DISPLAY_WORD) {
+        if (mc->f2 == F2_DW_LOAD_DDR) return &f2_dw_load_ddr;
+    }
+    return NULL;
+}
+
+/* Resolves the handlers in `tc` for the predecoded microinstruction
+ * `mc`.
+ */
+static
+void resolve_threaded_code(struct threaded_code *tc,
+                           const struct microcode *mc)
+{
+    tc->read_bus = resolve_bus(mc);
+    tc->compute_alu = resolve_alu(mc);
+    tc->do_shift = resolve_shift(mc);
+    tc->do_f1 = resolve_f1(mc);
+    tc->do_f2 = resolve_f2(mc);
+    tc->interpret = (!tc->read_bus || !tc->compute_alu || !tc->do_shift
+                     || !tc->do_f1 || !tc->do_f2);
+
+    /* Most microinstructions have no shift, F1 or F2, so these are
+     * not called at all.
+     */
+    if (tc->do_shift == &shift_none) tc->do_shift = NULL;
+    if (tc->do_f1 == &f1_none) tc->do_f1 = NULL;
+    if (tc->do_f2 == &f2_none) tc->do_f2 = NULL;
+
+    /* See get_modified_rsel(). */
+    tc->rsel_mask = 0;
+    tc->rsel_shift = 0;
+    if (mc->task == TASK_EMULATOR) {
+        if (mc->f2 == F2_EMU_ACSOURCE || mc->f2 == F2_EMU_UNK1) {
+            tc->rsel_mask = 0x3;
+            tc->rsel_shift = 13;
+        } else if (mc->f2 == F2_EMU_ACDEST
+                   || mc->f2 == F2_EMU_LOAD_DNS) {
+            tc->rsel_mask = 0x3;
+            tc->rsel_shift = 11;
+        }
+    }
+
+    tc->load_r = (!mc->use_constant && mc->bs == BS_LOAD_R);
+    tc->resolved = TRUE;
+}
+
+/* Executes the current microinstruction using the threaded engine.
+ * Each microinstruction in the control store is resolved once into
+ * a chain of handlers (one for each field), so that the decoding
+ * switches of the interpreter are skipped on later executions.
+ */
+static
+void execute_threaded(struct simulator *sim)
+{
+    const struct microcode *mc;
+    struct threaded_code *tc;
+    uint16_t modified_rsel;
+    uint16_t bus;
+    uint16_t alu;
+    uint16_t shifter_output;
+    uint16_t next_extra;
+    uint8_t nntask;
+    int aluC0;
+    int nova_carry;
+    int load_r;
+    int swmode;
+    int soft_reset;
+    size_t idx;
+
+    idx = sim->ctask * NUM_MICROCODE_BANKS * MICROCODE_SIZE + sim->mpc;
+    mc = &sim->mc_cache[idx];
+    if (unlikely(mc->mcode != sim->mir)) {
+        /* The MIR does not match the control store, so this is
+         * left for the interpreter.
+         */
+        execute_interpreted(sim);
+        return;
+    }
+
+    tc = &sim->tcode[idx];
+    if (unlikely(!tc->resolved)) resolve_threaded_code(tc, mc);
+
+    /* The generic functions also handle the RDRAM. */
+    if (unlikely(tc->interpret || sim->rdram)) {
+        execute_interpreted(sim);
+        return;
+    }
+
+    /* Updates the cycles. */
+    update_cycles(sim);
+
+    if (sim->ctask == TASK_ETHERNET) {
+        ethernet_before_step(&sim->ether);
+    }
+
+    /* Copy the soft_reset in a local variable. */
+    soft_reset = sim->soft_reset;
+    sim->soft_reset = FALSE;
+
+    load_r = tc->load_r;
+    modified_rsel = mc->rsel
+        | ((~(sim->ir >> tc->rsel_shift)) & tc->rsel_mask);
+
+    bus = tc->read_bus(sim, mc, modified_rsel);
+    if (sim->error) return;
+
+    alu = tc->compute_alu(sim, mc, bus, &aluC0);
+    if (sim->error) return;
+
+    if (unlikely(sim->wrtram)) do_wrtram(sim, alu);
+
+    if (tc->do_shift) {
+        shifter_output = tc->do_shift(sim, mc, &load_r, &nova_carry);
+    } else {
+        shifter_output = sim->l;
+        nova_carry = 0;
+    }
+
+    nntask = sim->ntask;
+    swmode = FALSE;
+    if (tc->do_f1) {
+        tc->do_f1(sim, mc, bus, alu, &nntask, &swmode);
+        if (sim->error) return;
+    }
+
+    next_extra = 0;
+    if (tc->do_f2) {
+        next_extra = tc->do_f2(sim, mc, bus, shifter_output, nova_carry);
+        if (sim->error) return;
+    }
+
+    if (mc->f1 == F1_BLOCK) do_block(sim, mc->task);
+
+    wb_registers(sim, mc, modified_rsel, load_r,
+                 bus, alu, shifter_output, aluC0);
+
+    update_program_counters(sim, next_extra, nntask, swmode);
+
+    if (soft_reset) do_soft_reset(sim);
+}
+
+/* Serializes the simulator state to `sd`. The ROMs, the microcode
+ * and the main memory are only included if the corresponding bits
+ * (STATE_ROMS and STATE_MEMORY) are set in `parts`.
+ */
+static
+void serialize_state(const struct simulator *sim, struct serdes *sd,
+                     unsigned int parts)
+{
+    serdes_put32(sd, (uint32_t) sim->sys_type);
+    serdes_put_bool(sd, sim->error);
+    serdes_put16_array(sd, sim->r, NUM_R_REGISTERS);
+    serdes_put16_array(sd, sim->s, NUM_S_BANKS * NUM_S_REGISTERS);
+    serdes_put16(sd, sim->t);
+    serdes_put16(sd, sim->l);
+    serdes_put16(sd, sim->m);
+    serdes_put16(sd, sim->mar);
+    serdes_put16(sd, sim->ir);
+    serdes_put16(sd, sim->mir);
+    serdes_put16(sd, sim->mpc);
+    serdes_put8(sd, sim->ctask);
+    serdes_put8(sd, sim->ntask);
+    serdes_put_bool(sd, sim->task_switch);
+    serdes_put_bool(sd, sim->aluC0);
+    serdes_put_bool(sd, sim->skip);
+    serdes_put_bool(sd, sim->carry);
+    serdes_put16(sd, sim->rmr);
+    serdes_put16(sd, sim->cram_addr);
+    serdes_put_bool(sd, sim->rdram);
+    serdes_put_bool(sd, sim->wrtram);
+    serdes_put_bool(sd, sim->soft_reset);
+    if (parts & STATE_ROMS) {
+        serdes_put8_array(sd, sim->acs_rom, ACSROM_SIZE);
+        serdes_put16_array(sd, sim->consts, CONSTANT_SIZE);
+        serdes_put32_array(sd, sim->microcode,
+                           NUM_MICROCODE_BANKS * MICROCODE_SIZE);
+    }
+    serdes_put16_array(sd, sim->task_mpc, TASK_NUM_TASKS);
+    serdes_put32(sd, sim->cycle);
+    serdes_put32_array(sd, (const uint32_t *) sim->task_cycle,
+                       TASK_NUM_TASKS);
+    serdes_put32(sd, sim->sched.intr_cycle);
+    if (parts & STATE_MEMORY) {
+        serdes_put16_array(sd, sim->mem, NUM_MEMORY_BANKS * MEMORY_SIZE);
+    }
+    serdes_put16_array(sd, sim->xm_banks, TASK_NUM_TASKS);
+    serdes_put8_array(sd, sim->sreg_banks, TASK_NUM_TASKS);
+    serdes_put16(sd, sim->mem_cycle);
+    serdes_put8(sd, sim->mem_task);
+    serdes_put16(sd, sim->mem_low);
+    serdes_put16(sd, sim->mem_high);
+    serdes_put16(sd, sim->mem_status);
+    disk_serialize(&sim->dsk, sd);
+    display_serialize(&sim->displ, sd);
+    ethernet_serialize(&sim->ether, sd);
+    keyboard_serialize(&sim->keyb, sd);
+    mouse_serialize(&sim->mous, sd);
+}
+
+/* Deserializes the simulator state from `sd`. The parameter `parts`
+ * must match the one used in serialize_state().
+ * Only the microinstructions that changed are predecoded again.
+ */
+static
+void deserialize_state(struct simulator *sim, struct serdes *sd,
+                       unsigned int parts)
+{
+    enum system_type sys_type;
+    uint32_t mcode;
+    uint16_t address;
+
+    sys_type = sim->sys_type;
+    sim->sys_type = (enum system_type) serdes_get32(sd);
+    sim->error = serdes_get_bool(sd);
+    serdes_get16_array(sd, sim->r, NUM_R_REGISTERS);
+    serdes_get16_array(sd, sim->s, NUM_S_BANKS * NUM_S_REGISTERS);
+    sim->t = serdes_get16(sd);
+    sim->l = serdes_get16(sd);
+    sim->m = serdes_get16(sd);
+    sim->mar = serdes_get16(sd);
+    sim->ir = serdes_get16(sd);
+    sim->mir = serdes_get16(sd);
+    sim->mpc = serdes_get16(sd);
+    sim->ctask = serdes_get8(sd);
+    sim->ntask = serdes_get8(sd);
+    sim->task_switch = serdes_get_bool(sd);
+    sim->aluC0 = serdes_get_bool(sd);
+    sim->skip = serdes_get_bool(sd);
+    sim->carry = serdes_get_bool(sd);
+    sim->rmr = serdes_get16(sd);
+    sim->cram_addr = serdes_get16(sd);
+    sim->rdram = serdes_get_bool(sd);
+    sim->wrtram = serdes_get_bool(sd);
+    sim->soft_reset = serdes_get_bool(sd);
+    if (parts & STATE_ROMS) {
+        serdes_get8_array(sd, sim->acs_rom, ACSROM_SIZE);
+        serdes_get16_array(sd, sim->consts, CONSTANT_SIZE);
+        sim->rom_epoch = sim->epoch;
+        for (address = 0;
+             address < NUM_MICROCODE_BANKS * MICROCODE_SIZE;
+             address++) {
+            mcode = serdes_get32(sd);
+            if (mcode == sim->microcode[address]) continue;
+            sim->microcode[address] = mcode;
+            if (sys_type == sim->sys_type) {
+                predecode_address(sim, address);
+            }
+        }
+    }
+    if (sys_type != sim->sys_type) {
+        predecode_microcode(sim);
+    }
+    serdes_get16_array(sd, sim->task_mpc, TASK_NUM_TASKS);
+    sim->cycle = serdes_get32(sd);
+    serdes_get32_array(sd, (uint32_t *) sim->task_cycle,
+                       TASK_NUM_TASKS);
+    /* The events are scheduled again by the controllers. */
+    serdes_get32(sd);
+    scheduler_clear(&sim->sched, sim->cycle);
+    if (parts & STATE_MEMORY) {
+        serdes_get16_array(sd, sim->mem, NUM_MEMORY_BANKS * MEMORY_SIZE);
+        touch_all_pages(sim);
+    }
+    serdes_get16_array(sd, sim->xm_banks, TASK_NUM_TASKS);
+    serdes_get8_array(sd, sim->sreg_banks, TASK_NUM_TASKS);
+    sim->mem_cycle = serdes_get16(sd);
+    sim->mem_task = serdes_get8(sd);
+    sim->mem_low = serdes_get16(sd);
+    sim->mem_high = serdes_get16(sd);
+    sim->mem_status = serdes_get16(sd);
+    disk_deserialize(&sim->dsk, sd);
+    display_deserialize(&sim->displ, sd);
+    ethernet_deserialize(&sim->ether, sd);
+    keyboard_deserialize(&sim->keyb, sd);
+    mouse_deserialize(&sim->mous, sd);
+}
+
+/* Undoes the writes logged by the differential engine. */
+static
+void undo_logged_writes(struct simulator *sim)
+{
+    const struct logged_write *lw;
+    unsigned int i;
+
+    for (i = sim->diff->num_writes; i--;) {
+        lw = &sim->diff->writes[i];
+        if (lw->microcode) {
+            sim->microcode[lw->address] = lw->old_value;
+            predecode_address(sim, lw->address);
+        } else {
+            simulator_write(sim, lw->address, (uint16_t) lw->old_value,
+                            lw->task, lw->extended_memory);
+        }
+    }
+    sim->diff->num_writes = 0;
+}
+
+/* Executes the current microinstruction with both the interpreter and
+ * the threaded engine, and checks that they produce the same state.
+ * The interpreter runs first, then its effects are rolled back (the
+ * register state is restored from a snapshot, and the memory writes
+ * are undone from the log), and then the threaded engine runs from
+ * the same state. Side effects outside of the simulator state (such as
+ * the pixels in the display data and the words written to the disk)
+ * happen twice, which is harmless as long as both engines agree.
+ */
+static
+void execute_differential(struct simulator *sim)
+{
+    struct differential *diff;
+    struct sim_stats stats;
+    uint64_t *nova_prof;
+    unsigned int i;
+    uint32_t mir;
+    uint16_t mpc;
+    uint8_t task;
+    int same;
+
+    diff = sim->diff;
+    task = sim->ctask;
+    mpc = sim->mpc;
+    mir = sim->mir;
+
+    serdes_rewind(&diff->before);
+    serialize_state(sim, &diff->before, 0);
+    diff->num_writes = 0;
+    stats = sim->stats;
+
+    /* The Nova profile is only updated by the threaded pass. */
+    nova_prof = sim->nova_prof;
+    sim->nova_prof = NULL;
+    execute_interpreted(sim);
+    sim->nova_prof = nova_prof;
+    if (sim->error) return;
+
+    serdes_rewind(&diff->reference);
+    serialize_state(sim, &diff->reference, 0);
+    diff->ref_num_writes = diff->num_writes;
+    memcpy(diff->ref_writes, diff->writes,
+           diff->num_writes * sizeof(struct logged_write));
+
+    /* Go back to the previous state. */
+    undo_logged_writes(sim);
+    serdes_rewind(&diff->before);
+    deserialize_state(sim, &diff->before, 0);
+
+    /* The serialized MIR only keeps the lower 16 bits, and the
+     * statistics are not serialized.
+     */
+    sim->mir = mir;
+    sim->stats = stats;
+
+    execute_threaded(sim);
+    if (unlikely(sim->error)) {
+        report_error("simulator: step: threaded engine failed "
+                     "(task = %o, mpc = %04o)", task, mpc);
+        return;
+    }
+
+    serdes_rewind(&diff->check);
+    serialize_state(sim, &diff->check, 0);
+
+    same = (diff->check.pos == diff->reference.pos);
+    if (same) {
+        same = (memcmp(diff->check.buffer, diff->reference.buffer,
+                       diff->check.pos) == 0);
+    }
+    if (same) same = (diff->num_writes == diff->ref_num_writes);
+    for (i = 0; same && i < diff->num_writes; i++) {
+        same = (diff->writes[i].microcode == diff->ref_writes[i].microcode
+                && diff->writes[i].address == diff->ref_writes[i].address
+                && diff->writes[i].task == diff->ref_writes[i].task
+                && (!diff->writes[i].extended_memory
+                    == !diff->ref_writes[i].extended_memory)
+                && diff->writes[i].new_value
+                   == diff->ref_writes[i].new_value);
+    }
+
+    if (unlikely(!same)) {
+        report_error("simulator: step: engines diverged at cycle %d "
+                     "(task = %o, mpc = %04o)", sim->cycle, task, mpc);
+        sim->error = TRUE;
+    }
+}
+
+/* Forgets the last visit of the idle loop detection (if enabled).
+ * This is needed whenever the state is replaced, because the saved
+ * visit no longer belongs to the same execution.
+ */
+static
+void forget_idle_loop(struct simulator *sim)
+{
+    if (!sim->idle) return;
+
+    /* Makes sure that the first visit does not match. */
+    sim->idle->mpc = 0xFFFFU;
+    sim->idle->cycle = sim->cycle;
+    sim->idle->has_state = FALSE;
+}
+
+int simulator_set_idle_skip(struct simulator *sim, int enable)
+{
+    if (!enable) {
+        if (sim->idle) free((void *) sim->idle);
+        sim->idle = NULL;
+        return TRUE;
+    }
+
+    if (!sim->idle) {
+        sim->idle = (struct idle_loop *) malloc(sizeof(struct idle_loop));
+        if (unlikely(!sim->idle)) {
+            report_error("simulator: set_idle_skip: memory exhausted");
+            return FALSE;
+        }
+    }
+
+    forget_idle_loop(sim);
+    return TRUE;
+}
+
+void simulator_set_nova_fast_path(struct simulator *sim, int enable)
+{
+    sim->nova_fast_path = enable;
+}
+
+int simulator_set_profiling(struct simulator *sim, int enable)
+{
+    if (!enable) {
+        if (sim->prof_steps) free((void *) sim->prof_steps);
+        sim->prof_steps = NULL;
+
+        if (sim->prof_cycles) free((void *) sim->prof_cycles);
+        sim->prof_cycles = NULL;
+        return TRUE;
+    }
+
+    if (sim->prof_steps) return TRUE;
+
+    sim->prof_steps = (uint64_t *) malloc(PROFILE_SIZE * sizeof(uint64_t));
+    sim->prof_cycles = (uint64_t *) malloc(PROFILE_SIZE * sizeof(uint64_t));
+    if (unlikely(!sim->prof_steps || !sim->prof_cycles)) {
+        report_error("simulator: set_profiling: memory exhausted");
+        simulator_set_profiling(sim, FALSE);
+        return FALSE;
+    }
+
+    simulator_clear_profile(sim);
+    return TRUE;
+}
+
+void simulator_clear_profile(struct simulator *sim)
+{
+    if (!sim->prof_steps) return;
+    memset(sim->prof_steps, 0, PROFILE_SIZE * sizeof(uint64_t));
+    memset(sim->prof_cycles, 0, PROFILE_SIZE * sizeof(uint64_t));
+}
+
+int simulator_set_nova_profiling(struct simulator *sim, int enable)
+{
+    if (!enable) {
+        if (sim->nova_prof) free((void *) sim->nova_prof);
+        sim->nova_prof = NULL;
+        return TRUE;
+    }
+
+    if (sim->nova_prof) return TRUE;
+
+    sim->nova_prof = (uint64_t *)
+        calloc(NUM_MEMORY_BANKS * MEMORY_SIZE, sizeof(uint64_t));
+    if (unlikely(!sim->nova_prof)) {
+        report_error("simulator: set_nova_profiling: memory exhausted");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void simulator_clear_nova_profile(struct simulator *sim)
+{
+    if (!sim->nova_prof) return;
+    memset(sim->nova_prof, 0,
+           NUM_MEMORY_BANKS * MEMORY_SIZE * sizeof(uint64_t));
+}
+
+void simulator_clear_stats(struct simulator *sim)
+{
+    memset(&sim->stats, 0, sizeof(sim->stats));
+}
+
+int simulator_save_profile(const struct simulator *sim,
+                           const char *filename)
+{
+    FILE *fp;
+    unsigned int idx;
+    uint16_t task, address;
+
+    if (unlikely(!sim->prof_steps)) {
+        report_error("simulator: save_profile: profiler not enabled");
+        return FALSE;
+    }
+
+    fp = fopen(filename, "w");
+    if (unlikely(!fp)) {
+        report_error("simulator: save_profile: could not open `%s` "
+                     "for writing", filename);
+        return FALSE;
+    }
+
+    fprintf(fp, "# TASK ADDRESS STEPS CYCLES\n");
+    for (idx = 0; idx < PROFILE_SIZE; idx++) {
+        if (sim->prof_steps[idx] == 0) continue;
+        task = idx / (NUM_MICROCODE_BANKS * MICROCODE_SIZE);
+        address = idx % (NUM_MICROCODE_BANKS * MICROCODE_SIZE);
+        fprintf(fp, "%02o %05o %llu %llu\n", task, address,
+                (unsigned long long) sim->prof_steps[idx],
+                (unsigned long long) sim->prof_cycles[idx]);
+    }
+
+    fclose(fp);
+    return TRUE;
+}
+
+/* Updates the microcode profile after executing the microinstruction
+ * at `mpc` of the task `task`, which started at `prev_cycle`.
+ */
+static
+void update_profile(struct simulator *sim, uint8_t task, uint16_t mpc,
+                    int32_t prev_cycle)
+{
+    unsigned int idx;
+
+    idx = task * NUM_MICROCODE_BANKS * MICROCODE_SIZE + mpc;
+    sim->prof_steps[idx]++;
+    sim->prof_cycles[idx] += INTR_CYCLE(sim->cycle - prev_cycle);
+}
+
+/* Processes the events of the journal and of the fingerprints that
+ * are due.
+ * Returns the number of cycles until the next event (but at most
+ * `max_cycles`).
+ */
+static
+uint32_t run_hooks(struct simulator *sim, uint32_t max_cycles)
+{
+    if (sim->journal) {
+        max_cycles = journal_inject(sim->journal, max_cycles);
+    }
+    if (sim->fprint) {
+        max_cycles = fingerprint_update(sim->fprint, max_cycles);
+    }
+    return max_cycles;
+}
+
+void simulator_step(struct simulator *sim)
+{
+    int32_t prev_cycle;
+    uint16_t mpc;
+    uint8_t task;
+
+    if (sim->error) {
+        report_error("simulator: step: "
+                     "simulator is in error state");
+        return;
+    }
+
+    if (unlikely(sim->journal != NULL || sim->fprint != NULL)) {
+        run_hooks(sim, 0);
+        if (sim->error) return;
+    }
+
+    /* Copy this to detect interrupts later. */
+    prev_cycle = sim->cycle;
+    task = sim->ctask;
+    mpc = sim->mpc;
+
+    switch (sim->engine) {
+    case ENGINE_THREADED:
+        execute_threaded(sim);
+        break;
+    case ENGINE_DIFFERENTIAL:
+        execute_differential(sim);
+        break;
+    default:
+        execute_interpreted(sim);
+        break;
+    }
+    if (sim->error) return;
+
+    sim->steps++;
+    if (unlikely(sim->prof_steps != NULL))
+        update_profile(sim, task, mpc, prev_cycle);
+    check_for_interrupts(sim, prev_cycle);
+}
+
+/* Records the current position of the emulator task as the last
+ * visit of the idle loop detection.
+ */
+static
+void mark_idle_visit(struct simulator *sim)
+{
+    struct idle_loop *idle;
+
+    idle = sim->idle;
+    idle->mpc = sim->mpc;
+    idle->cycle = sim->cycle;
+    idle->task_cycle = sim->task_cycle[TASK_EMULATOR];
+    idle->steps = sim->steps;
+    idle->mem_stalls = sim->stats.mem_stalls;
+    idle->num_writes = sim->num_writes;
+    memcpy(idle->r, sim->r, NUM_R_REGISTERS * sizeof(uint16_t));
+}
+
+/* Saves the state of the simulator compared by the idle loop
+ * detection in `st`.
+ */
+static
+void save_idle_state(const struct simulator *sim, struct idle_state *st)
+{
+    /* To be able to compare with memcmp(). */
+    memset(st, 0, sizeof(struct idle_state));
+
+    memcpy(st->r, sim->r, NUM_R_REGISTERS * sizeof(uint16_t));
+    memcpy(st->s,
+           &sim->s[sim->sreg_banks[TASK_EMULATOR] * NUM_S_REGISTERS],
+           NUM_S_REGISTERS * sizeof(uint16_t));
+    memcpy(st->task_mpc, sim->task_mpc, TASK_NUM_TASKS * sizeof(uint16_t));
+    memcpy(st->xm_banks, sim->xm_banks, TASK_NUM_TASKS * sizeof(uint16_t));
+    memcpy(st->sreg_banks, sim->sreg_banks,
+           TASK_NUM_TASKS * sizeof(uint8_t));
+
+    st->mir = sim->mir;
+    st->t = sim->t;
+    st->l = sim->l;
+    st->m = sim->m;
+    st->mar = sim->mar;
+    st->ir = sim->ir;
+    st->mpc = sim->mpc;
+    st->rmr = sim->rmr;
+    st->cram_addr = sim->cram_addr;
+    st->mem_cycle = sim->mem_cycle;
+    st->mem_low = sim->mem_low;
+    st->mem_high = sim->mem_high;
+    st->mem_status = sim->mem_status;
+    st->mem_task = sim->mem_task;
+    st->ctask = sim->ctask;
+    st->ntask = sim->ntask;
+    st->flags = (sim->task_switch ? 0x01 : 0)
+        | (sim->aluC0 ? 0x02 : 0) | (sim->skip ? 0x04 : 0)
+        | (sim->carry ? 0x08 : 0) | (sim->rdram ? 0x10 : 0)
+        | (sim->wrtram ? 0x20 : 0) | (sim->soft_reset ? 0x40 : 0)
+        | (sim->error ? 0x80 : 0);
+
+    st->dsk_pending = sim->dsk.pending;
+    st->displ_pending = sim->displ.pending;
+    st->ether_pending = sim->ether.pending;
+    st->countdown_wakeup = sim->ether.countdown_wakeup;
+    st->mouse_dx = sim->mous.dx;
+    st->mouse_dy = sim->mous.dy;
+    st->mouse_dir_x = sim->mous.dir_x;
+}
+
+/* Skips the iterations of an idle loop of the emulator task (see
+ * simulator_set_idle_skip()). This is called after every step of the
+ * emulator task. The iterations are skipped up to the next device
+ * event, but without going past `max_cycles` cycles.
+ * Returns the number of skipped cycles.
+ */
+static
+uint32_t skip_idle_loop(struct simulator *sim, uint32_t max_cycles)
+{
+    struct idle_loop *idle;
+    struct idle_state tmp;
+    uint32_t period, limit, count, skip;
+    uint64_t steps, stalls;
+
+    idle = sim->idle;
+    period = (uint32_t) INTR_CYCLE(sim->cycle - idle->cycle);
+    if (sim->mpc != idle->mpc) {
+        /* Looks for another loop if this one takes too long. */
+        if (period > MAX_IDLE_PERIOD) {
+            mark_idle_visit(sim);
+            idle->has_state = FALSE;
+        }
+        return 0;
+    }
+
+    /* Quick checks before comparing the whole state: no other task
+     * ran, nothing was written, and the R registers did not change.
+     */
+    if (period == 0 || period > MAX_IDLE_PERIOD
+        || (uint32_t) INTR_CYCLE(sim->task_cycle[TASK_EMULATOR]
+                                 - idle->task_cycle) != period
+        || sim->num_writes != idle->num_writes
+        || memcmp(sim->r, idle->r,
+                  NUM_R_REGISTERS * sizeof(uint16_t)) != 0) {
+        mark_idle_visit(sim);
+        idle->has_state = FALSE;
+        return 0;
+    }
+
+    /* The iterations are skipped up to the next event (which must
+     * not be dispatched before the cycle we skip to). When not even
+     * one iteration fits, the state is not worth comparing.
+     */
+    limit = max_cycles;
+    if (sim->sched.intr_cycle >= 0) {
+        limit = MIN(limit, (uint32_t) INTR_CYCLE(sim->sched.intr_cycle
+                                                 - sim->cycle));
+    }
+    count = limit / period;
+    if (count == 0) {
+        mark_idle_visit(sim);
+        idle->has_state = FALSE;
+        return 0;
+    }
+
+    save_idle_state(sim, &idle->check);
+    if (!idle->has_state
+        || memcmp(&idle->check, &idle->state,
+                  sizeof(struct idle_state)) != 0) {
+        /* The current state is compared in the next visit. */
+        tmp = idle->state;
+        idle->state = idle->check;
+        idle->check = tmp;
+        idle->has_state = TRUE;
+        mark_idle_visit(sim);
+        return 0;
+    }
+
+    /* The same iteration repeats until the next event. */
+    skip = count * period;
+    steps = sim->steps - idle->steps;
+    stalls = sim->stats.mem_stalls - idle->mem_stalls;
+
+    sim->cycle = INTR_CYCLE(sim->cycle + (int32_t) skip);
+    sim->task_cycle[TASK_EMULATOR] =
+        INTR_CYCLE(sim->task_cycle[TASK_EMULATOR] + (int32_t) skip);
+    sim->steps += count * steps;
+    sim->idle_cycles += skip;
+    sim->stats.task_cycles[TASK_EMULATOR] += skip;
+    sim->stats.mem_stalls += count * stalls;
+
+    mark_idle_visit(sim);
+    return skip;
+}
+
+/* Tests if the Nova fast path can be used in simulator_run().
+ * Returns TRUE if so.
+ */
+static
+int can_use_nova_fast_path(const struct simulator *sim)
+{
+    if (!sim->nova_fast_path || sim->prof_steps) return FALSE;
+
+    /* The differential engine checks every microinstruction. */
+    if (sim->sys_type == ALTO_I || sim->diff || sim->watch_map)
+        return FALSE;
+
+    /* The fast path mirrors the microcode of the standard ROM0. */
+    if (memcmp(sim->microcode, UROM2_0,
+               MICROCODE_SIZE * sizeof(uint32_t)) != 0
+        || memcmp(sim->consts, CROM,
+                  CONSTANT_SIZE * sizeof(uint16_t)) != 0
+        || memcmp(sim->acs_rom, ACSROM,
+                  ACSROM_SIZE * sizeof(uint8_t)) != 0) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* The functions below are used by the Nova fast path to mirror the
+ * effects of the microinstructions of the emulator task.
+ */
+
+/* Starts a new microinstruction. Unlike the engines, this does not
+ * call ethernet_before_step(), which only acts when the current task
+ * is the ethernet task: the fast path only runs when the emulator task
+ * is both the current and the next task, and no other task is pending.
+ */
+static
+void nova_cycle(struct simulator *sim)
+{
+    update_cycles(sim);
+    sim->steps++;
+}
+
+/* Loads the L (and M) register with `alu`, where the carry of the
+ * ALU is in `aluC0`.
+ */
+static
+void nova_load_l(struct simulator *sim, uint16_t alu, int aluC0)
+{
+    sim->l = alu;
+    sim->m = alu;
+    sim->aluC0 = aluC0;
+}
+
+/* Loads the T register with `alu`. */
+static
+void nova_load_t(struct simulator *sim, uint16_t alu)
+{
+    sim->t = alu;
+    sim->cram_addr = alu;
+}
+
+/* Loads the MAR register with `address` (as in f1_load_mar()). */
+static
+void nova_load_mar(struct simulator *sim, uint16_t address)
+{
+    wait_memory(sim, 5);
+    sim->mar = address;
+    sim->mem_cycle = 1;
+    sim->mem_task = TASK_EMULATOR;
+    sim->mem_status = 0;
+    sim->mem_low = simulator_read(sim, address, TASK_EMULATOR, FALSE);
+    sim->mem_high = simulator_read(sim, 1 ^ address, TASK_EMULATOR, FALSE);
+}
+
+/* Reads the memory data (as in read_md()).
+ * Returns the memory data.
+ */
+static
+uint16_t nova_read_md(struct simulator *sim)
+{
+    uint16_t output;
+
+    wait_memory(sim, 5);
+    if (sim->mem_status & MA_WORD_BIT) {
+        output = sim->mem_high;
+    } else {
+        output = sim->mem_low;
+    }
+    sim->mem_status ^= MA_WORD_BIT;
+    return output;
+}
+
+/* Writes `data` to the memory (as in f2_store_md()). */
+static
+void nova_store_md(struct simulator *sim, uint16_t data)
+{
+    uint16_t address;
+
+    wait_memory(sim, 3);
+    address = sim->mar;
+    if (sim->mem_cycle == 4 && (sim->mem_status & MA_WORD_BIT))
+        address ^= 1;
+    sim->mem_status ^= MA_WORD_BIT;
+    simulator_write(sim, address, data, TASK_EMULATOR, FALSE);
+}
+
+/* Executes the Nova ALU instruction in the IR (after the instruction
+ * fetch). The source accumulator is already in T.
+ */
+static
+void nova_alu(struct simulator *sim)
+{
+    uint32_t a, b, res;
+    uint16_t ir, shifter_output;
+    uint8_t dst;
+    int carry;
+
+    ir = sim->ir;
+    dst = 3 - ((ir >> 11) & 3);
+
+    /* TASK, L<- ACDEST op T. */
+    nova_cycle(sim);
+    a = sim->r[dst];
+    b = sim->t;
+    switch ((ir >> 8) & 7) {
+    case 0: /* COM */
+        res = (~b) & 0xFFFFU;
+        break;
+    case 1: /* NEG */
+        res = ((~b) & 0xFFFFU) + 1;
+        break;
+    case 2: /* MOV */
+        res = b;
+        break;
+    case 3: /* INC */
+        res = b + 1;
+        break;
+    case 4: /* ADC */
+        res = a + ((~b) & 0xFFFFU);
+        break;
+    case 5: /* SUB */
+        res = a + ((~b) & 0xFFFFU) + 1;
+        break;
+    case 6: /* ADD */
+        res = a + b;
+        break;
+    default: /* AND */
+        res = a & b;
+        break;
+    }
+    nova_load_l(sim, (uint16_t) res, (res & 0xFFFF0000) ? 1 : 0);
+
+    /* DNS<- ACDEST<- L (shifted). */
+    nova_cycle(sim);
+    switch ((ir >> 4) & 3) {
+    case 0:
+        carry = sim->carry;
+        break;
+    case 1:
+        carry = 0;
+        break;
+    case 2:
+        carry = 1;
+        break;
+    default:
+        carry = !(sim->carry);
+        break;
+    }
+    if (sim->aluC0) carry = !carry;
+
+    switch ((ir >> 6) & 3) {
+    case 1:
+        shifter_output = (sim->l << 1) | ((carry) ? 1 : 0);
+        carry = (sim->l & 0x8000) ? 1 : 0;
+        break;
+    case 2:
+        shifter_output = (sim->l >> 1) | ((carry) ? 0x8000 : 0);
+        carry = sim->l & 1;
+        break;
+    case 3:
+        shifter_output = (sim->l << 8) | (sim->l >> 8);
+        break;
+    default:
+        shifter_output = sim->l;
+        break;
+    }
+
+    switch (ir & 7) {
+    case 0:
+        sim->skip = FALSE;
+        break;
+    case 1: /* SKP */
+        sim->skip = TRUE;
+        break;
+    case 2: /* SZC */
+        sim->skip = (!carry);
+        break;
+    case 3: /* SNC */
+        sim->skip = carry;
+        break;
+    case 4: /* SZR */
+        sim->skip = (shifter_output == 0);
+        break;
+    case 5: /* SNR */
+        sim->skip = (shifter_output != 0);
+        break;
+    case 6: /* SEZ */
+        sim->skip = (shifter_output == 0 || (!carry));
+        break;
+    default: /* SBN */
+        sim->skip = (shifter_output != 0 && carry);
+        break;
+    }
+
+    if ((ir & 0x0008) == 0) {
+        sim->r[dst] = shifter_output;
+        sim->carry = carry;
+    }
+}
+
+/* Computes the effective address of the Nova memory reference
+ * instruction in the IR (after the instruction fetch), and stores
+ * it in R5.
+ */
+static
+void nova_effective_address(struct simulator *sim)
+{
+    uint32_t res;
+    uint16_t ir, base, disp;
+
+    ir = sim->ir;
+
+    /* T<- base register. */
+    nova_cycle(sim);
+    switch ((ir >> 8) & 3) {
+    case 0: /* Page zero. */
+        base = 0;
+        break;
+    case 1: /* Relative to the PC. */
+        base = sim->r[6] - 1;
+        break;
+    case 2: /* Relative to AC2. */
+        base = sim->r[1];
+        break;
+    default: /* Relative to AC3. */
+        base = sim->r[0];
+        break;
+    }
+    nova_load_t(sim, base);
+
+    disp = ir & 0x00FFU;
+    if (((ir & 0x300) != 0) && ((ir & 0x80) != 0)) {
+        disp |= 0xFF00U;
+    }
+
+    /* [TASK], L<- DISP + T. */
+    nova_cycle(sim);
+    res = ((uint32_t) disp) + base;
+    nova_load_l(sim, (uint16_t) res, (res & 0xFFFF0000) ? 1 : 0);
+
+    if (ir & 0x0400) {
+        /* Also MAR<- L. */
+        nova_load_mar(sim, sim->l);
+
+        /* R7<- L. */
+        nova_cycle(sim);
+        sim->r[7] = sim->l;
+
+        /* TASK, L<- MD. */
+        nova_cycle(sim);
+        nova_load_l(sim, nova_read_md(sim), 0);
+    }
+
+    /* R5<- L. */
+    nova_cycle(sim);
+    sim->r[5] = sim->l;
+}
+
+/* Executes the Nova ISZ or DSZ instruction (according to `inc`). */
+static
+void nova_isz(struct simulator *sim, uint16_t inc)
+{
+    uint32_t res;
+
+    /* MAR<- R5. */
+    nova_cycle(sim);
+    nova_load_mar(sim, sim->r[5]);
+
+    /* T<- 1 (or -1). */
+    nova_cycle(sim);
+    nova_load_t(sim, inc);
+
+    /* L<- MD + T. */
+    nova_cycle(sim);
+    res = ((uint32_t) nova_read_md(sim)) + sim->t;
+    nova_load_l(sim, (uint16_t) res, (res & 0xFFFF0000) ? 1 : 0);
+
+    /* SH=0, MAR<- R5. */
+    nova_cycle(sim);
+    nova_load_mar(sim, sim->r[5]);
+
+    /* R5<- L. */
+    nova_cycle(sim);
+    sim->r[5] = sim->l;
+
+    if (sim->l != 0) {
+        /* TASK, R5<- L. */
+        nova_cycle(sim);
+        sim->r[5] = sim->l;
+
+        /* MD<- R5. */
+        nova_cycle(sim);
+        nova_store_md(sim, sim->r[5]);
+        return;
+    }
+
+    /* MD<- R5. */
+    nova_cycle(sim);
+    nova_store_md(sim, sim->r[5]);
+
+    /* TASK, L<- PC + 1. */
+    nova_cycle(sim);
+    res = ((uint32_t) sim->r[6]) + 1;
+    nova_load_l(sim, (uint16_t) res, (res & 0xFFFF0000) ? 1 : 0);
+
+    /* PC<- L. */
+    nova_cycle(sim);
+    sim->r[6] = sim->l;
+}
+
+/* Executes the Nova memory reference instruction in the IR (after the
+ * instruction fetch).
+ */
+static
+void nova_memory_reference(struct simulator *sim)
+{
+    uint16_t ir;
+    uint8_t dst;
+
+    ir = sim->ir;
+    dst = 3 - ((ir >> 11) & 3);
+    nova_effective_address(sim);
+
+    switch ((ir >> 11) & 0xF) {
+    case 0: /* JMP */
+        /* TASK, L<- R5. */
+        nova_cycle(sim);
+        nova_load_l(sim, sim->r[5], 0);
+
+        /* PC<- L. */
+        nova_cycle(sim);
+        sim->r[6] = sim->l;
+        break;
+
+    case 1: /* JSR */
+        /* T<- R5. */
+        nova_cycle(sim);
+        nova_load_t(sim, sim->r[5]);
+
+        /* L<- PC. */
+        nova_cycle(sim);
+        nova_load_l(sim, sim->r[6], 0);
+
+        /* TASK, AC3<- L, L<- T. */
+        nova_cycle(sim);
+        sim->r[0] = sim->l;
+        nova_load_l(sim, sim->t, 0);
+
+        /* PC<- L. */
+        nova_cycle(sim);
+        sim->r[6] = sim->l;
+        break;
+
+    case 2: /* ISZ */
+        nova_isz(sim, 1);
+        break;
+
+    case 3: /* DSZ */
+        nova_isz(sim, 0xFFFFU);
+        break;
+
+    case 4: case 5: case 6: case 7: /* LDA */
+        /* MAR<- R5. */
+        nova_cycle(sim);
+        nova_load_mar(sim, sim->r[5]);
+
+        nova_cycle(sim);
+
+        /* TASK, L<- MD. */
+        nova_cycle(sim);
+        nova_load_l(sim, nova_read_md(sim), 0);
+
+        /* ACDEST<- L. */
+        nova_cycle(sim);
+        sim->r[dst] = sim->l;
+        break;
+
+    default: /* STA */
+        /* MAR<- R5. */
+        nova_cycle(sim);
+        nova_load_mar(sim, sim->r[5]);
+
+        /* L<- ACDEST. */
+        nova_cycle(sim);
+        nova_load_l(sim, sim->r[dst], 0);
+
+        /* TASK, R5<- L. */
+        nova_cycle(sim);
+        sim->r[5] = sim->l;
+
+        /* MD<- R5. */
+        nova_cycle(sim);
+        nova_store_md(sim, sim->r[5]);
+        break;
+    }
+}
+
+/* Executes the next Nova instruction directly, if the emulator task
+ * is about to fetch it (at NOVA_START), and if no other task can run
+ * before the next instruction fetch. The caller must check that the
+ * fast path can be used (see can_use_nova_fast_path()), and that the
+ * instruction can run for NOVA_MAX_CYCLES cycles.
+ * Returns TRUE if the instruction was executed.
+ */
+static
+int execute_nova_fast_path(struct simulator *sim)
+{
+    uint16_t address, insn, nww, ir;
+    int32_t max_cycles;
+
+    if (sim->ctask != TASK_EMULATOR || sim->ntask != TASK_EMULATOR
+        || sim->mpc != NOVA_START
+        || sim->task_mpc[TASK_EMULATOR] != NOVA_START_NEXT
+        || sim->rdram || sim->wrtram || sim->soft_reset)
+        return FALSE;
+
+    /* The interrupts are handled by the microcode (NWW is in R4). */
+    nww = sim->r[4];
+    if (nww != 0 && !(nww & 0x8000)) return FALSE;
+
+    address = sim->r[6] + ((sim->skip) ? 1 : 0);
+    insn = simulator_read(sim, address, TASK_EMULATOR, FALSE);
+    if (insn & 0x8000) {
+        max_cycles = NOVA_MAX_ALU_CYCLES;
+    } else if (((insn >> 13) & 3) != 3) {
+        max_cycles = NOVA_MAX_CYCLES;
+    } else {
+        return FALSE;
+    }
+
+    /* No other task can become pending during the instruction. */
+    if (get_pending(sim) != (1 << TASK_EMULATOR)) return FALSE;
+    if (sim->sched.intr_cycle >= 0
+        && INTR_CYCLE(sim->sched.intr_cycle - sim->cycle) < max_cycles)
+        return FALSE;
+
+    /* T<- MAR<- PC + SKIP. */
+    nova_cycle(sim);
+    nova_load_t(sim, address);
+    nova_load_mar(sim, address);
+
+    /* BUS=0, L<- NWW. */
+    nova_cycle(sim);
+    nova_load_l(sim, nww, 0);
+
+    /* SH<0, L<- T + 1. */
+    nova_cycle(sim);
+    nova_load_l(sim, address + 1, (address == 0xFFFFU) ? 1 : 0);
+
+    /* PC<- L (and L<- T, if NWW is not zero). */
+    nova_cycle(sim);
+    sim->r[6] = sim->l;
+    if (nww != 0) nova_load_l(sim, address, 0);
+
+    /* IR<- T<- L<- MD. */
+    nova_cycle(sim);
+    ir = nova_read_md(sim);
+    sim->ir = ir;
+    sim->skip = FALSE;
+    if (unlikely(sim->nova_prof != NULL)) update_nova_profile(sim);
+    nova_load_t(sim, ir);
+    nova_load_l(sim, ir, 0);
+
+    /* T<- ACSOURCE. */
+    nova_cycle(sim);
+    nova_load_t(sim, sim->r[3 - ((ir >> 13) & 3)]);
+
+    if (ir & 0x8000) {
+        nova_alu(sim);
+    } else {
+        nova_memory_reference(sim);
+    }
+
+    /* Back at NOVA_START (without task switches). */
+    sim->task_switch = FALSE;
+    sim->nova_fast_insns++;
+    return TRUE;
+}
+
+unsigned int simulator_run(struct simulator *sim, uint32_t max_cycles,
+                           unsigned int stop_mask)
+{
+    execute_cb execute;
+    int32_t prev_cycle, diff;
+    uint32_t cycles, limit;
+    uint16_t mpc;
+    uint8_t task;
+    int fast;
+
+    if (sim->error) {
+        report_error("simulator: run: "
+                     "simulator is in error state");
+        return RUN_ERROR;
+    }
+
+    switch (sim->engine) {
+    case ENGINE_THREADED:
+        execute = &execute_threaded;
+        break;
+    case ENGINE_DIFFERENTIAL:
+        execute = &execute_differential;
+        break;
+    default:
+        execute = &execute_interpreted;
+        break;
+    }
+
+    fast = can_use_nova_fast_path(sim) && !(stop_mask & RUN_MPC);
+
+    /* When there is a journal (or fingerprints), the simulation stops
+     * at each of their events (at `limit`).
+     */
+    limit = (unlikely(sim->journal != NULL || sim->fprint != NULL))
+        ? 0 : max_cycles;
+
+    cycles = 0;
+    while (cycles < max_cycles) {
+        if (unlikely(cycles >= limit)) {
+            limit = cycles + run_hooks(sim, max_cycles - cycles);
+            if (unlikely(sim->error)) return RUN_ERROR;
+        }
+
+        prev_cycle = sim->cycle;
+        if (!fast || limit - cycles < NOVA_MAX_CYCLES
+            || !execute_nova_fast_path(sim)) {
+            task = sim->ctask;
+            mpc = sim->mpc;
+            execute(sim);
+            sim->steps++;
+            if (unlikely(sim->error)) return RUN_ERROR;
+            if (unlikely(sim->prof_steps != NULL))
+                update_profile(sim, task, mpc, prev_cycle);
+        }
+
+        diff = INTR_CYCLE(sim->cycle - prev_cycle);
+        cycles += (uint32_t) diff;
+
+        /* Only calls check_for_interrupts() when the cycle of the
+         * next device event has been reached.
+         */
+        if (sim->sched.intr_cycle >= 0
+            && diff > INTR_CYCLE(sim->sched.intr_cycle - prev_cycle)) {
+            check_for_interrupts(sim, prev_cycle);
+            if (unlikely(sim->error)) return RUN_ERROR;
+            if (stop_mask & RUN_EVENT) return RUN_EVENT;
+        }
+
+        if (unlikely(stop_mask != 0)) {
+            if ((stop_mask & RUN_WATCH) && sim->watch_hit)
+                return RUN_WATCH;
+            if ((stop_mask & RUN_TASK_SWITCH) && sim->task_switch)
+                return RUN_TASK_SWITCH;
+            if ((stop_mask & RUN_MPC) && sim->mpc == sim->stop_mpc
+                && sim->ctask == sim->stop_task)
+                return RUN_MPC;
+        }
+
+        /* Most steps of the emulator task are not at the MPC of the
+         * last visit, so the call is avoided for them.
+         */
+        if (unlikely(sim->idle != NULL)) {
+            if (sim->ctask == TASK_EMULATOR && !sim->watch_map
+                && !sim->prof_steps && !(stop_mask & RUN_MPC)
+                && cycles < limit
+                && (sim->mpc == sim->idle->mpc
+                    || INTR_CYCLE(sim->cycle - sim->idle->cycle)
+                       > MAX_IDLE_PERIOD)) {
+                cycles += skip_idle_loop(sim, limit - cycles);
+            }
+        }
+    }
+    return RUN_CYCLES;
+}
+
+/* Copies the scanlines of the display marked as dirty to
+ * `display_data`, and moves their dirty bits to `dirty`.
+ */
+static
+void copy_dirty_lines(struct simulator *sim, uint16_t *display_data,
+                      uint32_t *dirty)
+{
+    uint32_t bits;
+    unsigned int i, line;
+    size_t offset;
+
+    for (i = 0; i < DISPLAY_DIRTY_SIZE; i++) {
+        bits = sim->displ.dirty[i];
+        if (!bits) continue;
+
+        dirty[i] |= bits;
+        sim->displ.dirty[i] = 0;
+        for (line = 32 * i; bits; line++, bits >>= 1) {
+            if (!(bits & 1) || line >= DISPLAY_HEIGHT) continue;
+            offset = line * DISPLAY_LINE_WORDS;
+            memcpy(&display_data[offset], &sim->displ.display_data[offset],
+                   DISPLAY_LINE_WORDS * sizeof(uint16_t));
+        }
+    }
+}
+
+int simulator_update(struct simulator *sim,
+                     const struct keyboard *keyb,
+                     const struct mouse *mous,
+                     uint16_t *display_data,
+                     uint32_t *dirty)
+{
+    if (display_data) {
+        if (dirty) {
+            copy_dirty_lines(sim, display_data, dirty);
+        } else {
+            memcpy(display_data, sim->displ.display_data,
+                   DISPLAY_DATA_SIZE * sizeof(uint16_t));
+        }
+    }
+    if (unlikely(sim->journal != NULL)) {
+        if (unlikely(!journal_update(sim->journal, keyb, mous))) {
+            report_error("simulator: update: could not update journal");
+            return FALSE;
+        }
+
+        /* The inputs come from the journal when replaying. */
+        if (sim->journal->mode == JOURNAL_REPLAY) {
+            keyb = NULL;
+            mous = NULL;
+        }
+    }
+    if (keyb) {
+        keyboard_update_from(&sim->keyb, keyb);
+    }
+    if (mous) {
+        mouse_update_from(&sim->mous, mous);
+    }
+    return TRUE;
+}
+
+void simulator_predecode(const struct simulator *sim,
+                         struct microcode *mc)
 {
     microcode_predecode(mc,
                         sim->sys_type,
@@ -1833,7 +4372,7 @@ void simulator_print_registers(const struct simulator *sim,
 
     decode_tagged_value(dec->vdec, "CYC", DECODE_SVALUE32, sim->cycle);
     decode_tagged_value(dec->vdec, "ICYC",
-                        DECODE_SVALUE32, sim->intr_cycle);
+                        DECODE_SVALUE32, sim->sched.intr_cycle);
     decode_tagged_value(dec->vdec, "TASKCYC", DECODE_SVALUE32,
                         sim->task_cycle[sim->ctask]);
     decode_tagged_value(dec->vdec, "MEMCYC",
@@ -1910,98 +4449,26 @@ void simulator_print_nova_registers(const struct simulator *sim,
 
 void simulator_serialize(const struct simulator *sim, struct serdes *sd)
 {
-    serdes_put32(sd, (uint32_t) sim->sys_type);
-    serdes_put_bool(sd, sim->error);
-    serdes_put16_array(sd, sim->r, NUM_R_REGISTERS);
-    serdes_put16_array(sd, sim->s, NUM_S_BANKS * NUM_S_REGISTERS);
-    serdes_put16(sd, sim->t);
-    serdes_put16(sd, sim->l);
-    serdes_put16(sd, sim->m);
-    serdes_put16(sd, sim->mar);
-    serdes_put16(sd, sim->ir);
-    serdes_put16(sd, sim->mir);
-    serdes_put16(sd, sim->mpc);
-    serdes_put8(sd, sim->ctask);
-    serdes_put8(sd, sim->ntask);
-    serdes_put_bool(sd, sim->task_switch);
-    serdes_put_bool(sd, sim->aluC0);
-    serdes_put_bool(sd, sim->skip);
-    serdes_put_bool(sd, sim->carry);
-    serdes_put16(sd, sim->rmr);
-    serdes_put16(sd, sim->cram_addr);
-    serdes_put_bool(sd, sim->rdram);
-    serdes_put_bool(sd, sim->wrtram);
-    serdes_put_bool(sd, sim->soft_reset);
-    serdes_put8_array(sd, sim->acs_rom, ACSROM_SIZE);
-    serdes_put16_array(sd, sim->consts, CONSTANT_SIZE);
-    serdes_put32_array(sd, sim->microcode,
-                       NUM_MICROCODE_BANKS * MICROCODE_SIZE);
-    serdes_put16_array(sd, sim->task_mpc, TASK_NUM_TASKS);
-    serdes_put32(sd, sim->cycle);
-    serdes_put32_array(sd, (const uint32_t *) sim->task_cycle,
-                       TASK_NUM_TASKS);
-    serdes_put32(sd, sim->intr_cycle);
-    serdes_put16_array(sd, sim->mem, NUM_MEMORY_BANKS * MEMORY_SIZE);
-    serdes_put16_array(sd, sim->xm_banks, TASK_NUM_TASKS);
-    serdes_put8_array(sd, sim->sreg_banks, TASK_NUM_TASKS);
-    serdes_put16(sd, sim->mem_cycle);
-    serdes_put8(sd, sim->mem_task);
-    serdes_put16(sd, sim->mem_low);
-    serdes_put16(sd, sim->mem_high);
-    serdes_put16(sd, sim->mem_status);
-    disk_serialize(&sim->dsk, sd);
-    display_serialize(&sim->displ, sd);
-    ethernet_serialize(&sim->ether, sd);
-    keyboard_serialize(&sim->keyb, sd);
-    mouse_serialize(&sim->mous, sd);
+    serialize_state(sim, sd, STATE_ALL);
 }
 
 void simulator_deserialize(struct simulator *sim, struct serdes *sd)
 {
-    sim->sys_type = (enum system_type) serdes_get32(sd);
-    sim->error = serdes_get_bool(sd);
-    serdes_get16_array(sd, sim->r, NUM_R_REGISTERS);
-    serdes_get16_array(sd, sim->s, NUM_S_BANKS * NUM_S_REGISTERS);
-    sim->t = serdes_get16(sd);
-    sim->l = serdes_get16(sd);
-    sim->m = serdes_get16(sd);
-    sim->mar = serdes_get16(sd);
-    sim->ir = serdes_get16(sd);
-    sim->mir = serdes_get16(sd);
-    sim->mpc = serdes_get16(sd);
-    sim->ctask = serdes_get8(sd);
-    sim->ntask = serdes_get8(sd);
-    sim->task_switch = serdes_get_bool(sd);
-    sim->aluC0 = serdes_get_bool(sd);
-    sim->skip = serdes_get_bool(sd);
-    sim->carry = serdes_get_bool(sd);
-    sim->rmr = serdes_get16(sd);
-    sim->cram_addr = serdes_get16(sd);
-    sim->rdram = serdes_get_bool(sd);
-    sim->wrtram = serdes_get_bool(sd);
-    sim->soft_reset = serdes_get_bool(sd);
-    serdes_get8_array(sd, sim->acs_rom, ACSROM_SIZE);
-    serdes_get16_array(sd, sim->consts, CONSTANT_SIZE);
-    serdes_get32_array(sd, sim->microcode,
-                       NUM_MICROCODE_BANKS * MICROCODE_SIZE);
-    serdes_get16_array(sd, sim->task_mpc, TASK_NUM_TASKS);
-    sim->cycle = serdes_get32(sd);
-    serdes_get32_array(sd, (uint32_t *) sim->task_cycle,
-                       TASK_NUM_TASKS);
-    sim->intr_cycle = serdes_get32(sd);
-    serdes_get16_array(sd, sim->mem, NUM_MEMORY_BANKS * MEMORY_SIZE);
-    serdes_get16_array(sd, sim->xm_banks, TASK_NUM_TASKS);
-    serdes_get8_array(sd, sim->sreg_banks, TASK_NUM_TASKS);
-    sim->mem_cycle = serdes_get16(sd);
-    sim->mem_task = serdes_get8(sd);
-    sim->mem_low = serdes_get16(sd);
-    sim->mem_high = serdes_get16(sd);
-    sim->mem_status = serdes_get16(sd);
-    disk_deserialize(&sim->dsk, sd);
-    display_deserialize(&sim->displ, sd);
-    ethernet_deserialize(&sim->ether, sd);
-    keyboard_deserialize(&sim->keyb, sd);
-    mouse_deserialize(&sim->mous, sd);
+    deserialize_state(sim, sd, STATE_ALL);
+    forget_idle_loop(sim);
+}
+
+void simulator_serialize_parts(const struct simulator *sim,
+                               struct serdes *sd, unsigned int parts)
+{
+    serialize_state(sim, sd, parts);
+}
+
+void simulator_deserialize_parts(struct simulator *sim,
+                                 struct serdes *sd, unsigned int parts)
+{
+    deserialize_state(sim, sd, parts);
+    forget_idle_loop(sim);
 }
 
 int simulator_save_state(const struct simulator *sim,
@@ -2009,12 +4476,15 @@ int simulator_save_state(const struct simulator *sim,
 {
     struct serdes sd;
 
-    if (unlikely(!serdes_create(&sd, STATE_SIZE, FALSE))) {
+    if (unlikely(!serdes_create(&sd, STATE_HEADER_SIZE + STATE_SIZE,
+                                FALSE))) {
         report_error("simulator: save_state: "
                      "could not create serializer");
         return FALSE;
     }
 
+    serdes_put32(&sd, STATE_MAGIC);
+    serdes_put32(&sd, STATE_VERSION);
     simulator_serialize(sim, &sd);
 
     if (unlikely(sd.pos != sd.size)) {
@@ -2041,8 +4511,11 @@ int simulator_load_state(struct simulator *sim,
                          const char *filename)
 {
     struct serdes sd;
+    size_t file_size;
+    uint32_t version;
 
-    if (unlikely(!serdes_create(&sd, STATE_SIZE, FALSE))) {
+    if (unlikely(!serdes_create(&sd, STATE_HEADER_SIZE + STATE_SIZE,
+                                FALSE))) {
         report_error("simulator: load_state: "
                      "could not create deserializer");
         return FALSE;
@@ -2055,14 +4528,35 @@ int simulator_load_state(struct simulator *sim,
         return FALSE;
     }
 
-    if (unlikely(sd.pos != sd.size)) {
+    file_size = sd.pos;
+    serdes_rewind(&sd);
+    if (unlikely(file_size < STATE_HEADER_SIZE
+                 || serdes_get32(&sd) != STATE_MAGIC)) {
+        report_error("simulator: load_state: "
+                     "invalid state file `%s` (the state files "
+                     "saved by older versions are not supported)",
+                     filename);
+        serdes_destroy(&sd);
+        return FALSE;
+    }
+
+    version = serdes_get32(&sd);
+    if (unlikely(version != STATE_VERSION)) {
+        report_error("simulator: load_state: "
+                     "unsupported version %u of state file `%s` "
+                     "(expecting %u)", (unsigned int) version,
+                     filename, (unsigned int) STATE_VERSION);
+        serdes_destroy(&sd);
+        return FALSE;
+    }
+
+    if (unlikely(file_size != sd.size)) {
         report_error("simulator: load_state: "
                      "invalid state file `%s`", filename);
         serdes_destroy(&sd);
         return FALSE;
     }
 
-    serdes_rewind(&sd);
     simulator_deserialize(sim, &sd);
 
     if (unlikely(sd.pos != sd.size)) {
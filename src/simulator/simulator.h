@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include "microcode/microcode.h"
 #include "microcode/nova.h"
+#include "simulator/intr.h"
 #include "simulator/disk.h"
 #include "simulator/display.h"
 #include "simulator/ethernet.h"
@@ -13,11 +14,76 @@
 #include "common/serdes.h"
 #include "common/string_buffer.h"
 
+/* Constants. */
+#define MEMORY_PAGE_SHIFT                  8
+#define MEMORY_PAGE_SIZE   (1 << MEMORY_PAGE_SHIFT)
+#define NUM_MEMORY_PAGES \
+    ((NUM_MEMORY_BANKS * MEMORY_SIZE) >> MEMORY_PAGE_SHIFT)
+
+/* Optional parts of the serialized state. */
+#define STATE_ROMS                         1 /* ROMs and microcode. */
+#define STATE_MEMORY                       2 /* Main memory. */
+#define STATE_ALL      (STATE_ROMS | STATE_MEMORY)
+
+/* The memory accesses of the watchpoints. */
+#define WATCH_READ                         1 /* Reads of MD. */
+#define WATCH_WRITE                        2 /* Writes of MD. */
+#define WATCH_ALL_BANKS                 0xFF /* Watch every bank. */
+
+/* The reasons for simulator_run() to stop. Except for RUN_CYCLES and
+ * RUN_ERROR, these are also the bits of its `stop_mask` parameter.
+ */
+#define RUN_CYCLES                         0 /* Ran the given cycles. */
+#define RUN_ERROR                          1 /* Simulation error. */
+#define RUN_EVENT                          2 /* A device event happened. */
+#define RUN_TASK_SWITCH                    4 /* A task switch happened. */
+#define RUN_WATCH                          8 /* A watchpoint was hit. */
+#define RUN_MPC                           16 /* The stop MPC was reached. */
+
+/* The number of entries of the microcode profile (one for each task
+ * and address of the microcode).
+ */
+#define PROFILE_SIZE \
+    (TASK_NUM_TASKS * NUM_MICROCODE_BANKS * MICROCODE_SIZE)
+
 /* Data structures and types. */
 
+/* The engines that execute the microinstructions. */
+enum sim_engine {
+    ENGINE_INTERPRETER,           /* Decodes each field at every step. */
+    ENGINE_THREADED,              /* Uses handlers resolved once per
+                                   * control store word.
+                                   */
+    ENGINE_DIFFERENTIAL,          /* Runs both engines at every step and
+                                   * stops when they diverge.
+                                   */
+};
+
+/* Runtime statistics of the simulator. These counters are always
+ * updated, and are reset by simulator_clear_stats().
+ */
+struct sim_stats {
+    uint64_t task_cycles[TASK_NUM_TASKS]; /* Cycles spent on each task. */
+    uint64_t task_switches;       /* Number of task switches. */
+    uint64_t disk_events;         /* Disk events dispatched. */
+    uint64_t display_events;      /* Display events dispatched. */
+    uint64_t ethernet_events;     /* Ethernet events dispatched. */
+    uint64_t mem_stalls;          /* Cycles spent waiting for the
+                                   * memory.
+                                   */
+};
+
+/* Internal structures of the simulator. */
+struct threaded_code;
+struct differential;
+struct idle_loop;
+struct journal;
+struct fingerprint;
+
 /* Structure representing an Alto simulator. */
 struct simulator {
     enum system_type sys_type;    /* The alto system type. */
+    enum sim_engine engine;       /* The execution engine. */
     int error;                    /* The simulator is in an error state. */
     uint16_t *r;                  /* R register file (32 registers). */
     uint16_t *s;                  /* S register file (8 x 32 registers). */
@@ -49,6 +115,20 @@ struct simulator {
     uint8_t *acs_rom;             /* The contents of the ACSROM. */
     uint16_t *consts;             /* Pointer to the constant rom. */
     uint32_t *microcode;          /* Microcode ROM + RAM. */
+    struct microcode *mc_cache;   /* The predecoded microcode (one entry
+                                   * per task and control store address).
+                                   */
+    struct threaded_code *tcode;  /* Handlers for the threaded engine
+                                   * (indexed as the mc_cache).
+                                   */
+    struct differential *diff;    /* State of the differential engine. */
+    struct idle_loop *idle;       /* State of the idle loop detection
+                                   * (NULL if disabled).
+                                   */
+    int nova_fast_path;           /* To execute the common Nova
+                                   * instructions directly (see
+                                   * simulator_set_nova_fast_path()).
+                                   */
 
     uint16_t *task_mpc;           /* Microcode program counter + bank
                                    * select (1 per task).
@@ -56,8 +136,8 @@ struct simulator {
 
     int32_t cycle;                /* Current cpu cycle. */
     int32_t *task_cycle;          /* Current task cycles. */
-    int32_t intr_cycle;           /* Next cycle when the simulator needs
-                                   * to check the controllers for events.
+    struct scheduler sched;       /* The scheduler of the events of the
+                                   * controllers.
                                    */
 
     uint16_t *mem;                /* Main memory. */
@@ -72,6 +152,65 @@ struct simulator {
     uint16_t mem_high;            /* Latched memory value (2nd word). */
     uint16_t mem_status;          /* The status of memory operation. */
 
+    uint32_t epoch;               /* The current epoch (for keeping track
+                                   * of the modified memory pages).
+                                   */
+    uint32_t *page_epoch;         /* The epoch of the last write to each
+                                   * memory page.
+                                   */
+    uint32_t rom_epoch;           /* The epoch of the last change to the
+                                   * ROMs or to the microcode RAM.
+                                   */
+    uint32_t num_writes;          /* Number of writes to the memory and
+                                   * to the microcode RAM.
+                                   */
+
+    uint8_t *watch_map;           /* Bitmap of the watched memory words
+                                   * (two bits per word, for reads and
+                                   * writes), or NULL if none.
+                                   */
+    unsigned int watch_hit;       /* The watched accesses (WATCH_*) since
+                                   * this was last cleared.
+                                   */
+    uint32_t watch_address;       /* The physical address (bank and
+                                   * address) of the last watched access.
+                                   */
+    uint16_t stop_mpc;            /* The MPC of `stop_task` for RUN_MPC
+                                   * (see simulator_set_stop_mpc()).
+                                   */
+    uint8_t stop_task;            /* The task for RUN_MPC. */
+    uint64_t steps;               /* Number of microinstructions executed
+                                   * since the simulator was created.
+                                   */
+    uint64_t idle_cycles;         /* Number of cycles skipped in idle
+                                   * loops (see simulator_set_idle_skip()).
+                                   */
+    uint64_t nova_fast_insns;     /* Number of Nova instructions executed
+                                   * by the fast path.
+                                   */
+    struct sim_stats stats;       /* The runtime statistics. */
+    struct journal *journal;      /* The journal of the inputs (see
+                                   * journal_record()), or NULL.
+                                   */
+    struct fingerprint *fprint;   /* To write the fingerprints of the
+                                   * state (see fingerprint_start()),
+                                   * or NULL.
+                                   */
+    uint64_t *prof_steps;         /* Number of executions of each
+                                   * microinstruction, indexed by
+                                   * task * NUM_MICROCODE_BANKS
+                                   * * MICROCODE_SIZE + address
+                                   * (NULL if not profiling).
+                                   */
+    uint64_t *prof_cycles;        /* Number of cycles spent on each
+                                   * microinstruction (same indexing).
+                                   */
+    uint64_t *nova_prof;          /* Number of Nova instructions loaded
+                                   * into the IR from each address,
+                                   * indexed by bank * MEMORY_SIZE
+                                   * + address (NULL if not profiling).
+                                   */
+
     struct disk dsk;              /* The disk controller. */
     struct display displ;         /* The display controller. */
     struct ethernet ether;        /* The ethernet controller. */
@@ -95,10 +234,12 @@ void simulator_destroy(struct simulator *sim);
 
 /* Creates a new simulator object.
  * This obeys the initvar / destroy / create protocol.
- * The `sys_type` variable specifies the system type.
+ * The `sys_type` variable specifies the system type, and `engine`
+ * selects the execution engine.
  * Returns TRUE on success.
  */
-int simulator_create(struct simulator *sim, enum system_type sys_type);
+int simulator_create(struct simulator *sim, enum system_type sys_type,
+                     enum sim_engine engine);
 
 /* Loads the constant rom from a file.
  * The filename with the constants is defined by parameter `filename`.
@@ -135,20 +276,132 @@ uint16_t simulator_read(const struct simulator *sim, uint16_t address,
 void simulator_write(struct simulator *sim, uint16_t address,
                      uint16_t data, uint8_t task, int extended_memory);
 
+/* Starts a new epoch for keeping track of the modified memory pages
+ * and disk sectors. Every page (or sector) written after this call
+ * will have an epoch greater than the returned value.
+ * Returns the epoch that has just ended.
+ */
+uint32_t simulator_next_epoch(struct simulator *sim);
+
+/* Watches the memory accesses (reads or writes of MD, as given by the
+ * WATCH_* bits in `flags`) to the addresses from `first` to `last`
+ * (inclusive) in the memory bank `bank`, or in every bank if `bank`
+ * is WATCH_ALL_BANKS. The bank of an access is determined by the
+ * bank register (xm_banks) of the task. Each watched access sets the
+ * corresponding bit in `watch_hit` and updates `watch_address`.
+ * Returns TRUE on success.
+ */
+int simulator_watch(struct simulator *sim, uint8_t bank, uint16_t first,
+                    uint16_t last, unsigned int flags);
+
+/* Removes all the watchpoints of the simulator. */
+void simulator_clear_watches(struct simulator *sim);
+
+/* Sets the microinstruction where simulator_run() stops with RUN_MPC:
+ * when the task `task` is about to execute the microinstruction at
+ * `mpc`.
+ */
+void simulator_set_stop_mpc(struct simulator *sim, uint8_t task,
+                            uint16_t mpc);
+
+/* Enables (or disables) the skipping of idle loops, according to
+ * `enable`. When enabled, simulator_run() looks for the emulator task
+ * running a loop that repeats exactly the same state (the registers,
+ * the memory, and the controllers, except for the cycle counters),
+ * such as the ones that wait for the keyboard or for the disk. As the
+ * following iterations of such loop are identical until the next
+ * device event, they are skipped by advancing the cycle counters
+ * directly, and the simulation continues from the last iteration
+ * before the event. This is not used when there are watchpoints (or
+ * while profiling).
+ * Returns TRUE on success.
+ */
+int simulator_set_idle_skip(struct simulator *sim, int enable);
+
+/* Enables (or disables) the fast path for the Nova instructions,
+ * according to `enable`. When enabled, simulator_run() executes the
+ * common Nova instructions (the ALU instructions, LDA, STA, JMP, JSR,
+ * ISZ and DSZ) directly, instead of running the corresponding
+ * microinstructions of the emulator task one at a time. The resulting
+ * state (including the cycle counters and the microcode registers) is
+ * the same. The fast path is only used with the standard ROM0 of the
+ * Alto II, and it falls back to the microcode when other tasks are
+ * pending (or might become pending during the instruction), when the
+ * emulator is running from the RAM, when an interrupt is pending, and
+ * when there are watchpoints.
+ */
+void simulator_set_nova_fast_path(struct simulator *sim, int enable);
+
+/* Enables (or disables) the microcode profiler, according to `enable`.
+ * When enabled, every microinstruction executed by simulator_step()
+ * and simulator_run() is counted in `prof_steps`, and the cycles it
+ * took (including the memory wait cycles) in `prof_cycles`. The idle
+ * loops and the Nova fast path are not used while profiling.
+ * Returns TRUE on success.
+ */
+int simulator_set_profiling(struct simulator *sim, int enable);
+
+/* Clears the counters of the microcode profiler. */
+void simulator_clear_profile(struct simulator *sim);
+
+/* Enables (or disables) the Nova profiler, according to `enable`.
+ * When enabled, the address of the Nova instruction (in the memory bank
+ * of the emulator task) is counted in `nova_prof` every time that the
+ * emulator loads the IR. Since the emulator increments the PC (R6)
+ * before loading the IR, the counted address is R6 - 1.
+ * Returns TRUE on success.
+ */
+int simulator_set_nova_profiling(struct simulator *sim, int enable);
+
+/* Clears the counters of the Nova profiler. */
+void simulator_clear_nova_profile(struct simulator *sim);
+
+/* Clears the runtime statistics (the `stats` field). */
+void simulator_clear_stats(struct simulator *sim);
+
+/* Saves the microcode profile to a text file named `filename`.
+ * Each line has the task, the address of the microcode (including
+ * the bank), the number of executions and the number of cycles,
+ * and only the microinstructions that were executed are listed.
+ * Returns TRUE on success.
+ */
+int simulator_save_profile(const struct simulator *sim,
+                           const char *filename);
+
 /* Performs a simulation step. */
 void simulator_step(struct simulator *sim);
 
+/* Runs the simulation for at least `max_cycles` cycles (the last
+ * microinstruction may take it a few cycles past that), or until one
+ * of the conditions in `stop_mask` (RUN_EVENT, RUN_TASK_SWITCH,
+ * RUN_WATCH or RUN_MPC) happens. The simulation always stops on
+ * errors. The idle loops and the Nova fast path are not used with
+ * RUN_MPC, as they skip microinstructions. This
+ * is equivalent to calling simulator_step() repeatedly, but avoids
+ * most of its per-step overhead.
+ * Returns the reason for stopping (RUN_CYCLES if the given number of
+ * cycles was run).
+ */
+unsigned int simulator_run(struct simulator *sim, uint32_t max_cycles,
+                           unsigned int stop_mask);
+
 /* Updates the input and output state of the simulation.
  * The keyboard input state is given by `keyb` and the mouse input state
- * is given by `mous`. The current pixel data from the display will be
- * copied to `display_data`. If any of these parameter is NULL, the
- * corresponding state will not be copied.
+ * is given by `mous`. The current pixel data from the display (packed
+ * with one bit per pixel, see struct display) will be copied to
+ * `display_data`. If any of these parameter is NULL, the
+ * corresponding state will not be copied. If `dirty` is not NULL,
+ * only the scanlines that changed since the last call are copied
+ * (so `display_data` must keep the previous contents), and their bits
+ * are set in the bitmap `dirty` (with DISPLAY_DIRTY_SIZE words, where
+ * bit `i % 32` of word `i / 32` corresponds to scanline `i`).
  * Returns TRUE on success.
  */
 int simulator_update(struct simulator *sim,
                      const struct keyboard *keyb,
                      const struct mouse *mous,
-                     uint8_t *display_data);
+                     uint16_t *display_data,
+                     uint32_t *dirty);
 
 /* Predecodes the current microinstruction.
  * The output is written to `mc`.
@@ -186,6 +439,20 @@ void simulator_serialize(const struct simulator *sim, struct serdes *sd);
 /* Deserializes the simulator object from `sd`. */
 void simulator_deserialize(struct simulator *sim, struct serdes *sd);
 
+/* Serializes part of the simulator object to `sd`.
+ * The optional parts to include (STATE_ROMS and STATE_MEMORY) are
+ * given by the bit mask `parts`. The contents of the disk packs
+ * are never included.
+ */
+void simulator_serialize_parts(const struct simulator *sim,
+                               struct serdes *sd, unsigned int parts);
+
+/* Deserializes part of the simulator object from `sd`.
+ * The bit mask `parts` must match the one used when serializing.
+ */
+void simulator_deserialize_parts(struct simulator *sim,
+                                 struct serdes *sd, unsigned int parts);
+
 /* Saves the state of the simulator in a file.
  * The state is saved in the file whoese name is `filename`.
  * Returns TRUE on success.
@@ -195,6 +462,8 @@ int simulator_save_state(const struct simulator *sim,
 
 /* Loads the state of the simulator in a file.
  * The state is loaded from the file whoese name is `filename`.
+ * The file must have the current version of the state (the files of
+ * older versions are rejected).
  * Returns TRUE on success.
  */
 int simulator_load_state(struct simulator *sim,
@@ -0,0 +1,348 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simulator/snapshot.h"
+#include "simulator/simulator.h"
+#include "simulator/disk.h"
+#include "microcode/microcode.h"
+#include "common/serdes.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define CORE_SIZE                      32768
+
+/* Functions. */
+
+void snapshot_initvar(struct snapshot *snap)
+{
+    unsigned int dnum;
+
+    serdes_initvar(&snap->core);
+    snap->pages = NULL;
+    for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
+        snap->drives[dnum].sectors = NULL;
+        snap->drives[dnum].length = 0;
+        snap->drives[dnum].loaded = FALSE;
+    }
+    snap->sim = NULL;
+    snap->epoch = 0;
+}
+
+/* Releases a reference to the memory page `pg`. */
+static
+void release_page(struct snapshot_page *pg)
+{
+    if (!pg) return;
+    if (--pg->refcount == 0) free((void *) pg);
+}
+
+/* Releases a reference to the disk sector `ss`. */
+static
+void release_sector(struct snapshot_sector *ss)
+{
+    if (!ss) return;
+    if (--ss->refcount == 0) free((void *) ss);
+}
+
+/* Releases all the sectors of the drive `drv`. */
+static
+void release_drive(struct snapshot_drive *drv)
+{
+    uint16_t i;
+
+    if (drv->sectors) {
+        for (i = 0; i < drv->length; i++) {
+            release_sector(drv->sectors[i]);
+        }
+        free((void *) drv->sectors);
+    }
+    drv->sectors = NULL;
+    drv->length = 0;
+    drv->loaded = FALSE;
+}
+
+void snapshot_destroy(struct snapshot *snap)
+{
+    unsigned int page, dnum;
+
+    if (snap->pages) {
+        for (page = 0; page < NUM_MEMORY_PAGES; page++) {
+            release_page(snap->pages[page]);
+        }
+        free((void *) snap->pages);
+    }
+    snap->pages = NULL;
+
+    for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
+        release_drive(&snap->drives[dnum]);
+    }
+
+    serdes_destroy(&snap->core);
+    snap->sim = NULL;
+}
+
+int snapshot_create(struct snapshot *snap)
+{
+    snapshot_initvar(snap);
+
+    if (unlikely(!serdes_create(&snap->core, CORE_SIZE, TRUE))) {
+        report_error("snapshot: create: could not create serializer");
+        snapshot_destroy(snap);
+        return FALSE;
+    }
+
+    snap->pages = (struct snapshot_page **)
+        calloc(NUM_MEMORY_PAGES, sizeof(struct snapshot_page *));
+    if (unlikely(!snap->pages)) {
+        report_error("snapshot: create: memory exhausted");
+        snapshot_destroy(snap);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Resizes the sector table of drive `drv` to `length` sectors.
+ * Returns TRUE on success.
+ */
+static
+int resize_drive(struct snapshot_drive *drv, uint16_t length)
+{
+    if (drv->sectors && drv->length == length) return TRUE;
+
+    release_drive(drv);
+    drv->sectors = (struct snapshot_sector **)
+        calloc(MAX(length, 1), sizeof(struct snapshot_sector *));
+    if (unlikely(!drv->sectors)) return FALSE;
+    drv->length = length;
+    return TRUE;
+}
+
+/* Takes a snapshot of the disk drive `dd` and stores it in `drv`.
+ * If `pdrv` is not NULL, the sectors that were not modified after
+ * the epoch `epoch` are shared with `pdrv`.
+ * Returns TRUE on success.
+ */
+static
+int take_drive(struct snapshot_drive *drv, const struct disk_drive *dd,
+               const struct snapshot_drive *pdrv, uint32_t epoch)
+{
+    struct snapshot_sector *ss;
+    uint16_t i;
+
+    if (!dd->loaded) {
+        release_drive(drv);
+        return TRUE;
+    }
+
+    if (pdrv) {
+        if (!pdrv->loaded || !pdrv->sectors
+            || pdrv->length != dd->length) {
+            pdrv = NULL;
+        }
+    }
+
+    if (unlikely(!resize_drive(drv, dd->length)))
+        return FALSE;
+
+    for (i = 0; i < dd->length; i++) {
+        ss = (pdrv) ? pdrv->sectors[i] : NULL;
+        if (ss && dd->sector_epoch[i] <= epoch) {
+            ss->refcount++;
+        } else {
+            ss = (struct snapshot_sector *)
+                malloc(sizeof(struct snapshot_sector));
+            if (unlikely(!ss)) return FALSE;
+            ss->refcount = 1;
+            memcpy(&ss->ds, &dd->sectors[i], sizeof(struct disk_sector));
+        }
+        release_sector(drv->sectors[i]);
+        drv->sectors[i] = ss;
+    }
+
+    drv->loaded = TRUE;
+    return TRUE;
+}
+
+int snapshot_take(struct snapshot *snap, struct simulator *sim,
+                  const struct snapshot *parent)
+{
+    struct snapshot_page *pg;
+    const struct snapshot_drive *pdrv;
+    unsigned int page, dnum;
+    uint32_t epoch;
+
+    if (parent && parent->sim != sim) parent = NULL;
+    epoch = (parent) ? parent->epoch : 0;
+
+    serdes_rewind(&snap->core);
+    simulator_serialize_parts(sim, &snap->core, STATE_ROMS);
+    /* The MIR is only serialized in part (16 bits). */
+    serdes_put32(&snap->core, sim->mir);
+    if (unlikely(!serdes_verify(&snap->core))) {
+        report_error("snapshot: take: could not serialize");
+        goto error;
+    }
+
+    for (page = 0; page < NUM_MEMORY_PAGES; page++) {
+        pg = (parent) ? parent->pages[page] : NULL;
+        if (pg && sim->page_epoch[page] <= epoch) {
+            pg->refcount++;
+        } else {
+            pg = (struct snapshot_page *)
+                malloc(sizeof(struct snapshot_page));
+            if (unlikely(!pg)) {
+                report_error("snapshot: take: memory exhausted");
+                goto error;
+            }
+            pg->refcount = 1;
+            memcpy(pg->words, &sim->mem[page << MEMORY_PAGE_SHIFT],
+                   MEMORY_PAGE_SIZE * sizeof(uint16_t));
+        }
+        release_page(snap->pages[page]);
+        snap->pages[page] = pg;
+    }
+
+    for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
+        pdrv = (parent) ? &parent->drives[dnum] : NULL;
+        if (unlikely(!take_drive(&snap->drives[dnum],
+                                 &sim->dsk.drives[dnum],
+                                 pdrv, epoch))) {
+            report_error("snapshot: take: memory exhausted");
+            goto error;
+        }
+    }
+
+    snap->sim = sim;
+    snap->epoch = simulator_next_epoch(sim);
+    return TRUE;
+
+error:
+    /* The contents are no longer valid. */
+    serdes_rewind(&snap->core);
+    snap->sim = NULL;
+    return FALSE;
+}
+
+int snapshot_fork(struct snapshot *child, const struct snapshot *parent)
+{
+    const struct snapshot_drive *pdrv;
+    struct snapshot_drive *drv;
+    struct snapshot_page *pg;
+    struct snapshot_sector *ss;
+    unsigned int page, dnum;
+    uint16_t i;
+
+    if (child == parent) return TRUE;
+
+    if (parent->core.pos > child->core.size) {
+        if (unlikely(!serdes_extend(&child->core, parent->core.pos))) {
+            report_error("snapshot: fork: could not extend serializer");
+            return FALSE;
+        }
+    }
+    memcpy(child->core.buffer, parent->core.buffer, parent->core.pos);
+    child->core.pos = parent->core.pos;
+
+    for (page = 0; page < NUM_MEMORY_PAGES; page++) {
+        pg = parent->pages[page];
+        if (pg) pg->refcount++;
+        release_page(child->pages[page]);
+        child->pages[page] = pg;
+    }
+
+    for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
+        pdrv = &parent->drives[dnum];
+        drv = &child->drives[dnum];
+        if (!pdrv->loaded) {
+            release_drive(drv);
+            continue;
+        }
+
+        if (unlikely(!resize_drive(drv, pdrv->length))) {
+            report_error("snapshot: fork: memory exhausted");
+            serdes_rewind(&child->core);
+            child->sim = NULL;
+            return FALSE;
+        }
+
+        for (i = 0; i < pdrv->length; i++) {
+            ss = pdrv->sectors[i];
+            ss->refcount++;
+            release_sector(drv->sectors[i]);
+            drv->sectors[i] = ss;
+        }
+        drv->loaded = TRUE;
+    }
+
+    child->sim = parent->sim;
+    child->epoch = parent->epoch;
+    return TRUE;
+}
+
+int snapshot_restore(struct snapshot *snap, struct simulator *sim)
+{
+    const struct snapshot_drive *drv;
+    struct disk_drive *dd;
+    unsigned int page, dnum;
+    size_t size;
+    uint16_t i;
+    int same;
+
+    size = snap->core.pos;
+    if (unlikely(size == 0)) {
+        report_error("snapshot: restore: empty snapshot");
+        return FALSE;
+    }
+
+    for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
+        drv = &snap->drives[dnum];
+        if (unlikely(drv->loaded
+                     && drv->length != sim->dsk.drives[dnum].length)) {
+            report_error("snapshot: restore: invalid disk geometry");
+            return FALSE;
+        }
+    }
+
+    serdes_rewind(&snap->core);
+    simulator_deserialize_parts(sim, &snap->core, STATE_ROMS);
+    sim->mir = serdes_get32(&snap->core);
+    if (unlikely(snap->core.pos != size)) {
+        /* This should not happen. */
+        report_error("snapshot: restore: error in deserialization");
+        snap->core.pos = size;
+        return FALSE;
+    }
+
+    /* Only the pages (and sectors) modified since the last time the
+     * snapshot was synchronized with the simulator are copied.
+     */
+    same = (snap->sim == sim);
+    for (page = 0; page < NUM_MEMORY_PAGES; page++) {
+        if (same && sim->page_epoch[page] <= snap->epoch) continue;
+        memcpy(&sim->mem[page << MEMORY_PAGE_SHIFT],
+               snap->pages[page]->words,
+               MEMORY_PAGE_SIZE * sizeof(uint16_t));
+        sim->page_epoch[page] = sim->epoch;
+    }
+
+    for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
+        drv = &snap->drives[dnum];
+        dd = &sim->dsk.drives[dnum];
+        dd->loaded = drv->loaded;
+        if (!drv->loaded) continue;
+
+        for (i = 0; i < drv->length; i++) {
+            if (same && dd->sector_epoch[i] <= snap->epoch) continue;
+            memcpy(&dd->sectors[i], &drv->sectors[i]->ds,
+                   sizeof(struct disk_sector));
+            dd->sector_epoch[i] = sim->dsk.epoch;
+        }
+    }
+
+    snap->sim = sim;
+    snap->epoch = simulator_next_epoch(sim);
+    return TRUE;
+}
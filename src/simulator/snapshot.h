@@ -0,0 +1,100 @@
+#ifndef __SIMULATOR_SNAPSHOT_H
+#define __SIMULATOR_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "simulator/simulator.h"
+#include "simulator/disk.h"
+#include "common/serdes.h"
+
+/* Data structures and types. */
+
+/* A memory page shared by the snapshots (copy-on-write). */
+struct snapshot_page {
+    unsigned int refcount;        /* Number of snapshots using the page. */
+    uint16_t words[MEMORY_PAGE_SIZE]; /* The contents of the page. */
+};
+
+/* A disk sector shared by the snapshots (copy-on-write). */
+struct snapshot_sector {
+    unsigned int refcount;        /* Number of snapshots using the sector. */
+    struct disk_sector ds;        /* The contents of the sector. */
+};
+
+/* The contents of a disk drive in the snapshot. */
+struct snapshot_drive {
+    struct snapshot_sector **sectors; /* The sectors of the disk. */
+    uint16_t length;              /* Number of sectors. */
+    int loaded;                   /* If the disk was loaded. */
+};
+
+/* Structure representing an in-memory snapshot of the simulator
+ * (including the main memory and the disk packs). The memory pages
+ * and the disk sectors are reference counted and shared with the
+ * other snapshots, so they must never be modified after the snapshot
+ * is taken. For this reason, snapshots sharing data must not be used
+ * concurrently by different threads.
+ */
+struct snapshot {
+    struct serdes core;           /* The state of the simulator (without
+                                   * the main memory and the disks).
+                                   */
+    struct snapshot_page **pages; /* The pages of the main memory. */
+    struct snapshot_drive drives[NUM_DISK_DRIVES]; /* The disk drives. */
+
+    const struct simulator *sim;  /* The simulator that was last
+                                   * synchronized with the snapshot.
+                                   */
+    uint32_t epoch;               /* The epoch of the simulator when it
+                                   * was synchronized.
+                                   */
+};
+
+/* Functions. */
+
+/* Initializes the snapshot variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void snapshot_initvar(struct snapshot *snap);
+
+/* Destroys the snapshot object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void snapshot_destroy(struct snapshot *snap);
+
+/* Creates a new (empty) snapshot object.
+ * This obeys the initvar / destroy / create protocol.
+ * Returns TRUE on success.
+ */
+int snapshot_create(struct snapshot *snap);
+
+/* Takes a snapshot of the simulator `sim` and stores it in `snap`,
+ * replacing its previous contents. If `parent` is not NULL and was
+ * taken from (or restored into) `sim`, the memory pages and the disk
+ * sectors that were not modified since then are shared with `parent`
+ * instead of being copied. The parent can be `snap` itself.
+ * Returns TRUE on success.
+ */
+int snapshot_take(struct snapshot *snap, struct simulator *sim,
+                  const struct snapshot *parent);
+
+/* Makes `child` a copy of the snapshot `parent`, sharing all of its
+ * memory pages and disk sectors.
+ * Returns TRUE on success.
+ */
+int snapshot_fork(struct snapshot *child, const struct snapshot *parent);
+
+/* Restores the snapshot `snap` into the simulator `sim`. When the
+ * snapshot was taken from (or last restored into) the same simulator,
+ * only the memory pages and disk sectors modified since then are
+ * copied back.
+ * Note that the snapshot keeps a reference to the simulator, so it
+ * should not be used with another simulator that is later created
+ * at the same address (since it will be taken as the same simulator).
+ * Returns TRUE on success.
+ */
+int snapshot_restore(struct snapshot *snap, struct simulator *sim);
+
+#endif /* __SIMULATOR_SNAPSHOT_H */